@@ -35,9 +35,11 @@ using namespace labutils::literals;
 #include "../labutils/vkobject.hpp"
 #include "../labutils/vkbuffer.hpp"
 #include "../labutils/allocator.hpp" 
+#include "../labutils/pipeline_cache.hpp"
 namespace lut = labutils;
 
 #include "model.hpp"
+#include "render_queue.hpp"
 
 namespace
 {
@@ -60,6 +62,15 @@ namespace
 		constexpr char const* roadPath = ASSETDIR_ "max_track_road.jpg";
 		constexpr char const* roofPath = ASSETDIR_ "roof.jpg";
 #		undef ASSETDIR_
+
+		// The city's textures, in the order of their descriptor sets (see
+		// city_texture_index())
+		constexpr char const* kCityTextures[] = { brickPath, roadPath, roofPath, concretePath };
+		constexpr std::uint32_t kCityTextureCount = std::uint32_t(sizeof(kCityTextures) / sizeof(kCityTextures[0]));
+
+		// Frames between prints of the bind counts
+		constexpr std::uint32_t kStatsInterval = 500;
+
 		// General rule: with a standard 24 bit or 32 bit float depth buffer,
 		// you can support a 1:1000 ratio between the near and far plane with
 		// minimal depth fighting. Larger ratios will introduce more depth
@@ -72,6 +83,11 @@ namespace
 
 		constexpr VkFormat kDepthFormat = VK_FORMAT_D32_SFLOAT;
 
+		// Pipeline cache, relative to the working directory. Loaded at
+		// startup and saved on exit, such that later runs skip compiling
+		// the pipelines.
+		constexpr char const* kPipelineCachePath = "cw1-pipelines.bin";
+
 		//For Camera
 		bool firstMouse = true;
 		bool enableMouse = false;
@@ -145,6 +161,16 @@ namespace
 	ColourMesh createCar(ModelData const& aCar, lut::VulkanContext const& aContext, lut::Allocator const& aAllocator);
 	TextureMesh createCity(ModelData const& aCity, lut::VulkanContext const& aContext, lut::Allocator const& aAllocator);
 
+	// Index of the city mesh's texture in cfg::kCityTextures, or
+	// cfg::kCityTextureCount if it has none of these
+	std::uint32_t city_texture_index(std::string const& aPath);
+
+	// The draws of both meshes, ordered by pipeline and then texture (see
+	// render_queue.hpp), such that each pipeline and texture set is bound
+	// once. Values below the car's mesh count are the car's meshes, the
+	// others the city's. The scene is static, so the order is computed once.
+	RenderQueue make_draw_queue(ColourMesh const&, TextureMesh const&);
+
 	// GLFW callbacks
 	void glfw_callback_key_press(GLFWwindow*, int, int, int, int);
 
@@ -179,7 +205,8 @@ namespace
 		std::uint32_t aFramebufferHeight
 	);
 
-	void record_commands(
+	// Returns the binds that were issued for the draws
+	BindCounts record_commands(
 		VkCommandBuffer,
 		VkRenderPass,
 		VkFramebuffer,
@@ -193,11 +220,9 @@ namespace
 		VkPipelineLayout,
 		VkDescriptorSet aSceneDescriptors,
 		//--------------------------------------
-		VkDescriptorSet aBrickDescriptors,
-		VkDescriptorSet aRoofDescriptors,
-		VkDescriptorSet aRoadDescriptors,
-		VkDescriptorSet aConcreteDescriptors,
-		TextureMesh&
+		std::vector<VkDescriptorSet> const& aTextureDescriptors,
+		TextureMesh&,
+		RenderQueue const& aDraws
 	);
 	void submit_commands(
 		lut::VulkanWindow const&,
@@ -222,6 +247,9 @@ int main() try
 	// Create Vulkan Window
 	auto window = lut::make_vulkan_window();
 
+	// All pipelines are created with the window's pipeline cache
+	std::size_t const pipelineCacheBytes = lut::load_pipeline_cache(window, cfg::kPipelineCachePath);
+
 #pragma region glfwCallBack functions
 	glfwSetWindowUserPointer(window.window, nullptr);
 	//Set the input Mode
@@ -252,9 +280,14 @@ int main() try
 
 	//create pipeline layout
 	lut::PipelineLayout pipeLayout = create_pipeline_layout(window, sceneLayout.handle, objectLayout.handle);
+	auto const pipelinesStart = std::chrono::steady_clock::now();
+
 	lut::Pipeline pipe = create_pipeline(window, renderPass.handle, pipeLayout.handle);
 	lut::Pipeline texturePipe = create_texture_pipeline(window, renderPass.handle, pipeLayout.handle);
 
+	auto const pipelinesMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pipelinesStart).count();
+	std::printf("Pipelines created in %.3f ms (%s pipeline cache)\n", pipelinesMs, pipelineCacheBytes > 0 ? "warm" : "cold");
+
 	//create depth buffer
 	auto [depthBuffer, depthBufferView] = create_depth_buffer(window, allocator);
 	std::vector<lut::Framebuffer> framebuffers;
@@ -419,6 +452,20 @@ int main() try
 		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
 		vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
 	}
+
+	// By city_texture_index(); meshes without a known texture keep the set
+	// that is bound
+	std::vector<VkDescriptorSet> const textureDescriptors{ brickDescriptors, roadDescriptors, roofDescriptors, concreteDescriptors, VK_NULL_HANDLE };
+	assert(textureDescriptors.size() == cfg::kCityTextureCount + 1);
+
+	auto const sortStart = std::chrono::steady_clock::now();
+	RenderQueue const drawQueue = make_draw_queue(carMesh, cityMesh);
+	auto const sortMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - sortStart).count();
+	std::printf("Draw queue: %zu draws sorted by pipeline and texture in %.3f ms\n", drawQueue.size(), sortMs);
+
+	// Binds of the last recording (see cfg::kStatsInterval)
+	BindCounts lastRecordBinds;
+	std::uint32_t statsFrames = 0;
 #pragma endregion
 
 #pragma region main loop
@@ -506,7 +553,7 @@ int main() try
 		assert(std::size_t(imageIndex) < cbuffers.size());
 		assert(std::size_t(imageIndex) < framebuffers.size());
 
-		record_commands(
+		lastRecordBinds = record_commands(
 			cbuffers[imageIndex],
 			renderPass.handle,
 			framebuffers[imageIndex].handle,
@@ -521,11 +568,9 @@ int main() try
 			sceneUniforms,
 			pipeLayout.handle,
 			sceneDescriptors,
-			brickDescriptors,
-			roofDescriptors,
-			roadDescriptors,
-			concreteDescriptors,
-			cityMesh
+			textureDescriptors,
+			cityMesh,
+			drawQueue
 		);
 
 		submit_commands(
@@ -544,12 +589,21 @@ int main() try
 		);
 
 		camera.updateCameraPosition();
+
+		if (++statsFrames == cfg::kStatsInterval)
+		{
+			auto const& binds = lastRecordBinds;
+			std::printf("Last recording: %u pipeline, %u descriptor set and %u vertex buffer binds for %u draws (sorted by pipeline and texture)\n", binds.pipelines, binds.descriptorSets, binds.vertexBuffers, binds.draws);
+			statsFrames = 0;
+		}
 	}
 
 	// Cleanup takes place automatically in the destructors, but we sill need
 	// to ensure that all Vulkan commands have finished before that.
 	vkDeviceWaitIdle(window.device);
 
+	lut::save_pipeline_cache(window, cfg::kPipelineCachePath);
+
 	return 0;
 }
 #pragma endregion
@@ -1015,6 +1069,35 @@ namespace
 		}
 		return temp;
 	}
+
+	std::uint32_t city_texture_index(std::string const& aPath)
+	{
+		for (std::uint32_t i = 0; i < cfg::kCityTextureCount; ++i)
+		{
+			if (aPath == cfg::kCityTextures[i])
+				return i;
+		}
+
+		return cfg::kCityTextureCount;
+	}
+
+	RenderQueue make_draw_queue(ColourMesh const& aCarMesh, TextureMesh const& aCityMesh)
+	{
+		auto const carDraws = std::uint32_t(aCarMesh.positions.size());
+		auto const cityDraws = std::uint32_t(aCityMesh.positions.size());
+
+		// Pipeline 0 draws the car, which has no texture; pipeline 1 the
+		// city, with the texture as the material
+		RenderQueue queue;
+		queue.reserve(carDraws + cityDraws);
+		for (std::uint32_t i = 0; i < carDraws; ++i)
+			queue.push(make_draw_key(0, 0, 0, 0), i);
+		for (std::uint32_t i = 0; i < cityDraws; ++i)
+			queue.push(make_draw_key(0, 1, city_texture_index(aCityMesh.path[i]), 0), carDraws + i);
+
+		queue.sort();
+		return queue;
+	}
 }
 
 /// <summary>
@@ -1238,7 +1321,7 @@ namespace
 		pipelineInfo.pDynamicState = nullptr;
 
 		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
+		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, aWindow.pipelineCache, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
 		}
@@ -1388,7 +1471,7 @@ namespace
 		pipelineInfo.pDynamicState = nullptr;
 
 		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
+		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, aWindow.pipelineCache, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
 		}
@@ -1474,7 +1557,7 @@ namespace
 		return lut::DescriptorSetLayout(aWindow.device, layout);
 	}
 
-	void record_commands(
+	BindCounts record_commands(
 		VkCommandBuffer aCmdBuff,
 		VkRenderPass aRenderPass,
 		VkFramebuffer aFramebuffer,
@@ -1487,11 +1570,9 @@ namespace
 		VkPipelineLayout aGraphicsLayout,
 		VkDescriptorSet aSceneDescriptors,
 		///------------------------------------
-		VkDescriptorSet aBrickDescriptors,
-		VkDescriptorSet aRoofDescriptors,
-		VkDescriptorSet aRoadDescriptors,
-		VkDescriptorSet aConcreteDescriptors,
-		TextureMesh& aCityMesh
+		std::vector<VkDescriptorSet> const& aTextureDescriptors,
+		TextureMesh& aCityMesh,
+		RenderQueue const& aDraws
 	)
 		//	VkDescriptorSet aObjectDescriptors, VkBuffer aSpritePosBuffer, VkBuffer aSpriteTexBuffer, std::uint32_t aSpriteVertexCount, VkDescriptorSet aSpriteObjDescriptors)
 	{
@@ -1531,43 +1612,57 @@ namespace
 
 		vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		//drawing with pipeline
-		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsPipe);
-
 		//bind 
 		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
 
-		// Bind vertex input
-		for (int i = 0; i < aColourMesh.positions.size(); i++)
-		{
-			auto& pos = aColourMesh.positions;
-			auto& col = aColourMesh.colours;
-			VkBuffer buffers[2] = { pos[i].buffer, col[i].buffer };
-			VkDeviceSize offsets[2]{};
-			vkCmdBindVertexBuffers(aCmdBuff, 0, 2, buffers, offsets);
-			vkCmdDraw(aCmdBuff, aColourMesh.vertexCount[i], 1, 0, 0);
-		}
-		
-		
-		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aTexturePipe);
-		//---------------------------------
-		for (int i = 0; i < aCityMesh.positions.size(); i++)
+		// The draws are sorted by pipeline and texture (make_draw_queue()),
+		// so these are only bound when they change. Both pipelines share
+		// the layout, so the bound sets remain valid.
+		auto const carDraws = std::uint32_t(aColourMesh.positions.size());
+
+		BindTracker binds;
+		for (std::size_t d = 0; d < aDraws.size(); ++d)
 		{
-			if(cfg::brickPath == aCityMesh.path[i])
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aBrickDescriptors, 0, nullptr);
-			else if (cfg::roadPath == aCityMesh.path[i])
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aRoadDescriptors, 0, nullptr);
-			else if(cfg::roofPath == aCityMesh.path[i])
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aRoofDescriptors, 0, nullptr);
-			else if(cfg::concretePath == aCityMesh.path[i])
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aConcreteDescriptors, 0, nullptr);
-
-			VkBuffer cityBuffers[2] = { aCityMesh.positions[i].buffer, aCityMesh.texCoord[i].buffer };
-			VkDeviceSize cityOffsets[2]{};
-			vkCmdBindVertexBuffers(aCmdBuff, 0, 2, cityBuffers, cityOffsets);
-			vkCmdDraw(aCmdBuff, aCityMesh.vertexCount[i], 1, 0, 0);
+			auto const key = aDraws.keys()[d];
+			auto const draw = aDraws.values()[d];
+			bool const textured = draw >= carDraws;
+			assert(textured == (1 == draw_key_pipeline(key)));
+
+			if (binds.change(BindTracker::Slot::pipeline, textured))
+				vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, textured ? aTexturePipe : aGraphicsPipe);
+
+			// Bind vertex input
+			VkBuffer buffers[2]{};
+			std::uint32_t vertexCount = 0;
+			if (textured)
+			{
+				auto const i = draw - carDraws;
+				auto const texture = draw_key_material(key);
+				assert(texture < aTextureDescriptors.size());
+				if (aTextureDescriptors[texture] != VK_NULL_HANDLE && binds.change(BindTracker::Slot::descriptorSet, texture))
+					vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aTextureDescriptors[texture], 0, nullptr);
+
+				buffers[0] = aCityMesh.positions[i].buffer;
+				buffers[1] = aCityMesh.texCoord[i].buffer;
+				vertexCount = aCityMesh.vertexCount[i];
+			}
+			else
+			{
+				buffers[0] = aColourMesh.positions[draw].buffer;
+				buffers[1] = aColourMesh.colours[draw].buffer;
+				vertexCount = aColourMesh.vertexCount[draw];
+			}
+
+			// Each mesh has its own buffers
+			if (binds.change(BindTracker::Slot::vertexBuffers, draw))
+			{
+				VkDeviceSize offsets[2]{};
+				vkCmdBindVertexBuffers(aCmdBuff, 0, 2, buffers, offsets);
+			}
+
+			vkCmdDraw(aCmdBuff, vertexCount, 1, 0, 0);
+			binds.draw();
 		}
-		//----------------------------------
 		
 		vkCmdEndRenderPass(aCmdBuff);
 		//end recording
@@ -1575,6 +1670,8 @@ namespace
 		{
 			throw lut::Error("Unable to end recording command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
 		}
+
+		return binds.counts();
 	}
 
 	void submit_commands(lut::VulkanWindow const& aWindow, VkCommandBuffer aCmdBuff, VkFence aFence, VkSemaphore aWaitSemaphore, VkSemaphore aSignalSemaphore)
@@ -0,0 +1,188 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+namespace
+{
+	constexpr unsigned kPassShift_ = 56;
+	constexpr unsigned kPipelineShift_ = 40;
+	constexpr unsigned kMaterialShift_ = 16;
+
+	constexpr std::uint64_t kPassMask_ = 0xff;
+	constexpr std::uint64_t kPipelineMask_ = 0xffff;
+	constexpr std::uint64_t kMaterialMask_ = 0xffffff;
+	constexpr std::uint64_t kDepthMask_ = 0xffff;
+
+	constexpr std::size_t kRadixBits_ = 8;
+	constexpr std::size_t kRadixSize_ = std::size_t(1) << kRadixBits_;
+	constexpr std::size_t kRadixPasses_ = 64 / kRadixBits_;
+}
+
+std::uint64_t make_draw_key(std::uint32_t aPass, std::uint32_t aPipeline, std::uint32_t aMaterial, std::uint32_t aDepthBucket) noexcept
+{
+	assert(aPass <= kPassMask_ && aPipeline <= kPipelineMask_ && aMaterial <= kMaterialMask_ && aDepthBucket <= kDepthMask_);
+
+	return (std::uint64_t(aPass) << kPassShift_)
+		| (std::uint64_t(aPipeline) << kPipelineShift_)
+		| (std::uint64_t(aMaterial) << kMaterialShift_)
+		| std::uint64_t(aDepthBucket);
+}
+
+std::uint32_t draw_key_pipeline(std::uint64_t aKey) noexcept
+{
+	return std::uint32_t((aKey >> kPipelineShift_) & kPipelineMask_);
+}
+
+std::uint32_t draw_key_material(std::uint64_t aKey) noexcept
+{
+	return std::uint32_t((aKey >> kMaterialShift_) & kMaterialMask_);
+}
+
+std::uint32_t depth_bucket(float aDistance, float aNear, float aFar, std::uint32_t aBuckets) noexcept
+{
+	assert(aNear > 0.f && aFar > aNear);
+	assert(aBuckets > 0 && aBuckets <= kDrawKeyDepthBuckets);
+
+	float const t = std::log(std::max(aDistance, aNear) / aNear) / std::log(aFar / aNear);
+	auto const bucket = std::uint32_t(std::clamp(t, 0.f, 1.f) * float(aBuckets - 1) + 0.5f);
+
+	// Spread over the full field, such that keys with fewer buckets order
+	// the same way
+	return bucket * ((kDrawKeyDepthBuckets - 1) / std::max(aBuckets - 1, 1u));
+}
+
+void RenderQueue::clear() noexcept
+{
+	mKeys.clear();
+	mValues.clear();
+}
+
+void RenderQueue::reserve(std::size_t aCount)
+{
+	mKeys.reserve(aCount);
+	mValues.reserve(aCount);
+}
+
+void RenderQueue::push(std::uint64_t aKey, std::uint32_t aValue)
+{
+	mKeys.emplace_back(aKey);
+	mValues.emplace_back(aValue);
+}
+
+void RenderQueue::sort()
+{
+	radix_sort(mKeys, mValues, mKeyScratch, mValueScratch);
+}
+
+std::size_t RenderQueue::size() const noexcept
+{
+	return mKeys.size();
+}
+
+std::vector<std::uint64_t> const& RenderQueue::keys() const noexcept
+{
+	return mKeys;
+}
+
+std::vector<std::uint32_t> const& RenderQueue::values() const noexcept
+{
+	return mValues;
+}
+
+void radix_sort(std::vector<std::uint64_t>& aKeys, std::vector<std::uint32_t>& aValues, std::vector<std::uint64_t>& aKeyScratch, std::vector<std::uint32_t>& aValueScratch)
+{
+	assert(aKeys.size() == aValues.size());
+
+	std::size_t const count = aKeys.size();
+	if (count < 2)
+		return;
+
+	aKeyScratch.resize(count);
+	aValueScratch.resize(count);
+
+	// Histograms of all bytes in a single pass over the keys
+	std::vector<std::uint32_t> histograms(kRadixPasses_ * kRadixSize_, 0);
+	for (auto const key : aKeys)
+	{
+		for (std::size_t pass = 0; pass < kRadixPasses_; ++pass)
+			++histograms[pass * kRadixSize_ + ((key >> (pass * kRadixBits_)) & (kRadixSize_ - 1))];
+	}
+
+	for (std::size_t pass = 0; pass < kRadixPasses_; ++pass)
+	{
+		auto* const histogram = histograms.data() + pass * kRadixSize_;
+
+		// All keys have the same byte: the pass would not move anything
+		auto const first = (aKeys.front() >> (pass * kRadixBits_)) & (kRadixSize_ - 1);
+		if (histogram[first] == count)
+			continue;
+
+		// Exclusive prefix sum: the first output slot of each byte value
+		std::uint32_t offset = 0;
+		for (std::size_t i = 0; i < kRadixSize_; ++i)
+		{
+			auto const n = histogram[i];
+			histogram[i] = offset;
+			offset += n;
+		}
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			auto const slot = histogram[(aKeys[i] >> (pass * kRadixBits_)) & (kRadixSize_ - 1)]++;
+			aKeyScratch[slot] = aKeys[i];
+			aValueScratch[slot] = aValues[i];
+		}
+
+		aKeys.swap(aKeyScratch);
+		aValues.swap(aValueScratch);
+	}
+}
+
+BindCounts& BindCounts::operator+= (BindCounts const& aOther) noexcept
+{
+	pipelines += aOther.pipelines;
+	descriptorSets += aOther.descriptorSets;
+	vertexBuffers += aOther.vertexBuffers;
+	draws += aOther.draws;
+	return *this;
+}
+
+bool BindTracker::change(Slot aSlot, std::uint64_t aState) noexcept
+{
+	auto const slot = std::size_t(aSlot);
+	assert(slot < kSlotCount_);
+
+	if (mBound[slot] && mState[slot] == aState)
+		return false;
+
+	mBound[slot] = true;
+	mState[slot] = aState;
+
+	switch (aSlot)
+	{
+		case Slot::pipeline: ++mCounts.pipelines; break;
+		case Slot::descriptorSet: ++mCounts.descriptorSets; break;
+		case Slot::vertexBuffers: ++mCounts.vertexBuffers; break;
+	}
+
+	return true;
+}
+
+void BindTracker::reset() noexcept
+{
+	for (auto& bound : mBound)
+		bound = false;
+}
+
+void BindTracker::draw() noexcept
+{
+	++mCounts.draws;
+}
+
+BindCounts const& BindTracker::counts() const noexcept
+{
+	return mCounts;
+}
@@ -0,0 +1,223 @@
+#include "pipeline_cache.hpp"
+
+#include <string>
+#include <vector>
+#include <system_error>
+#include <filesystem>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	constexpr char kMagic_[8] = { 'L', 'U', 'T', 'P', 'S', 'O', '0', '1' };
+
+	// Identifies the device and driver that the cache data is valid for
+	struct FileHeader_
+	{
+		char magic[8];
+		std::uint32_t vendorID;
+		std::uint32_t deviceID;
+		std::uint32_t driverVersion;
+		std::uint32_t pad;
+		std::uint8_t driverUUID[VK_UUID_SIZE];
+		std::uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		std::uint64_t dataSize;
+	};
+
+	FileHeader_ make_header_( VkPhysicalDevice aPhysicalDev )
+	{
+		VkPhysicalDeviceIDProperties idProps{};
+		idProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+		VkPhysicalDeviceProperties2 props{};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props.pNext = &idProps;
+
+		vkGetPhysicalDeviceProperties2( aPhysicalDev, &props );
+
+		FileHeader_ header{};
+		std::memcpy( header.magic, kMagic_, sizeof(kMagic_) );
+		header.vendorID = props.properties.vendorID;
+		header.deviceID = props.properties.deviceID;
+		header.driverVersion = props.properties.driverVersion;
+		std::memcpy( header.driverUUID, idProps.driverUUID, VK_UUID_SIZE );
+		std::memcpy( header.pipelineCacheUUID, props.properties.pipelineCacheUUID, VK_UUID_SIZE );
+		return header;
+	}
+
+	bool same_device_( FileHeader_ const& aA, FileHeader_ const& aB )
+	{
+		return 0 == std::memcmp( aA.magic, aB.magic, sizeof(aA.magic) )
+			&& aA.vendorID == aB.vendorID
+			&& aA.deviceID == aB.deviceID
+			&& aA.driverVersion == aB.driverVersion
+			&& 0 == std::memcmp( aA.driverUUID, aB.driverUUID, VK_UUID_SIZE )
+			&& 0 == std::memcmp( aA.pipelineCacheUUID, aB.pipelineCacheUUID, VK_UUID_SIZE );
+	}
+
+	// The data starts with the driver's own header, which must agree with
+	// the file's (see the Vulkan spec, "Pipeline Cache")
+	bool valid_data_( FileHeader_ const& aHeader, std::vector<std::uint8_t> const& aData )
+	{
+		VkPipelineCacheHeaderVersionOne vkHeader{};
+		if( aData.size() < sizeof(vkHeader) )
+			return false;
+
+		std::memcpy( &vkHeader, aData.data(), sizeof(vkHeader) );
+		return vkHeader.headerSize >= sizeof(vkHeader)
+			&& vkHeader.headerSize <= aData.size()
+			&& VK_PIPELINE_CACHE_HEADER_VERSION_ONE == vkHeader.headerVersion
+			&& vkHeader.vendorID == aHeader.vendorID
+			&& vkHeader.deviceID == aHeader.deviceID
+			&& 0 == std::memcmp( vkHeader.pipelineCacheUUID, aHeader.pipelineCacheUUID, VK_UUID_SIZE );
+	}
+
+	// Bytes from the current position to the end of aFile, or -1 if they
+	// cannot be determined
+	long remaining_bytes_( std::FILE* aFile )
+	{
+		long const pos = std::ftell( aFile );
+		if( pos < 0 || 0 != std::fseek( aFile, 0, SEEK_END ) )
+			return -1;
+
+		long const end = std::ftell( aFile );
+		if( end < pos || 0 != std::fseek( aFile, pos, SEEK_SET ) )
+			return -1;
+
+		return end - pos;
+	}
+
+	// Returns the cache data in aPath, or nothing if there is no usable data
+	std::vector<std::uint8_t> read_cache_file_( char const* aPath, FileHeader_ const& aExpected )
+	{
+		std::FILE* in = std::fopen( aPath, "rb" );
+		if( !in )
+			return {};
+
+		std::vector<std::uint8_t> data;
+
+		FileHeader_ header{};
+		if( 1 == std::fread( &header, sizeof(header), 1, in ) )
+		{
+			if( !same_device_( header, aExpected ) )
+			{
+				std::fprintf( stderr, "Pipeline cache '%s' is from a different device or driver, ignored\n", aPath );
+			}
+			// The data size is only trusted if the file holds exactly that
+			// much data, such that a damaged or partially written file does
+			// not make us allocate an arbitrary amount
+			else if( auto const remaining = remaining_bytes_( in ); remaining <= 0 || header.dataSize != std::uint64_t(remaining) )
+			{
+				std::fprintf( stderr, "Pipeline cache '%s' is damaged or incomplete, ignored\n", aPath );
+			}
+			else
+			{
+				data.resize( std::size_t(header.dataSize) );
+				if( 1 != std::fread( data.data(), data.size(), 1, in ) )
+					data.clear();
+			}
+		}
+
+		std::fclose( in );
+
+		if( !data.empty() && !valid_data_( header, data ) )
+			data.clear();
+
+		return data;
+	}
+}
+
+namespace labutils
+{
+	std::size_t load_pipeline_cache( VulkanContext& aContext, char const* aPath )
+	{
+		assert( VK_NULL_HANDLE == aContext.pipelineCache );
+
+		std::vector<std::uint8_t> data;
+		if( aPath )
+			data = read_cache_file_( aPath, make_header_( aContext.physicalDevice ) );
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		VkPipelineCache cache = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineCache( aContext.device, &cacheInfo, nullptr, &cache ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create pipeline cache\n"
+				"vkCreatePipelineCache() returned %s", to_string(res).c_str()
+			);
+		}
+
+		aContext.pipelineCache = cache;
+		return data.size();
+	}
+
+	std::size_t save_pipeline_cache( VulkanContext const& aContext, char const* aPath )
+	{
+		assert( aPath );
+		if( VK_NULL_HANDLE == aContext.pipelineCache )
+			return 0;
+
+		std::size_t size = 0;
+		if( auto const res = vkGetPipelineCacheData( aContext.device, aContext.pipelineCache, &size, nullptr ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to query pipeline cache size\n"
+				"vkGetPipelineCacheData() returned %s", to_string(res).c_str()
+			);
+		}
+
+		// The cache may grow between the two calls (VK_INCOMPLETE), in
+		// which case the first size bytes are still a valid cache
+		std::vector<std::uint8_t> data( size );
+		if( auto const res = vkGetPipelineCacheData( aContext.device, aContext.pipelineCache, &size, data.data() ); VK_SUCCESS != res && VK_INCOMPLETE != res )
+		{
+			throw Error( "Unable to get pipeline cache data\n"
+				"vkGetPipelineCacheData() returned %s", to_string(res).c_str()
+			);
+		}
+
+		data.resize( size );
+		if( data.empty() )
+			return 0;
+
+		FileHeader_ header = make_header_( aContext.physicalDevice );
+		header.dataSize = data.size();
+
+		std::string const tempPath = std::string(aPath) + ".tmp";
+
+		std::FILE* out = std::fopen( tempPath.c_str(), "wb" );
+		if( !out )
+		{
+			std::fprintf( stderr, "Warning: unable to open '%s' for writing, pipeline cache not saved\n", tempPath.c_str() );
+			return 0;
+		}
+
+		bool ok = 1 == std::fwrite( &header, sizeof(header), 1, out )
+			&& 1 == std::fwrite( data.data(), data.size(), 1, out );
+		ok = 0 == std::fclose( out ) && ok;
+
+		// Replaces an existing file, also on Windows (unlike std::rename())
+		std::error_code ec;
+		if( ok )
+			std::filesystem::rename( tempPath, aPath, ec );
+
+		if( !ok || ec )
+		{
+			std::fprintf( stderr, "Warning: unable to write '%s', pipeline cache not saved\n", aPath );
+			std::filesystem::remove( tempPath, ec );
+			return 0;
+		}
+
+		return data.size();
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -33,6 +33,9 @@ namespace labutils
 	VulkanContext::~VulkanContext()
 	{
 		// Device-related objects
+		if( VK_NULL_HANDLE != pipelineCache )
+			vkDestroyPipelineCache( device, pipelineCache, nullptr );
+
 		if( VK_NULL_HANDLE != device )
 			vkDestroyDevice( device, nullptr );
 
@@ -51,6 +54,7 @@ namespace labutils
 		, device( std::exchange( aOther.device, VK_NULL_HANDLE ) )
 		, graphicsFamilyIndex( aOther.graphicsFamilyIndex )
 		, graphicsQueue( std::exchange( aOther.graphicsQueue, VK_NULL_HANDLE ) )
+		, pipelineCache( std::exchange( aOther.pipelineCache, VK_NULL_HANDLE ) )
 		, debugMessenger( std::exchange( aOther.debugMessenger, VK_NULL_HANDLE ) )
 	{}
 
@@ -72,6 +76,7 @@ namespace labutils
 		std::swap( device, aOther.device );
 		std::swap( graphicsFamilyIndex, aOther.graphicsFamilyIndex );
 		std::swap( graphicsQueue, aOther.graphicsQueue );
+		std::swap( pipelineCache, aOther.pipelineCache );
 		std::swap( debugMessenger, aOther.debugMessenger );
 		return *this;
 	}
@@ -1,5 +1,6 @@
 #include <volk/volk.h>
 
+#include <array>
 #include <tuple>
 #include <chrono>
 #include <limits>
@@ -34,6 +35,12 @@ using namespace labutils::literals;
 #include "../labutils/vkobject.hpp"
 #include "../labutils/vkbuffer.hpp"
 #include "../labutils/allocator.hpp" 
+#include "../labutils/pipeline_cache.hpp"
+#include "../labutils/pipeline_builder.hpp"
+#include "../labutils/pipeline_registry.hpp"
+#include "../labutils/pipeline_variants.hpp"
+#include "../labutils/shader_reflection.hpp"
+#include "../labutils/descriptor_layout_cache.hpp"
 namespace lut = labutils;
 
 #include "model.hpp"
@@ -78,6 +85,11 @@ namespace
 
 		constexpr VkFormat kDepthFormat = VK_FORMAT_D32_SFLOAT;
 
+		// Pipeline cache, relative to the working directory. Loaded at
+		// startup and saved on exit, such that later runs skip compiling
+		// the pipelines.
+		constexpr char const* kPipelineCachePath = "cw2-pipelines.bin";
+
 		//For Camera
 		bool firstMouse = true;
 		bool enableMouse = false;
@@ -148,12 +160,15 @@ namespace
 			glm::vec4 colour;
 		};
 
+		// Size of UScene.light, and the largest LIGHT_COUNT variant
+		constexpr std::uint32_t kSceneLightCount = 4;
+
 		struct SceneUniform
 		{
 			glm::mat4 camera;
 			glm::mat4 projection;
 			glm::mat4 projCam;
-			Light lights[4];
+			Light lights[kSceneLightCount];
 			alignas(16)	glm::vec3 camPos;
 			int constant;
 		};
@@ -200,19 +215,26 @@ namespace
 	// Helpers:
 	lut::RenderPass create_render_pass(lut::VulkanWindow const&);
 
-	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const&);
-	lut::DescriptorSetLayout create_advanced_descriptor_layout(lut::VulkanWindow const&);
+	// The scene set (set 0) and the material set (set 1), reflected from the
+	// shaders that use them
+	VkDescriptorSetLayout scene_set_layout(lut::DescriptorLayoutCache&);
+	VkDescriptorSetLayout advanced_set_layout(lut::DescriptorLayoutCache&);
+
+	// Check the structs in glsl:: against the shaders' uniform blocks;
+	// throws lut::Error on the first mismatch
+	void check_shader_interfaces();
 
 	lut::PipelineLayout create_pipeline_layout(lut::VulkanContext const&, VkDescriptorSetLayout, VkDescriptorSetLayout);
 
-    //2.1
-	lut::Pipeline create_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-	lut::Pipeline create_view_direction_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-	lut::Pipeline create_light_direction_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-	//2.2
-	lut::Pipeline create_blinn_phong_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-	//2.3
-	lut::Pipeline create_PBR_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
+	// The pipelines of the shading modes (2.1 - 2.3) differ only in their
+	// shaders, and in whether they read the normals (vertex binding 1). They
+	// are built, once per distinct description, by the lut::PipelineRegistry.
+	lut::PipelineDesc make_pipeline_desc(VkRenderPass, VkPipelineLayout, char const* aVertPath, char const* aFragPath, bool aNormals);
+
+	// The Blinn-Phong and PBR shaders have one variant per light count
+	// (LIGHT_COUNT, constant_id 0). The BRDF model and feature constants
+	// keep their defaults.
+	std::vector<std::uint32_t> light_count_constants(int aLightCount);
 
 	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanWindow const&, lut::Allocator const&);
 
@@ -295,6 +317,9 @@ int main() try
 	// Create Vulkan Window
 	auto window = lut::make_vulkan_window();
 
+	// All pipelines are created with the window's pipeline cache
+	std::size_t const pipelineCacheBytes = lut::load_pipeline_cache(window, cfg::kPipelineCachePath);
+
 	glfwSetWindowUserPointer(window.window, &sceneUniforms);
 	//Set the input Mode
 	glfwSetInputMode(window.window, GLFW_CURSOR, NULL);
@@ -312,20 +337,65 @@ int main() try
 	// Intialize resources
 	lut::RenderPass renderPass = create_render_pass(window);
 
-	//create scene descriptor set layout
-	//call create_scene_descriptor_layout
-	lut::DescriptorSetLayout sceneLayout = create_scene_descriptor_layout(window);
-	lut::DescriptorSetLayout advancedLayout = create_advanced_descriptor_layout(window);
+	//create scene descriptor set layout, from the shaders' declarations
+	check_shader_interfaces();
+
+	lut::DescriptorLayoutCache setLayouts(window);
+	VkDescriptorSetLayout const sceneLayout = scene_set_layout(setLayouts);
+	VkDescriptorSetLayout const advancedLayout = advanced_set_layout(setLayouts);
 	
 	//create pipeline layout
-	lut::PipelineLayout pipeLayout = create_pipeline_layout(window, sceneLayout.handle, advancedLayout.handle);
-	lut::Pipeline pipe = create_pipeline(window, renderPass.handle, pipeLayout.handle);
-	lut::Pipeline viewPipe = create_view_direction_pipeline(window, renderPass.handle, pipeLayout.handle);
-	lut::Pipeline lightPipe = create_light_direction_pipeline(window, renderPass.handle, pipeLayout.handle);
+	lut::PipelineLayout pipeLayout = create_pipeline_layout(window, sceneLayout, advancedLayout);
+
+	// Descriptions of the five pipelines, for the current render pass:
+	// default, view direction, light direction, Blinn-Phong and PBR
+	auto const pipeline_descs = [&renderPass, &pipeLayout] {
+		VkRenderPass const pass = renderPass.handle;
+		VkPipelineLayout const layout = pipeLayout.handle;
+
+		return std::array<lut::PipelineDesc, 5>{
+			make_pipeline_desc(pass, layout, cfg::kVertShaderPath, cfg::kFragShaderPath, true),
+			make_pipeline_desc(pass, layout, cfg::kViewDirectionVert, cfg::kViewDirectionFrag, false),
+			make_pipeline_desc(pass, layout, cfg::kLightDirectionVert, cfg::kLightDirectionFrag, false),
+			make_pipeline_desc(pass, layout, cfg::kBlinnPhongVertPath, cfg::kBlinnPhongFragPath, true),
+			make_pipeline_desc(pass, layout, cfg::kPBRVertPath, cfg::kPBRFragPath, true)
+		};
+	};
+
+	// The registry owns the pipelines. They are compiled concurrently on
+	// worker threads, while the rest of the setup (e.g., loading the model)
+	// continues. The builder is declared after the render pass, layout and
+	// registry, so that, should the setup throw, it waits for the builds
+	// before these are destroyed.
+	lut::PipelineRegistry pipelineRegistry(window);
+	lut::ThreadPool pipelineWorkers;
+	lut::PipelineBuilder pipelineBuilder(&pipelineWorkers);
+
+	auto const build_pipeline = [&pipelineBuilder, &pipelineRegistry] (char const* aName, lut::PipelineDesc aDesc) {
+		return pipelineBuilder.build(aName, [&pipelineRegistry, desc = std::move(aDesc)] {
+			return pipelineRegistry.get(desc);
+		});
+	};
 
-	lut::Pipeline blinnPhongPipe = create_blinn_phong_pipeline(window, renderPass.handle, pipeLayout.handle);
+	auto descs = pipeline_descs();
+	auto pipeJob = build_pipeline("default", std::move(descs[0]));
+	auto viewPipeJob = build_pipeline("view_direction", std::move(descs[1]));
+	auto lightPipeJob = build_pipeline("light_direction", std::move(descs[2]));
+
+	// The number keys select the light count, so the variants of all counts
+	// are built here. Only the current count's are waited for; the others
+	// finish in the background, and switching to one of them at most waits
+	// for its build.
+	lut::PipelineVariants blinnPhongVariants(pipelineRegistry, std::move(descs[3]));
+	lut::PipelineVariants pbrVariants(pipelineRegistry, std::move(descs[4]));
+
+	std::vector<std::future<VkPipeline>> variantJobs;
+	for (std::uint32_t count = 0; count <= glsl::kSceneLightCount; ++count)
+	{
+		variantJobs.emplace_back(build_pipeline("blinn_phong", blinnPhongVariants.desc(light_count_constants(int(count)))));
+		variantJobs.emplace_back(build_pipeline("pbr", pbrVariants.desc(light_count_constants(int(count)))));
+	}
 
-	lut::Pipeline pbrPipe = create_PBR_pipeline(window, renderPass.handle, pipeLayout.handle);
 	//create depth buffer
 	auto [depthBuffer, depthBufferView] = create_depth_buffer(window, allocator);
 	std::vector<lut::Framebuffer> framebuffers;
@@ -363,7 +433,7 @@ int main() try
 		VMA_MEMORY_USAGE_GPU_ONLY
 	);
 	// allocate descriptor set for uniform buffer
-	VkDescriptorSet sceneDescriptors = lut::alloc_desc_set(window, dpool.handle, sceneLayout.handle);
+	VkDescriptorSet sceneDescriptors = lut::alloc_desc_set(window, dpool.handle, sceneLayout);
 	{
 		VkWriteDescriptorSet desc[1]{};
 		VkDescriptorBufferInfo sceneUboInfo{};
@@ -396,7 +466,7 @@ int main() try
 				VMA_MEMORY_USAGE_GPU_ONLY
 			);
 
-			materialDescriptors[i] = lut::alloc_desc_set(window, dpool.handle, advancedLayout.handle);
+			materialDescriptors[i] = lut::alloc_desc_set(window, dpool.handle, advancedLayout);
 			{
 					VkWriteDescriptorSet desc[1]{};
 					VkDescriptorBufferInfo materialInfo{};
@@ -428,7 +498,7 @@ int main() try
 			VMA_MEMORY_USAGE_GPU_ONLY
 		);
 
-		pbrDescriptors[i] = lut::alloc_desc_set(window, dpool.handle, advancedLayout.handle);
+		pbrDescriptors[i] = lut::alloc_desc_set(window, dpool.handle, advancedLayout);
 		{
 			VkWriteDescriptorSet desc[1]{};
 			VkDescriptorBufferInfo materialInfo{};
@@ -448,6 +518,22 @@ int main() try
 	}
 #pragma endregion
 
+	// Wait for the pipelines that the first frame may use. A build that
+	// failed rethrows its exception here.
+	auto const pipelinesWaitStart = std::chrono::steady_clock::now();
+
+	VkPipeline pipe = pipeJob.get();
+	VkPipeline viewPipe = viewPipeJob.get();
+	VkPipeline lightPipe = lightPipeJob.get();
+	VkPipeline blinnPhongPipe = blinnPhongVariants.get(light_count_constants(sceneUniforms.constant));
+	VkPipeline pbrPipe = pbrVariants.get(light_count_constants(sceneUniforms.constant));
+
+	{
+		auto const waitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pipelinesWaitStart).count();
+		auto const stats = pipelineBuilder.stats();
+		auto const registryStats = pipelineRegistry.stats();
+		std::printf("Pipelines: %zu builds (%zu distinct) in %.3f ms on %zu threads (%.3f ms compiling, longest %s %.3f ms), waited %.3f ms after setup (%s pipeline cache)\n", stats.count, registryStats.pipelines, stats.wallMs, pipelineWorkers.thread_count(), stats.totalMs, stats.longest, stats.longestMs, waitMs, pipelineCacheBytes > 0 ? "warm" : "cold");
+	}
 
 	bool recreateSwapchain = false;
 
@@ -471,22 +557,24 @@ int main() try
 			auto const changes = lut::recreate_swapchain(window);
 			if (changes.changedFormat)
 			{
+				// The old pass' pipelines go first, as the new pass may
+				// reuse its handle. Variants may still be building for it.
+				pipelineBuilder.wait_idle();
+				pipelineRegistry.evict(renderPass.handle);
 				renderPass = create_render_pass(window);
-			}
 
-			if (changes.changedSize)
-			{
-				if(cfg::normalDirection)
-					lut::Pipeline pipe = create_pipeline(window, renderPass.handle, pipeLayout.handle);
-				else if(cfg::normalDirection)
-					lut::Pipeline viewPipe = create_view_direction_pipeline(window, renderPass.handle, pipeLayout.handle);
-				else if(cfg::lightDirection)
-					lut::Pipeline lightPipe = create_light_direction_pipeline(window, renderPass.handle, pipeLayout.handle);
-				else if(cfg::blinnPhong)
-					lut::Pipeline blinnPhongPipe = create_blinn_phong_pipeline(window, renderPass.handle, pipeLayout.handle);
-				else if(cfg::PBR)
-					lut::Pipeline pbrPipe = create_PBR_pipeline(window, renderPass.handle, pipeLayout.handle);
+				// Variants of the other light counts are built when they
+				// are first selected
+				auto newDescs = pipeline_descs();
+				pipe = pipelineRegistry.get(newDescs[0]);
+				viewPipe = pipelineRegistry.get(newDescs[1]);
+				lightPipe = pipelineRegistry.get(newDescs[2]);
+				blinnPhongVariants.reset(std::move(newDescs[3]));
+				pbrVariants.reset(std::move(newDescs[4]));
 			}
+
+			// The pipelines' viewports are dynamic, so a new size does not
+			// require new pipelines
 			//TODO: (Section 6) re-create depth buffer image
 			if (changes.changedSize)
 			{
@@ -531,6 +619,10 @@ int main() try
 		}
 		
 		update_scene_uniforms(camera, sceneUniforms, window.swapchainExtent.width, window.swapchainExtent.height);
+
+		// Variants of the light count selected with the number keys
+		blinnPhongPipe = blinnPhongVariants.get(light_count_constants(sceneUniforms.constant));
+		pbrPipe = pbrVariants.get(light_count_constants(sceneUniforms.constant));
 	
 		// record and submit commands
 		assert(std::size_t(imageIndex) < cbuffers.size());
@@ -540,11 +632,11 @@ int main() try
 			cbuffers[imageIndex],
 			renderPass.handle,
 			framebuffers[imageIndex].handle,
-			pipe.handle,
-			viewPipe.handle,
-			lightPipe.handle,
-			blinnPhongPipe.handle,
-			pbrPipe.handle,
+			pipe,
+			viewPipe,
+			lightPipe,
+			blinnPhongPipe,
+			pbrPipe,
 			window.swapchainExtent,
 			materialMesh,
 
@@ -582,6 +674,8 @@ int main() try
 	// to ensure that all Vulkan commands have finished before that.
 	vkDeviceWaitIdle(window.device);
 
+	lut::save_pipeline_cache(window, cfg::kPipelineCachePath);
+
 	return 0;
 }
 
@@ -857,732 +951,38 @@ namespace
 		return lut::PipelineLayout(aContext.device, layout);
 	}
 
-#pragma region 2.1
-	lut::Pipeline create_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	lut::PipelineDesc make_pipeline_desc(VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, char const* aVertPath, char const* aFragPath, bool aNormals)
 	{
-		//first step  : load shader modules
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kVertShaderPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kFragShaderPath);
-
-		//Shader stages in the pipeline
-		//We need two here, vert and frag
-		VkPipelineShaderStageCreateInfo  stages[2]{};
-		//vertex  [0]
-		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
-		stages[0].pName = "main";
-
-		//fragment [1]
-		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
-		stages[1].pName = "main";
-
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo
-		VkVertexInputBindingDescription vertexInputs[2]{};
-		//position
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		//normal
-		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 3;    //change here 
-		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		VkVertexInputAttributeDescription vertexAttributes[2]{};
-		//position
-		vertexAttributes[0].binding = 0;
-		vertexAttributes[0].location = 0;
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[0].offset = 0;
-		//normal
-		vertexAttributes[1].binding = 1;
-		vertexAttributes[1].location = 1;
-		vertexAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;   // change here 
-		vertexAttributes[1].offset = 0;
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo 
-
-		VkPipelineVertexInputStateCreateInfo inputInfo{};
-		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 2;
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 2;
-		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
-
-
-		//for rasterization
-		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
-		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		assemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-		//todo list...   Tessellation State   not now
-
-		//viewport state
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = float(aWindow.swapchainExtent.width);
-		viewport.height = float(aWindow.swapchainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.extent = VkExtent2D{ aWindow.swapchainExtent.width,
-									 aWindow.swapchainExtent.height };
-		scissor.offset = VkOffset2D{ 0,0 };
-
-		VkPipelineViewportStateCreateInfo viewportInfo{};
-		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
-		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
-
-		//Rasterization State
-		VkPipelineRasterizationStateCreateInfo rasterInfo{};
-		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterInfo.depthClampEnable = VK_FALSE;
-		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // like OpenGL
-		rasterInfo.depthBiasEnable = VK_FALSE;
-		rasterInfo.lineWidth = 1.0f;
-
-
-		//Mulitisampling 
-		VkPipelineMultisampleStateCreateInfo sampleInfo{};
-		sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		sampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		//Depth/Stencil State    not now
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
-
-		//Color Blend State  
-			//mask 
-		VkPipelineColorBlendAttachmentState blendStates[1]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		VkPipelineColorBlendStateCreateInfo blendInfo{};
-		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		blendInfo.attachmentCount = 1;
-		blendInfo.pAttachments = blendStates;
-
-		//Dynamic States  not now
-
-		//Create pipeline
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;  //vert frag
-		pipelineInfo.pStages = stages;
-		pipelineInfo.pVertexInputState = &inputInfo;
-		pipelineInfo.pInputAssemblyState = &assemblyInfo;
-		pipelineInfo.pViewportState = &viewportInfo;
-		pipelineInfo.pRasterizationState = &rasterInfo;
-		pipelineInfo.pMultisampleState = &sampleInfo;
-		pipelineInfo.pColorBlendState = &blendInfo;
-		pipelineInfo.layout = aPipelineLayout;
-		pipelineInfo.renderPass = aRenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.pTessellationState = nullptr;
-		pipelineInfo.pDepthStencilState = &depthInfo;
-		pipelineInfo.pDynamicState = nullptr;
-
-		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
+		lut::PipelineDesc desc;
+		desc.vertexShader = aVertPath;
+		desc.fragmentShader = aFragPath;
+
+		// Position, and (with aNormals) the normal
+		desc.vertexBindings = { lut::vertex_binding(0, sizeof(float) * 3) };
+		desc.vertexAttributes = { lut::vertex_attribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT) };
+		if (aNormals)
 		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
+			desc.vertexBindings.emplace_back(lut::vertex_binding(1, sizeof(float) * 3));
+			desc.vertexAttributes.emplace_back(lut::vertex_attribute(1, 1, VK_FORMAT_R32G32B32_SFLOAT));
 		}
 
-		return lut::Pipeline(aWindow.device, pipe);
-	}
+		// Defaults otherwise: back-face culling with counter-clockwise front
+		// faces (like OpenGL), depth test and write with LESS_OR_EQUAL
+		desc.blendAttachments = { lut::opaque_attachment() };
 
-	lut::Pipeline create_view_direction_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
-	{
-		//first step  : load shader modules
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kViewDirectionVert);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kViewDirectionFrag);
-
-		//Shader stages in the pipeline
-		//We need two here, vert and frag
-		VkPipelineShaderStageCreateInfo  stages[2]{};
-		//vertex  [0]
-		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
-		stages[0].pName = "main";
-
-		//fragment [1]
-		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
-		stages[1].pName = "main";
-
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo
-		VkVertexInputBindingDescription vertexInputs[2]{};
-		//position
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		VkVertexInputAttributeDescription vertexAttributes[2]{};
-		//position
-		vertexAttributes[0].binding = 0;
-		vertexAttributes[0].location = 0;
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[0].offset = 0;
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo 
-
-		VkPipelineVertexInputStateCreateInfo inputInfo{};
-		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 1;
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 1;
-		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
-
-
-		//for rasterization
-		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
-		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		assemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-		//todo list...   Tessellation State   not now
-
-		//viewport state
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = float(aWindow.swapchainExtent.width);
-		viewport.height = float(aWindow.swapchainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.extent = VkExtent2D{ aWindow.swapchainExtent.width,
-									 aWindow.swapchainExtent.height };
-		scissor.offset = VkOffset2D{ 0,0 };
-
-		VkPipelineViewportStateCreateInfo viewportInfo{};
-		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
-		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
-
-		//Rasterization State
-		VkPipelineRasterizationStateCreateInfo rasterInfo{};
-		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterInfo.depthClampEnable = VK_FALSE;
-		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // like OpenGL
-		rasterInfo.depthBiasEnable = VK_FALSE;
-		rasterInfo.lineWidth = 1.0f;
-
-
-		//Mulitisampling 
-		VkPipelineMultisampleStateCreateInfo sampleInfo{};
-		sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		sampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		//Depth/Stencil State    not now
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
-
-		//Color Blend State  
-			//mask 
-		VkPipelineColorBlendAttachmentState blendStates[1]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		VkPipelineColorBlendStateCreateInfo blendInfo{};
-		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		blendInfo.attachmentCount = 1;
-		blendInfo.pAttachments = blendStates;
-
-		//Dynamic States  not now
-
-		//Create pipeline
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;  //vert frag
-		pipelineInfo.pStages = stages;
-		pipelineInfo.pVertexInputState = &inputInfo;
-		pipelineInfo.pInputAssemblyState = &assemblyInfo;
-		pipelineInfo.pViewportState = &viewportInfo;
-		pipelineInfo.pRasterizationState = &rasterInfo;
-		pipelineInfo.pMultisampleState = &sampleInfo;
-		pipelineInfo.pColorBlendState = &blendInfo;
-		pipelineInfo.layout = aPipelineLayout;
-		pipelineInfo.renderPass = aRenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.pTessellationState = nullptr;
-		pipelineInfo.pDepthStencilState = &depthInfo;
-		pipelineInfo.pDynamicState = nullptr;
-
-		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
-		}
-
-		return lut::Pipeline(aWindow.device, pipe);
+		desc.layout = aPipelineLayout;
+		desc.renderPass = aRenderPass;
+		desc.subpass = 0;
+		return desc;
 	}
-	
-	lut::Pipeline create_light_direction_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
-	{
-		//first step  : load shader modules
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kLightDirectionVert);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kLightDirectionFrag);
-
-		//Shader stages in the pipeline
-		//We need two here, vert and frag
-		VkPipelineShaderStageCreateInfo  stages[2]{};
-		//vertex  [0]
-		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
-		stages[0].pName = "main";
-
-		//fragment [1]
-		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
-		stages[1].pName = "main";
-
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo
-		VkVertexInputBindingDescription vertexInputs[1]{};
-		//position
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		VkVertexInputAttributeDescription vertexAttributes[1]{};
-		//position
-		vertexAttributes[0].binding = 0;
-		vertexAttributes[0].location = 0;
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[0].offset = 0;
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo 
-
-		VkPipelineVertexInputStateCreateInfo inputInfo{};
-		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 1;
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 1;
-		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
-
-
-		//for rasterization
-		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
-		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		assemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-		//todo list...   Tessellation State   not now
-
-		//viewport state
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = float(aWindow.swapchainExtent.width);
-		viewport.height = float(aWindow.swapchainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
 
-		VkRect2D scissor{};
-		scissor.extent = VkExtent2D{ aWindow.swapchainExtent.width,
-									 aWindow.swapchainExtent.height };
-		scissor.offset = VkOffset2D{ 0,0 };
-
-		VkPipelineViewportStateCreateInfo viewportInfo{};
-		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
-		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
-
-		//Rasterization State
-		VkPipelineRasterizationStateCreateInfo rasterInfo{};
-		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterInfo.depthClampEnable = VK_FALSE;
-		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // like OpenGL
-		rasterInfo.depthBiasEnable = VK_FALSE;
-		rasterInfo.lineWidth = 1.0f;
-
-
-		//Mulitisampling 
-		VkPipelineMultisampleStateCreateInfo sampleInfo{};
-		sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		sampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		//Depth/Stencil State    not now
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
-
-		//Color Blend State  
-			//mask 
-		VkPipelineColorBlendAttachmentState blendStates[1]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		VkPipelineColorBlendStateCreateInfo blendInfo{};
-		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		blendInfo.attachmentCount = 1;
-		blendInfo.pAttachments = blendStates;
-
-		//Dynamic States  not now
-
-		//Create pipeline
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;  //vert frag
-		pipelineInfo.pStages = stages;
-		pipelineInfo.pVertexInputState = &inputInfo;
-		pipelineInfo.pInputAssemblyState = &assemblyInfo;
-		pipelineInfo.pViewportState = &viewportInfo;
-		pipelineInfo.pRasterizationState = &rasterInfo;
-		pipelineInfo.pMultisampleState = &sampleInfo;
-		pipelineInfo.pColorBlendState = &blendInfo;
-		pipelineInfo.layout = aPipelineLayout;
-		pipelineInfo.renderPass = aRenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.pTessellationState = nullptr;
-		pipelineInfo.pDepthStencilState = &depthInfo;
-		pipelineInfo.pDynamicState = nullptr;
-
-		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
-		}
-
-		return lut::Pipeline(aWindow.device, pipe);
-	}
-#pragma endregion
-
-#pragma region 2.2
-	lut::Pipeline create_blinn_phong_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	std::vector<std::uint32_t> light_count_constants(int aLightCount)
 	{
-		//first step  : load shader modules
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kBlinnPhongVertPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kBlinnPhongFragPath);
-
-		//Shader stages in the pipeline
-		//We need two here, vert and frag
-		VkPipelineShaderStageCreateInfo  stages[2]{};
-		//vertex  [0]
-		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
-		stages[0].pName = "main";
-
-		//fragment [1]
-		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
-		stages[1].pName = "main";
-
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo
-		VkVertexInputBindingDescription vertexInputs[2]{};
-		//position
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		//normal
-		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 3;
-		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		VkVertexInputAttributeDescription vertexAttributes[2]{};
-		//position
-		vertexAttributes[0].binding = 0;
-		vertexAttributes[0].location = 0;
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[0].offset = 0;
-		//normal
-		vertexAttributes[1].binding = 1;
-		vertexAttributes[1].location = 1;
-		vertexAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[1].offset = 0;
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo 
-
-		VkPipelineVertexInputStateCreateInfo inputInfo{};
-		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 2;
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 2;
-		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
-
-
-		//for rasterization
-		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
-		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		assemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-		//todo list...   Tessellation State   not now
-
-		//viewport state
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = float(aWindow.swapchainExtent.width);
-		viewport.height = float(aWindow.swapchainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+		assert(aLightCount >= 0 && std::uint32_t(aLightCount) <= glsl::kSceneLightCount);
 
-		VkRect2D scissor{};
-		scissor.extent = VkExtent2D{ aWindow.swapchainExtent.width,
-									 aWindow.swapchainExtent.height };
-		scissor.offset = VkOffset2D{ 0,0 };
-
-		VkPipelineViewportStateCreateInfo viewportInfo{};
-		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
-		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
-
-		//Rasterization State
-		VkPipelineRasterizationStateCreateInfo rasterInfo{};
-		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterInfo.depthClampEnable = VK_FALSE;
-		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // like OpenGL
-		rasterInfo.depthBiasEnable = VK_FALSE;
-		rasterInfo.lineWidth = 1.0f;
-
-
-		//Mulitisampling 
-		VkPipelineMultisampleStateCreateInfo sampleInfo{};
-		sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		sampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		//Depth/Stencil State    not now
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
-
-		//Color Blend State  
-		//mask 
-		VkPipelineColorBlendAttachmentState blendStates[1]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		VkPipelineColorBlendStateCreateInfo blendInfo{};
-		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		blendInfo.attachmentCount = 1;
-		blendInfo.pAttachments = blendStates;
-
-		//Dynamic States  not now
-
-		//Create pipeline
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;  //vert frag
-		pipelineInfo.pStages = stages;
-		pipelineInfo.pVertexInputState = &inputInfo;
-		pipelineInfo.pInputAssemblyState = &assemblyInfo;
-		pipelineInfo.pViewportState = &viewportInfo;
-		pipelineInfo.pRasterizationState = &rasterInfo;
-		pipelineInfo.pMultisampleState = &sampleInfo;
-		pipelineInfo.pColorBlendState = &blendInfo;
-		pipelineInfo.layout = aPipelineLayout;
-		pipelineInfo.renderPass = aRenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.pTessellationState = nullptr;
-		pipelineInfo.pDepthStencilState = &depthInfo;
-		pipelineInfo.pDynamicState = nullptr;
-
-		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
-		}
-
-		return lut::Pipeline(aWindow.device, pipe);
+		// Indexed by constant_id
+		return { std::uint32_t(aLightCount) };
 	}
-#pragma endregion 
-
-#pragma region 2.3
-	lut::Pipeline create_PBR_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
-	{
-			//first step  : load shader modules
-			lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kPBRVertPath);
-			lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kPBRFragPath);
-
-			//Shader stages in the pipeline
-			//We need two here, vert and frag
-			VkPipelineShaderStageCreateInfo  stages[2]{};
-			//vertex  [0]
-			stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-			stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-			stages[0].module = vert.handle;
-			stages[0].pName = "main";
-
-			//fragment [1]
-			stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-			stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-			stages[1].module = frag.handle;
-			stages[1].pName = "main";
-
-			//----------------------------------------------------VkPipelineVertexInputStateCreateInfo
-			VkVertexInputBindingDescription vertexInputs[2]{};
-			//position
-			vertexInputs[0].binding = 0;
-			vertexInputs[0].stride = sizeof(float) * 3;
-			vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-			//normal
-			vertexInputs[1].binding = 1;
-			vertexInputs[1].stride = sizeof(float) * 3;
-			vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-			VkVertexInputAttributeDescription vertexAttributes[2]{};
-			//position
-			vertexAttributes[0].binding = 0;
-			vertexAttributes[0].location = 0;
-			vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-			vertexAttributes[0].offset = 0;
-			//normal
-			vertexAttributes[1].binding = 1;
-			vertexAttributes[1].location = 1;
-			vertexAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-			vertexAttributes[1].offset = 0;
-			//----------------------------------------------------VkPipelineVertexInputStateCreateInfo 
-
-			VkPipelineVertexInputStateCreateInfo inputInfo{};
-			inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-			inputInfo.vertexBindingDescriptionCount = 2;
-			inputInfo.pVertexBindingDescriptions = vertexInputs;
-			inputInfo.vertexAttributeDescriptionCount = 2;
-			inputInfo.pVertexAttributeDescriptions = vertexAttributes;
-
-
-			//for rasterization
-			VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
-			assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-			assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-			assemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-			//todo list...   Tessellation State   not now
-
-			//viewport state
-			VkViewport viewport{};
-			viewport.x = 0.0f;
-			viewport.y = 0.0f;
-			viewport.width = float(aWindow.swapchainExtent.width);
-			viewport.height = float(aWindow.swapchainExtent.height);
-			viewport.minDepth = 0.0f;
-			viewport.maxDepth = 1.0f;
-
-			VkRect2D scissor{};
-			scissor.extent = VkExtent2D{ aWindow.swapchainExtent.width,
-										 aWindow.swapchainExtent.height };
-			scissor.offset = VkOffset2D{ 0,0 };
-
-			VkPipelineViewportStateCreateInfo viewportInfo{};
-			viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-			viewportInfo.viewportCount = 1;
-			viewportInfo.pViewports = &viewport;
-			viewportInfo.scissorCount = 1;
-			viewportInfo.pScissors = &scissor;
-
-			//Rasterization State
-			VkPipelineRasterizationStateCreateInfo rasterInfo{};
-			rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-			rasterInfo.depthClampEnable = VK_FALSE;
-			rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-			rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-			rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-			rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // like OpenGL
-			rasterInfo.depthBiasEnable = VK_FALSE;
-			rasterInfo.lineWidth = 1.0f;
-
-
-			//Mulitisampling 
-			VkPipelineMultisampleStateCreateInfo sampleInfo{};
-			sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-			sampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-			//Depth/Stencil State    not now
-			VkPipelineDepthStencilStateCreateInfo depthInfo{};
-			depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-			depthInfo.depthTestEnable = VK_TRUE;
-			depthInfo.depthWriteEnable = VK_TRUE;
-			depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-			depthInfo.minDepthBounds = 0.f;
-			depthInfo.maxDepthBounds = 1.f;
-
-			//Color Blend State  
-			//mask 
-			VkPipelineColorBlendAttachmentState blendStates[1]{};
-			blendStates[0].blendEnable = VK_FALSE;
-			blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-			VkPipelineColorBlendStateCreateInfo blendInfo{};
-			blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-			blendInfo.attachmentCount = 1;
-			blendInfo.pAttachments = blendStates;
-
-			//Dynamic States  not now
-
-			//Create pipeline
-			VkGraphicsPipelineCreateInfo pipelineInfo{};
-			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineInfo.stageCount = 2;  //vert frag
-			pipelineInfo.pStages = stages;
-			pipelineInfo.pVertexInputState = &inputInfo;
-			pipelineInfo.pInputAssemblyState = &assemblyInfo;
-			pipelineInfo.pViewportState = &viewportInfo;
-			pipelineInfo.pRasterizationState = &rasterInfo;
-			pipelineInfo.pMultisampleState = &sampleInfo;
-			pipelineInfo.pColorBlendState = &blendInfo;
-			pipelineInfo.layout = aPipelineLayout;
-			pipelineInfo.renderPass = aRenderPass;
-			pipelineInfo.subpass = 0;
-			pipelineInfo.pTessellationState = nullptr;
-			pipelineInfo.pDepthStencilState = &depthInfo;
-			pipelineInfo.pDynamicState = nullptr;
-
-			VkPipeline pipe = VK_NULL_HANDLE;
-			if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
-			{
-				throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
-			}
-
-			return lut::Pipeline(aWindow.device, pipe);
-		
-	}
-#pragma endregion
 
 	void create_swapchain_framebuffers(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, std::vector<lut::Framebuffer>& aFramebuffers, VkImageView aDepthView)
 	{
@@ -1616,50 +1016,90 @@ namespace
 		assert(aWindow.swapViews.size() == aFramebuffers.size());
 	}
 
-	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const& aWindow)
+	VkDescriptorSetLayout scene_set_layout(lut::DescriptorLayoutCache& aCache)
 	{
-		VkDescriptorSetLayoutBinding bindings[1]{};
-		bindings[0].binding = 0;
-		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		bindings[0].descriptorCount = 1;
-		bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-
-		//descriptor set layout
-		VkDescriptorSetLayoutCreateInfo layoutInfo{};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
-		layoutInfo.pBindings = bindings;
-
-		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
-		}
+		// All shading modes read the scene uniforms
+		auto const shaders = lut::reflect_shaders({
+			cfg::kVertShaderPath, cfg::kFragShaderPath,
+			cfg::kViewDirectionVert, cfg::kViewDirectionFrag,
+			cfg::kLightDirectionVert, cfg::kLightDirectionFrag,
+			cfg::kBlinnPhongVertPath, cfg::kBlinnPhongFragPath,
+			cfg::kPBRVertPath, cfg::kPBRFragPath
+		});
+
+		auto const bindings = lut::set_layout_bindings(shaders, 0);
+		if (1 != bindings.size() || VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER != bindings[0].descriptorType)
+			throw lut::Error("Scene set: expected a single uniform buffer, the shaders declare %zu bindings", bindings.size());
+
+		return aCache.get(bindings);
+	}
 
-		return lut::DescriptorSetLayout(aWindow.device, layout);
+	VkDescriptorSetLayout advanced_set_layout(lut::DescriptorLayoutCache& aCache)
+	{
+		// The Blinn-Phong and PBR materials use the same set layout
+		auto const shaders = lut::reflect_shaders({ cfg::kBlinnPhongFragPath, cfg::kPBRFragPath });
+
+		auto const bindings = lut::set_layout_bindings(shaders, 1);
+		if (1 != bindings.size() || VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER != bindings[0].descriptorType)
+			throw lut::Error("Material set: expected a single uniform buffer, the shaders declare %zu bindings", bindings.size());
+
+		return aCache.get(bindings);
 	}
 
-	lut::DescriptorSetLayout create_advanced_descriptor_layout(lut::VulkanWindow const& aWindow)
+	void check_shader_interfaces()
 	{
-		VkDescriptorSetLayoutBinding bindings[1]{};
-		bindings[0].binding = 0;
-		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		bindings[0].descriptorCount = 1;
-		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-		//descriptor set layout
-		VkDescriptorSetLayoutCreateInfo layoutInfo{};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
-		layoutInfo.pBindings = bindings;
-
-		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		char const* const scenePaths[] = {
+			cfg::kVertShaderPath,
+			cfg::kViewDirectionVert, cfg::kViewDirectionFrag,
+			cfg::kLightDirectionVert, cfg::kLightDirectionFrag,
+			cfg::kBlinnPhongVertPath, cfg::kBlinnPhongFragPath,
+			cfg::kPBRVertPath, cfg::kPBRFragPath
+		};
+
+		for (auto const path : scenePaths)
 		{
-			throw lut::Error("Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
+			auto const shader = lut::reflect_spirv_file(path);
+			auto const* scene = lut::find_binding(shader, 0, 0);
+			if (!scene)
+				throw lut::Error("%s: no scene uniforms (set 0, binding 0)", path);
+
+			lut::check_block_layout(scene->block, "glsl::SceneUniform", sizeof(glsl::SceneUniform), {
+				offsetof(glsl::SceneUniform, camera),
+				offsetof(glsl::SceneUniform, projection),
+				offsetof(glsl::SceneUniform, projCam),
+				offsetof(glsl::SceneUniform, lights),
+				offsetof(glsl::SceneUniform, camPos),
+				offsetof(glsl::SceneUniform, constant)
+			});
 		}
 
-		return lut::DescriptorSetLayout(aWindow.device, layout);
+		{
+			auto const shader = lut::reflect_spirv_file(cfg::kBlinnPhongFragPath);
+			auto const* material = lut::find_binding(shader, 1, 0);
+			if (!material)
+				throw lut::Error("%s: no material uniforms (set 1, binding 0)", cfg::kBlinnPhongFragPath);
+
+			lut::check_block_layout(material->block, "glsl::MaterialUniform", sizeof(glsl::MaterialUniform), {
+				offsetof(glsl::MaterialUniform, emissive),
+				offsetof(glsl::MaterialUniform, diffuse),
+				offsetof(glsl::MaterialUniform, specular),
+				offsetof(glsl::MaterialUniform, shininess)
+			});
+		}
+
+		{
+			auto const shader = lut::reflect_spirv_file(cfg::kPBRFragPath);
+			auto const* material = lut::find_binding(shader, 1, 0);
+			if (!material)
+				throw lut::Error("%s: no material uniforms (set 1, binding 0)", cfg::kPBRFragPath);
+
+			lut::check_block_layout(material->block, "glsl::PBRuniform", sizeof(glsl::PBRuniform), {
+				offsetof(glsl::PBRuniform, emissive),
+				offsetof(glsl::PBRuniform, albedo),
+				offsetof(glsl::PBRuniform, shininess),
+				offsetof(glsl::PBRuniform, metalness)
+			});
+		}
 	}
 
 	void record_commands(
@@ -1751,6 +1191,19 @@ namespace
 
 		vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
 
+		// The pipelines' viewport and scissor are dynamic state
+		VkViewport viewport{};
+		viewport.width = float(aImageExtent.width);
+		viewport.height = float(aImageExtent.height);
+		viewport.minDepth = 0.f;
+		viewport.maxDepth = 1.f;
+		vkCmdSetViewport(aCmdBuff, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.offset = VkOffset2D{ 0, 0 };
+		scissor.extent = aImageExtent;
+		vkCmdSetScissor(aCmdBuff, 0, 1, &scissor);
+
 
 			//drawing with pipeline
 		if (cfg::normalDirection)
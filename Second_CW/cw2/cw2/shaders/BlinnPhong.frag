@@ -33,6 +33,17 @@ layout(location = 1) in vec3 v2fNormal;
 
 layout(location = 0) out vec4 outColour;
 
+// Shader variant (see PipelineDesc::specialization). The light loop is
+// unrolled for LIGHT_COUNT (0 to 4) lights, selected with the number keys.
+layout(constant_id = 0) const int LIGHT_COUNT = 4;
+
+// Terms added besides the lights: bit 0 emissive, bit 1 ambient
+// (constant_id 1 is the BRDF model of PBR.frag)
+layout(constant_id = 2) const uint SHADE_FEATURES = 3u;
+
+#define SHADE_EMISSIVE 1u
+#define SHADE_AMBIENT  2u
+
 // ambient factor
 
 void main()
@@ -56,8 +67,13 @@ void main()
 	vec3 viewDir = normalize(uScene.camPos - v2fPos);
 	float shinessFactor = (uMaterial.shininess + 2.f) / 8.f;
 
+	if ((SHADE_FEATURES & SHADE_EMISSIVE) == 0u)
+		Cemit = vec3(0.f);
+	if ((SHADE_FEATURES & SHADE_AMBIENT) == 0u)
+		Camibent = vec3(0.f);
+
 	vec4 fragColour = vec4((Cemit+Camibent),1.f);
-	for(int i = 0; i < uScene.constant; i++)
+	for(int i = 0; i < LIGHT_COUNT; i++)
 	{
 		//light direction
 		vec3 lightDir = normalize(uScene.light[i].position.xyz - v2fPos);
@@ -1,11 +1,20 @@
 #version 450
 
+struct Light
+{
+	vec4 position;
+	vec4 colour;
+};
+
+// glsl::SceneUniform
 layout(set = 0, binding = 0) uniform UScene
 {
 			mat4 camera;
 			mat4 projection;
 			mat4 projCam;
+			Light light[4];
 			vec3 camPos;
+			int constant;
 } uScene;
 
 
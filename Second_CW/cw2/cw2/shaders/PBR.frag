@@ -33,6 +33,19 @@ layout(location = 1) in vec3 v2fNormal;
 
 layout(location = 0) out vec4 outColour;
 
+// Shader variant (see PipelineDesc::specialization). The light loop is
+// unrolled for LIGHT_COUNT (0 to 4) lights, selected with the number keys.
+layout(constant_id = 0) const int LIGHT_COUNT = 4;
+
+// BRDF of the lights: 0 = microfacet, 1 = Lambert (diffuse only)
+layout(constant_id = 1) const int BRDF_MODEL = 0;
+
+// Terms added besides the lights: bit 0 emissive, bit 1 ambient
+layout(constant_id = 2) const uint SHADE_FEATURES = 3u;
+
+#define SHADE_EMISSIVE 1u
+#define SHADE_AMBIENT  2u
+
 void main()
 {
 	//modular code
@@ -42,10 +55,10 @@ void main()
 	float nv = max(dot(normal, viewDir), 0.f);
 
 	//Le
-	vec3 Lemit = uMaterial.emissive.xyz;
+	vec3 Lemit = (SHADE_FEATURES & SHADE_EMISSIVE) != 0u ? uMaterial.emissive.xyz : vec3(0.f);
 
 	//Lamibent
-	vec3 Lamibent = vec3(0.02f, 0.02f, 0.02f) * uMaterial.albedo.xyz;
+	vec3 Lamibent = (SHADE_FEATURES & SHADE_AMBIENT) != 0u ? vec3(0.02f, 0.02f, 0.02f) * uMaterial.albedo.xyz : vec3(0.f);
 	
 	//Fresnel Term
 	vec3 F0 = (1 - uMaterial.metalness) * vec3(0.04f, 0.04f, 0.04f) + uMaterial.metalness * uMaterial.albedo.xyz;
@@ -53,12 +66,19 @@ void main()
 
 	vec4 fragColour = vec4((Lemit + Lamibent),1.f);
 
-	for(int i = 0; i < uScene.constant; i++)
+	for(int i = 0; i < LIGHT_COUNT; i++)
 	{
 		vec3 lightDir = normalize(uScene.light[i].position.xyz - v2fPos);
+		float nl = max(dot(normal, lightDir), 0.f);
+
+		if (BRDF_MODEL == 1)
+		{
+			fragColour += vec4((uMaterial.albedo.xyz/PI) * (1 - uMaterial.metalness) * uScene.light[i].colour.xyz * nl, 1.f);
+			continue;
+		}
+
 		vec3 halfwayDir = normalize(lightDir + viewDir);
 		float nh = max(dot(normal, halfwayDir), 0.f);
-		float nl = max(dot(normal, lightDir), 0.f);
 		float vh = dot(viewDir, halfwayDir);
 
 		//Fresnel Term
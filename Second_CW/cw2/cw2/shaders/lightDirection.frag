@@ -1,13 +1,20 @@
 #version 450
 
+struct Light
+{
+	vec4 position;
+	vec4 colour;
+};
+
+// glsl::SceneUniform
 layout(set = 0, binding = 0) uniform UScene
 {
 			mat4 camera;
 			mat4 projection;
 			mat4 projCam;
-			vec3 position;
-			vec3 colour;
+			Light light[4];
 			vec3 camPos;
+			int constant;
 } uScene;
 
 
@@ -17,7 +24,7 @@ layout(location = 0) out vec4 outColour;
 
 void main()
 {
-	vec3 lightDir = normalize(uScene.position - v2fPos); 
+	vec3 lightDir = normalize(uScene.light[0].position.xyz - v2fPos); 
 	
 	outColour = vec4(lightDir, 1.f);
 }
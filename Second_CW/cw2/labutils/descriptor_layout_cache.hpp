@@ -0,0 +1,45 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+#include <utility>
+
+#include <cstddef>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Owns the application's descriptor set layouts, one per distinct set of
+	// bindings. get() creates the layout on first use; pipelines whose
+	// shaders declare the same set (see shader_reflection.hpp) then share
+	// one layout, which keeps their pipeline layouts compatible.
+	//
+	// Bindings compare by binding, type, count and stages. Immutable
+	// samplers are not supported. Not thread safe; the layouts are meant to
+	// be created during setup.
+	class DescriptorLayoutCache final
+	{
+		public:
+			explicit DescriptorLayoutCache( VulkanContext const& );
+
+			DescriptorLayoutCache( DescriptorLayoutCache const& ) = delete;
+			DescriptorLayoutCache& operator= (DescriptorLayoutCache const&) = delete;
+
+		public:
+			// Throws labutils::Error if the layout cannot be created
+			VkDescriptorSetLayout get( std::vector<VkDescriptorSetLayoutBinding> const& );
+
+			std::size_t size() const;
+
+		private:
+			VulkanContext const* mContext;
+
+			// Few layouts, so a linear search is fine
+			std::vector<std::pair<std::vector<VkDescriptorSetLayoutBinding>, DescriptorSetLayout>> mLayouts;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
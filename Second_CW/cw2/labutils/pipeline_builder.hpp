@@ -0,0 +1,92 @@
+#pragma once
+
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <type_traits>
+#include <condition_variable>
+
+#include <cstddef>
+
+#include "thread_pool.hpp"
+
+namespace labutils
+{
+	// Compiles pipelines concurrently on the threads of a ThreadPool. Each
+	// build is a function that creates one or more pipelines, typically one
+	// of the application's create_*_pipeline() functions, and build() returns
+	// a std::future<> for its result. The caller can continue with other
+	// setup (e.g., loading meshes) and only waits, with get(), once it
+	// actually needs the pipelines.
+	//
+	// Pipeline creation may run concurrently: vkCreate*Pipelines() only
+	// requires external synchronization of the pipeline cache, and the
+	// context's cache (VulkanContext::pipelineCache) is created without
+	// VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT, i.e., the driver
+	// synchronizes it. The build functions must therefore only share
+	// read-only state; Vulkan handles should be captured by value.
+	//
+	// Without a pool, builds run immediately on the calling thread, which
+	// gives the serial baseline for comparison.
+	class PipelineBuilder final
+	{
+		public:
+			explicit PipelineBuilder( ThreadPool* = nullptr );
+
+			// Waits for all outstanding builds
+			~PipelineBuilder();
+
+			PipelineBuilder( PipelineBuilder const& ) = delete;
+			PipelineBuilder& operator= (PipelineBuilder const&) = delete;
+
+		public:
+			// aName identifies the build in stats(). It must outlive the
+			// builder (e.g., a string literal).
+			template< typename tFunc >
+			auto build( char const* aName, tFunc&& aCreate ) -> std::future<std::invoke_result_t<std::decay_t<tFunc>>>;
+
+			// Block until all builds that were started so far have finished
+			void wait_idle();
+
+			struct Stats
+			{
+				std::size_t count = 0;
+
+				// From the start of the first build to the end of the last
+				float wallMs = 0.f;
+
+				// Sum over all builds, i.e., the time a serial build would
+				// take, and the longest build
+				float totalMs = 0.f;
+				float longestMs = 0.f;
+				char const* longest = nullptr;
+			};
+
+			// Of the builds that have finished so far
+			Stats stats() const;
+
+		private:
+			using Clock_ = std::chrono::steady_clock;
+
+			void started_();
+			void finished_( char const* aName, Clock_::time_point aStart );
+
+			ThreadPool* mPool;
+
+			mutable std::mutex mMutex;
+			std::condition_variable mIdle;
+			std::size_t mPending = 0;
+
+			Clock_::time_point mFirstStart{}, mLastEnd{};
+			Stats mStats;
+	};
+
+	// Result of a build, or an empty (default-constructed) result if aJob
+	// was never started, e.g., because the pipeline is not used
+	template< typename tResult >
+	tResult take_result( std::future<tResult>& aJob );
+}
+
+#include "pipeline_builder.inl"
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
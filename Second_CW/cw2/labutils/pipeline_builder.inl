@@ -0,0 +1,43 @@
+#include <utility>
+
+namespace labutils
+{
+	template< typename tFunc >
+	inline
+	auto PipelineBuilder::build( char const* aName, tFunc&& aCreate ) -> std::future<std::invoke_result_t<std::decay_t<tFunc>>>
+	{
+		using Result_ = std::invoke_result_t<std::decay_t<tFunc>>;
+
+		started_();
+
+		auto job = [this, aName, create = std::forward<tFunc>(aCreate)] () mutable -> Result_ {
+			// Report the build as finished even if it throws; the exception
+			// is passed on through the future
+			struct Finish_
+			{
+				PipelineBuilder* self;
+				char const* name;
+				Clock_::time_point start;
+
+				~Finish_() { self->finished_( name, start ); }
+			} finish{ this, aName, Clock_::now() };
+
+			return create();
+		};
+
+		if( mPool )
+			return mPool->submit( std::move(job) );
+
+		std::packaged_task<Result_()> task( std::move(job) );
+		auto future = task.get_future();
+		task();
+		return future;
+	}
+
+	template< typename tResult >
+	inline
+	tResult take_result( std::future<tResult>& aJob )
+	{
+		return aJob.valid() ? aJob.get() : tResult{};
+	}
+}
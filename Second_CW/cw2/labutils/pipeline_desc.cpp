@@ -0,0 +1,332 @@
+#include "pipeline_desc.hpp"
+
+#include <tuple>
+#include <functional>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	// See boost::hash_combine()
+	template< typename tValue >
+	void hash_combine_( std::size_t& aSeed, tValue const& aValue )
+	{
+		aSeed ^= std::hash<tValue>{}( aValue ) + 0x9e3779b9 + (aSeed << 6) + (aSeed >> 2);
+	}
+
+	auto tie_( VkVertexInputBindingDescription const& aX )
+	{
+		return std::tie( aX.binding, aX.stride, aX.inputRate );
+	}
+	auto tie_( VkVertexInputAttributeDescription const& aX )
+	{
+		return std::tie( aX.location, aX.binding, aX.format, aX.offset );
+	}
+	auto tie_( VkStencilOpState const& aX )
+	{
+		return std::tie( aX.failOp, aX.passOp, aX.depthFailOp, aX.compareOp, aX.compareMask, aX.writeMask, aX.reference );
+	}
+	auto tie_( VkPipelineColorBlendAttachmentState const& aX )
+	{
+		return std::tie( aX.blendEnable, aX.srcColorBlendFactor, aX.dstColorBlendFactor, aX.colorBlendOp, aX.srcAlphaBlendFactor, aX.dstAlphaBlendFactor, aX.alphaBlendOp, aX.colorWriteMask );
+	}
+
+	template< typename tVk >
+	bool equal_( std::vector<tVk> const& aX, std::vector<tVk> const& aY )
+	{
+		if( aX.size() != aY.size() )
+			return false;
+
+		for( std::size_t i = 0; i < aX.size(); ++i )
+		{
+			if( tie_( aX[i] ) != tie_( aY[i] ) )
+				return false;
+		}
+
+		return true;
+	}
+
+	template< typename tVk >
+	void hash_members_( std::size_t& aSeed, tVk const& aX )
+	{
+		std::apply( [&aSeed] (auto const&... aMembers) { (hash_combine_( aSeed, aMembers ), ...); }, tie_( aX ) );
+	}
+
+	template< typename tVk >
+	void hash_members_( std::size_t& aSeed, std::vector<tVk> const& aX )
+	{
+		hash_combine_( aSeed, aX.size() );
+		for( auto const& x : aX )
+			hash_members_( aSeed, x );
+	}
+
+	// Specialization info for aDesc.specialization; refers to aEntries and
+	// to the description, which must outlive it.
+	VkSpecializationInfo specialization_info_( labutils::PipelineDesc const& aDesc, std::vector<VkSpecializationMapEntry>& aEntries )
+	{
+		aEntries.resize( aDesc.specialization.size() );
+		for( std::size_t i = 0; i < aEntries.size(); ++i )
+		{
+			aEntries[i].constantID = std::uint32_t(i);
+			aEntries[i].offset = std::uint32_t(i * sizeof(std::uint32_t));
+			aEntries[i].size = sizeof(std::uint32_t);
+		}
+
+		VkSpecializationInfo ret{};
+		ret.mapEntryCount = std::uint32_t(aEntries.size());
+		ret.pMapEntries = aEntries.data();
+		ret.dataSize = aDesc.specialization.size() * sizeof(std::uint32_t);
+		ret.pData = aDesc.specialization.data();
+		return ret;
+	}
+
+	labutils::Pipeline create_compute_( labutils::VulkanContext const& aContext, labutils::PipelineDesc const& aDesc )
+	{
+		assert( aDesc.vertexShader.empty() && aDesc.fragmentShader.empty() );
+
+		labutils::ShaderModule comp = labutils::load_shader_module( aContext, aDesc.computeShader.c_str() );
+
+		std::vector<VkSpecializationMapEntry> specEntries;
+		VkSpecializationInfo const specInfo = specialization_info_( aDesc, specEntries );
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = comp.handle;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.stage.pSpecializationInfo = aDesc.specialization.empty() ? nullptr : &specInfo;
+		pipelineInfo.layout = aDesc.layout;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aContext.device, aContext.pipelineCache, 1, &pipelineInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		{
+			throw labutils::Error( "Unable to create compute pipeline (%s)\n"
+				"vkCreateComputePipelines() returned %s", aDesc.computeShader.c_str(), labutils::to_string(res).c_str()
+			);
+		}
+
+		return labutils::Pipeline( aContext.device, pipe );
+	}
+
+	labutils::Pipeline create_graphics_( labutils::VulkanContext const& aContext, labutils::PipelineDesc const& aDesc )
+	{
+		assert( !aDesc.vertexShader.empty() );
+
+		labutils::ShaderModule vert = labutils::load_shader_module( aContext, aDesc.vertexShader.c_str() );
+
+		labutils::ShaderModule frag;
+		if( !aDesc.fragmentShader.empty() )
+			frag = labutils::load_shader_module( aContext, aDesc.fragmentShader.c_str() );
+
+		std::vector<VkSpecializationMapEntry> specEntries;
+		VkSpecializationInfo const specInfo = specialization_info_( aDesc, specEntries );
+		VkSpecializationInfo const* const spec = aDesc.specialization.empty() ? nullptr : &specInfo;
+
+		VkPipelineShaderStageCreateInfo stages[2]{};
+		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		stages[0].module = vert.handle;
+		stages[0].pName = "main";
+		stages[0].pSpecializationInfo = spec;
+
+		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		stages[1].module = frag.handle;
+		stages[1].pName = "main";
+		stages[1].pSpecializationInfo = spec;
+
+		VkPipelineVertexInputStateCreateInfo inputInfo{};
+		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		inputInfo.vertexBindingDescriptionCount = std::uint32_t(aDesc.vertexBindings.size());
+		inputInfo.pVertexBindingDescriptions = aDesc.vertexBindings.data();
+		inputInfo.vertexAttributeDescriptionCount = std::uint32_t(aDesc.vertexAttributes.size());
+		inputInfo.pVertexAttributeDescriptions = aDesc.vertexAttributes.data();
+
+		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		assemblyInfo.topology = aDesc.topology;
+		assemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+		VkPipelineViewportStateCreateInfo viewportInfo{};
+		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportInfo.viewportCount = 1;
+		viewportInfo.scissorCount = 1;
+
+		VkPipelineRasterizationStateCreateInfo rasterInfo{};
+		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterInfo.depthClampEnable = VK_FALSE;
+		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
+		rasterInfo.polygonMode = aDesc.polygonMode;
+		rasterInfo.cullMode = aDesc.cullMode;
+		rasterInfo.frontFace = aDesc.frontFace;
+		rasterInfo.depthBiasEnable = VK_FALSE;
+		rasterInfo.lineWidth = 1.f;
+
+		VkPipelineMultisampleStateCreateInfo sampleInfo{};
+		sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		sampleInfo.rasterizationSamples = aDesc.samples;
+
+		VkPipelineDepthStencilStateCreateInfo depthInfo{};
+		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthInfo.depthTestEnable = aDesc.depthTest ? VK_TRUE : VK_FALSE;
+		depthInfo.depthWriteEnable = aDesc.depthWrite ? VK_TRUE : VK_FALSE;
+		depthInfo.depthCompareOp = aDesc.depthCompare;
+		depthInfo.stencilTestEnable = aDesc.stencilTest ? VK_TRUE : VK_FALSE;
+		depthInfo.front = aDesc.stencilFront;
+		depthInfo.back = aDesc.stencilBack;
+		depthInfo.minDepthBounds = 0.f;
+		depthInfo.maxDepthBounds = 1.f;
+
+		VkPipelineColorBlendStateCreateInfo blendInfo{};
+		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		blendInfo.attachmentCount = std::uint32_t(aDesc.blendAttachments.size());
+		blendInfo.pAttachments = aDesc.blendAttachments.data();
+
+		VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamicInfo{};
+		dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+		dynamicInfo.pDynamicStates = dynamicStates;
+
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = frag.handle ? 2 : 1;
+		pipelineInfo.pStages = stages;
+		pipelineInfo.pVertexInputState = &inputInfo;
+		pipelineInfo.pInputAssemblyState = &assemblyInfo;
+		pipelineInfo.pViewportState = &viewportInfo;
+		pipelineInfo.pRasterizationState = &rasterInfo;
+		pipelineInfo.pMultisampleState = &sampleInfo;
+		pipelineInfo.pDepthStencilState = &depthInfo;
+		pipelineInfo.pColorBlendState = &blendInfo;
+		pipelineInfo.pDynamicState = &dynamicInfo;
+		pipelineInfo.layout = aDesc.layout;
+		pipelineInfo.renderPass = aDesc.renderPass;
+		pipelineInfo.subpass = aDesc.subpass;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateGraphicsPipelines( aContext.device, aContext.pipelineCache, 1, &pipelineInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		{
+			throw labutils::Error( "Unable to create graphics pipeline (%s, %s)\n"
+				"vkCreateGraphicsPipelines() returned %s", aDesc.vertexShader.c_str(), aDesc.fragmentShader.c_str(), labutils::to_string(res).c_str()
+			);
+		}
+
+		return labutils::Pipeline( aContext.device, pipe );
+	}
+}
+
+namespace labutils
+{
+	bool operator== (PipelineDesc const& aX, PipelineDesc const& aY)
+	{
+		// Cheap members first
+		return aX.layout == aY.layout
+			&& aX.renderPass == aY.renderPass
+			&& aX.subpass == aY.subpass
+			&& aX.topology == aY.topology
+			&& aX.polygonMode == aY.polygonMode
+			&& aX.cullMode == aY.cullMode
+			&& aX.frontFace == aY.frontFace
+			&& aX.samples == aY.samples
+			&& aX.depthTest == aY.depthTest
+			&& aX.depthWrite == aY.depthWrite
+			&& aX.depthCompare == aY.depthCompare
+			&& aX.stencilTest == aY.stencilTest
+			&& tie_( aX.stencilFront ) == tie_( aY.stencilFront )
+			&& tie_( aX.stencilBack ) == tie_( aY.stencilBack )
+			&& equal_( aX.vertexBindings, aY.vertexBindings )
+			&& equal_( aX.vertexAttributes, aY.vertexAttributes )
+			&& equal_( aX.blendAttachments, aY.blendAttachments )
+			&& aX.specialization == aY.specialization
+			&& aX.vertexShader == aY.vertexShader
+			&& aX.fragmentShader == aY.fragmentShader
+			&& aX.computeShader == aY.computeShader
+		;
+	}
+	bool operator!= (PipelineDesc const& aX, PipelineDesc const& aY)
+	{
+		return !(aX == aY);
+	}
+
+	std::size_t hash_value( PipelineDesc const& aDesc )
+	{
+		std::size_t seed = 0;
+
+		hash_combine_( seed, aDesc.vertexShader );
+		hash_combine_( seed, aDesc.fragmentShader );
+		hash_combine_( seed, aDesc.computeShader );
+
+		hash_combine_( seed, aDesc.specialization.size() );
+		for( auto const value : aDesc.specialization )
+			hash_combine_( seed, value );
+
+		hash_members_( seed, aDesc.vertexBindings );
+		hash_members_( seed, aDesc.vertexAttributes );
+		hash_combine_( seed, aDesc.topology );
+
+		hash_combine_( seed, aDesc.polygonMode );
+		hash_combine_( seed, aDesc.cullMode );
+		hash_combine_( seed, aDesc.frontFace );
+		hash_combine_( seed, aDesc.samples );
+
+		hash_combine_( seed, aDesc.depthTest );
+		hash_combine_( seed, aDesc.depthWrite );
+		hash_combine_( seed, aDesc.depthCompare );
+
+		hash_combine_( seed, aDesc.stencilTest );
+		hash_members_( seed, aDesc.stencilFront );
+		hash_members_( seed, aDesc.stencilBack );
+
+		hash_members_( seed, aDesc.blendAttachments );
+
+		hash_combine_( seed, aDesc.layout );
+		hash_combine_( seed, aDesc.renderPass );
+		hash_combine_( seed, aDesc.subpass );
+
+		return seed;
+	}
+
+	VkVertexInputBindingDescription vertex_binding( std::uint32_t aBinding, std::uint32_t aStride, VkVertexInputRate aRate )
+	{
+		VkVertexInputBindingDescription ret{};
+		ret.binding = aBinding;
+		ret.stride = aStride;
+		ret.inputRate = aRate;
+		return ret;
+	}
+
+	VkVertexInputAttributeDescription vertex_attribute( std::uint32_t aLocation, std::uint32_t aBinding, VkFormat aFormat, std::uint32_t aOffset )
+	{
+		VkVertexInputAttributeDescription ret{};
+		ret.location = aLocation;
+		ret.binding = aBinding;
+		ret.format = aFormat;
+		ret.offset = aOffset;
+		return ret;
+	}
+
+	VkPipelineColorBlendAttachmentState opaque_attachment()
+	{
+		VkPipelineColorBlendAttachmentState ret{};
+		ret.blendEnable = VK_FALSE;
+		ret.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		return ret;
+	}
+
+	Pipeline create_pipeline( VulkanContext const& aContext, PipelineDesc const& aDesc )
+	{
+		if( !aDesc.computeShader.empty() )
+			return create_compute_( aContext, aDesc );
+
+		return create_graphics_( aContext, aDesc );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <mutex>
+#include <future>
+#include <vector>
+#include <unordered_map>
+
+#include <cstddef>
+
+#include "vkobject.hpp"
+#include "pipeline_desc.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Owns the application's pipelines, one per distinct PipelineDesc.
+	// get() builds the pipeline for a description on first use; later
+	// requests for an identical description return the same VkPipeline
+	// without compiling anything.
+	//
+	// get() may be called concurrently (e.g., from PipelineBuilder builds).
+	// Concurrent requests for the same description wait for the one build.
+	// A build that fails is not cached, and its exception is passed on to
+	// all requests that waited for it. The registry must outlive the builds
+	// that use it, i.e., be declared before the PipelineBuilder.
+	//
+	// The descriptions refer to render passes and layouts by handle. A new
+	// object may reuse the handle of a destroyed one, so the pipelines of a
+	// render pass must be evicted before it is destroyed (e.g., when the
+	// swapchain format changes).
+	class PipelineRegistry final
+	{
+		public:
+			explicit PipelineRegistry( VulkanContext const& );
+
+			PipelineRegistry( PipelineRegistry const& ) = delete;
+			PipelineRegistry& operator= (PipelineRegistry const&) = delete;
+
+		public:
+			VkPipeline get( PipelineDesc const& );
+
+			// Destroys the pipelines created for aRenderPass, which must no
+			// longer be in use (or still be building). Returns the number of
+			// pipelines destroyed.
+			std::size_t evict( VkRenderPass aRenderPass );
+
+			struct Stats
+			{
+				std::size_t pipelines = 0; // currently owned
+
+				std::size_t builds = 0;
+				std::size_t hits = 0; // get() calls that did not build
+			};
+
+			Stats stats() const;
+
+		private:
+			VulkanContext const* mContext;
+
+			mutable std::mutex mMutex;
+
+			// Entries are inserted before the build starts, such that other
+			// requests for the same description wait for it
+			std::unordered_map<PipelineDesc, std::shared_future<VkPipeline>, PipelineDescHash> mEntries;
+			std::vector<Pipeline> mPipelines;
+
+			Stats mStats;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,45 @@
+#include "pipeline_variants.hpp"
+
+#include <utility>
+
+#include <cassert>
+
+namespace labutils
+{
+	PipelineVariants::PipelineVariants( PipelineRegistry& aRegistry, PipelineDesc aBase )
+		: mRegistry( &aRegistry )
+		, mBase( std::move(aBase) )
+	{}
+
+	PipelineDesc PipelineVariants::desc( std::vector<std::uint32_t> const& aConstants ) const
+	{
+		PipelineDesc ret = mBase;
+		ret.specialization = aConstants;
+		return ret;
+	}
+
+	VkPipeline PipelineVariants::get( std::vector<std::uint32_t> const& aConstants )
+	{
+		assert( mRegistry );
+
+		if( auto const it = mVariants.find( aConstants ); mVariants.end() != it )
+			return it->second;
+
+		VkPipeline const pipe = mRegistry->get( desc( aConstants ) );
+		mVariants.emplace( aConstants, pipe );
+		return pipe;
+	}
+
+	void PipelineVariants::reset( PipelineDesc aBase )
+	{
+		mBase = std::move(aBase);
+		mVariants.clear();
+	}
+
+	std::size_t PipelineVariants::size() const
+	{
+		return mVariants.size();
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
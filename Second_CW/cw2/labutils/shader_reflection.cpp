@@ -0,0 +1,642 @@
+#include "shader_reflection.hpp"
+
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include <cstdio>
+#include <cassert>
+
+#include "error.hpp"
+
+namespace
+{
+	// The subset of the SPIR-V specification's enums that is reflected
+	// (see the SPIR-V specification, section 3)
+	constexpr std::uint32_t kSpirvMagic_ = 0x07230203;
+	constexpr std::size_t kSpirvHeaderWords_ = 5;
+
+	enum SpirvOp_ : std::uint32_t
+	{
+		OpName_ = 5,
+		OpMemberName_ = 6,
+		OpEntryPoint_ = 15,
+		OpTypeBool_ = 20,
+		OpTypeInt_ = 21,
+		OpTypeFloat_ = 22,
+		OpTypeVector_ = 23,
+		OpTypeMatrix_ = 24,
+		OpTypeImage_ = 25,
+		OpTypeSampler_ = 26,
+		OpTypeSampledImage_ = 27,
+		OpTypeArray_ = 28,
+		OpTypeRuntimeArray_ = 29,
+		OpTypeStruct_ = 30,
+		OpTypePointer_ = 32,
+		OpConstant_ = 43,
+		OpSpecConstant_ = 50,
+		OpVariable_ = 59,
+		OpDecorate_ = 71,
+		OpMemberDecorate_ = 72
+	};
+
+	enum SpirvDecoration_ : std::uint32_t
+	{
+		DecorationBlock_ = 2,
+		DecorationBufferBlock_ = 3,
+		DecorationArrayStride_ = 6,
+		DecorationMatrixStride_ = 7,
+		DecorationBinding_ = 33,
+		DecorationDescriptorSet_ = 34,
+		DecorationOffset_ = 35
+	};
+
+	enum SpirvStorageClass_ : std::uint32_t
+	{
+		StorageClassUniformConstant_ = 0,
+		StorageClassUniform_ = 2,
+		StorageClassPushConstant_ = 9,
+		StorageClassStorageBuffer_ = 12
+	};
+
+	enum SpirvDim_ : std::uint32_t
+	{
+		DimBuffer_ = 5,
+		DimSubpassData_ = 6
+	};
+
+	constexpr std::uint32_t kNone_ = std::numeric_limits<std::uint32_t>::max();
+
+	struct MemberInfo_
+	{
+		std::string name;
+		std::uint32_t offset = kNone_;
+		std::uint32_t matrixStride = 0;
+	};
+
+	// Everything that is known about an id. The meaning of a and b depends
+	// on op:
+	//  - OpTypeInt, OpTypeFloat: a = width
+	//  - OpTypeVector, OpTypeMatrix: a = component/column type, b = count
+	//  - OpTypeArray: a = element type, b = length (constant id)
+	//  - OpTypeRuntimeArray, OpTypeSampledImage: a = element/image type
+	//  - OpTypeImage: a = dim, b = sampled
+	//  - OpTypePointer, OpVariable: a = storage class, b = (pointee) type
+	//  - OpConstant, OpSpecConstant: a = value (low word)
+	struct IdInfo_
+	{
+		std::uint32_t op = 0;
+		std::uint32_t a = 0, b = 0;
+		std::vector<std::uint32_t> members; // OpTypeStruct
+
+		std::string name;
+		std::vector<MemberInfo_> memberInfos;
+
+		bool block = false, bufferBlock = false;
+		std::uint32_t arrayStride = 0;
+		std::uint32_t set = kNone_, binding = kNone_;
+	};
+
+	std::string read_string_( std::uint32_t const* aWords, std::size_t aCount )
+	{
+		std::string ret;
+		for( std::size_t i = 0; i < aCount; ++i )
+		{
+			for( std::uint32_t byte = 0; byte < 4; ++byte )
+			{
+				char const c = char( (aWords[i] >> (8*byte)) & 0xff );
+				if( '\0' == c )
+					return ret;
+
+				ret += c;
+			}
+		}
+
+		return ret;
+	}
+
+	VkShaderStageFlagBits stage_from_model_( std::uint32_t aModel )
+	{
+		switch( aModel )
+		{
+			case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+			case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+			case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+			case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+			case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+			case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		throw labutils::Error( "Unsupported execution model %u", aModel );
+	}
+
+	class Module_
+	{
+		public:
+			Module_( std::uint32_t const* aWords, std::size_t aWordCount )
+			{
+				if( aWordCount < kSpirvHeaderWords_ || kSpirvMagic_ != aWords[0] )
+					throw labutils::Error( "Not a SPIR-V module" );
+
+				// Word 3 is the bound on all ids
+				mIds.resize( aWords[3] );
+
+				for( std::size_t i = kSpirvHeaderWords_; i < aWordCount; )
+				{
+					std::uint32_t const op = aWords[i] & 0xffff;
+					std::uint32_t const count = aWords[i] >> 16;
+					if( 0 == count || i + count > aWordCount )
+						throw labutils::Error( "Truncated SPIR-V instruction at word %zu", i );
+
+					parse_( op, aWords + i + 1, count - 1 );
+					i += count;
+				}
+			}
+
+		public:
+			VkShaderStageFlags stage() const
+			{
+				if( 0 == mStage )
+					throw labutils::Error( "SPIR-V module has no entry point" );
+
+				return mStage;
+			}
+
+			std::vector<std::uint32_t> const& variables() const
+			{
+				return mVariables;
+			}
+
+			IdInfo_ const& id( std::uint32_t aId ) const
+			{
+				if( aId >= mIds.size() )
+					throw labutils::Error( "SPIR-V id %u out of bounds", aId );
+
+				return mIds[aId];
+			}
+
+			labutils::BlockLayout block_layout( std::uint32_t aStruct ) const
+			{
+				auto const& info = id( aStruct );
+				assert( OpTypeStruct_ == info.op );
+
+				labutils::BlockLayout ret;
+				ret.name = info.name;
+
+				for( std::size_t i = 0; i < info.members.size(); ++i )
+				{
+					MemberInfo_ const mi = i < info.memberInfos.size() ? info.memberInfos[i] : MemberInfo_{};
+					if( kNone_ == mi.offset )
+						throw labutils::Error( "Member %zu of block '%s' has no offset", i, info.name.c_str() );
+
+					labutils::BlockMember member;
+					member.name = mi.name;
+					member.offset = mi.offset;
+					member.size = size_of_( info.members[i], mi.matrixStride );
+
+					ret.size = std::max( ret.size, member.offset + member.size );
+					ret.members.emplace_back( std::move(member) );
+				}
+
+				return ret;
+			}
+
+		private:
+			IdInfo_& at_( std::uint32_t aId )
+			{
+				if( aId >= mIds.size() )
+					throw labutils::Error( "SPIR-V id %u out of bounds", aId );
+
+				return mIds[aId];
+			}
+
+			MemberInfo_& member_at_( std::uint32_t aStruct, std::uint32_t aMember )
+			{
+				auto& infos = at_( aStruct ).memberInfos;
+				if( aMember >= infos.size() )
+					infos.resize( aMember + 1 );
+
+				return infos[aMember];
+			}
+
+			void parse_( std::uint32_t aOp, std::uint32_t const* aArgs, std::size_t aCount )
+			{
+				// Operand counts are checked only as far as they are read
+				auto const need = [&] (std::size_t aN) {
+					if( aCount < aN )
+						throw labutils::Error( "SPIR-V instruction %u has too few operands", aOp );
+				};
+
+				switch( aOp )
+				{
+					case OpName_:
+						need( 1 );
+						at_( aArgs[0] ).name = read_string_( aArgs + 1, aCount - 1 );
+						break;
+					case OpMemberName_:
+						need( 2 );
+						member_at_( aArgs[0], aArgs[1] ).name = read_string_( aArgs + 2, aCount - 2 );
+						break;
+
+					case OpEntryPoint_:
+						need( 1 );
+						if( 0 != mStage )
+							throw labutils::Error( "SPIR-V modules with multiple entry points are not supported" );
+						mStage = stage_from_model_( aArgs[0] );
+						break;
+
+					case OpTypeBool_:
+						need( 1 );
+						at_( aArgs[0] ).op = aOp;
+						break;
+					case OpTypeInt_: case OpTypeFloat_:
+					case OpTypeRuntimeArray_: case OpTypeSampledImage_:
+						need( 2 );
+						at_( aArgs[0] ).op = aOp;
+						at_( aArgs[0] ).a = aArgs[1];
+						break;
+					case OpTypeVector_: case OpTypeMatrix_: case OpTypeArray_:
+					case OpTypePointer_:
+						need( 3 );
+						at_( aArgs[0] ).op = aOp;
+						at_( aArgs[0] ).a = aArgs[1];
+						at_( aArgs[0] ).b = aArgs[2];
+						break;
+					case OpTypeImage_:
+						// result, sampled type, dim, depth, arrayed, ms, sampled
+						need( 7 );
+						at_( aArgs[0] ).op = aOp;
+						at_( aArgs[0] ).a = aArgs[2];
+						at_( aArgs[0] ).b = aArgs[6];
+						break;
+					case OpTypeSampler_:
+						need( 1 );
+						at_( aArgs[0] ).op = aOp;
+						break;
+					case OpTypeStruct_:
+						need( 1 );
+						at_( aArgs[0] ).op = aOp;
+						at_( aArgs[0] ).members.assign( aArgs + 1, aArgs + aCount );
+						break;
+
+					case OpConstant_: case OpSpecConstant_:
+						// result type, result, value
+						need( 3 );
+						at_( aArgs[1] ).op = aOp;
+						at_( aArgs[1] ).a = aArgs[2];
+						break;
+
+					case OpVariable_:
+						// result type, result, storage class
+						need( 3 );
+						at_( aArgs[1] ).op = aOp;
+						at_( aArgs[1] ).a = aArgs[2];
+						at_( aArgs[1] ).b = aArgs[0];
+						mVariables.emplace_back( aArgs[1] );
+						break;
+
+					case OpDecorate_:
+						need( 2 );
+						decorate_( at_( aArgs[0] ), aArgs[1], aArgs + 2, aCount - 2 );
+						break;
+					case OpMemberDecorate_:
+						need( 3 );
+						if( DecorationOffset_ == aArgs[2] && aCount > 3 )
+							member_at_( aArgs[0], aArgs[1] ).offset = aArgs[3];
+						else if( DecorationMatrixStride_ == aArgs[2] && aCount > 3 )
+							member_at_( aArgs[0], aArgs[1] ).matrixStride = aArgs[3];
+						break;
+				}
+			}
+
+			void decorate_( IdInfo_& aInfo, std::uint32_t aDecoration, std::uint32_t const* aArgs, std::size_t aCount )
+			{
+				switch( aDecoration )
+				{
+					case DecorationBlock_: aInfo.block = true; break;
+					case DecorationBufferBlock_: aInfo.bufferBlock = true; break;
+					case DecorationArrayStride_: if( aCount > 0 ) aInfo.arrayStride = aArgs[0]; break;
+					case DecorationBinding_: if( aCount > 0 ) aInfo.binding = aArgs[0]; break;
+					case DecorationDescriptorSet_: if( aCount > 0 ) aInfo.set = aArgs[0]; break;
+				}
+			}
+
+			std::uint32_t size_of_( std::uint32_t aType, std::uint32_t aMatrixStride ) const
+			{
+				auto const& info = id( aType );
+				switch( info.op )
+				{
+					case OpTypeBool_:
+						return 4;
+					case OpTypeInt_: case OpTypeFloat_:
+						return info.a / 8;
+					case OpTypeVector_:
+						return info.b * size_of_( info.a, 0 );
+					case OpTypeMatrix_:
+						return info.b * (aMatrixStride ? aMatrixStride : size_of_( info.a, 0 ));
+					case OpTypeArray_:
+					{
+						auto const length = id( info.b ).a;
+						return length * (info.arrayStride ? info.arrayStride : size_of_( info.a, aMatrixStride ));
+					}
+					case OpTypeRuntimeArray_:
+						return 0;
+					case OpTypeStruct_:
+						return block_layout( aType ).size;
+				}
+
+				throw labutils::Error( "Unsupported type (op %u) in block", info.op );
+			}
+
+		private:
+			std::vector<IdInfo_> mIds;
+			std::vector<std::uint32_t> mVariables;
+			VkShaderStageFlags mStage = 0;
+	};
+
+	VkDescriptorType descriptor_type_( Module_ const& aModule, std::uint32_t aStorage, std::uint32_t aType )
+	{
+		auto const& info = aModule.id( aType );
+
+		if( StorageClassStorageBuffer_ == aStorage )
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		if( StorageClassUniform_ == aStorage )
+			return info.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+		assert( StorageClassUniformConstant_ == aStorage );
+		switch( info.op )
+		{
+			case OpTypeSampler_:
+				return VK_DESCRIPTOR_TYPE_SAMPLER;
+			case OpTypeSampledImage_:
+				return DimBuffer_ == aModule.id( info.a ).a ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			case OpTypeImage_:
+				if( DimSubpassData_ == info.a )
+					return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				if( DimBuffer_ == info.a )
+					return 2 == info.b ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				return 2 == info.b ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+
+		throw labutils::Error( "Unsupported descriptor type (op %u)", info.op );
+	}
+
+	bool same_block_( labutils::BlockLayout const& aX, labutils::BlockLayout const& aY )
+	{
+		return aX.size == aY.size
+			&& aX.members.size() == aY.members.size()
+			&& std::equal( aX.members.begin(), aX.members.end(), aY.members.begin(), [] (auto const& aA, auto const& aB) {
+				return aA.offset == aB.offset && aA.size == aB.size;
+			} )
+		;
+	}
+
+	std::uint32_t block_begin_( labutils::BlockLayout const& aBlock )
+	{
+		std::uint32_t ret = aBlock.size;
+		for( auto const& member : aBlock.members )
+			ret = std::min( ret, member.offset );
+		return ret;
+	}
+}
+
+namespace labutils
+{
+	ShaderInterface reflect_spirv( std::uint32_t const* aWords, std::size_t aWordCount )
+	{
+		assert( aWords );
+
+		Module_ const module( aWords, aWordCount );
+
+		ShaderInterface ret;
+		ret.stages = module.stage();
+
+		for( auto const var : module.variables() )
+		{
+			auto const& varInfo = module.id( var );
+			auto const storage = varInfo.a;
+
+			if( StorageClassUniformConstant_ != storage && StorageClassUniform_ != storage
+				&& StorageClassStorageBuffer_ != storage && StorageClassPushConstant_ != storage )
+			{
+				continue;
+			}
+
+			// Variables are pointers to their type
+			std::uint32_t type = module.id( varInfo.b ).b;
+
+			if( StorageClassPushConstant_ == storage )
+			{
+				ReflectedPushConstants push;
+				push.stages = ret.stages;
+				push.block = module.block_layout( type );
+				ret.pushConstants.emplace_back( std::move(push) );
+				continue;
+			}
+
+			ReflectedBinding binding;
+			binding.name = varInfo.name;
+			binding.stages = ret.stages;
+
+			if( kNone_ == varInfo.set || kNone_ == varInfo.binding )
+				throw Error( "Resource '%s' has no descriptor set or binding", varInfo.name.c_str() );
+
+			binding.set = varInfo.set;
+			binding.binding = varInfo.binding;
+
+			// Arrays of resources
+			if( OpTypeRuntimeArray_ == module.id( type ).op )
+				throw Error( "Resource '%s': runtime arrays are not supported", varInfo.name.c_str() );
+
+			if( OpTypeArray_ == module.id( type ).op )
+			{
+				binding.count = module.id( module.id( type ).b ).a;
+				type = module.id( type ).a;
+			}
+
+			binding.type = descriptor_type_( module, storage, type );
+
+			if( OpTypeStruct_ == module.id( type ).op )
+			{
+				binding.block = module.block_layout( type );
+				if( binding.name.empty() )
+					binding.name = binding.block.name;
+			}
+
+			ret.bindings.emplace_back( std::move(binding) );
+		}
+
+		std::sort( ret.bindings.begin(), ret.bindings.end(), [] (ReflectedBinding const& aX, ReflectedBinding const& aY) {
+			return aX.set != aY.set ? aX.set < aY.set : aX.binding < aY.binding;
+		} );
+
+		return ret;
+	}
+
+	ShaderInterface reflect_spirv_file( char const* aSpirvPath )
+	{
+		assert( aSpirvPath );
+
+		std::FILE* fin = std::fopen( aSpirvPath, "rb" );
+		if( !fin )
+			throw Error( "Unable to open '%s' for reading", aSpirvPath );
+
+		std::fseek( fin, 0, SEEK_END );
+		auto const bytes = std::size_t(std::ftell( fin ));
+		std::fseek( fin, 0, SEEK_SET );
+
+		std::vector<std::uint32_t> words( bytes / 4 );
+		auto const read = std::fread( words.data(), sizeof(std::uint32_t), words.size(), fin );
+		std::fclose( fin );
+
+		if( read != words.size() || bytes % 4 != 0 )
+			throw Error( "Error reading '%s'", aSpirvPath );
+
+		try
+		{
+			return reflect_spirv( words.data(), words.size() );
+		}
+		catch( Error const& eErr )
+		{
+			throw Error( "%s: %s", aSpirvPath, eErr.what() );
+		}
+	}
+
+	void merge_interface( ShaderInterface& aInto, ShaderInterface const& aOther )
+	{
+		aInto.stages |= aOther.stages;
+
+		for( auto const& binding : aOther.bindings )
+		{
+			auto const it = std::lower_bound( aInto.bindings.begin(), aInto.bindings.end(), binding, [] (ReflectedBinding const& aX, ReflectedBinding const& aY) {
+				return aX.set != aY.set ? aX.set < aY.set : aX.binding < aY.binding;
+			} );
+
+			if( aInto.bindings.end() == it || it->set != binding.set || it->binding != binding.binding )
+			{
+				aInto.bindings.insert( it, binding );
+				continue;
+			}
+
+			if( it->type != binding.type || it->count != binding.count )
+			{
+				throw Error( "Set %u, binding %u is declared differently ('%s' and '%s')", binding.set, binding.binding, it->name.c_str(), binding.name.c_str() );
+			}
+
+			it->stages |= binding.stages;
+		}
+
+		for( auto const& push : aOther.pushConstants )
+		{
+			auto const it = std::find_if( aInto.pushConstants.begin(), aInto.pushConstants.end(), [&push] (ReflectedPushConstants const& aX) {
+				return same_block_( aX.block, push.block );
+			} );
+
+			if( aInto.pushConstants.end() == it )
+				aInto.pushConstants.emplace_back( push );
+			else
+				it->stages |= push.stages;
+		}
+	}
+
+	ShaderInterface reflect_shaders( std::initializer_list<char const*> aSpirvPaths )
+	{
+		ShaderInterface ret;
+		for( auto const path : aSpirvPaths )
+			merge_interface( ret, reflect_spirv_file( path ) );
+
+		return ret;
+	}
+
+	ReflectedBinding const* find_binding( ShaderInterface const& aInterface, std::uint32_t aSet, std::uint32_t aBinding )
+	{
+		for( auto const& binding : aInterface.bindings )
+		{
+			if( aSet == binding.set && aBinding == binding.binding )
+				return &binding;
+		}
+
+		return nullptr;
+	}
+
+	std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings( ShaderInterface const& aInterface, std::uint32_t aSet )
+	{
+		std::vector<VkDescriptorSetLayoutBinding> ret;
+		for( auto const& binding : aInterface.bindings )
+		{
+			if( aSet != binding.set )
+				continue;
+
+			VkDescriptorSetLayoutBinding desc{};
+			desc.binding = binding.binding;
+			desc.descriptorType = binding.type;
+			desc.descriptorCount = binding.count;
+			desc.stageFlags = binding.stages;
+			ret.emplace_back( desc );
+		}
+
+		return ret;
+	}
+
+	std::vector<VkPushConstantRange> push_constant_ranges( ShaderInterface const& aInterface )
+	{
+		// A stage may only appear in one range, so each stage gets the
+		// union of its blocks. Stages with the same union share a range.
+		std::vector<VkPushConstantRange> ret;
+		for( std::uint32_t bit = 0; bit < 32; ++bit )
+		{
+			auto const stage = VkShaderStageFlags(1u << bit);
+
+			std::uint32_t begin = std::numeric_limits<std::uint32_t>::max(), end = 0;
+			for( auto const& push : aInterface.pushConstants )
+			{
+				if( !(push.stages & stage) )
+					continue;
+
+				begin = std::min( begin, block_begin_( push.block ) );
+				end = std::max( end, push.block.size );
+			}
+
+			if( end <= begin )
+				continue;
+
+			auto const it = std::find_if( ret.begin(), ret.end(), [begin, end] (VkPushConstantRange const& aRange) {
+				return begin == aRange.offset && end - begin == aRange.size;
+			} );
+
+			if( ret.end() != it )
+				it->stageFlags |= stage;
+			else
+				ret.emplace_back( VkPushConstantRange{ stage, begin, end - begin } );
+		}
+
+		return ret;
+	}
+
+	void check_block_layout( BlockLayout const& aBlock, char const* aCppName, std::size_t aCppSize, std::initializer_list<std::size_t> aCppOffsets )
+	{
+		assert( aCppName );
+
+		if( aBlock.members.size() > aCppOffsets.size() )
+		{
+			throw Error( "%s has %zu members, but the shader's block '%s' has %zu", aCppName, aCppOffsets.size(), aBlock.name.c_str(), aBlock.members.size() );
+		}
+
+		auto cppOffset = aCppOffsets.begin();
+		for( std::size_t i = 0; i < aBlock.members.size(); ++i, ++cppOffset )
+		{
+			auto const& member = aBlock.members[i];
+			if( member.offset != *cppOffset )
+			{
+				throw Error( "%s: member %zu ('%s') is at offset %zu, but at offset %u in the shader's block '%s'", aCppName, i, member.name.c_str(), *cppOffset, member.offset, aBlock.name.c_str() );
+			}
+		}
+
+		if( aBlock.size > aCppSize )
+		{
+			throw Error( "%s is %zu bytes, but the shader's block '%s' is %u bytes", aCppName, aCppSize, aBlock.name.c_str(), aBlock.size );
+		}
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,69 @@
+#include "thread_pool.hpp"
+
+#include <cassert>
+
+namespace labutils
+{
+	ThreadPool::ThreadPool( std::size_t aThreadCount )
+	{
+		assert( aThreadCount > 0 );
+
+		mThreads.reserve( aThreadCount );
+		for( std::size_t i = 0; i < aThreadCount; ++i )
+		{
+			mThreads.emplace_back( [this] { worker_loop_(); } );
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mStopping = true;
+		}
+
+		mWakeUp.notify_all();
+
+		// Workers drain the remaining jobs before returning, so any futures
+		// that are still held elsewhere will become ready.
+		for( auto& thread : mThreads )
+			thread.join();
+	}
+
+	std::size_t ThreadPool::thread_count() const noexcept
+	{
+		return mThreads.size();
+	}
+
+	std::size_t ThreadPool::default_thread_count() noexcept
+	{
+		auto const count = std::thread::hardware_concurrency();
+		return count ? count : 1;
+	}
+
+	void ThreadPool::worker_loop_()
+	{
+		for( ;; )
+		{
+			std::function<void()> job;
+
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mWakeUp.wait( lock, [this] { return mStopping || !mJobs.empty(); } );
+
+				if( mJobs.empty() )
+				{
+					assert( mStopping );
+					return;
+				}
+
+				job = std::move( mJobs.front() );
+				mJobs.pop_front();
+			}
+
+			job();
+		}
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+#include <cstddef>
+
+namespace labutils
+{
+	// A simple fixed-size pool of worker threads that execute jobs from a
+	// shared FIFO queue. Jobs are submitted with submit(), which returns a
+	// std::future<> for the job's result. Exceptions thrown by a job are
+	// captured and rethrown by the corresponding std::future<>::get().
+	//
+	// The pool is intended for coarse-grained work (e.g., compiling a
+	// pipeline). The per-job overhead is a mutex lock and a heap allocation,
+	// which is negligible at that scale, but not suitable for very
+	// fine-grained tasks.
+	class ThreadPool final
+	{
+		public:
+			explicit ThreadPool( std::size_t aThreadCount = default_thread_count() );
+			~ThreadPool();
+
+			ThreadPool( ThreadPool const& ) = delete;
+			ThreadPool& operator= (ThreadPool const&) = delete;
+
+			// Not movable either: the worker threads refer to `this`.
+			ThreadPool( ThreadPool&& ) = delete;
+			ThreadPool& operator= (ThreadPool&&) = delete;
+
+		public:
+			template< typename tFunc >
+			auto submit( tFunc&& aFunc ) -> std::future<std::invoke_result_t<std::decay_t<tFunc>>>;
+
+			std::size_t thread_count() const noexcept;
+
+			// std::thread::hardware_concurrency(), but at least one.
+			static std::size_t default_thread_count() noexcept;
+
+		private:
+			void worker_loop_();
+
+			std::vector<std::thread> mThreads;
+
+			std::mutex mMutex;
+			std::condition_variable mWakeUp;
+			std::deque<std::function<void()>> mJobs;
+			bool mStopping = false;
+	};
+}
+
+#include "thread_pool.inl"
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
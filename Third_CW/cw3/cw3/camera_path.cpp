@@ -0,0 +1,187 @@
+#include "camera_path.hpp"
+
+#include <utility>
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Index of the last key with time <= aTime, or 0
+	template< typename tKey >
+	std::size_t find_key_(std::vector<tKey> const& aKeys, float aTime)
+	{
+		auto const it = std::upper_bound(aKeys.begin(), aKeys.end(), aTime, [] (float aT, tKey const& aKey) {
+			return aT < aKey.time;
+		});
+
+		return it == aKeys.begin() ? 0 : std::size_t(it - aKeys.begin()) - 1;
+	}
+
+	template< typename tKey >
+	float key_blend_(std::vector<tKey> const& aKeys, std::size_t aIndex, float aTime)
+	{
+		if (aIndex + 1 >= aKeys.size())
+			return 0.f;
+
+		float const t0 = aKeys[aIndex].time;
+		float const t1 = aKeys[aIndex + 1].time;
+		if (t1 <= t0)
+			return 0.f;
+
+		return std::clamp((aTime - t0) / (t1 - t0), 0.f, 1.f);
+	}
+}
+
+CameraPath load_camera_path(char const* aPath)
+{
+	assert(aPath);
+
+	std::FILE* file = std::fopen(aPath, "r");
+	if (!file)
+		throw lut::Error("Unable to open camera path '%s'", aPath);
+
+	CameraPath ret;
+	bool explicitFrames = false;
+
+	char line[512];
+	for (unsigned lineNumber = 1; std::fgets(line, sizeof(line), file); ++lineNumber)
+	{
+		char kind[16] = {};
+		if (std::sscanf(line, "%15s", kind) != 1 || '#' == kind[0])
+			continue;
+
+		bool ok = false;
+		if (0 == std::strcmp(kind, "timestep"))
+		{
+			ok = std::sscanf(line, "%*s %f", &ret.timestep) == 1 && ret.timestep > 0.f;
+		}
+		else if (0 == std::strcmp(kind, "frames"))
+		{
+			unsigned long long frames = 0;
+			ok = std::sscanf(line, "%*s %llu", &frames) == 1 && frames > 0;
+			ret.frameCount = frames;
+			explicitFrames = true;
+		}
+		else if (0 == std::strcmp(kind, "camera"))
+		{
+			CameraKey key{};
+			float yawDeg = 0.f, pitchDeg = 0.f;
+			ok = std::sscanf(line, "%*s %f %f %f %f %f %f", &key.time, &key.pose.position.x, &key.pose.position.y, &key.pose.position.z, &yawDeg, &pitchDeg) == 6;
+			ok = ok && (ret.cameraKeys.empty() || key.time >= ret.cameraKeys.back().time);
+
+			key.pose.yaw = glm::radians(yawDeg);
+			key.pose.pitch = glm::radians(pitchDeg);
+			ret.cameraKeys.emplace_back(key);
+		}
+		else if (0 == std::strcmp(kind, "light"))
+		{
+			LightKey key{};
+			ok = std::sscanf(line, "%*s %f %f", &key.time, &key.angle) == 2;
+			ok = ok && (ret.lightKeys.empty() || key.time >= ret.lightKeys.back().time);
+
+			ret.lightKeys.emplace_back(key);
+		}
+
+		if (!ok)
+		{
+			std::fclose(file);
+			throw lut::Error("%s:%u: invalid camera path entry '%s'", aPath, lineNumber, kind);
+		}
+	}
+
+	std::fclose(file);
+
+	if (ret.cameraKeys.empty())
+		throw lut::Error("%s: camera path has no camera keys", aPath);
+
+	if (!explicitFrames)
+	{
+		float const lastTime = std::max(ret.cameraKeys.back().time, ret.lightKeys.empty() ? 0.f : ret.lightKeys.back().time);
+		ret.frameCount = std::uint64_t(std::floor(lastTime / ret.timestep)) + 1;
+	}
+
+	return ret;
+}
+
+CameraPose sample_camera_pose(CameraPath const& aPath, float aTime)
+{
+	assert(!aPath.cameraKeys.empty());
+
+	auto const i = find_key_(aPath.cameraKeys, aTime);
+	float const blend = key_blend_(aPath.cameraKeys, i, aTime);
+	if (0.f == blend)
+		return aPath.cameraKeys[i].pose;
+
+	auto const& a = aPath.cameraKeys[i].pose;
+	auto const& b = aPath.cameraKeys[i + 1].pose;
+
+	CameraPose ret;
+	ret.position = glm::mix(a.position, b.position, blend);
+	ret.yaw = glm::mix(a.yaw, b.yaw, blend);
+	ret.pitch = glm::mix(a.pitch, b.pitch, blend);
+	return ret;
+}
+
+float sample_light_angle(CameraPath const& aPath, float aTime)
+{
+	if (aPath.lightKeys.empty())
+		return 0.f;
+
+	auto const i = find_key_(aPath.lightKeys, aTime);
+	float const blend = key_blend_(aPath.lightKeys, i, aTime);
+	if (0.f == blend)
+		return aPath.lightKeys[i].angle;
+
+	return glm::mix(aPath.lightKeys[i].angle, aPath.lightKeys[i + 1].angle, blend);
+}
+
+
+CameraPathRecorder::CameraPathRecorder(char const* aPath)
+	: mFile(std::fopen(aPath, "w"))
+	, mPath(aPath)
+{
+	if (!mFile)
+		throw lut::Error("Unable to open '%s' for writing", aPath);
+
+	std::fprintf(mFile, "# Recorded camera path (see camera_path.hpp)\n");
+}
+
+CameraPathRecorder::~CameraPathRecorder()
+{
+	if (mFile)
+		std::fclose(mFile);
+}
+
+CameraPathRecorder::CameraPathRecorder(CameraPathRecorder&& aOther) noexcept
+	: mFile(std::exchange(aOther.mFile, nullptr))
+	, mPath(std::move(aOther.mPath))
+{}
+
+CameraPathRecorder& CameraPathRecorder::operator=(CameraPathRecorder&& aOther) noexcept
+{
+	std::swap(mFile, aOther.mFile);
+	std::swap(mPath, aOther.mPath);
+	return *this;
+}
+
+CameraPathRecorder::operator bool() const noexcept
+{
+	return nullptr != mFile;
+}
+
+void CameraPathRecorder::record(float aTime, CameraPose const& aPose, float aLightAngle)
+{
+	assert(mFile);
+
+	std::fprintf(mFile, "camera %.6f %.6f %.6f %.6f %.4f %.4f\n", aTime, aPose.position.x, aPose.position.y, aPose.position.z, glm::degrees(aPose.yaw), glm::degrees(aPose.pitch));
+	std::fprintf(mFile, "light %.6f %.4f\n", aTime, aLightAngle);
+
+	if (std::ferror(mFile))
+		throw lut::Error("Error while writing '%s'", mPath.c_str());
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+/* Camera paths drive the camera and the light animation from a file instead
+ * of from user input, such that benchmark runs are reproducible (see the
+ * --replay option). A path is a text file with one entry per line:
+ *
+ *   timestep <seconds>                    virtual time step (default 1/60)
+ *   frames <count>                        number of frames to render
+ *   camera <t> <x> <y> <z> <yaw> <pitch>  camera key (angles in degrees)
+ *   light <t> <angle>                     light rotation key (degrees)
+ *
+ * Empty lines and lines starting with '#' are ignored. Keys must be sorted
+ * by time. Between keys, values are interpolated linearly; before the first
+ * and after the last key, the nearest key is used. If "frames" is missing,
+ * the path runs until the last key.
+ *
+ * Paths can be scripted by hand or recorded from an interactive session
+ * with CameraPathRecorder (--record-path).
+ */
+struct CameraPose
+{
+	glm::vec3 position;
+	float yaw;   // radians
+	float pitch; // radians
+};
+
+struct CameraKey
+{
+	float time;
+	CameraPose pose;
+};
+
+struct LightKey
+{
+	float time;
+	float angle; // degrees
+};
+
+struct CameraPath
+{
+	float timestep = 1.f / 60.f;
+	std::uint64_t frameCount = 0;
+
+	std::vector<CameraKey> cameraKeys;
+	std::vector<LightKey> lightKeys;
+};
+
+CameraPath load_camera_path(char const* aPath);
+
+// Requires at least one camera key.
+CameraPose sample_camera_pose(CameraPath const&, float aTime);
+
+// Returns zero if the path has no light keys.
+float sample_light_angle(CameraPath const&, float aTime);
+
+
+// Writes one camera and one light key per call to record().
+class CameraPathRecorder
+{
+public:
+	CameraPathRecorder() noexcept = default;
+	explicit CameraPathRecorder(char const* aPath);
+	~CameraPathRecorder();
+
+	CameraPathRecorder(CameraPathRecorder const&) = delete;
+	CameraPathRecorder& operator=(CameraPathRecorder const&) = delete;
+
+	CameraPathRecorder(CameraPathRecorder&&) noexcept;
+	CameraPathRecorder& operator=(CameraPathRecorder&&) noexcept;
+
+	explicit operator bool() const noexcept;
+
+	void record(float aTime, CameraPose const&, float aLightAngle);
+
+private:
+	std::FILE* mFile = nullptr;
+	std::string mPath;
+};
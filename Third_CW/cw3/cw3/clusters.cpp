@@ -0,0 +1,314 @@
+#include "clusters.hpp"
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+	std::uint32_t cluster_slice_(float aDepth, float aNear, float aFar)
+	{
+		if (aDepth <= aNear)
+			return 0;
+
+		float const slice = std::floor(std::log(aDepth / aNear) * (float(kClusterGridZ) / std::log(aFar / aNear)));
+		return std::uint32_t(std::clamp(slice, 0.f, float(kClusterGridZ - 1)));
+	}
+
+	std::uint32_t cluster_tile_(float aNdc, std::uint32_t aTiles)
+	{
+		float const tile = std::floor((aNdc * 0.5f + 0.5f) * float(aTiles));
+		return std::uint32_t(std::clamp(tile, 0.f, float(aTiles - 1)));
+	}
+
+	// Distance from aX to the interval [aMin, aMax]
+	float axis_distance_(float aX, float aMin, float aMax)
+	{
+		return std::max(std::max(aMin - aX, 0.f), aX - aMax);
+	}
+
+	// Squared distance from the centre of aSphere to aBounds.
+	//
+	// assign_lights() rejects clusters early on a partial sum of the same
+	// terms. Float addition of non-negative terms is monotonic, so the
+	// partial sums never exceed the full one, and no cluster that passes
+	// this test is rejected early.
+	float distance_sq_(glm::vec4 const& aSphere, ClusterBounds const& aBounds)
+	{
+		float const dx = axis_distance_(aSphere.x, aBounds.min.x, aBounds.max.x);
+		float const dy = axis_distance_(aSphere.y, aBounds.min.y, aBounds.max.y);
+		float const dz = axis_distance_(aSphere.z, aBounds.min.z, aBounds.max.z);
+		return dx*dx + dy*dy + dz*dz;
+	}
+
+	// View-space centres and radii (in w) of the lights
+	std::vector<glm::vec4> view_spheres_(glm::mat4 const& aView, std::vector<PointLight> const& aLights)
+	{
+		std::vector<glm::vec4> spheres(aLights.size());
+		for (std::size_t i = 0; i < aLights.size(); ++i)
+		{
+			glm::vec4 const centre = aView * glm::vec4(glm::vec3(aLights[i].positionRadius), 1.f);
+			spheres[i] = glm::vec4(glm::vec3(centre), aLights[i].positionRadius.w);
+		}
+
+		return spheres;
+	}
+
+	void append_light_(LightClusters& aClusters, std::uint32_t aCluster, std::uint32_t aLight)
+	{
+		auto* const cluster = aClusters.data.data() + std::size_t(aCluster) * kClusterStride;
+		if (cluster[0] < kMaxLightsPerCluster)
+			cluster[1 + cluster[0]++] = aLight;
+		else
+			++aClusters.overflows;
+	}
+
+	glm::mat4 make_projection_(float aFovY, float aAspect, float aNear, float aFar)
+	{
+		// Same as update_scene_uniforms()
+		glm::mat4 projection = glm::perspectiveRH_ZO(aFovY, aAspect, aNear, aFar);
+		projection[1][1] *= -1.f;
+		return projection;
+	}
+}
+
+float cluster_slice_depth(std::uint32_t aSlice, float aNear, float aFar)
+{
+	return aNear * std::pow(aFar / aNear, float(aSlice) / float(kClusterGridZ));
+}
+
+std::uint32_t find_cluster(glm::vec3 const& aViewPos, glm::mat4 const& aProjection, float aNear, float aFar)
+{
+	glm::vec4 const clip = aProjection * glm::vec4(aViewPos, 1.f);
+	glm::vec2 const ndc = glm::vec2(clip) / std::max(clip.w, 1e-6f);
+
+	return cluster_index(
+		cluster_tile_(ndc.x, kClusterGridX),
+		cluster_tile_(ndc.y, kClusterGridY),
+		cluster_slice_(-aViewPos.z, aNear, aFar)
+	);
+}
+
+std::vector<ClusterBounds> compute_cluster_bounds(glm::mat4 const& aProjection, float aNear, float aFar)
+{
+	// A view-space point at distance d with NDC coordinates (x, y) is at
+	// (x * d * sx, y * d * sy, -d). The extremes of a cluster are thus at
+	// the corners of its tile, on its near or far depth.
+	float const sx = 1.f / aProjection[0][0];
+	float const sy = 1.f / aProjection[1][1];
+
+	auto const extent_ = [] (float aNdc0, float aNdc1, float aScale, float aD0, float aD1) {
+		float const a0 = aNdc0 * aScale * aD0, a1 = aNdc0 * aScale * aD1;
+		float const b0 = aNdc1 * aScale * aD0, b1 = aNdc1 * aScale * aD1;
+		return glm::vec2(std::min({ a0, a1, b0, b1 }), std::max({ a0, a1, b0, b1 }));
+	};
+
+	std::vector<ClusterBounds> bounds(kClusterCount);
+	for (std::uint32_t z = 0; z < kClusterGridZ; ++z)
+	{
+		float const d0 = cluster_slice_depth(z, aNear, aFar);
+		float const d1 = cluster_slice_depth(z + 1, aNear, aFar);
+
+		for (std::uint32_t y = 0; y < kClusterGridY; ++y)
+		{
+			auto const ey = extent_(2.f * y / kClusterGridY - 1.f, 2.f * (y + 1) / kClusterGridY - 1.f, sy, d0, d1);
+
+			for (std::uint32_t x = 0; x < kClusterGridX; ++x)
+			{
+				auto const ex = extent_(2.f * x / kClusterGridX - 1.f, 2.f * (x + 1) / kClusterGridX - 1.f, sx, d0, d1);
+
+				auto& b = bounds[cluster_index(x, y, z)];
+				b.min = glm::vec3(ex.x, ey.x, -d1);
+				b.max = glm::vec3(ex.y, ey.y, -d0);
+			}
+		}
+	}
+
+	return bounds;
+}
+
+LightClusters assign_lights_brute_force(std::vector<ClusterBounds> const& aBounds, glm::mat4 const& aView, std::vector<PointLight> const& aLights)
+{
+	assert(kClusterCount == aBounds.size());
+
+	auto const spheres = view_spheres_(aView, aLights);
+
+	LightClusters ret;
+	ret.data.assign(std::size_t(kClusterCount) * kClusterStride, 0);
+
+	for (std::uint32_t c = 0; c < kClusterCount; ++c)
+	{
+		for (std::uint32_t i = 0; i < spheres.size(); ++i)
+		{
+			if (distance_sq_(spheres[i], aBounds[c]) <= spheres[i].w * spheres[i].w)
+				append_light_(ret, c, i);
+		}
+	}
+
+	return ret;
+}
+
+LightClusters assign_lights(std::vector<ClusterBounds> const& aBounds, glm::mat4 const& aView, std::vector<PointLight> const& aLights)
+{
+	assert(kClusterCount == aBounds.size());
+
+	auto const spheres = view_spheres_(aView, aLights);
+
+	LightClusters ret;
+	ret.data.assign(std::size_t(kClusterCount) * kClusterStride, 0);
+
+	// The x extent of a cluster only depends on its column and slice, and
+	// the z extent only on its slice (see compute_cluster_bounds()). The
+	// bounds of row 0 thus stand in for the whole column. Visiting lights
+	// in order keeps each cluster's list in ascending order.
+	for (std::uint32_t i = 0; i < spheres.size(); ++i)
+	{
+		auto const& s = spheres[i];
+		float const r2 = s.w * s.w;
+
+		for (std::uint32_t z = 0; z < kClusterGridZ; ++z)
+		{
+			auto const& slice = aBounds[cluster_index(0, 0, z)];
+			float const dz = axis_distance_(s.z, slice.min.z, slice.max.z);
+			if (dz*dz > r2)
+				continue;
+
+			for (std::uint32_t x = 0; x < kClusterGridX; ++x)
+			{
+				auto const& column = aBounds[cluster_index(x, 0, z)];
+				float const dx = axis_distance_(s.x, column.min.x, column.max.x);
+				if (dx*dx + dz*dz > r2)
+					continue;
+
+				for (std::uint32_t y = 0; y < kClusterGridY; ++y)
+				{
+					auto const c = cluster_index(x, y, z);
+					if (distance_sq_(s, aBounds[c]) <= r2)
+						append_light_(ret, c, i);
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+
+bool check_light_clusters(float aFovY, float aNear, float aFar, glm::vec3 const& aSceneMin, glm::vec3 const& aSceneMax)
+{
+	using Clock_ = std::chrono::steady_clock;
+
+	struct View
+	{
+		char const* name;
+		glm::vec3 eye;
+		glm::vec3 target;
+		float aspect;
+	};
+
+	glm::vec3 const centre = 0.5f * (aSceneMin + aSceneMax);
+	glm::vec3 const extent = aSceneMax - aSceneMin;
+
+	View const views[] = {
+		{ "front", centre - glm::vec3(0.f, 0.f, 1.5f * extent.z), centre, 16.f / 9.f },
+		{ "inside", centre, centre + glm::vec3(1.f, 0.f, 0.2f), 16.f / 9.f },
+		{ "above", centre + glm::vec3(0.f, extent.y, 0.f), centre + glm::vec3(0.1f, 0.f, 0.f), 1.f },
+		{ "corner", aSceneMax + 0.25f * extent, centre, 4.f / 3.f }
+	};
+
+	std::uint32_t const lightCounts[] = { 1, 100, 1000, 10000 };
+
+	// Points per case for the coverage check. Each point is checked
+	// against every light.
+	constexpr std::uint32_t kPoints = 2000;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	bool ok = true;
+	for (auto const count : lightCounts)
+	{
+		auto const animated = make_stress_lights(count, aSceneMin, aSceneMax);
+
+		std::vector<PointLight> lights(count);
+		animate_lights(animated, 1.f, lights.data());
+
+		for (auto const& view : views)
+		{
+			glm::mat4 const viewMatrix = glm::lookAt(view.eye, view.target, glm::vec3(0.f, 1.f, 0.f));
+			glm::mat4 const projection = make_projection_(aFovY, view.aspect, aNear, aFar);
+			auto const bounds = compute_cluster_bounds(projection, aNear, aFar);
+
+			auto const bruteStart = Clock_::now();
+			auto const reference = assign_lights_brute_force(bounds, viewMatrix, lights);
+			auto const bruteMs = std::chrono::duration<float, std::milli>(Clock_::now() - bruteStart).count();
+
+			auto const start = Clock_::now();
+			auto const clusters = assign_lights(bounds, viewMatrix, lights);
+			auto const ms = std::chrono::duration<float, std::milli>(Clock_::now() - start).count();
+
+			bool const same = reference.data == clusters.data && reference.overflows == clusters.overflows;
+
+			// Coverage: a point within a light's radius (with a little
+			// margin for rounding) must find the light in its cluster,
+			// unless that cluster is full.
+			std::uint32_t points = 0, missing = 0;
+			for (std::uint32_t p = 0; p < kPoints; ++p)
+			{
+				auto const& light = lights[rng() % count];
+				glm::vec3 const dir = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.f - 1.f;
+				if (glm::dot(dir, dir) > 1.f || glm::dot(dir, dir) < 1e-6f)
+					continue;
+
+				glm::vec3 const pos = glm::vec3(light.positionRadius) + dir * light.positionRadius.w;
+				glm::vec3 const viewPos = glm::vec3(viewMatrix * glm::vec4(pos, 1.f));
+
+				glm::vec4 const clip = projection * glm::vec4(viewPos, 1.f);
+				if (-viewPos.z < aNear || -viewPos.z > aFar || std::abs(clip.x) > clip.w || std::abs(clip.y) > clip.w)
+					continue;
+
+				auto const* cluster = clusters.data.data() + std::size_t(find_cluster(viewPos, projection, aNear, aFar)) * kClusterStride;
+				if (cluster[0] == kMaxLightsPerCluster)
+					continue;
+
+				++points;
+				for (std::uint32_t i = 0; i < count; ++i)
+				{
+					float const radius = 0.999f * lights[i].positionRadius.w;
+					glm::vec3 const d = pos - glm::vec3(lights[i].positionRadius);
+					if (glm::dot(d, d) >= radius * radius)
+						continue;
+
+					if (!std::binary_search(cluster + 1, cluster + 1 + cluster[0], i))
+						++missing;
+				}
+			}
+
+			std::uint32_t maxLights = 0;
+			std::uint64_t totalLights = 0;
+			for (std::uint32_t c = 0; c < kClusterCount; ++c)
+			{
+				maxLights = std::max(maxLights, clusters.data[std::size_t(c) * kClusterStride]);
+				totalLights += clusters.data[std::size_t(c) * kClusterStride];
+			}
+
+			std::printf("%5u lights, %-6s: %6.2f lights/cluster (max %3u, %u dropped), brute force %8.2f ms, light-centric %6.2f ms, %4u points: %s\n",
+				count, view.name,
+				double(totalLights) / kClusterCount, maxLights, clusters.overflows,
+				bruteMs, ms,
+				points,
+				!same ? "MISMATCH" : missing ? "MISSING LIGHTS" : "ok"
+			);
+
+			ok = ok && same && 0 == missing;
+		}
+	}
+
+	std::printf("Cluster check %s\n", ok ? "passed" : "FAILED");
+	return ok;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "point_lights.hpp"
+
+/* Clustered light culling. The view frustum between the near and the far
+ * plane is divided into a grid of froxels ("clusters"): kClusterGridX by
+ * kClusterGridY screen-space tiles, each split into kClusterGridZ depth
+ * slices. The slices grow exponentially with the distance from the camera,
+ * such that clusters are roughly cube-shaped.
+ *
+ * Each frame, a compute pass (shaders/cluster_lights.comp) finds the lights
+ * whose sphere of influence touches a cluster's view-space bounding box.
+ * The lighting pass then only evaluates the lights of the pixel's cluster.
+ *
+ * The cluster buffer has kClusterStride uints per cluster: the number of
+ * lights, followed by up to kMaxLightsPerCluster light indices in
+ * ascending order. Lights past that limit are dropped.
+ *
+ * The constants and the cluster math must match shaders/clusters.glsl. The
+ * functions below are a CPU reference of the compute pass;
+ * check_light_clusters() (--check-clusters) tests it against brute force.
+ */
+constexpr std::uint32_t kClusterGridX = 16;
+constexpr std::uint32_t kClusterGridY = 9;
+constexpr std::uint32_t kClusterGridZ = 24;
+constexpr std::uint32_t kClusterCount = kClusterGridX * kClusterGridY * kClusterGridZ;
+
+constexpr std::uint32_t kMaxLightsPerCluster = 255;
+constexpr std::uint32_t kClusterStride = kMaxLightsPerCluster + 1;
+
+// Workgroup size of the compute pass (CLUSTER_GROUP_SIZE)
+constexpr std::uint32_t kClusterGroupSize = 64;
+
+// View-space bounding box of a cluster
+struct ClusterBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Cluster index of tile (aX, aY) and slice aZ
+inline std::uint32_t cluster_index(std::uint32_t aX, std::uint32_t aY, std::uint32_t aZ)
+{
+	return aX + kClusterGridX * (aY + kClusterGridY * aZ);
+}
+
+// Distance from the camera (along -z in view space) where slice aSlice
+// starts. Slice kClusterGridZ starts at the far plane.
+float cluster_slice_depth(std::uint32_t aSlice, float aNear, float aFar);
+
+// Index of the cluster that contains the view-space position aViewPos.
+// Positions outside of the frustum are clamped to the nearest cluster.
+std::uint32_t find_cluster(glm::vec3 const& aViewPos, glm::mat4 const& aProjection, float aNear, float aFar);
+
+// Bounding boxes of all clusters, by cluster index. aProjection must be a
+// symmetric perspective projection (as in update_scene_uniforms()).
+std::vector<ClusterBounds> compute_cluster_bounds(glm::mat4 const& aProjection, float aNear, float aFar);
+
+
+// Contents of the cluster buffer (see above)
+struct LightClusters
+{
+	std::vector<std::uint32_t> data;
+
+	// Number of light/cluster pairs that were dropped because the cluster
+	// was full
+	std::uint32_t overflows = 0;
+};
+
+// Test every light against every cluster. This is what the compute pass
+// does, with one invocation per cluster.
+LightClusters assign_lights_brute_force(std::vector<ClusterBounds> const&, glm::mat4 const& aView, std::vector<PointLight> const&);
+
+// Light-centric assignment: each light narrows the search down to the depth
+// slices, then the tile columns, that its sphere reaches, and only tests
+// the clusters in those. Gives the same result as brute force.
+LightClusters assign_lights(std::vector<ClusterBounds> const&, glm::mat4 const& aView, std::vector<PointLight> const&);
+
+// Compare assign_lights() against brute force for a number of light counts
+// and views of a stress scene in the box [aSceneMin, aSceneMax]. Also check
+// that the cluster of any point in the frustum lists every light that
+// reaches the point. Prints the results to stdout and returns false if any
+// check failed.
+bool check_light_clusters(float aFovY, float aNear, float aFar, glm::vec3 const& aSceneMin, glm::vec3 const& aSceneMax);
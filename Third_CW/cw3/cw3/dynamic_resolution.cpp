@@ -0,0 +1,100 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+namespace
+{
+	// Weight of a new sample in the moving average
+	constexpr float kAverageWeight = 0.1f;
+
+	// Samples at the current scale before the scale may change again
+	constexpr std::uint32_t kMinSamples = 16;
+
+	// Band around the target in which the scale is left alone
+	constexpr float kDecreaseAbove = 1.0f;
+	constexpr float kIncreaseBelow = 0.85f;
+
+	float quantize_(float aScale)
+	{
+		// The small bias keeps exact steps from rounding down
+		return std::floor(aScale / kRenderScaleStep + 1e-3f) * kRenderScaleStep;
+	}
+}
+
+ResolutionController::ResolutionController(float aTargetMs, float aMinScale, float aMaxScale)
+	: mTargetMs(aTargetMs)
+	, mMinScale(aMinScale)
+	, mMaxScale(aMaxScale)
+	, mScale(aMaxScale)
+	, mMinScaleSeen(aMaxScale)
+{
+	assert(aTargetMs > 0.f);
+	assert(0.f < aMinScale && aMinScale <= aMaxScale && aMaxScale <= 1.f);
+}
+
+bool ResolutionController::update(std::uint64_t aFrame, float aGpuMs)
+{
+	if (aGpuMs < 0.f || aFrame < mFirstFrame || (mHaveFrame && aFrame == mLastFrame))
+		return false;
+
+	mLastFrame = aFrame;
+	mHaveFrame = true;
+
+	mAverageMs = 0 == mSamples ? aGpuMs : mAverageMs + kAverageWeight * (aGpuMs - mAverageMs);
+	if (++mSamples < kMinSamples)
+		return false;
+
+	bool const overBudget = mAverageMs > kDecreaseAbove * mTargetMs;
+	bool const headroom = mAverageMs < kIncreaseBelow * mTargetMs;
+	if (!overBudget && !headroom)
+		return false;
+
+	float const wanted = mScale * std::sqrt(mTargetMs / std::max(mAverageMs, 1e-3f));
+	float const scale = std::clamp(quantize_(wanted), mMinScale, mMaxScale);
+	if (scale == mScale)
+		return false;
+
+	mScale = scale;
+	mMinScaleSeen = std::min(mMinScaleSeen, scale);
+	++mChanges;
+
+	mSamples = 0;
+	return true;
+}
+
+void ResolutionController::set_first_frame(std::uint64_t aFrame) noexcept
+{
+	mFirstFrame = aFrame;
+}
+
+float ResolutionController::scale() const noexcept
+{
+	return mScale;
+}
+
+float ResolutionController::target_ms() const noexcept
+{
+	return mTargetMs;
+}
+
+float ResolutionController::min_scale_seen() const noexcept
+{
+	return mMinScaleSeen;
+}
+
+std::uint32_t ResolutionController::change_count() const noexcept
+{
+	return mChanges;
+}
+
+VkExtent2D scaled_extent(VkExtent2D const& aExtent, float aScale)
+{
+	auto const scale_ = [aScale] (std::uint32_t aSize) {
+		return std::max(1u, std::uint32_t(float(aSize) * aScale + 0.5f));
+	};
+
+	return VkExtent2D{ scale_(aExtent.width), scale_(aExtent.height) };
+}
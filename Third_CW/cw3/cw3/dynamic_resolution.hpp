@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+/* Dynamic resolution (--dynamic-resolution). The G-buffer and the lighting
+ * are rendered to the top-left part of full-size images, which is then
+ * scaled up to the target image. Changing the scale thus only changes the
+ * viewport, and never reallocates the images.
+ *
+ * ResolutionController picks the scale from the measured GPU frame times.
+ * The GPU cost of a deferred renderer is roughly proportional to the number
+ * of pixels, i.e., to the square of the scale, so the controller scales by
+ * the square root of the ratio between the target and the measured time.
+ * To keep it from oscillating (and from re-recording the command buffers
+ * every frame), the scale is quantized to kRenderScaleStep, and only
+ * changes if the time leaves a band around the target:
+ *  - it drops once the averaged time exceeds the target,
+ *  - it grows once there is a clear margin below the target.
+ * After a change, the frames that are still in flight at the old scale are
+ * ignored.
+ */
+constexpr float kRenderScaleStep = 1.f / 20.f;
+
+class ResolutionController
+{
+	public:
+		ResolutionController() noexcept = default;
+		explicit ResolutionController(float aTargetMs, float aMinScale = 0.5f, float aMaxScale = 1.f);
+
+	public:
+		// Feed the GPU time of frame aFrame. Frames rendered before the last
+		// change (see set_first_frame()) and repeated frames are ignored.
+		// Returns true if the scale changed.
+		bool update(std::uint64_t aFrame, float aGpuMs);
+
+		// The first frame that renders at the current scale. Must be called
+		// after each change.
+		void set_first_frame(std::uint64_t aFrame) noexcept;
+
+		float scale() const noexcept;
+		float target_ms() const noexcept;
+
+		float min_scale_seen() const noexcept;
+		std::uint32_t change_count() const noexcept;
+
+	private:
+		float mTargetMs = 0.f;
+		float mMinScale = 1.f;
+		float mMaxScale = 1.f;
+
+		float mScale = 1.f;
+		float mMinScaleSeen = 1.f;
+		std::uint32_t mChanges = 0;
+
+		std::uint64_t mFirstFrame = 0;
+		std::uint64_t mLastFrame = 0;
+		bool mHaveFrame = false;
+
+		// Exponential moving average of the GPU time at the current scale
+		float mAverageMs = 0.f;
+		std::uint32_t mSamples = 0;
+};
+
+// The part of aExtent that is rendered at aScale (at least one pixel)
+VkExtent2D scaled_extent(VkExtent2D const& aExtent, float aScale);
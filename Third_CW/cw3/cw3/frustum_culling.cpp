@@ -0,0 +1,486 @@
+#include "frustum_culling.hpp"
+
+#include <chrono>
+#include <random>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__AVX__)
+#	include <immintrin.h>
+#	define CULL_AVX_ 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define CULL_SSE2_ 1
+#endif
+
+namespace
+{
+	// Per-plane constants of the box test. The box (c, e) is outside of the
+	// plane if n.c + d + |n|.e < 0, i.e., if even its corner furthest along
+	// the normal is outside.
+	struct PlaneTerms_
+	{
+		float a, b, c, d;
+		float absA, absB, absC;
+	};
+
+	void plane_terms_(FrustumPlanes const& aPlanes, PlaneTerms_ (&aTerms)[6])
+	{
+		for (std::size_t i = 0; i < 6; ++i)
+		{
+			auto const& p = aPlanes.planes[i];
+			aTerms[i] = PlaneTerms_{ p.x, p.y, p.z, p.w, std::abs(p.x), std::abs(p.y), std::abs(p.z) };
+		}
+	}
+
+	bool box_visible_(PlaneTerms_ const (&aTerms)[6], BoundingBoxes const& aBoxes, std::size_t aIndex)
+	{
+		for (auto const& t : aTerms)
+		{
+			float const s = t.a * aBoxes.centreX[aIndex] + t.b * aBoxes.centreY[aIndex] + t.c * aBoxes.centreZ[aIndex] + t.d;
+			float const r = t.absA * aBoxes.extentX[aIndex] + t.absB * aBoxes.extentY[aIndex] + t.absC * aBoxes.extentZ[aIndex];
+			if (s + r < 0.f)
+				return false;
+		}
+
+		return true;
+	}
+
+	// Append the boxes [aFirst, aLast) that pass to aOut, from aCount on
+	std::size_t cull_range_scalar_(PlaneTerms_ const (&aTerms)[6], BoundingBoxes const& aBoxes, std::size_t aFirst, std::size_t aLast, std::uint32_t* aOut, std::size_t aCount)
+	{
+		for (std::size_t i = aFirst; i < aLast; ++i)
+		{
+			// Branchless: always write, only advance past visible boxes
+			aOut[aCount] = std::uint32_t(i);
+			aCount += box_visible_(aTerms, aBoxes, i) ? 1 : 0;
+		}
+
+		return aCount;
+	}
+
+	// Bits 0..N-1 of aMask are set for the visible boxes aBase..aBase+N-1
+	template< std::size_t tN >
+	std::size_t compact_(unsigned aMask, std::size_t aBase, std::uint32_t* aOut, std::size_t aCount)
+	{
+		for (std::size_t j = 0; j < tN; ++j)
+		{
+			aOut[aCount] = std::uint32_t(aBase + j);
+			aCount += (aMask >> j) & 1u;
+		}
+
+		return aCount;
+	}
+
+#	if defined(CULL_AVX_)
+	std::size_t cull_simd_(PlaneTerms_ const (&aTerms)[6], BoundingBoxes const& aBoxes, std::uint32_t* aOut)
+	{
+		std::size_t const count = aBoxes.size();
+		std::size_t const blocks = count / 8 * 8;
+
+		std::size_t visible = 0;
+		for (std::size_t i = 0; i < blocks; i += 8)
+		{
+			__m256 const cx = _mm256_loadu_ps(aBoxes.centreX.data() + i);
+			__m256 const cy = _mm256_loadu_ps(aBoxes.centreY.data() + i);
+			__m256 const cz = _mm256_loadu_ps(aBoxes.centreZ.data() + i);
+			__m256 const ex = _mm256_loadu_ps(aBoxes.extentX.data() + i);
+			__m256 const ey = _mm256_loadu_ps(aBoxes.extentY.data() + i);
+			__m256 const ez = _mm256_loadu_ps(aBoxes.extentZ.data() + i);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (auto const& t : aTerms)
+			{
+				// Same order of operations as box_visible_()
+				__m256 s = _mm256_mul_ps(_mm256_set1_ps(t.a), cx);
+				s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_set1_ps(t.b), cy));
+				s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_set1_ps(t.c), cz));
+				s = _mm256_add_ps(s, _mm256_set1_ps(t.d));
+
+				__m256 r = _mm256_mul_ps(_mm256_set1_ps(t.absA), ex);
+				r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(t.absB), ey));
+				r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(t.absC), ez));
+
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(s, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+
+			unsigned const mask = ~unsigned(_mm256_movemask_ps(outside)) & 0xffu;
+			visible = compact_<8>(mask, i, aOut, visible);
+		}
+
+		return cull_range_scalar_(aTerms, aBoxes, blocks, count, aOut, visible);
+	}
+#	elif defined(CULL_SSE2_)
+	std::size_t cull_simd_(PlaneTerms_ const (&aTerms)[6], BoundingBoxes const& aBoxes, std::uint32_t* aOut)
+	{
+		std::size_t const count = aBoxes.size();
+		std::size_t const blocks = count / 4 * 4;
+
+		std::size_t visible = 0;
+		for (std::size_t i = 0; i < blocks; i += 4)
+		{
+			__m128 const cx = _mm_loadu_ps(aBoxes.centreX.data() + i);
+			__m128 const cy = _mm_loadu_ps(aBoxes.centreY.data() + i);
+			__m128 const cz = _mm_loadu_ps(aBoxes.centreZ.data() + i);
+			__m128 const ex = _mm_loadu_ps(aBoxes.extentX.data() + i);
+			__m128 const ey = _mm_loadu_ps(aBoxes.extentY.data() + i);
+			__m128 const ez = _mm_loadu_ps(aBoxes.extentZ.data() + i);
+
+			__m128 outside = _mm_setzero_ps();
+			for (auto const& t : aTerms)
+			{
+				// Same order of operations as box_visible_()
+				__m128 s = _mm_mul_ps(_mm_set1_ps(t.a), cx);
+				s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(t.b), cy));
+				s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(t.c), cz));
+				s = _mm_add_ps(s, _mm_set1_ps(t.d));
+
+				__m128 r = _mm_mul_ps(_mm_set1_ps(t.absA), ex);
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(t.absB), ey));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(t.absC), ez));
+
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(s, r), _mm_setzero_ps()));
+			}
+
+			unsigned const mask = ~unsigned(_mm_movemask_ps(outside)) & 0xfu;
+			visible = compact_<4>(mask, i, aOut, visible);
+		}
+
+		return cull_range_scalar_(aTerms, aBoxes, blocks, count, aOut, visible);
+	}
+#	endif
+
+	// Smallest margin by which the box (aIndex) is inside of the planes,
+	// relative to the magnitude of the terms; in double precision. Boxes
+	// with a margin close to zero may go either way in float.
+	double relative_margin_(FrustumPlanes const& aPlanes, BoundingBoxes const& aBoxes, std::size_t aIndex)
+	{
+		double margin = std::numeric_limits<double>::max();
+		for (auto const& p : aPlanes.planes)
+		{
+			double const terms[] = {
+				double(p.x) * aBoxes.centreX[aIndex], double(p.y) * aBoxes.centreY[aIndex], double(p.z) * aBoxes.centreZ[aIndex], double(p.w),
+				std::abs(double(p.x)) * aBoxes.extentX[aIndex], std::abs(double(p.y)) * aBoxes.extentY[aIndex], std::abs(double(p.z)) * aBoxes.extentZ[aIndex]
+			};
+
+			double sum = 0., magnitude = 0.;
+			for (auto const term : terms)
+			{
+				sum += term;
+				magnitude += std::abs(term);
+			}
+
+			margin = std::min(margin, sum / std::max(magnitude, 1e-30));
+		}
+
+		return margin;
+	}
+
+	glm::mat4 make_projection_(float aFovY, float aAspect, float aNear, float aFar)
+	{
+		// Same as update_scene_uniforms()
+		glm::mat4 projection = glm::perspectiveRH_ZO(aFovY, aAspect, aNear, aFar);
+		projection[1][1] *= -1.f;
+		return projection;
+	}
+}
+
+FrustumPlanes extract_frustum_planes(glm::mat4 const& aProjCam)
+{
+	// Rows of the matrix (glm is column-major). A point is inside if its
+	// clip coordinates satisfy -w <= x, y <= w and 0 <= z <= w; each of
+	// these is a plane in world space. The flip of y only swaps the
+	// bottom and top planes.
+	auto const row = [&aProjCam] (int aRow) {
+		return glm::vec4(aProjCam[0][aRow], aProjCam[1][aRow], aProjCam[2][aRow], aProjCam[3][aRow]);
+	};
+
+	FrustumPlanes ret{};
+	ret.planes[0] = row(3) + row(0); // left
+	ret.planes[1] = row(3) - row(0); // right
+	ret.planes[2] = row(3) + row(1); // bottom
+	ret.planes[3] = row(3) - row(1); // top
+	ret.planes[4] = row(2);          // near
+	ret.planes[5] = row(3) - row(2); // far
+
+	// Normalized, such that d is a distance (not required by the test)
+	for (auto& plane : ret.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return ret;
+}
+
+std::size_t BoundingBoxes::size() const noexcept
+{
+	assert(centreX.size() == extentZ.size());
+	return centreX.size();
+}
+
+void BoundingBoxes::reserve(std::size_t aCount)
+{
+	for (auto* values : { &centreX, &centreY, &centreZ, &extentX, &extentY, &extentZ })
+		values->reserve(aCount);
+}
+
+void BoundingBoxes::add(glm::vec3 const& aMin, glm::vec3 const& aMax)
+{
+	glm::vec3 const centre = 0.5f * (aMin + aMax);
+	glm::vec3 const extent = 0.5f * (aMax - aMin);
+
+	centreX.emplace_back(centre.x);
+	centreY.emplace_back(centre.y);
+	centreZ.emplace_back(centre.z);
+	extentX.emplace_back(extent.x);
+	extentY.emplace_back(extent.y);
+	extentZ.emplace_back(extent.z);
+}
+
+BoundingBoxes compute_mesh_bounds(ModelData const& aModel)
+{
+	BoundingBoxes boxes;
+	boxes.reserve(aModel.meshes.size());
+
+	for (auto const& mesh : aModel.meshes)
+	{
+		glm::vec3 bmin(std::numeric_limits<float>::max());
+		glm::vec3 bmax(-std::numeric_limits<float>::max());
+		for (std::size_t i = 0; i < mesh.numberOfVertices; ++i)
+		{
+			auto const& pos = aModel.vertexPositions[mesh.vertexStartIndex + i];
+			bmin = glm::min(bmin, pos);
+			bmax = glm::max(bmax, pos);
+		}
+
+		// An empty mesh gets an empty box at the origin (never culled
+		// by mistake, never drawn with any effect)
+		if (0 == mesh.numberOfVertices)
+			bmin = bmax = glm::vec3(0.f);
+
+		boxes.add(bmin, bmax);
+	}
+
+	return boxes;
+}
+
+std::vector<NormalCone> compute_normal_cones(ModelData const& aModel)
+{
+	std::vector<NormalCone> cones;
+	cones.reserve(aModel.meshes.size());
+
+	std::vector<glm::vec3> normals;
+	for (auto const& mesh : aModel.meshes)
+	{
+		// The meshes are triangle lists
+		normals.clear();
+		for (std::size_t i = 0; i + 2 < mesh.numberOfVertices; i += 3)
+		{
+			auto const* v = &aModel.vertexPositions[mesh.vertexStartIndex + i];
+			auto const n = glm::cross(v[1] - v[0], v[2] - v[0]);
+
+			// Degenerate triangles are never rasterized
+			if (float const len = glm::length(n); len > 1e-12f)
+				normals.emplace_back(n / len);
+		}
+
+		NormalCone cone{ glm::vec3(0.f, 0.f, 1.f), 1.f };
+
+		glm::vec3 sum(0.f);
+		for (auto const& n : normals)
+			sum += n;
+
+		if (float const len = glm::length(sum); !normals.empty() && len > 1e-6f)
+		{
+			auto const axis = sum / len;
+
+			float minCos = 1.f;
+			for (auto const& n : normals)
+				minCos = std::min(minCos, glm::dot(n, axis));
+
+			// Wider than a half space: the test would never pass
+			if (minCos > 0.f)
+				cone = NormalCone{ axis, std::sqrt(std::max(0.f, 1.f - minCos * minCos)) };
+		}
+
+		cones.emplace_back(cone);
+	}
+
+	return cones;
+}
+
+std::size_t cull_boxes(FrustumPlanes const& aPlanes, BoundingBoxes const& aBoxes, std::vector<std::uint32_t>& aVisible)
+{
+	PlaneTerms_ terms[6];
+	plane_terms_(aPlanes, terms);
+
+	// The compaction writes one index past the visible ones
+	aVisible.resize(aBoxes.size() + 1);
+
+#	if defined(CULL_AVX_) || defined(CULL_SSE2_)
+	std::size_t const count = cull_simd_(terms, aBoxes, aVisible.data());
+#	else
+	std::size_t const count = cull_range_scalar_(terms, aBoxes, 0, aBoxes.size(), aVisible.data(), 0);
+#	endif
+
+	aVisible.resize(count);
+	return count;
+}
+
+std::size_t cull_boxes_scalar(FrustumPlanes const& aPlanes, BoundingBoxes const& aBoxes, std::vector<std::uint32_t>& aVisible)
+{
+	PlaneTerms_ terms[6];
+	plane_terms_(aPlanes, terms);
+
+	aVisible.clear();
+	for (std::size_t i = 0; i < aBoxes.size(); ++i)
+	{
+		if (box_visible_(terms, aBoxes, i))
+			aVisible.emplace_back(std::uint32_t(i));
+	}
+
+	return aVisible.size();
+}
+
+char const* culling_isa() noexcept
+{
+#	if defined(CULL_AVX_)
+	return "AVX";
+#	elif defined(CULL_SSE2_)
+	return "SSE2";
+#	else
+	return "scalar";
+#	endif
+}
+
+bool check_frustum_culling(std::size_t aMaxBoxes, float aFovY, float aNear, float aFar, glm::vec3 const& aSceneMin, glm::vec3 const& aSceneMax)
+{
+	using Clock_ = std::chrono::steady_clock;
+
+	struct View
+	{
+		char const* name;
+		glm::vec3 eye;
+		glm::vec3 target;
+	};
+
+	// Boxes are spread over a volume around the scene that is a few times
+	// its size, so that a good part of them is culled.
+	glm::vec3 const centre = 0.5f * (aSceneMin + aSceneMax);
+	glm::vec3 const extent = aSceneMax - aSceneMin;
+	glm::vec3 const volumeMin = centre - 2.f * extent;
+	glm::vec3 const volumeMax = centre + 2.f * extent;
+	float const maxBoxSize = 0.02f * glm::length(extent);
+
+	View const views[] = {
+		{ "front", centre - glm::vec3(0.f, 0.f, 1.5f * extent.z), centre },
+		{ "inside", centre, centre + glm::vec3(1.f, 0.f, 0.2f) },
+		{ "above", centre + glm::vec3(0.f, extent.y, 0.f), centre + glm::vec3(0.1f, 0.f, 0.f) }
+	};
+
+	// Box counts from 100k up to aMaxBoxes
+	std::vector<std::size_t> counts;
+	for (std::size_t count = 100000; count < aMaxBoxes; count *= 10)
+	{
+		counts.emplace_back(count);
+		if (3 * count < aMaxBoxes)
+			counts.emplace_back(3 * count);
+	}
+	counts.emplace_back(aMaxBoxes);
+
+	// Timed runs per case, after one untimed warm-up run
+	constexpr std::uint32_t kIterations = 10;
+
+	// Boxes per case for the corner check
+	constexpr std::size_t kCornerChecks = 10000;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	std::printf("Frustum culling (%s), average of %u runs:\n", culling_isa(), kIterations);
+
+	std::vector<std::uint32_t> reference, visible;
+
+	bool ok = true;
+	for (auto const count : counts)
+	{
+		BoundingBoxes boxes;
+		boxes.reserve(count);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			glm::vec3 const pos = volumeMin + (volumeMax - volumeMin) * glm::vec3(unit(rng), unit(rng), unit(rng));
+			glm::vec3 const size = maxBoxSize * glm::vec3(unit(rng), unit(rng), unit(rng));
+			boxes.add(pos, pos + size);
+		}
+
+		for (auto const& view : views)
+		{
+			glm::mat4 const projCam = make_projection_(aFovY, 16.f / 9.f, aNear, aFar) * glm::lookAt(view.eye, view.target, glm::vec3(0.f, 1.f, 0.f));
+			FrustumPlanes const planes = extract_frustum_planes(projCam);
+
+			auto const time_ = [&] (auto&& aCull) {
+				aCull();
+
+				auto const start = Clock_::now();
+				for (std::uint32_t iter = 0; iter < kIterations; ++iter)
+					aCull();
+				return std::chrono::duration<float, std::milli>(Clock_::now() - start).count() / kIterations;
+			};
+
+			float const scalarMs = time_([&] { cull_boxes_scalar(planes, boxes, reference); });
+			float const simdMs = time_([&] { cull_boxes(planes, boxes, visible); });
+
+			// Differences must be down to rounding (e.g., a contracted
+			// multiply-add in the scalar code)
+			std::vector<std::uint32_t> differ;
+			std::set_symmetric_difference(reference.begin(), reference.end(), visible.begin(), visible.end(), std::back_inserter(differ));
+
+			std::size_t mismatches = 0;
+			for (auto const index : differ)
+			{
+				if (std::abs(relative_margin_(planes, boxes, index)) > 1e-5)
+					++mismatches;
+			}
+
+			// A box with a corner that is strictly inside of the clip
+			// volume must be kept
+			std::size_t missing = 0;
+			for (std::size_t i = 0; i < std::min(count, kCornerChecks); ++i)
+			{
+				if (std::binary_search(visible.begin(), visible.end(), std::uint32_t(i)))
+					continue;
+
+				glm::vec3 const c(boxes.centreX[i], boxes.centreY[i], boxes.centreZ[i]);
+				glm::vec3 const e(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+				for (int corner = 0; corner < 8; ++corner)
+				{
+					glm::vec3 const sign((corner & 1) ? 1.f : -1.f, (corner & 2) ? 1.f : -1.f, (corner & 4) ? 1.f : -1.f);
+					glm::vec4 const clip = projCam * glm::vec4(c + sign * e, 1.f);
+					if (std::abs(clip.x) < clip.w && std::abs(clip.y) < clip.w && clip.z > 0.f && clip.z < clip.w)
+					{
+						++missing;
+						break;
+					}
+				}
+			}
+
+			std::printf("%8zu boxes, %-6s: %7zu visible, scalar %7.3f ms, %-6s %7.3f ms (%.2fx), %zu rounding differences: %s\n",
+				count, view.name,
+				visible.size(),
+				scalarMs, culling_isa(), simdMs, scalarMs / simdMs,
+				differ.size() - mismatches,
+				mismatches ? "MISMATCH" : missing ? "MISSING BOXES" : "ok"
+			);
+
+			ok = ok && 0 == mismatches && 0 == missing;
+		}
+	}
+
+	std::printf("Culling check %s\n", ok ? "passed" : "FAILED");
+	return ok;
+}
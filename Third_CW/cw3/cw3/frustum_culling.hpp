@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "model.hpp"
+
+/* Frustum culling of axis-aligned bounding boxes on the CPU.
+ *
+ * The boxes are stored as structure of arrays (centre and half extent per
+ * axis), such that the SIMD culler can test several boxes per instruction:
+ * eight with AVX, four with SSE2. cull_boxes() picks the widest instruction
+ * set that the build targets (see culling_isa()); cull_boxes_scalar() is the
+ * reference that it is checked against (--bench-cull).
+ *
+ * A box is culled if it lies entirely on the outside of one of the six
+ * frustum planes. This is conservative: boxes that are near a corner of the
+ * frustum may be kept even though they are outside.
+ */
+
+// Planes (a, b, c, d) with the normal pointing inwards: a point p is on the
+// inside if a*p.x + b*p.y + c*p.z + d >= 0.
+struct FrustumPlanes
+{
+	glm::vec4 planes[6];
+};
+
+// Planes of the frustum of aProjCam (projection * view), in world space.
+// The projection must map depth to [0,1] (perspectiveRH_ZO, as in
+// update_scene_uniforms()).
+FrustumPlanes extract_frustum_planes(glm::mat4 const& aProjCam);
+
+
+struct BoundingBoxes
+{
+	std::vector<float> centreX, centreY, centreZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	std::size_t size() const noexcept;
+
+	void reserve(std::size_t);
+	void add(glm::vec3 const& aMin, glm::vec3 const& aMax);
+};
+
+// Bounds of each mesh of aModel, by mesh index (= index in the ColourMesh)
+BoundingBoxes compute_mesh_bounds(ModelData const&);
+
+
+// Normal cone of a mesh, for culling meshes that face away from the camera
+// as a whole (--gpu-culling; see cull_draws.comp). The normals of all of
+// the mesh's triangles are within the angle theta of axis, and cutoff is
+// sin(theta). The mesh is entirely back-facing for a camera at p if
+//   dot(c - p, axis) >= cutoff * |c - p| + r
+// where (c, r) is its bounding sphere. Meshes whose normals spread over a
+// half space or more get a cutoff of one, which never passes.
+struct NormalCone
+{
+	glm::vec3 axis;
+	float cutoff;
+};
+
+// Normal cone of each mesh of aModel, by mesh index. The triangles' normals
+// follow their winding: counter-clockwise is front-facing, as in the
+// G-buffer pipeline.
+std::vector<NormalCone> compute_normal_cones(ModelData const&);
+
+
+// Replace the contents of aVisible with the indices of the boxes that are
+// not culled, in ascending order. Returns their number.
+std::size_t cull_boxes(FrustumPlanes const&, BoundingBoxes const&, std::vector<std::uint32_t>& aVisible);
+std::size_t cull_boxes_scalar(FrustumPlanes const&, BoundingBoxes const&, std::vector<std::uint32_t>& aVisible);
+
+// Instruction set used by cull_boxes(): "AVX", "SSE2" or "scalar"
+char const* culling_isa() noexcept;
+
+// Time cull_boxes() against the scalar reference for up to aMaxBoxes
+// random boxes (from 100k) and a number of views of the box [aSceneMin,
+// aSceneMax], and compare the results. Boxes on which the two disagree
+// only by rounding are accepted. Also check that no box with a corner
+// inside the frustum is culled. Prints the results to stdout and returns
+// false if any check failed.
+bool check_frustum_culling(std::size_t aMaxBoxes, float aFovY, float aNear, float aFar, glm::vec3 const& aSceneMin, glm::vec3 const& aSceneMax);
@@ -0,0 +1,278 @@
+#include "gbuffer.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Create a transient attachment. Lazily allocated memory is preferred;
+	// without it (typically on desktop GPUs), fall back to regular device
+	// memory. aLazy reports which one was used.
+	lut::Image create_transient_image_(lut::Allocator const& aAllocator, VkExtent2D const& aExtent, VkFormat aFormat, VkImageUsageFlags aUsage, bool& aLazy)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = aFormat;
+		imageInfo.extent.width = aExtent.width;
+		imageInfo.extent.height = aExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = aUsage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VmaAllocationCreateInfo allocInfo{};
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+		VkImage image = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+
+		aLazy = true;
+		if (VK_SUCCESS == vmaCreateImage(aAllocator.allocator, &imageInfo, &allocInfo, &image, &allocation, nullptr))
+			return lut::Image(aAllocator.allocator, image, allocation);
+
+		aLazy = false;
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		if (auto const res = vmaCreateImage(aAllocator.allocator, &imageInfo, &allocInfo, &image, &allocation, nullptr); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to allocate transient G-buffer image.\n" "vmaCreateImage() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::Image(aAllocator.allocator, image, allocation);
+	}
+}
+
+GBufferDesc make_gbuffer_desc(GBufferLayout aLayout, bool aTransient)
+{
+	GBufferDesc desc{};
+	desc.layout = aLayout;
+	desc.depthFormat = VK_FORMAT_D32_SFLOAT;
+	desc.transient = aTransient;
+	desc.stencil = false;
+	desc.sampleDepth = false;
+	desc.depthPrepass = false;
+
+	switch (aLayout)
+	{
+		case GBufferLayout::classic:
+			desc.colourFormats = {
+				VK_FORMAT_R8G8B8A8_SRGB,
+				VK_FORMAT_R16G16B16A16_SFLOAT,
+				VK_FORMAT_R16G16B16A16_SFLOAT,
+				VK_FORMAT_R8G8B8A8_SRGB
+			};
+			desc.readDepth = false;
+			break;
+
+		case GBufferLayout::compact:
+			desc.colourFormats = {
+				VK_FORMAT_R16G16_SNORM,
+				VK_FORMAT_R8G8B8A8_UNORM,
+				VK_FORMAT_R8G8B8A8_SRGB
+			};
+			desc.readDepth = true;
+			break;
+	}
+
+	return desc;
+}
+
+char const* to_string(GBufferLayout aLayout)
+{
+	switch (aLayout)
+	{
+		case GBufferLayout::classic: return "classic";
+		case GBufferLayout::compact: return "compact";
+	}
+
+	return "unknown";
+}
+
+bool parse_gbuffer_layout(char const* aName, GBufferLayout& aLayout)
+{
+	for (auto const layout : { GBufferLayout::classic, GBufferLayout::compact })
+	{
+		if (0 == std::strcmp(aName, to_string(layout)))
+		{
+			aLayout = layout;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void enable_gbuffer_stencil(lut::VulkanContext const& aContext, GBufferDesc& aDesc)
+{
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (aDesc.readDepth)
+		required |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+	// Neither format is supported everywhere, but one of them is
+	for (auto const format : { VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT })
+	{
+		VkFormatProperties props{};
+		vkGetPhysicalDeviceFormatProperties(aContext.physicalDevice, format, &props);
+
+		if (required == (props.optimalTilingFeatures & required))
+		{
+			aDesc.depthFormat = format;
+			aDesc.stencil = true;
+			return;
+		}
+	}
+
+	throw lut::Error("No supported depth/stencil format for the G-buffer");
+}
+
+VkImageLayout gbuffer_depth_layout(GBufferDesc const& aDesc)
+{
+	// With a stencil, the lighting pass uses the depth buffer as its
+	// attachment. Only the stencil is written then, so the depth can be
+	// sampled at the same time.
+	if (aDesc.stencil)
+		return aDesc.readDepth ? VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	return aDesc.readDepth || aDesc.sampleDepth ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+}
+
+std::uint32_t format_size(VkFormat aFormat)
+{
+	switch (aFormat)
+	{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_R16G16_SNORM:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+			return 4;
+
+		// Commonly stored as separate depth and stencil planes
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return 5;
+
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return 8;
+
+		default:
+			throw lut::Error("format_size(): unsupported format %d", int(aFormat));
+	}
+}
+
+std::uint32_t gbuffer_bytes_per_pixel(GBufferDesc const& aDesc)
+{
+	std::uint32_t bytes = format_size(aDesc.depthFormat);
+	for (auto const format : aDesc.colourFormats)
+		bytes += format_size(format);
+
+	return bytes;
+}
+
+GBuffer create_gbuffer(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, GBufferDesc const& aDesc, VkExtent2D const& aExtent)
+{
+	GBuffer gbuffer;
+
+	// Transient G-buffers are read as input attachments within the render
+	// pass, others are sampled by the separate lighting pass
+	VkImageUsageFlags const readUsage = aDesc.transient ? VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	auto const create_image_ = [&] (VkFormat aFormat, VkImageUsageFlags aUsage) {
+		if (!aDesc.transient)
+			return lut::create_image(aAllocator, aExtent.width, aExtent.height, aFormat, aUsage);
+
+		bool lazy = false;
+		auto image = create_transient_image_(aAllocator, aExtent, aFormat, aUsage, lazy);
+		gbuffer.lazilyAllocated = lazy;
+		return image;
+	};
+
+	for (auto const format : aDesc.colourFormats)
+	{
+		gbuffer.images.emplace_back(create_image_(format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | readUsage));
+		gbuffer.views.emplace_back(lut::create_image_view(aContext, gbuffer.images.back().image, format));
+	}
+
+	VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (aDesc.readDepth)
+		depthUsage |= readUsage;
+	if (aDesc.sampleDepth)
+	{
+		assert(!aDesc.transient);
+		depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+
+	gbuffer.depthImage = create_image_(aDesc.depthFormat, depthUsage);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = gbuffer.depthImage.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = aDesc.depthFormat;
+	viewInfo.components = VkComponentMapping{};
+	viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+	auto const create_depth_view_ = [&] (VkImageAspectFlags aAspect) {
+		viewInfo.subresourceRange.aspectMask = aAspect;
+
+		VkImageView view = VK_NULL_HANDLE;
+		if (auto const res = vkCreateImageView(aContext.device, &viewInfo, nullptr, &view); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create G-buffer depth view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::ImageView(aContext.device, view);
+	};
+
+	// Attachments use all aspects of the format, but only a single aspect
+	// can be sampled
+	if (aDesc.stencil)
+	{
+		gbuffer.depthView = create_depth_view_(VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+		if (aDesc.readDepth)
+			gbuffer.depthReadView = create_depth_view_(VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+	else
+	{
+		gbuffer.depthView = create_depth_view_(VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+
+	if (aDesc.readDepth)
+		gbuffer.lightingInputs.emplace_back(aDesc.stencil ? gbuffer.depthReadView.handle : gbuffer.depthView.handle);
+	for (auto const& colourView : gbuffer.views)
+		gbuffer.lightingInputs.emplace_back(colourView.handle);
+
+	assert(4 == gbuffer.lightingInputs.size());
+	return gbuffer;
+}
+
+lut::Sampler create_gbuffer_sampler(lut::VulkanContext const& aContext)
+{
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0.f;
+	samplerInfo.maxLod = 0.f;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	if (auto const res = vkCreateSampler(aContext.device, &samplerInfo, nullptr, &sampler); VK_SUCCESS != res)
+	{
+		throw lut::Error("Unable to create G-buffer sampler\n" "vkCreateSampler() returned %s", lut::to_string(res).c_str());
+	}
+
+	return lut::Sampler(aContext.device, sampler);
+}
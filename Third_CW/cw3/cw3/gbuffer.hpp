@@ -0,0 +1,126 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstdint>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/vulkan_context.hpp"
+namespace lut = labutils;
+
+/* The G-buffer is written by the first (geometry) pass and read by the second
+ * (lighting) pass. Two layouts are supported (see --gbuffer):
+ *
+ * classic: four colour targets and a depth buffer that is not read back.
+ *   0  position         R8G8B8A8_SRGB         (read as "depth" by deferred.frag)
+ *   1  normal           R16G16B16A16_SFLOAT
+ *   2  emissive, shin.  R16G16B16A16_SFLOAT
+ *   3  albedo, metal.   R8G8B8A8_SRGB
+ *   -  depth            D32_SFLOAT
+ *
+ * compact: three 32-bit colour targets and the depth buffer, which the
+ * lighting pass samples to reconstruct the world position.
+ *   0  depth            D32_SFLOAT
+ *   1  normal           R16G16_SNORM          (octahedral encoding)
+ *   2  emissive, shin.  R8G8B8A8_UNORM        (sqrt emissive, log shininess)
+ *   3  albedo, metal.   R8G8B8A8_SRGB
+ *
+ * The encodings are implemented in shaders/gbuffer_compact.glsl. In both
+ * layouts, the lighting pass reads four images in the order shown above
+ * (bindings 0 to 3).
+ *
+ * By default, the two passes are separate render passes and the lighting pass
+ * samples the G-buffer. With a transient G-buffer, both are subpasses of one
+ * render pass (--merge-passes). The lighting subpass then reads the G-buffer
+ * as input attachments, and the G-buffer is never stored to memory. Its
+ * images are transient and, where the device supports it, lazily allocated,
+ * such that tile-based GPUs can keep the G-buffer on-chip.
+ *
+ * For light volumes (--light-volumes), the depth buffer gets a stencil
+ * aspect (see enable_gbuffer_stencil()). The geometry pass marks the pixels
+ * that it covers in the stencil, and the lighting pass then uses the
+ * G-buffer's depth and stencil as its own depth/stencil attachment.
+ */
+enum class GBufferLayout
+{
+	classic,
+	compact
+};
+
+struct GBufferDesc
+{
+	GBufferLayout layout;
+
+	// Colour targets in attachment order
+	std::vector<VkFormat> colourFormats;
+	VkFormat depthFormat;
+
+	// True if the lighting pass reads the depth buffer instead of the
+	// first colour target
+	bool readDepth;
+
+	// True if the G-buffer only lives within a single render pass
+	bool transient;
+
+	// True if depthFormat has a stencil aspect
+	bool stencil;
+
+	// True if the depth buffer is also sampled after the geometry pass for
+	// something other than lighting (the Hi-Z pyramid of
+	// --occlusion-culling). Not supported with a transient G-buffer.
+	bool sampleDepth;
+
+	// True if a depth pre-pass (--depth-prepass) lays down the depth
+	// before the geometry pass. The geometry pass then loads the depth and
+	// only shades the fragments that are at the stored depth, without
+	// writing it. Not supported with a transient G-buffer.
+	bool depthPrepass;
+};
+
+GBufferDesc make_gbuffer_desc(GBufferLayout, bool aTransient = false);
+
+// Switch to a depth/stencil format that the device supports for aDesc.
+// Throws if there is none.
+void enable_gbuffer_stencil(lut::VulkanContext const&, GBufferDesc& aDesc);
+
+// Layout that the geometry pass leaves the depth buffer in, and in which the
+// lighting pass (and the Hi-Z build) reads it (if at all)
+VkImageLayout gbuffer_depth_layout(GBufferDesc const&);
+
+char const* to_string(GBufferLayout);
+bool parse_gbuffer_layout(char const* aName, GBufferLayout& aLayout);
+
+// Size of a texel of the formats used by the G-buffer, in bytes
+std::uint32_t format_size(VkFormat);
+
+// Bytes per pixel of all G-buffer images, including depth
+std::uint32_t gbuffer_bytes_per_pixel(GBufferDesc const&);
+
+
+struct GBuffer
+{
+	std::vector<lut::Image> images;
+	std::vector<lut::ImageView> views;
+
+	lut::Image depthImage;
+	lut::ImageView depthView;
+
+	// Depth aspect only, for reading a depth/stencil buffer in the lighting
+	// pass. Otherwise, depthView is read.
+	lut::ImageView depthReadView;
+
+	// Views read by the lighting pass, in binding order
+	std::vector<VkImageView> lightingInputs;
+
+	// True if the (transient) images are backed by lazily allocated memory
+	bool lazilyAllocated = false;
+};
+
+GBuffer create_gbuffer(lut::VulkanContext const&, lut::Allocator const&, GBufferDesc const&, VkExtent2D const&);
+
+// Nearest-neighbour sampler for sampling the G-buffer in the lighting pass
+lut::Sampler create_gbuffer_sampler(lut::VulkanContext const&);
@@ -0,0 +1,61 @@
+#include "instances.hpp"
+
+#include <random>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+	// Space between neighbouring copies, relative to the model's size
+	constexpr float kGridSpacing = 1.1f;
+}
+
+InstanceData make_instance(glm::mat4 const& aTransform, std::uint32_t aMaterial)
+{
+	// glm matrices are column-major
+	glm::mat4 const rows = glm::transpose(aTransform);
+
+	InstanceData instance{};
+	instance.rows[0] = rows[0];
+	instance.rows[1] = rows[1];
+	instance.rows[2] = rows[2];
+	instance.material = aMaterial;
+	return instance;
+}
+
+std::vector<InstanceData> make_instance_grid(std::uint32_t aCount, glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aMaterialCount, std::uint32_t aSeed)
+{
+	assert(aMin.x <= aMax.x && aMin.z <= aMax.z);
+
+	// See make_stress_lights()
+	std::mt19937 rng(aSeed);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	glm::vec3 const centre = 0.5f * (aMin + aMax);
+
+	// Rotated about its centre, the model stays within the circle through
+	// the corners of its box
+	float const spacing = kGridSpacing * glm::length(glm::vec2(aMax.x - aMin.x, aMax.z - aMin.z));
+	auto const columns = std::uint32_t(std::ceil(std::sqrt(float(aCount))));
+	auto const rows = columns > 0 ? (aCount + columns - 1) / columns : 0;
+
+	std::vector<InstanceData> instances(aCount);
+	for (std::uint32_t i = 0; i < aCount; ++i)
+	{
+		float const x = (float(i % columns) - 0.5f * float(columns - 1)) * spacing;
+		float const z = (float(i / columns) - 0.5f * float(rows - 1)) * spacing;
+		float const yaw = 6.2831853f * unit(rng);
+
+		glm::mat4 transform = glm::translate(glm::mat4(1.f), centre + glm::vec3(x, 0.f, z));
+		transform = glm::rotate(transform, yaw, glm::vec3(0.f, 1.f, 0.f));
+		transform = glm::translate(transform, -centre);
+
+		std::uint32_t const material = (1 == i % 2 && aMaterialCount > 0) ? (i / 2) % aMaterialCount : kNoMaterialOverride;
+		instances[i] = make_instance(transform, material);
+	}
+
+	return instances;
+}
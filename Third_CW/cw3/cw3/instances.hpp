@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+/* Hardware instancing (--instances): the model is placed many times, and
+ * each of its meshes is drawn with a single instanced draw for all copies.
+ *
+ * InstanceData is the per-instance vertex input of the instanced G-buffer
+ * pipeline (binding 2, see shaders/MRT_instanced.vert): the rows of the
+ * copy's affine object-to-world transform, and a material that replaces
+ * the meshes' own materials (or kNoMaterialOverride).
+ */
+constexpr std::uint32_t kNoMaterialOverride = ~std::uint32_t(0);
+
+struct InstanceData
+{
+	glm::vec4 rows[3]; // rows of the 3x4 transform
+	std::uint32_t material;
+	std::uint32_t pad[3];
+};
+
+static_assert(sizeof(InstanceData) == 64, "InstanceData must match the instance attributes in MRT_instanced.vert");
+
+// Instance with the transform aTransform, which must be affine. Normals are
+// transformed with the same matrix, so it must not scale non-uniformly.
+InstanceData make_instance(glm::mat4 const& aTransform, std::uint32_t aMaterial = kNoMaterialOverride);
+
+// Stress scene: aCount copies of a model with the bounds [aMin, aMax], on a
+// square grid in the xz plane around the model's original place. Each copy
+// is rotated randomly about its vertical axis; the cells are large enough
+// for any rotation. Every other copy overrides the materials with one of
+// aMaterialCount, in turn. The same seed always gives the same copies.
+std::vector<InstanceData> make_instance_grid(std::uint32_t aCount, glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aMaterialCount, std::uint32_t aSeed = 1);
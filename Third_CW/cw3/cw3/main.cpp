@@ -2,11 +2,15 @@
 
 #include <tuple>
 #include <chrono>
+#include <future>
 #include <limits>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <stdexcept>
 
 #include <cstdio>
+#include <cstdlib>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -34,9 +38,32 @@ using namespace labutils::literals;
 #include "../labutils/vkobject.hpp"
 #include "../labutils/vkbuffer.hpp"
 #include "../labutils/allocator.hpp" 
+#include "../labutils/frame_context.hpp"
+#include "../labutils/command_cache.hpp"
+#include "../labutils/thread_pool.hpp"
+#include "../labutils/gpu_timeline.hpp"
+#include "../labutils/offscreen.hpp"
+#include "../labutils/gpu_profiler.hpp"
+#include "../labutils/trace.hpp"
+#include "../labutils/cpu_profiler.hpp"
+#include "../labutils/frame_stats.hpp"
+#include "../labutils/pipeline_cache.hpp"
+#include "../labutils/pipeline_builder.hpp"
+#include "../labutils/pipeline_registry.hpp"
+#include "../labutils/pipeline_variants.hpp"
+#include "../labutils/shader_reflection.hpp"
+#include "../labutils/descriptor_layout_cache.hpp"
 namespace lut = labutils;
 
 #include "model.hpp"
+#include "camera_path.hpp"
+#include "gbuffer.hpp"
+#include "clusters.hpp"
+#include "point_lights.hpp"
+#include "dynamic_resolution.hpp"
+#include "frustum_culling.hpp"
+#include "instances.hpp"
+#include "render_queue.hpp"
 
 namespace
 {
@@ -56,6 +83,15 @@ namespace
 
 		constexpr auto kCameraFov    = 60.0_degf;
 
+		// Number of frames that the CPU may record ahead of the GPU. Each of
+		// these has its own command pool, synchronization objects and
+		// uniform buffer (see lut::FrameContext). 2-3 is a reasonable range:
+		// more frames give more CPU/GPU overlap, but also add latency.
+		constexpr std::uint32_t kFramesInFlight = 2;
+
+		// Print frame timing statistics every this many frames.
+		constexpr std::uint32_t kStatsInterval = 500;
+
 		//For Camera
 		bool firstMouse = true;
 		bool enableMouse = false;
@@ -65,8 +101,260 @@ namespace
 		float delta;
 
 		bool moveable = false;
+
+		// Rotation of the lights about the y axis, in degrees. Advanced
+		// while the lights are moveable, or taken from the camera path
+		// during a replay. update_scene_uniforms() applies the change since
+		// the previous frame.
+		float lightAngle = 0.f;
+		float appliedLightAngle = 0.f;
+
+		// Light rotation speed in degrees per second
+		constexpr float kLightSpeed = 20.f;
+
+		// Reuse pre-recorded command buffers (toggle with C). The draw
+		// sequence of the scene is static; only the scene uniforms change,
+		// and these are passed through a per-frame buffer.
+		bool cacheCommands = true;
+
+		// Record the G-buffer draws into secondary command buffers on
+		// several threads (toggle with P). This only pays off with many
+		// draws; see the --bench-record option. Parallel recording uses
+		// per-frame command pools that are reset every frame, so it
+		// bypasses the command buffer cache.
+		bool parallelRecording = false;
+
+		// Skip the meshes whose bounding boxes are outside of the view
+		// frustum (toggle with F). The draw list then changes with the
+		// view, and the cached command buffers are re-recorded whenever it
+		// does.
+		bool frustumCulling = true;
+
+		// Number of draws in the synthetic scene used by --bench-record
+		constexpr std::size_t kBenchDrawCount = 50000;
+
+		// Number of timed recordings per thread count in --bench-record
+		constexpr std::uint32_t kBenchIterations = 20;
+
+		// Maximum number of boxes in --bench-cull
+		constexpr std::size_t kBenchCullBoxes = 1000000;
+
+		// --bench-sort: maximum number of draws, and the pipelines and
+		// materials that they are spread over
+		constexpr std::size_t kBenchSortDraws = 1000000;
+		constexpr std::uint32_t kBenchSortPipelines = 8;
+		constexpr std::uint32_t kBenchSortMaterials = 256;
+
+		// Depth buckets of the sorted draws (--sort-draws). Few buckets keep
+		// the order, and with it the cached command buffers, stable while
+		// the camera moves.
+		constexpr std::uint32_t kSortDepthBuckets = 16;
+
+		// Maximum number of copies of the model for --instances
+		constexpr std::uint32_t kMaxInstances = 1u << 20;
+
+		// Headless rendering (--headless). Frames are written out as 8-bit
+		// RGBA, so the format must match. The fixed time step replaces the
+		// wall-clock delta, such that every run renders the same frames.
+		constexpr VkExtent2D kHeadlessExtent{ 1280, 720 };
+		constexpr VkFormat kHeadlessFormat = VK_FORMAT_R8G8B8A8_SRGB;
+		constexpr std::uint64_t kHeadlessFrames = 300;
+		constexpr float kHeadlessFrameTime = 1.f / 60.f;
+
+		// Pipeline cache, relative to the working directory. Loaded at
+		// startup and saved on exit (see --pipeline-cache).
+		constexpr char const* kPipelineCachePath = "cw3-pipelines.bin";
+
+		// GPU profiler slots: one per frame in flight (the slot index is the
+		// frame index), and one for each of the two upload batches.
+		constexpr std::uint32_t kMeshUploadProfilerSlot = kFramesInFlight;
+		constexpr std::uint32_t kMaterialUploadProfilerSlot = kFramesInFlight + 1;
+		constexpr std::uint32_t kProfilerSlotCount = kFramesInFlight + 2;
+
+		// Frames at the start of a replay that are left out of the report
+		// (first use of pipelines and resources, uploads still in flight).
+		constexpr std::uint64_t kReplayWarmupFrames = 10;
+
+		// Trace tracks: the GPU events, followed by one track per CPU thread
+		// that recorded zones
+		constexpr std::uint32_t kGpuTraceThread = 0;
+		constexpr std::uint32_t kFirstCpuTraceThread = 1;
+
+		// Maximum number of point lights for --lights
+		constexpr std::uint32_t kMaxPointLights = 16384;
+
+		// Dynamic resolution (--dynamic-resolution): the default GPU frame
+		// time to hold, and the smallest scale of the rendered extent
+		constexpr float kDefaultTargetGpuMs = 14.f;
+		constexpr float kMinRenderScale = 0.5f;
 	}
 
+	// Shading variant of the lighting pass, passed to its shaders as
+	// specialization constants (constant_id 0 to 2 in deferred_shading.glsl,
+	// see specialization_constants()). Each distinct variant is a separate
+	// pipeline, in which the light loop is unrolled and the unused terms
+	// are stripped.
+	enum class BrdfModel : std::uint32_t
+	{
+		microfacet = 0,
+		lambert = 1 // diffuse only
+	};
+
+	struct ShadingVariant
+	{
+		// Of the scene's four lights (number keys); not used with --lights
+		std::uint32_t lightCount = 4;
+
+		BrdfModel brdf = BrdfModel::microfacet;
+		bool emissive = true;
+		bool ambient = true;
+	};
+
+	// Command line options
+	struct Options
+	{
+		// --bench-record [draws]: time recording of a synthetic scene with
+		// 1 to N threads instead of rendering, then exit.
+		bool benchRecord = false;
+		std::size_t benchDraws = cfg::kBenchDrawCount;
+
+		// --bench-cull [boxes]: time the SIMD frustum culler against the
+		// scalar reference for 100k to N random boxes, check that both
+		// agree, then exit. Does not need Vulkan.
+		bool benchCull = false;
+		std::size_t benchCullBoxes = cfg::kBenchCullBoxes;
+
+		// --bench-sort [draws]: time the render queue's radix sort against
+		// std::stable_sort() for 10k to N random draws, check that both
+		// agree, and count the binds with and without sorting, then exit.
+		// Does not need Vulkan.
+		bool benchSort = false;
+		std::size_t benchSortDraws = cfg::kBenchSortDraws;
+
+		// --sort-draws: issue the G-buffer draws sorted by state key
+		// (material, then front to back; see render_queue.hpp) instead of
+		// in file order. Not used with --gpu-culling.
+		bool sortDraws = false;
+
+		// --headless [frames]: render a fixed number of frames to offscreen
+		// images without creating a window, then exit.
+		// --output <dir>: write the headless frames to <dir> as PNGs.
+		bool headless = false;
+		std::uint64_t headlessFrames = cfg::kHeadlessFrames;
+		char const* outputDir = nullptr;
+
+		// --trace <file>: on exit, write the GPU timestamps and CPU zones as
+		// a Chrome trace (JSON). --trace-csv <file>: the same as CSV. CPU
+		// zones are only recorded if LUT_CPU_PROFILING is enabled (by
+		// default in debug builds).
+		char const* tracePath = nullptr;
+		char const* traceCsvPath = nullptr;
+
+		// --replay <file>: drive the camera and lights from a camera path
+		// (see camera_path.hpp) with its fixed time step, render the path's
+		// frames and report frame-time statistics as JSON, to stdout or to
+		// --report <file>. Combine with --headless to avoid being limited
+		// by the display's refresh rate.
+		// --record-path <file>: record the camera and lights to a path.
+		char const* replayPath = nullptr;
+		char const* reportPath = nullptr;
+		char const* recordPath = nullptr;
+
+		// --gbuffer classic|compact: G-buffer layout (see gbuffer.hpp)
+		// --merge-passes: render the G-buffer and lighting passes as two
+		// subpasses of one render pass, with a transient G-buffer.
+		GBufferLayout gbufferLayout = GBufferLayout::classic;
+		bool mergePasses = false;
+
+		// --lights <count>: replace the scene's four lights with a stress
+		// scene of animated point lights, shaded with clustered lighting
+		// (see clusters.hpp).
+		// --check-clusters: test the CPU reference of the light clustering
+		// against brute force, then exit. Does not need Vulkan.
+		std::uint32_t pointLights = 0;
+		bool checkClusters = false;
+
+		// --compute-lighting: run the lighting pass as a compute shader over
+		// screen tiles, instead of drawing a fullscreen triangle. With
+		// --lights, each tile culls the point lights itself (in place of
+		// the clusters). Not compatible with --merge-passes.
+		bool computeLighting = false;
+
+		// --light-volumes: draw each point light of --lights as a sphere
+		// with additive blending, limited by the stencil to the pixels
+		// within the light's radius, instead of the fullscreen lighting pass.
+		// Not compatible with --merge-passes or --compute-lighting.
+		bool lightVolumes = false;
+
+		// --dynamic-resolution [ms]: render the G-buffer and the lighting at
+		// a reduced resolution, scaled up to the target image, and adjust
+		// the scale to hold a GPU frame time of ms (see
+		// dynamic_resolution.hpp). Not compatible with --merge-passes.
+		bool dynamicResolution = false;
+		float targetGpuMs = cfg::kDefaultTargetGpuMs;
+
+		// --gpu-culling: cull the meshes on the GPU, against the view frustum
+		// and their normal cones, and draw the G-buffer with a single
+		// indirect draw (see cull_draws.comp). Replaces the CPU frustum
+		// culling, so the recorded commands no longer depend on the view.
+		bool gpuCulling = false;
+
+		// --occlusion-culling: with --gpu-culling, also cull the meshes that
+		// are hidden behind others, against a Hi-Z pyramid of the G-buffer's
+		// depth (two phases, see cull_draws.glsl). Not compatible with
+		// --merge-passes or --light-volumes.
+		bool occlusionCulling = false;
+
+		// --instances <count>: place count copies of the model on a grid
+		// (see instances.hpp), and draw each mesh with one instanced draw
+		// for all copies. The meshes are not culled. Not compatible with
+		// --gpu-culling.
+		// --draw-per-instance: with --instances, issue one draw per copy
+		// and mesh instead, from the same buffers, for comparison.
+		std::uint32_t instances = 0;
+		bool drawPerInstance = false;
+
+		// --depth-prepass: draw the meshes' positions into the G-buffer's
+		// depth first, such that the G-buffer pass only writes the visible
+		// fragments (no overdraw). Not compatible with --merge-passes,
+		// --gpu-culling or --instances.
+		bool depthPrepass = false;
+
+		// --pipeline-cache <file>: load the pipeline cache from file at
+		// startup, and save it there on exit (default: see cfg). With a warm
+		// cache, the driver skips compiling the pipelines.
+		// --no-pipeline-cache: always create the pipelines from scratch.
+		char const* pipelineCachePath = cfg::kPipelineCachePath;
+
+		// --serial-pipelines: compile the pipelines one after another on
+		// the main thread, before the rest of the setup, instead of on the
+		// worker threads (see lut::PipelineBuilder). For comparison.
+		bool serialPipelines = false;
+
+		// --brdf microfacet|lambert: BRDF of the lights in the lighting pass
+		// --no-emissive, --no-ambient: leave out the emissive or ambient
+		// term. These select the shader variant (see ShadingVariant).
+		BrdfModel brdf = BrdfModel::microfacet;
+		bool emissive = true;
+		bool ambient = true;
+	};
+
+	// The images that the final pass renders to: the swapchain images, or
+	// offscreen images when running headless.
+	struct RenderTarget
+	{
+		VkFormat format;
+		VkExtent2D extent;
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+
+		// Layout that the final pass leaves the images in
+		VkImageLayout finalLayout;
+	};
+
+	RenderTarget make_render_target(lut::VulkanWindow const&);
+	RenderTarget make_render_target(lut::OffscreenTarget const&);
+
 	namespace deferred
 	{
 		// Compiled shader code for the graphics pipeline(s)
@@ -77,14 +365,89 @@ namespace
 
 		constexpr char const* kVertShaderPath = SHADERDIR_ "MRT.vert.spv";
 		constexpr char const* kFragShaderPath = SHADERDIR_ "MRT.frag.spv";
+
+		// Variants for the compact G-buffer layout
+		constexpr char const* kCompactPostFragPath = SHADERDIR_ "deferred_compact.frag.spv";
+		constexpr char const* kCompactFragShaderPath = SHADERDIR_ "MRT_compact.frag.spv";
+
+		// Variants of the lighting pass that read input attachments
+		constexpr char const* kSubpassPostFragPath = SHADERDIR_ "deferred_subpass.frag.spv";
+		constexpr char const* kCompactSubpassPostFragPath = SHADERDIR_ "deferred_compact_subpass.frag.spv";
+
+		// Clustered lighting: light assignment and lighting pass variants
+		constexpr char const* kClusterCompPath = SHADERDIR_ "cluster_lights.comp.spv";
+		constexpr char const* kClusteredPostFragPath = SHADERDIR_ "deferred_clustered.frag.spv";
+		constexpr char const* kCompactClusteredPostFragPath = SHADERDIR_ "deferred_compact_clustered.frag.spv";
+		constexpr char const* kSubpassClusteredPostFragPath = SHADERDIR_ "deferred_subpass_clustered.frag.spv";
+		constexpr char const* kCompactSubpassClusteredPostFragPath = SHADERDIR_ "deferred_compact_subpass_clustered.frag.spv";
+
+		// Compute lighting pass variants, without and with tiled point lights
+		constexpr char const* kTiledCompPath = SHADERDIR_ "deferred_tiled.comp.spv";
+		constexpr char const* kCompactTiledCompPath = SHADERDIR_ "deferred_tiled_compact.comp.spv";
+		constexpr char const* kTiledLightsCompPath = SHADERDIR_ "deferred_tiled_lights.comp.spv";
+		constexpr char const* kCompactTiledLightsCompPath = SHADERDIR_ "deferred_tiled_compact_lights.comp.spv";
+
+		// Light volumes: the ambient (fullscreen) pass, and the light volumes
+		// themselves. The stencil pass only has the vertex shader.
+		constexpr char const* kAmbientPostFragPath = SHADERDIR_ "deferred_ambient.frag.spv";
+		constexpr char const* kCompactAmbientPostFragPath = SHADERDIR_ "deferred_compact_ambient.frag.spv";
+		constexpr char const* kVolumeVertPath = SHADERDIR_ "deferred_volume.vert.spv";
+		constexpr char const* kVolumeFragPath = SHADERDIR_ "deferred_volume.frag.spv";
+		constexpr char const* kCompactVolumeFragPath = SHADERDIR_ "deferred_compact_volume.frag.spv";
+
+		// GPU-driven draws: the culling, and the G-buffer pass variants that
+		// draw from the merged vertex buffers
+		constexpr char const* kDrawCullCompPath = SHADERDIR_ "cull_draws.comp.spv";
+		constexpr char const* kIndirectVertShaderPath = SHADERDIR_ "MRT_indirect.vert.spv";
+		constexpr char const* kIndirectFragShaderPath = SHADERDIR_ "MRT_indirect.frag.spv";
+		constexpr char const* kCompactIndirectFragShaderPath = SHADERDIR_ "MRT_compact_indirect.frag.spv";
+
+		// Occlusion culling: the two-phase draw culling, and the Hi-Z build
+		constexpr char const* kDrawCullOcclusionCompPath = SHADERDIR_ "cull_draws_occlusion.comp.spv";
+		constexpr char const* kHiZBuildCompPath = SHADERDIR_ "hiz_build.comp.spv";
+
+		// Instanced draws: the vertex shader applies the instance transforms.
+		// The fragment shaders are those of the GPU-driven draws.
+		constexpr char const* kInstancedVertShaderPath = SHADERDIR_ "MRT_instanced.vert.spv";
+
+		// Depth pre-pass (vertex shader only)
+		constexpr char const* kDepthPrepassVertPath = SHADERDIR_ "depth_prepass.vert.spv";
 #	undef SHADERDIR_
 
+		// Depth buffer of the second pass. The G-buffer formats are defined
+		// by its layout (see make_gbuffer_desc()).
 		constexpr VkFormat kDepthFormat = VK_FORMAT_D32_SFLOAT;
-		constexpr VkFormat kPositionFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-		constexpr VkFormat kNormalFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-		constexpr VkFormat kEmissiveFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-		constexpr VkFormat kAlbedoFormat = VK_FORMAT_R8G8B8A8_SRGB;
-		constexpr VkFormat kDepthViewFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+		// The compute lighting pass shades tiles of kLightingTileSize^2
+		// pixels (TILE_SIZE in deferred_tiled.glsl) into an image with
+		// kLightingFormat, which is then blitted to the target image.
+		constexpr std::uint32_t kLightingTileSize = 16;
+		constexpr VkFormat kLightingFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+		// Stencil of the light volumes. The G-buffer pass sets
+		// kGeometryStencilBit where it draws; the remaining bits count the
+		// light volume's faces behind the surface (see
+		// light_volume_pipeline_descs()).
+		constexpr std::uint32_t kGeometryStencilBit = 0x80;
+		constexpr std::uint32_t kVolumeStencilMask = 0x7f;
+
+		// Draws per workgroup of the draw culling (DRAW_CULL_GROUP_SIZE in
+		// cull_draws.glsl)
+		constexpr std::uint32_t kDrawCullGroupSize = 64;
+
+		// Counters of the draw culling (Count in cull_draws.glsl): the
+		// draws of the early and late phase, the draws tested against the
+		// Hi-Z pyramid and the occluded ones
+		constexpr std::uint32_t kDrawCounterCount = 4;
+
+		// Hi-Z pyramid: each workgroup of the build reduces a tile of
+		// kHiZTileSize^2 texels of level 0 (HIZ_TILE in hiz_build.comp).
+		// Level 0 is at most kMaxHiZExtent wide and high, so there are at
+		// most kMaxHiZLevels levels (HIZ_MAX_LEVELS).
+		constexpr std::uint32_t kHiZTileSize = 32;
+		constexpr std::uint32_t kMaxHiZExtent = 4096;
+		constexpr std::uint32_t kMaxHiZLevels = 13;
+		constexpr VkFormat kHiZFormat = VK_FORMAT_R32_SFLOAT;
 	}
 
 	// Local types/structures:
@@ -136,6 +499,9 @@ namespace
 			glm::vec4 colour;
 		};
 
+		// Size of UScene.light, and the largest LIGHT_COUNT variant
+		constexpr std::uint32_t kSceneLightCount = 4;
+
 		struct SceneUniform
 		{
 			glm::mat4 camera;
@@ -143,14 +509,26 @@ namespace
 			glm::mat4 projCam;
 			glm::mat4 viewInv;
 			glm::mat4 projectionInv;
-			Light lights[4];
+			Light lights[kSceneLightCount];
 			alignas(16)	glm::vec3 camPos;
 			int constant;
+
+			// Part of the G-buffer that is rendered (see dynamic_resolution.hpp)
+			glm::uvec2 renderExtent;
 		};
 
 		static_assert(sizeof(SceneUniform) <= 65536, "SceneUniform must be less than 65536 bytes for vkCmdUpdateBuffer");
 		static_assert(sizeof(SceneUniform) % 4 == 0, "SceneUniform size must be a multiple of 4 bytes");
 
+		// Push constants of the clustered lighting (ClusterParams in
+		// clusters.glsl)
+		struct ClusterParams
+		{
+			float near;
+			float far;
+			std::uint32_t lightCount;
+		};
+
 		struct PBRuniform
 		{
 			// Note: must map to the std140 uniform interface in the fragment
@@ -160,14 +538,221 @@ namespace
 			float shininess;
 			float metalness;
 		};
+
+		// GPU-driven draws: one record per mesh (DrawRecord in
+		// cull_draws.comp), and the materials (Material in gbuffer_main.glsl,
+		// the same as PBRuniform, but in a std430 array).
+		struct DrawRecord
+		{
+			glm::vec4 sphere;
+			glm::vec4 cone;
+			std::uint32_t firstVertex;
+			std::uint32_t vertexCount;
+			std::uint32_t material;
+			std::uint32_t pad;
+		};
+
+		struct alignas(16) GpuMaterial
+		{
+			glm::vec4 emissive;
+			glm::vec4 albedo;
+			float shininess;
+			float metalness;
+		};
+
+		static_assert(sizeof(DrawRecord) == 48, "DrawRecord must match the std430 layout in cull_draws.comp");
+		static_assert(sizeof(GpuMaterial) == 48, "GpuMaterial must match the std430 array stride in gbuffer_main.glsl");
+
+		// Push constants of the draw culling (UCull in cull_draws.glsl). The
+		// phase and the Hi-Z pyramid's size are only used by the occlusion
+		// culling.
+		struct DrawCullParams
+		{
+			std::uint32_t drawCount;
+			std::uint32_t compact;
+			std::uint32_t phase;
+			std::uint32_t hizLevels;
+			glm::uvec2 hizExtent;
+		};
+
+		// Push constants of the Hi-Z build (UHiZ in hiz_build.comp)
+		struct HiZParams
+		{
+			glm::uvec2 depthExtent;
+			glm::uvec2 hizExtent;
+			std::uint32_t levels;
+		};
+
+		// Push constants of the instanced draws (UMesh in
+		// MRT_instanced.vert): the material of the copies that do not
+		// override it
+		struct InstancedMeshParams
+		{
+			std::uint32_t material;
+		};
 	}
 
+	// Clustered lighting, as recorded by record_commands(). Disabled if pipe
+	// is VK_NULL_HANDLE.
+	struct ClusterPass
+	{
+		VkPipeline pipe = VK_NULL_HANDLE;
+		VkDescriptorSet descriptors = VK_NULL_HANDLE;
+		VkBuffer clusters = VK_NULL_HANDLE;
+		glsl::ClusterParams params{};
+	};
+
+	// Lighting into an intermediate image, as recorded by record_commands().
+	// The lighting pass renders the image's top-left render extent, which
+	// is then blitted (and possibly scaled up) to target, which is left in
+	// targetLayout. Used by the compute lighting pass and by dynamic
+	// resolution. Disabled if image is VK_NULL_HANDLE.
+	struct LightingBlit
+	{
+		VkImage image = VK_NULL_HANDLE;
+
+		VkImage target = VK_NULL_HANDLE;
+		VkImageLayout targetLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	// Compute lighting pass (--compute-lighting), as recorded by
+	// record_commands(). The lighting pipeline is then a compute pipeline,
+	// which writes the lighting image (through the output descriptors); it
+	// requires a LightingBlit. Disabled if output is VK_NULL_HANDLE.
+	struct ComputeLighting
+	{
+		VkDescriptorSet output = VK_NULL_HANDLE;
+
+		// Point lights (set 2), or VK_NULL_HANDLE
+		VkDescriptorSet lights = VK_NULL_HANDLE;
+		glsl::ClusterParams params{};
+	};
+
+	// Light volumes (--light-volumes), as recorded by record_commands(). The
+	// lighting pipeline then only adds the ambient and emissive terms, and
+	// each light is drawn as an instance of the volume mesh: first into the
+	// stencil (stencilPipe), then shaded (lightPipe). Disabled if stencilPipe
+	// is VK_NULL_HANDLE.
+	struct LightVolumes
+	{
+		VkPipeline stencilPipe = VK_NULL_HANDLE;
+		VkPipeline lightPipe = VK_NULL_HANDLE;
+
+		VkBuffer vertices = VK_NULL_HANDLE;
+		VkBuffer indices = VK_NULL_HANDLE;
+		std::uint32_t indexCount = 0;
+
+		// Point lights (set 2)
+		VkDescriptorSet lights = VK_NULL_HANDLE;
+		std::uint32_t lightCount = 0;
+	};
+
+	// Depth pre-pass (--depth-prepass), as recorded by record_commands(). The
+	// draws of the G-buffer pass are first drawn with pipe, which only
+	// writes the G-buffer's depth (through framebuffer). Disabled if pass is
+	// VK_NULL_HANDLE.
+	struct DepthPrepass
+	{
+		VkRenderPass pass = VK_NULL_HANDLE;
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		VkPipeline pipe = VK_NULL_HANDLE;
+	};
+
+	// GPU-driven draws (--gpu-culling), as recorded by record_commands(). The
+	// culling pass fills the frame's indirect commands, and the G-buffer
+	// pass draws them with gbufferPipe, from one pair of vertex buffers for
+	// all meshes. With params.compact, the draws are compacted and their
+	// number is read from count (vkCmdDrawIndirectCount()); otherwise, all
+	// params.drawCount draws are issued, and culled ones have no instances.
+	// Disabled if cullPipe is VK_NULL_HANDLE.
+	struct GpuDrivenDraws
+	{
+		VkPipeline cullPipe = VK_NULL_HANDLE;
+		VkPipelineLayout cullLayout = VK_NULL_HANDLE;
+		VkDescriptorSet cullDescriptors = VK_NULL_HANDLE;
+		glsl::DrawCullParams params{};
+
+		VkBuffer commands = VK_NULL_HANDLE;
+		VkBuffer count = VK_NULL_HANDLE;
+
+		VkPipeline gbufferPipe = VK_NULL_HANDLE;
+		VkPipelineLayout gbufferLayout = VK_NULL_HANDLE;
+		VkDescriptorSet materials = VK_NULL_HANDLE;
+		VkBuffer positions = VK_NULL_HANDLE;
+		VkBuffer normals = VK_NULL_HANDLE;
+
+		// Without multiDrawIndirect, each indirect draw is issued separately
+		bool multiDraw = false;
+
+		// Occlusion culling (--occlusion-culling): the culling runs in two
+		// phases, each with its own list of commands. The early phase's
+		// draws are rendered with the first render pass, then hizPipe
+		// builds the Hi-Z pyramid from their depth, and the late phase's
+		// draws are added with latePass (which loads the G-buffer).
+		// Disabled if hizPipe is VK_NULL_HANDLE.
+		VkPipeline hizPipe = VK_NULL_HANDLE;
+		VkPipelineLayout hizLayout = VK_NULL_HANDLE;
+		VkDescriptorSet hizDescriptors = VK_NULL_HANDLE;
+		VkImage hizImage = VK_NULL_HANDLE;
+		VkBuffer hizCounter = VK_NULL_HANDLE;
+		VkBuffer visibility = VK_NULL_HANDLE;
+		VkRenderPass latePass = VK_NULL_HANDLE;
+	};
+
+	// Instanced draws (--instances), as recorded by record_commands(). The
+	// G-buffer pass draws each mesh of the model once for all instanceCount
+	// copies, from one pair of vertex buffers for all meshes and the
+	// per-instance data (InstanceData) in instances. With perInstance, each
+	// copy of each mesh is drawn separately instead. Disabled if pipe is
+	// VK_NULL_HANDLE.
+	struct InstancedDraws
+	{
+		VkPipeline pipe = VK_NULL_HANDLE;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkDescriptorSet materials = VK_NULL_HANDLE;
+
+		VkBuffer positions = VK_NULL_HANDLE;
+		VkBuffer normals = VK_NULL_HANDLE;
+		VkBuffer instances = VK_NULL_HANDLE;
+		std::uint32_t instanceCount = 0;
+
+		bool perInstance = false;
+	};
+
+	// Hi-Z pyramid of the occlusion culling (R32_SFLOAT, see
+	// hiz_build.comp), in VK_IMAGE_LAYOUT_GENERAL. The culling samples
+	// view; the build writes each level through levelViews.
+	struct HiZPyramid
+	{
+		lut::Image image;
+		lut::ImageView view;
+		std::vector<lut::ImageView> levelViews;
+
+		VkExtent2D extent{};
+		std::uint32_t levels = 0;
+	};
+
 	///-----------------------------------------------------------------------
 	/// Load Obj files
 	///-----------------------------------------------------------------------
 	ModelData newShip = load_obj_model(cfg::kNewShipPath);
 
 	// Local functions:
+	Options parse_options(int aArgc, char** aArgv);
+
+	// Bounding box of all vertices of a model
+	std::tuple<glm::vec3, glm::vec3> compute_model_bounds(ModelData const&);
+
+	// Print the rolling per-scope GPU timings
+	void print_gpu_stats(lut::GpuProfiler const&);
+
+	// Write the trace files requested by --trace and --trace-csv. The GPU
+	// must be idle.
+	void write_traces(Options const&, lut::GpuTimeline&, lut::GpuProfiler&);
+
+	// Write the frame-time statistics of a replay as JSON
+	void write_replay_report(Options const&, CameraPath const&, VkExtent2D const&, std::vector<float> const& aFrameMs, lut::GpuProfiler const&, ResolutionController const&);
+
 	// GLFW callbacks
 	void glfw_callback_key_press(GLFWwindow*, int, int, int, int);
 
@@ -175,32 +760,142 @@ namespace
 
 	void glfw_callback_mouse_button(GLFWwindow* window, int, int, int);
 	//Deferred Helpers
-	lut::RenderPass create_deferred_first_pass(lut::VulkanWindow const&);
-	lut::RenderPass create_deferred_second_pass(lut::VulkanWindow const&);
+	// With aLoad, the pass continues where a previous G-buffer pass left the
+	// images, instead of clearing them (the late pass of the occlusion
+	// culling).
+	lut::RenderPass create_deferred_first_pass(lut::VulkanContext const&, GBufferDesc const&, bool aLoad = false);
+	// With a G-buffer stencil (light volumes), the lighting pass uses the
+	// G-buffer's depth/stencil buffer instead of its own depth buffer.
+	lut::RenderPass create_deferred_second_pass(lut::VulkanContext const&, RenderTarget const&, GBufferDesc const&);
+
+	// Depth pre-pass: a render pass with the G-buffer's depth as its only
+	// attachment, which is left for the G-buffer pass to load (see
+	// GBufferDesc::depthPrepass). Its framebuffer, and its pipeline, which
+	// only has a vertex shader. The pipeline uses the G-buffer pass' layout.
+	lut::RenderPass create_depth_prepass(lut::VulkanContext const&, GBufferDesc const&);
+	void create_depth_prepass_framebuffer(lut::VulkanContext const&, VkExtent2D const&, VkRenderPass, lut::Framebuffer&, GBuffer const&);
+	lut::PipelineDesc depth_prepass_pipeline_desc(VkRenderPass, VkPipelineLayout, GBufferDesc const&);
+
+	// Both passes as subpasses of a single render pass, for a transient
+	// G-buffer. The lighting pipeline uses subpass 1.
+	lut::RenderPass create_deferred_merged_pass(lut::VulkanContext const&, GBufferDesc const&, RenderTarget const&);
 
 	lut::PipelineLayout create_deferred_first_layout(lut::VulkanContext const&, VkDescriptorSetLayout, VkDescriptorSetLayout);
-	lut::PipelineLayout create_deferred_second_layout(lut::VulkanContext const&, VkDescriptorSetLayout, VkDescriptorSetLayout);
-
-	lut::Pipeline create_deferred_first_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-	lut::Pipeline create_deferred_second_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-
-	lut::DescriptorSetLayout create_deferred_descriptor_layout(lut::VulkanWindow const& aWindow);
-
-	void create_deferred_framebuffers(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, lut::Framebuffer& aFramebuffers, VkImageView aPosView, VkImageView aNormView, VkImageView aEmissiveView, VkImageView aAlbedoView, VkImageView aDepthView);
+	// With clustered lighting (aClusterLayout not VK_NULL_HANDLE), the layout
+	// has a third set and the cluster push constants. The light assignment
+	// compute pipeline uses the same layout. The compute lighting pass adds
+	// its output image as the fourth set (aOutputLayout), which requires
+	// aClusterLayout.
+	lut::PipelineLayout create_deferred_second_layout(lut::VulkanContext const&, VkDescriptorSetLayout, VkDescriptorSetLayout, VkDescriptorSetLayout aClusterLayout = VK_NULL_HANDLE, VkDescriptorSetLayout aOutputLayout = VK_NULL_HANDLE);
+
+	// With aMaterialBuffer, the pipeline draws the GPU-driven draws: set 1
+	// holds all materials (see create_material_buffer_layout()). With
+	// aInstanced as well, it draws the instanced draws, which add the
+	// per-instance data as vertex binding 2 (see MRT_instanced.vert).
+	//
+	// The pipelines are described by *_pipeline_desc(), and built (once per
+	// distinct description) by the lut::PipelineRegistry.
+	lut::PipelineDesc deferred_first_pipeline_desc(VkRenderPass, VkPipelineLayout, GBufferDesc const&, bool aMaterialBuffer = false, bool aInstanced = false);
+	lut::PipelineDesc deferred_second_pipeline_desc(VkRenderPass, VkPipelineLayout, GBufferDesc const&, bool aClustered);
+
+	// Values of the lighting shaders' specialization constants for a variant
+	// (lut::PipelineDesc::specialization)
+	std::vector<std::uint32_t> specialization_constants(ShadingVariant const&);
+
+	// Light volumes: with a G-buffer stencil, the lighting pipeline is the
+	// ambient pass. The stencil and light pipelines use the same layout,
+	// with the point lights in set 2.
+	std::tuple<lut::PipelineDesc, lut::PipelineDesc> light_volume_pipeline_descs(VkRenderPass, VkPipelineLayout, GBufferDesc const&);
+	std::tuple<lut::Buffer, lut::Buffer> create_light_volume_buffers(lut::VulkanContext const&, lut::Allocator const&, lut::GpuTimeline&, lut::DeletionQueue&, LightVolumeMesh const&);
+
+	// Clustered lighting: the light and cluster buffers (set 2), and the
+	// light assignment compute pipeline
+	// GPU-driven draws (--gpu-culling): the materials of the G-buffer pass
+	// (set 1), and the draw records, indirect commands and counter of the
+	// culling pass (set 1, after the scene)
+	lut::DescriptorSetLayout create_material_buffer_layout(lut::VulkanContext const&);
+	// With aOcclusion, the culling set also holds the visibility and the
+	// Hi-Z pyramid.
+	lut::DescriptorSetLayout create_draw_cull_descriptor_layout(lut::VulkanContext const&, bool aOcclusion);
+	lut::PipelineLayout create_draw_cull_layout(lut::VulkanContext const&, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aCullLayout);
+	lut::PipelineDesc draw_cull_pipeline_desc(VkPipelineLayout, bool aOcclusion);
+
+	// Instanced draws: the scene and the material buffer, with the mesh's
+	// material as push constant (glsl::InstancedMeshParams)
+	lut::PipelineLayout create_instanced_gbuffer_layout(lut::VulkanContext const&, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aMaterialLayout);
+
+	// Occlusion culling: the Hi-Z pyramid for a render target of aExtent, and
+	// the build's descriptors (depth, levels and counter), layout and
+	// pipeline. hiz_extent() is the size of level 0 when rendering
+	// aRenderExtent pixels, hiz_levels() its number of levels.
+	VkExtent2D hiz_extent(VkExtent2D const& aRenderExtent);
+	std::uint32_t hiz_levels(VkExtent2D const& aHiZExtent);
+
+	HiZPyramid create_hiz_pyramid(lut::VulkanContext const&, lut::Allocator const&, VkExtent2D const& aExtent);
+	lut::DescriptorSetLayout create_hiz_descriptor_layout(lut::VulkanContext const&);
+	lut::PipelineLayout create_hiz_layout(lut::VulkanContext const&, VkDescriptorSetLayout);
+	lut::PipelineDesc hiz_pipeline_desc(VkPipelineLayout);
+
+	// Point the Hi-Z build's descriptors at the G-buffer's depth and at the
+	// pyramid, and the culling's (binding 4) at the pyramid
+	void update_hiz_descriptors(lut::VulkanContext const&, VkDescriptorSet aHiZDescriptors, std::vector<VkDescriptorSet> const& aCullDescriptors, VkSampler, GBuffer const&, HiZPyramid const&, VkBuffer aCounter);
+
+	// Static device-local buffer with the contents aData, uploaded through a
+	// staging buffer. The upload is submitted on aTimeline and made visible
+	// to aDstAccess in aDstStage.
+	lut::Buffer create_static_buffer(lut::VulkanContext const&, lut::Allocator const&, lut::GpuTimeline&, lut::DeletionQueue&, void const* aData, VkDeviceSize aSize, VkBufferUsageFlags, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage);
+
+	lut::DescriptorSetLayout create_cluster_descriptor_layout(lut::VulkanContext const&);
+	lut::PipelineDesc cluster_pipeline_desc(VkPipelineLayout);
+
+	// Compute lighting pass: the output image (set 3), the image itself and
+	// the compute pipeline. The image is created for aTarget's extent, and
+	// must be blitted to aTarget's format. Dynamic resolution renders the
+	// lighting pass into the same image.
+	lut::DescriptorSetLayout create_lighting_output_layout(lut::VulkanContext const&);
+	std::tuple<lut::Image, lut::ImageView> create_lighting_image(lut::VulkanContext const&, lut::Allocator const&, RenderTarget const& aTarget);
+	void update_lighting_output_descriptors(lut::VulkanContext const&, VkDescriptorSet, VkImageView);
+	lut::PipelineDesc compute_lighting_pipeline_desc(VkPipelineLayout, GBufferDesc const&, bool aTiledLights);
+
+	// The G-buffer set of the lighting pass (set 1), reflected from the
+	// lighting shaders of the G-buffer layout
+	VkDescriptorSetLayout deferred_set_layout(lut::DescriptorLayoutCache&, GBufferDesc const&);
+
+	// Point the lighting pass' descriptors at the G-buffer images
+	void update_deferred_descriptors(lut::VulkanContext const&, VkDescriptorSet, VkSampler, GBuffer const&, GBufferDesc const&);
+
+	void create_deferred_framebuffers(lut::VulkanContext const&, VkExtent2D const&, VkRenderPass aRenderPass, lut::Framebuffer& aFramebuffers, GBuffer const&);
 
 	// Helpers:
-	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const&);
-	lut::DescriptorSetLayout create_advanced_descriptor_layout(lut::VulkanWindow const&);
+	// The scene set (set 0 of all passes) and the material set of the
+	// G-buffer pass (set 1), reflected from the shaders that use them
+	VkDescriptorSetLayout scene_set_layout(lut::DescriptorLayoutCache&);
+	VkDescriptorSetLayout advanced_set_layout(lut::DescriptorLayoutCache&);
+
+	// Check the structs in glsl:: that are copied to uniform buffers or push
+	// constants against the shaders' blocks; throws lut::Error on the first
+	// mismatch
+	void check_shader_interfaces();
 	
-	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanWindow const&, lut::Allocator const&);
+	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanContext const&, lut::Allocator const&, VkExtent2D const&);
 
 	void create_swapchain_framebuffers(
-		lut::VulkanWindow const&,
+		lut::VulkanContext const&,
+		RenderTarget const&,
 		VkRenderPass,
 		std::vector<lut::Framebuffer>&,
 		VkImageView aDepthView
 	);
 
+	// One framebuffer per target image for the merged render pass
+	void create_merged_framebuffers(
+		lut::VulkanContext const&,
+		RenderTarget const&,
+		VkRenderPass,
+		std::vector<lut::Framebuffer>&,
+		GBuffer const&
+	);
+
 
 	void update_scene_uniforms(
 		Camera& camera,
@@ -210,35 +905,149 @@ namespace
 	);
 
 
-	void record_commands(
+	void upload_material_uniforms(
+		lut::VulkanContext const&,
+		lut::GpuTimeline&,
+		lut::DeletionQueue&,
+		std::vector<lut::Buffer>&,
+		lut::GpuProfiler* aProfiler = nullptr,
+		std::uint32_t aProfilerSlot = 0
+	);
+
+	// Record the full frame. The G-buffer draws are taken from aDrawList
+	// (indices into aColourMesh). If aWorkers is non-null, the draws are
+	// recorded in parallel into aSecondaries (see record_gbuffer_secondaries).
+	// If aProfiler is non-null, each render pass is timed in aProfilerSlot.
+	// With clustered lighting, the light assignment is dispatched first.
+	// With compute lighting, aPostPipe is a compute pipeline, and the second
+	// render pass and the target's framebuffer are unused. With light
+	// volumes, aPostPipe is the ambient pass, followed by the volumes.
+	// With a transient G-buffer, the first render pass is the merged pass,
+	// the first framebuffer is the target's and the second pass is unused.
+	// With GPU-driven draws, the culling is dispatched before the G-buffer
+	// pass, which then ignores aDrawList and aWorkers. With occlusion
+	// culling, the Hi-Z build, the late culling and the late G-buffer pass
+	// (into the same framebuffer) follow the first G-buffer pass. Instanced
+	// draws also ignore aDrawList and aWorkers. With a depth pre-pass, the
+	// draws from aDrawList are recorded into it first, on this thread.
+	// Returns the binds of the G-buffer draws from aDrawList or of the
+	// instanced draws (none with GPU-driven draws).
+	BindCounts record_commands(
 		VkCommandBuffer,
+		VkCommandBufferUsageFlags,
 		VkRenderPass,
 		VkRenderPass,
 		VkFramebuffer,
 		VkFramebuffer,
 		VkPipeline,
 		VkPipeline,
-		VkExtent2D const&,
+		VkExtent2D const& aImageExtent,
+		VkExtent2D const& aRenderExtent,
+		GBufferDesc const&,
 		//--------------------------------------
-		ColourMesh&,
-
-		VkBuffer aSceneUBO,
-		std::vector<lut::Buffer>&,
-
-		glsl::SceneUniform const&,
+		ColourMesh const&,
+		std::vector<std::uint32_t> const& aDrawList,
 
 		VkPipelineLayout,
 		VkPipelineLayout,
 		VkDescriptorSet aSceneDescriptors,
 		VkDescriptorSet aImageDescriptors,
-		std::vector<VkDescriptorSet> aPBRDescriptors
+		std::vector<VkDescriptorSet> const& aPBRDescriptors,
+		ClusterPass const&,
+		LightingBlit const&,
+		ComputeLighting const&,
+		LightVolumes const&,
+		GpuDrivenDraws const&,
+		InstancedDraws const&,
+		DepthPrepass const&,
 		//--------------------------------------
+		lut::ThreadPool* aWorkers = nullptr,
+		std::vector<VkCommandBuffer> const& aSecondaries = {},
+		lut::GpuProfiler* aProfiler = nullptr,
+		std::uint32_t aProfilerSlot = 0
+	);
+
+	// Set the dynamic viewport and scissor of the deferred pipelines to the
+	// top-left aRenderExtent pixels of the attachments
+	void set_render_viewport(VkCommandBuffer, VkExtent2D const& aRenderExtent);
+
+	// Record the draws aDrawList[aFirst..aLast) of the G-buffer pass. This
+	// binds all state that the draws need, so it can be used both inline
+	// and in a secondary command buffer (which does not inherit any state).
+	// A material is only bound when it differs from the previous draw's,
+	// so draws that are sorted by material (--sort-draws) need fewer binds.
+	BindCounts record_gbuffer_draws(
+		VkCommandBuffer,
+		VkPipeline,
+		VkPipelineLayout,
+		VkExtent2D const& aRenderExtent,
+		VkDescriptorSet aSceneDescriptors,
+		ColourMesh const&,
+		std::vector<VkDescriptorSet> const& aPBRDescriptors,
+		std::vector<std::uint32_t> const& aDrawList,
+		std::size_t aFirst,
+		std::size_t aLast
+	);
+
+	// Record the GPU-driven draws of the G-buffer pass: one indirect draw of
+	// the commands that the culling pass wrote. aList selects the early (0)
+	// or late (1) commands of the occlusion culling.
+	void record_gbuffer_indirect(VkCommandBuffer, GpuDrivenDraws const&, VkExtent2D const& aRenderExtent, VkDescriptorSet aSceneDescriptors, std::uint32_t aList = 0);
+
+	// Record the draws aDrawList of the depth pre-pass. Only the positions
+	// are bound.
+	void record_depth_prepass(VkCommandBuffer, VkPipeline, VkPipelineLayout, VkExtent2D const& aRenderExtent, VkDescriptorSet aSceneDescriptors, ColourMesh const&, std::vector<std::uint32_t> const& aDrawList);
+
+	// Record the instanced draws of the G-buffer pass: one draw per mesh,
+	// or one per mesh and copy with aDraws.perInstance
+	BindCounts record_gbuffer_instanced(VkCommandBuffer, InstancedDraws const&, VkExtent2D const& aRenderExtent, VkDescriptorSet aSceneDescriptors);
+
+	// Record the draw culling (aPhase: see DrawCullParams), followed by the
+	// barriers for the indirect draws
+	void record_draw_culling(VkCommandBuffer, GpuDrivenDraws const&, VkDescriptorSet aSceneDescriptors, std::uint32_t aPhase);
+
+	// Record the Hi-Z build from the G-buffer's depth, for aRenderExtent
+	void record_hiz_build(VkCommandBuffer, GpuDrivenDraws const&, VkExtent2D const& aRenderExtent);
+
+	// Split aDrawList into one chunk per worker thread and record each chunk
+	// into its own secondary command buffer, continuing subpass 0 of aPass.
+	// Returns the number of secondary command buffers (taken from the front
+	// of aSecondaries) that were recorded. The binds of all chunks are
+	// added to aBinds.
+	std::uint32_t record_gbuffer_secondaries(
+		lut::ThreadPool&,
+		std::vector<VkCommandBuffer> const& aSecondaries,
+		VkRenderPass aPass,
+		VkFramebuffer,
+		VkPipeline,
+		VkPipelineLayout,
+		VkExtent2D const& aRenderExtent,
+		VkDescriptorSet aSceneDescriptors,
+		ColourMesh const&,
+		std::vector<VkDescriptorSet> const& aPBRDescriptors,
+		std::vector<std::uint32_t> const& aDrawList,
+		BindCounts& aBinds
+	);
+
+	// Time recording of a synthetic draw list with 1 to aMaxThreads worker
+	// threads (and inline, on the calling thread, for reference). aRecord
+	// records a full frame into the given command buffer. Results are
+	// printed to stdout.
+	void run_record_benchmark(
+		lut::VulkanContext const&,
+		lut::GpuTimeline&,
+		lut::FrameContext&,
+		std::size_t aDrawCount,
+		std::size_t aMeshCount,
+		std::size_t aMaxThreads,
+		std::function<void(std::vector<std::uint32_t> const&, lut::ThreadPool*)> const& aRecord
 	);
 
-	void submit_commands(
-		lut::VulkanWindow const&,
+	// Returns the GPU timeline value that is signalled on completion
+	std::uint64_t submit_commands(
+		lut::VulkanContext const&,
+		lut::GpuTimeline&,
 		VkCommandBuffer,
-		VkFence,
 		VkSemaphore,
 		VkSemaphore
 	);
@@ -251,8 +1060,36 @@ namespace
 	);
 }
 
-int main() try
+int main(int argc, char** argv) try
 {
+	lut::cpu_profiler::set_thread_name("main");
+
+	Options const options = parse_options(argc, argv);
+
+	if (options.checkClusters)
+	{
+		auto const [sceneMin, sceneMax] = compute_model_bounds(newShip);
+		return check_light_clusters(lut::Radians(cfg::kCameraFov).value(), cfg::kCameraNear, cfg::kCameraFar, sceneMin, sceneMax) ? 0 : 1;
+	}
+
+	if (options.benchCull)
+	{
+		auto const [sceneMin, sceneMax] = compute_model_bounds(newShip);
+		return check_frustum_culling(options.benchCullBoxes, lut::Radians(cfg::kCameraFov).value(), cfg::kCameraNear, cfg::kCameraFar, sceneMin, sceneMax) ? 0 : 1;
+	}
+
+	if (options.benchSort)
+		return check_render_queue(options.benchSortDraws, cfg::kBenchSortPipelines, cfg::kBenchSortMaterials) ? 0 : 1;
+
+	// Camera path replay and recording. The path is loaded up front, such
+	// that errors are reported before any of the setup.
+	CameraPath replayPath;
+	if (options.replayPath)
+		replayPath = load_camera_path(options.replayPath);
+
+	CameraPathRecorder pathRecorder;
+	if (options.recordPath)
+		pathRecorder = CameraPathRecorder(options.recordPath);
 
 	/// <summary>
 	/// initialize the light array
@@ -271,164 +1108,351 @@ int main() try
 	sceneUniforms.lights[3].position = glm::vec4(0.f, 9.3f, +3.f, 1.f);
 	sceneUniforms.lights[3].colour = glm::vec4(0.f, 0.f, 1.0f, 1.f);
 
-	// Create Vulkan Window
-	auto window = lut::make_vulkan_window();
+	// Create Vulkan Window. When running headless, create just a Vulkan
+	// context instead; offscreen images then stand in for the swapchain.
+	lut::VulkanWindow window;
+	lut::VulkanContext headlessContext;
+
+	if (options.headless)
+		headlessContext = lut::make_vulkan_context();
+	else
+		window = lut::make_vulkan_window();
+
+	// All pipelines are created with the context's pipeline cache
+	std::size_t pipelineCacheBytes = 0;
+	if (options.pipelineCachePath)
+		pipelineCacheBytes = lut::load_pipeline_cache(options.headless ? headlessContext : static_cast<lut::VulkanContext&>(window), options.pipelineCachePath);
+
+	lut::VulkanContext const& context = options.headless ? headlessContext : static_cast<lut::VulkanContext const&>(window);
 
-	glfwSetWindowUserPointer(window.window, &sceneUniforms);
-	//Set the input Mode
-	glfwSetInputMode(window.window, GLFW_CURSOR, NULL);
+	if (!options.headless)
+	{
+		glfwSetWindowUserPointer(window.window, &sceneUniforms);
+		//Set the input Mode
+		glfwSetInputMode(window.window, GLFW_CURSOR, NULL);
 
-	// Configure the GLFW window
-	glfwSetKeyCallback(window.window, &glfw_callback_key_press);
+		// Configure the GLFW window
+		glfwSetKeyCallback(window.window, &glfw_callback_key_press);
 
-	glfwSetMouseButtonCallback(window.window, &glfw_callback_mouse_button);
+		glfwSetMouseButtonCallback(window.window, &glfw_callback_mouse_button);
 
-	glfwSetCursorPosCallback(window.window, &glfw_callback_cursor_pos);
+		glfwSetCursorPosCallback(window.window, &glfw_callback_cursor_pos);
+	}
 
 	// Create VMA allocator
-	lut::Allocator allocator = lut::create_allocator(window);
+	lut::Allocator allocator = lut::create_allocator(context);
+
+	// All submissions signal the GPU timeline. Resources that may still be
+	// in use by the GPU are released through the deletion queue.
+	lut::GpuTimeline timeline(context);
+	lut::DeletionQueue deletionQueue;
+
+	// GPU timestamps of the render passes and upload batches. Results are
+	// collected once a frame, when the GPU has finished the corresponding
+	// submissions.
+	lut::GpuProfiler gpuProfiler(context, cfg::kProfilerSlotCount);
+
+	// Images that the final pass renders to. One offscreen image per frame in
+	// flight, such that a frame never overwrites an image that is in use.
+	lut::OffscreenTarget offscreen;
+	if (options.headless)
+	{
+		// The lighting image is blitted to the target images
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		if (options.computeLighting || options.dynamicResolution)
+			usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
-	#pragma region deferred pass/pipe/pipe layout
-	lut::RenderPass deferred_first_pass = create_deferred_first_pass(window);
-	lut::RenderPass deferred_second_pass = create_deferred_second_pass(window);
+		offscreen = lut::create_offscreen_target(context, allocator, cfg::kHeadlessExtent, cfg::kHeadlessFormat, cfg::kFramesInFlight, usage);
+	}
 
-	lut::DescriptorSetLayout deferred_descriptor_layout = create_deferred_descriptor_layout(window);
-	lut::DescriptorSetLayout sceneLayout = create_scene_descriptor_layout(window);
-	lut::DescriptorSetLayout advancedLayout = create_advanced_descriptor_layout(window);
+	RenderTarget target = options.headless ? make_render_target(offscreen) : make_render_target(window);
+
+	// The light volumes use the G-buffer's depth buffer, with a stencil. The
+	// occlusion culling builds its Hi-Z pyramid from it.
+	GBufferDesc gbufferDesc = make_gbuffer_desc(options.gbufferLayout, options.mergePasses);
+	if (options.lightVolumes)
+		enable_gbuffer_stencil(context, gbufferDesc);
+	gbufferDesc.sampleDepth = options.occlusionCulling;
+	gbufferDesc.depthPrepass = options.depthPrepass;
+
+	// The point lights are culled either into clusters, for the fullscreen
+	// lighting pass, or per tile by the compute lighting pass. Light
+	// volumes are not culled.
+	bool const hasPointLights = options.pointLights > 0;
+	bool const clustered = hasPointLights && !options.computeLighting && !options.lightVolumes;
+	bool const tiledLights = hasPointLights && options.computeLighting;
+
+	// Without a render pass, the final image is produced by a blit
+	bool const needsSecondPass = !gbufferDesc.transient && !options.computeLighting;
+
+	// The lighting image receives the compute lighting pass' output, or,
+	// with dynamic resolution, the lighting pass' scaled rendering. It is
+	// then blitted to the target image.
+	bool const usesLightingImage = options.computeLighting || options.dynamicResolution;
+	RenderTarget lightingTarget{ deferred::kLightingFormat, target.extent, {}, {}, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+	RenderTarget const& lightingPassTarget = options.dynamicResolution ? lightingTarget : target;
+
+	// Worker threads: they record the G-buffer draws in parallel, and at
+	// startup they compile the pipelines
+	lut::ThreadPool recordWorkers;
 
-	lut::PipelineLayout deferred_first_layout = create_deferred_first_layout(window, sceneLayout.handle, advancedLayout.handle);
-	lut::PipelineLayout deferred_second_layout = create_deferred_second_layout(window, sceneLayout.handle, deferred_descriptor_layout.handle);
+	#pragma region deferred pass/pipe/pipe layout
+	// With a transient G-buffer, deferred_first_pass is the merged pass (with
+	// the lighting in its second subpass) and deferred_second_pass is unused.
+	// The compute lighting pass does not use it either.
+	lut::RenderPass deferred_first_pass = gbufferDesc.transient ? create_deferred_merged_pass(context, gbufferDesc, target) : create_deferred_first_pass(context, gbufferDesc);
+	lut::RenderPass deferred_second_pass;
+	if (needsSecondPass)
+		deferred_second_pass = create_deferred_second_pass(context, lightingPassTarget, gbufferDesc);
+
+	VkRenderPass lightingPass = gbufferDesc.transient ? deferred_first_pass.handle : deferred_second_pass.handle;
+
+	// The descriptor set layouts of the shaders' sets are reflected from
+	// them, and shared through the cache
+	check_shader_interfaces();
+
+	lut::DescriptorLayoutCache setLayouts(context);
+	VkDescriptorSetLayout const deferred_descriptor_layout = deferred_set_layout(setLayouts, gbufferDesc);
+	VkDescriptorSetLayout const sceneLayout = scene_set_layout(setLayouts);
+	VkDescriptorSetLayout const advancedLayout = advanced_set_layout(setLayouts);
+
+	// The compute lighting layout always has the point light set
+	lut::DescriptorSetLayout clusterLayout;
+	if (hasPointLights || options.computeLighting)
+		clusterLayout = create_cluster_descriptor_layout(context);
+
+	lut::DescriptorSetLayout lightingOutputLayout;
+	if (options.computeLighting)
+		lightingOutputLayout = create_lighting_output_layout(context);
+
+	lut::PipelineLayout deferred_first_layout = create_deferred_first_layout(context, sceneLayout, advancedLayout);
+	lut::PipelineLayout deferred_second_layout = create_deferred_second_layout(context, sceneLayout, deferred_descriptor_layout, clusterLayout.handle, lightingOutputLayout.handle);
+
+	// The depth pre-pass only writes the G-buffer's depth, whose format does
+	// not depend on the swapchain. Its pipeline uses the scene set only.
+	lut::RenderPass depthPrepassPass;
+	if (options.depthPrepass)
+		depthPrepassPass = create_depth_prepass(context, gbufferDesc);
+
+	// GPU-driven draws: the G-buffer pipeline takes all materials from one
+	// buffer (set 1), and the culling pipeline shares the scene set
+	lut::DescriptorSetLayout materialBufferLayout, drawCullLayout;
+	lut::PipelineLayout indirectGBufferLayout, drawCullPipeLayout;
+	if (options.gpuCulling)
+	{
+		// The material index is passed as the first instance
+		if (!context.drawIndirectFirstInstance)
+			throw lut::Error("--gpu-culling: the device does not support drawIndirectFirstInstance");
 
-	lut::Pipeline deferred_first_pipe = create_deferred_first_pipeline(window, deferred_first_pass.handle, deferred_first_layout.handle);
-	lut::Pipeline deferred_second_pipe = create_deferred_second_pipeline(window, deferred_second_pass.handle, deferred_second_layout.handle);
+		materialBufferLayout = create_material_buffer_layout(context);
+		drawCullLayout = create_draw_cull_descriptor_layout(context, options.occlusionCulling);
 
-	
-	#pragma endregion
-	//create depth buffer
-	auto [depthBuffer, depthBufferView] = create_depth_buffer(window, allocator);
-	std::vector<lut::Framebuffer> framebuffers;
-	
-	create_swapchain_framebuffers(window, deferred_second_pass.handle, framebuffers, depthBufferView.handle);
-	
+		indirectGBufferLayout = create_deferred_first_layout(context, sceneLayout, materialBufferLayout.handle);
+		drawCullPipeLayout = create_draw_cull_layout(context, sceneLayout, drawCullLayout.handle);
+	}
 
-	lut::CommandPool cpool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	// Occlusion culling: the late G-buffer pass uses the first pass'
+	// framebuffer and pipelines
+	lut::RenderPass lateGBufferPass;
+	lut::DescriptorSetLayout hizDescriptorLayout;
+	lut::PipelineLayout hizPipeLayout;
+	if (options.occlusionCulling)
+	{
+		lateGBufferPass = create_deferred_first_pass(context, gbufferDesc, true);
 
-	std::vector<VkCommandBuffer> cbuffers;
-	std::vector<lut::Fence> cbfences;
+		hizDescriptorLayout = create_hiz_descriptor_layout(context);
+		hizPipeLayout = create_hiz_layout(context, hizDescriptorLayout.handle);
+	}
 
-	for (std::size_t i = 0; i < framebuffers.size(); ++i)
+	// Instanced draws: the materials are in one buffer, as with the
+	// GPU-driven draws (which cannot be combined with them)
+	bool const instanced = options.instances > 0;
+	lut::PipelineLayout instancedGBufferLayout;
+	if (instanced)
 	{
-		cbuffers.emplace_back(lut::alloc_command_buffer(window, cpool.handle));
-		cbfences.emplace_back(lut::create_fence(window, VK_FENCE_CREATE_SIGNALED_BIT));
+		materialBufferLayout = create_material_buffer_layout(context);
+		instancedGBufferLayout = create_instanced_gbuffer_layout(context, sceneLayout, materialBufferLayout.handle);
 	}
 
-	lut::Semaphore imageAvailable = lut::create_semaphore(window);
-	lut::Semaphore renderFinished = lut::create_semaphore(window);
+	// Start the pipeline builds. They run on the workers while the rest of
+	// the setup continues (see "Wait for the pipelines" below). The
+	// registry owns the pipelines, and builds each distinct description
+	// once. The builder is declared after the passes, layouts and registry,
+	// so that, should the setup throw, it waits for the builds before these
+	// are destroyed.
+	lut::PipelineRegistry pipelineRegistry(context);
+	lut::PipelineBuilder pipelineBuilder(options.serialPipelines ? nullptr : &recordWorkers);
+
+	// Builds the pipeline for aDesc through the registry
+	auto const build_pipeline = [&pipelineBuilder, &pipelineRegistry] (char const* aName, lut::PipelineDesc aDesc) {
+		return pipelineBuilder.build(aName, [&pipelineRegistry, desc = std::move(aDesc)] {
+			return pipelineRegistry.get(desc);
+		});
+	};
 
-	/// <summary>
-	/// material buffer
-	/// </summary>
-	/// <returns></returns>
-	ColourMesh materialMesh = createObjBuffer(newShip, window, allocator);
+	auto deferredFirstPipeJob = build_pipeline("gbuffer_pipeline", deferred_first_pipeline_desc(deferred_first_pass.handle, deferred_first_layout.handle, gbufferDesc));
+
+	// The lighting pipeline is built per shading variant. The light count
+	// follows the number keys (sceneUniforms.constant), so with the scene's
+	// four lights, the variants of the other counts are built here as well.
+	// The first frame does not wait for them; they finish in the background,
+	// and switching to one of them at most waits for its build.
+	ShadingVariant shadingVariant;
+	shadingVariant.lightCount = std::uint32_t(sceneUniforms.constant);
+	shadingVariant.brdf = options.brdf;
+	shadingVariant.emissive = options.emissive;
+	shadingVariant.ambient = options.ambient;
+
+	lut::PipelineVariants lightingVariants(pipelineRegistry, options.computeLighting
+		? compute_lighting_pipeline_desc(deferred_second_layout.handle, gbufferDesc, tiledLights)
+		: deferred_second_pipeline_desc(lightingPass, deferred_second_layout.handle, gbufferDesc, clustered)
+	);
 
-	//create descriptor pool
-	lut::DescriptorPool dpool = lut::create_descriptor_pool(window);
-	
-#pragma region deferred image from first pass to second pass
-	lut::Sampler defaultSampler = lut::create_default_sampler(window);
+	auto deferredSecondPipeJob = build_pipeline("lighting_pipeline", lightingVariants.desc(specialization_constants(shadingVariant)));
 
-	//lut::Image posImage = lut::create_image(allocator, window.swapchainExtent.width, window.swapchainExtent.height, deferred::kPositionFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	//lut::ImageView posView = lut::create_image_view(window, posImage.image, deferred::kPositionFormat);
+	std::vector<std::future<VkPipeline>> lightingVariantJobs;
+	if (!hasPointLights)
+	{
+		for (std::uint32_t count = 0; count <= glsl::kSceneLightCount; ++count)
+		{
+			if (count == shadingVariant.lightCount)
+				continue;
 
-	lut::Image posImage = lut::create_image(allocator, window.swapchainExtent.width, window.swapchainExtent.height, deferred::kDepthViewFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	lut::ImageView posView = lut::create_image_view(window, posImage.image, deferred::kDepthViewFormat);
+			ShadingVariant variant = shadingVariant;
+			variant.lightCount = count;
+			lightingVariantJobs.emplace_back(build_pipeline("lighting_variant", lightingVariants.desc(specialization_constants(variant))));
+		}
+	}
 
-	lut::Image normImage = lut::create_image(allocator, window.swapchainExtent.width, window.swapchainExtent.height, deferred::kNormalFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	lut::ImageView normView = lut::create_image_view(window, normImage.image, deferred::kNormalFormat);
+	std::future<VkPipeline> depthPrepassPipeJob;
+	if (options.depthPrepass)
+		depthPrepassPipeJob = build_pipeline("depth_prepass_pipeline", depth_prepass_pipeline_desc(depthPrepassPass.handle, deferred_first_layout.handle, gbufferDesc));
 
-	lut::Image emissiveImage = lut::create_image(allocator, window.swapchainExtent.width, window.swapchainExtent.height, deferred::kEmissiveFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	lut::ImageView emissiveView = lut::create_image_view(window, emissiveImage.image, deferred::kEmissiveFormat);
+	std::future<VkPipeline> clusterPipeJob;
+	if (clustered)
+		clusterPipeJob = build_pipeline("cluster_pipeline", cluster_pipeline_desc(deferred_second_layout.handle));
 
-	lut::Image albedoImage = lut::create_image(allocator, window.swapchainExtent.width, window.swapchainExtent.height, deferred::kAlbedoFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	lut::ImageView albedoView = lut::create_image_view(window, albedoImage.image, deferred::kAlbedoFormat);
+	std::future<VkPipeline> volumeStencilPipeJob, volumeLightPipeJob;
+	if (options.lightVolumes)
+	{
+		auto [stencilDesc, lightDesc] = light_volume_pipeline_descs(lightingPass, deferred_second_layout.handle, gbufferDesc);
+		lightDesc.specialization = specialization_constants(shadingVariant);
+		volumeStencilPipeJob = build_pipeline("light_volume_stencil_pipeline", std::move(stencilDesc));
+		volumeLightPipeJob = build_pipeline("light_volume_pipeline", std::move(lightDesc));
+	}
 
-	VkDescriptorSet deferredDescriptors = lut::alloc_desc_set(window, dpool.handle, deferred_descriptor_layout.handle);
+	std::future<VkPipeline> indirectGBufferPipeJob, drawCullPipeJob;
+	if (options.gpuCulling)
 	{
-		VkWriteDescriptorSet desc[4]{};
-		VkDescriptorImageInfo posInfo{};
-		posInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		posInfo.imageView = posView.handle;
-		posInfo.sampler = defaultSampler.handle;
-
-		VkDescriptorImageInfo normInfo{};
-		normInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		normInfo.imageView = normView.handle;
-		normInfo.sampler = defaultSampler.handle;
-
-		VkDescriptorImageInfo emissiveInfo{};
-		emissiveInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		emissiveInfo.imageView = emissiveView.handle;
-		emissiveInfo.sampler = defaultSampler.handle;
-
-		VkDescriptorImageInfo albedoInfo{};
-		albedoInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		albedoInfo.imageView = albedoView.handle;
-		albedoInfo.sampler = defaultSampler.handle;
+		indirectGBufferPipeJob = build_pipeline("indirect_gbuffer_pipeline", deferred_first_pipeline_desc(deferred_first_pass.handle, indirectGBufferLayout.handle, gbufferDesc, true));
+		drawCullPipeJob = build_pipeline("draw_cull_pipeline", draw_cull_pipeline_desc(drawCullPipeLayout.handle, options.occlusionCulling));
+	}
 
-		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[0].dstSet = deferredDescriptors;
-		desc[0].dstBinding = 0;
-		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		desc[0].descriptorCount = 1;
-		desc[0].pImageInfo = &posInfo;
+	std::future<VkPipeline> hizPipeJob;
+	if (options.occlusionCulling)
+		hizPipeJob = build_pipeline("hiz_pipeline", hiz_pipeline_desc(hizPipeLayout.handle));
 
-		desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[1].dstSet = deferredDescriptors;
-		desc[1].dstBinding = 1;
-		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		desc[1].descriptorCount = 1;
-		desc[1].pImageInfo = &normInfo;
+	std::future<VkPipeline> instancedGBufferPipeJob;
+	if (instanced)
+		instancedGBufferPipeJob = build_pipeline("instanced_gbuffer_pipeline", deferred_first_pipeline_desc(deferred_first_pass.handle, instancedGBufferLayout.handle, gbufferDesc, true, true));
+	
+	#pragma endregion
+	//create depth buffer (the merged pass only needs the G-buffer's, and
+	//the light volumes use the G-buffer's in the second pass)
+	lut::Image depthBuffer;
+	lut::ImageView depthBufferView;
+	if (needsSecondPass && !gbufferDesc.stencil)
+		std::tie(depthBuffer, depthBufferView) = create_depth_buffer(context, allocator, target.extent);
+
+	// One per target image, if the lighting is rendered to the target, or
+	// one for the lighting image
+	std::vector<lut::Framebuffer> framebuffers;
+	
 
-		desc[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[2].dstSet = deferredDescriptors;
-		desc[2].dstBinding = 2;
-		desc[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		desc[2].descriptorCount = 1;
-		desc[2].pImageInfo = &emissiveInfo;
+	// Per-frame resources: command pool/buffer, semaphores, fence, scene
+	// uniform buffer and descriptor pool. These are decoupled from the number
+	// of swapchain images.
+	// Each frame also gets one secondary command buffer (and pool) per
+	// recording thread.
+	std::vector<lut::FrameContext> frames = lut::create_frame_contexts(context, allocator, cfg::kFramesInFlight, sizeof(glsl::SceneUniform), std::uint32_t(recordWorkers.thread_count()));
 
-		desc[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[3].dstSet = deferredDescriptors;
-		desc[3].dstBinding = 3;
-		desc[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		desc[3].descriptorCount = 1;
-		desc[3].pImageInfo = &albedoInfo;
+	/// <summary>
+	/// material buffer
+	/// </summary>
+	/// <returns></returns>
+	ColourMesh materialMesh = createObjBuffer(newShip, context, allocator, timeline, deletionQueue, &gpuProfiler, cfg::kMeshUploadProfilerSlot);
 
-		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
-		vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
+	//create descriptor pool
+	lut::DescriptorPool dpool = lut::create_descriptor_pool(context);
+	
+#pragma region deferred image from first pass to second pass
+	// The lighting pass reads the G-buffer at pixel centres, so the images
+	// are sampled without filtering (which depth formats may not support).
+	lut::Sampler gbufferSampler = create_gbuffer_sampler(context);
+	GBuffer gbuffer = create_gbuffer(context, allocator, gbufferDesc, target.extent);
+
+	std::printf("G-buffer: %s layout, %u bytes/pixel (classic %u, compact %u), %.1f MiB at %ux%u%s\n",
+		to_string(gbufferDesc.layout),
+		gbuffer_bytes_per_pixel(gbufferDesc),
+		gbuffer_bytes_per_pixel(make_gbuffer_desc(GBufferLayout::classic)),
+		gbuffer_bytes_per_pixel(make_gbuffer_desc(GBufferLayout::compact)),
+		double(gbuffer_bytes_per_pixel(gbufferDesc)) * target.extent.width * target.extent.height / (1024. * 1024.),
+		target.extent.width, target.extent.height,
+		!gbufferDesc.transient ? "" : gbuffer.lazilyAllocated ? ", transient (lazily allocated)" : ", transient (no lazily allocated memory)"
+	);
+
+	VkDescriptorSet deferredDescriptors = lut::alloc_desc_set(context, dpool.handle, deferred_descriptor_layout);
+	update_deferred_descriptors(context, deferredDescriptors, gbufferSampler.handle, gbuffer, gbufferDesc);
+
+	// The lighting image. Like the G-buffer, it is shared by all frames in
+	// flight.
+	lut::Image lightingImage;
+	lut::ImageView lightingView;
+	VkDescriptorSet lightingDescriptors = VK_NULL_HANDLE;
+	if (usesLightingImage)
+	{
+		std::tie(lightingImage, lightingView) = create_lighting_image(context, allocator, target);
+		lightingTarget.images = { lightingImage.image };
+		lightingTarget.views = { lightingView.handle };
+	}
+
+	if (options.computeLighting)
+	{
+		lightingDescriptors = lut::alloc_desc_set(context, dpool.handle, lightingOutputLayout.handle);
+		update_lighting_output_descriptors(context, lightingDescriptors, lightingView.handle);
 	}
 
 	lut::Framebuffer deferredBuff;
-	create_deferred_framebuffers(window, deferred_first_pass.handle, deferredBuff, posView.handle, normView.handle, emissiveView.handle, albedoView.handle, depthBufferView.handle);
+	lut::Framebuffer depthPrepassBuff;
+	if (gbufferDesc.transient)
+	{
+		create_merged_framebuffers(context, target, deferred_first_pass.handle, framebuffers, gbuffer);
+	}
+	else
+	{
+		create_deferred_framebuffers(context, target.extent, deferred_first_pass.handle, deferredBuff, gbuffer);
+		if (options.depthPrepass)
+			create_depth_prepass_framebuffer(context, target.extent, depthPrepassPass.handle, depthPrepassBuff, gbuffer);
+		if (needsSecondPass)
+			create_swapchain_framebuffers(context, lightingPassTarget, deferred_second_pass.handle, framebuffers, gbufferDesc.stencil ? gbuffer.depthView.handle : depthBufferView.handle);
+	}
 #pragma endregion
 
 #pragma region secene uniform, light buffer (with thier descriptorSets)
-	// create scene uniform buffer with lut::create_buffer()
-	lut::Buffer sceneUBO = lut::create_buffer(
-		allocator,
-		sizeof(glsl::SceneUniform),
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY
-	);
-	// allocate descriptor set for uniform buffer
-	VkDescriptorSet sceneDescriptors = lut::alloc_desc_set(window, dpool.handle, sceneLayout.handle);
+	// allocate one descriptor set per frame in flight, each referring to that
+	// frame's scene uniform buffer
+	std::vector<VkDescriptorSet> sceneDescriptors(frames.size());
+	for (std::size_t i = 0; i < frames.size(); ++i)
 	{
+		sceneDescriptors[i] = lut::alloc_desc_set(context, frames[i].descriptorPool.handle, sceneLayout);
+
 		VkWriteDescriptorSet desc[1]{};
 		VkDescriptorBufferInfo sceneUboInfo{};
-		sceneUboInfo.buffer = sceneUBO.buffer;
+		sceneUboInfo.buffer = frames[i].uniforms.buffer;
 		sceneUboInfo.range = VK_WHOLE_SIZE;
 
 		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[0].dstSet = sceneDescriptors;
+		desc[0].dstSet = sceneDescriptors[i];
 		desc[0].dstBinding = 0;
 		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		desc[0].descriptorCount = 1;
@@ -436,7 +1460,94 @@ int main() try
 
 		//initialize descriptor set with vkUpdateDescriptorSets
 		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
-		vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
+		vkUpdateDescriptorSets(context.device, numSets, desc, 0, nullptr);
+	}
+#pragma endregion
+
+#pragma region point lights and light clusters (--lights)
+	// Each frame in flight has its own light buffer, which the CPU writes
+	// every frame, and, with clustered lighting, its own cluster buffer,
+	// which the frame's light assignment pass writes.
+	std::vector<AnimatedLight> pointLights;
+	std::vector<lut::Buffer> lightBuffers;
+	std::vector<PointLight*> lightData;
+	std::vector<lut::Buffer> clusterBuffers;
+	std::vector<VkDescriptorSet> clusterDescriptors(frames.size(), VK_NULL_HANDLE);
+
+	if (hasPointLights)
+	{
+		// The lights are spread over the ship
+		auto const [sceneMin, sceneMax] = compute_model_bounds(newShip);
+		pointLights = make_stress_lights(options.pointLights, sceneMin, sceneMax);
+
+		for (std::size_t i = 0; i < frames.size(); ++i)
+		{
+			lightBuffers.emplace_back(lut::create_buffer(
+				allocator,
+				sizeof(PointLight) * pointLights.size(),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT
+			));
+
+			VmaAllocationInfo allocInfo{};
+			vmaGetAllocationInfo(allocator.allocator, lightBuffers.back().allocation, &allocInfo);
+			lightData.emplace_back(static_cast<PointLight*>(allocInfo.pMappedData));
+
+			// The compute lighting pass does not use the clusters (binding 1)
+			if (clustered)
+			{
+				clusterBuffers.emplace_back(lut::create_buffer(
+					allocator,
+					sizeof(std::uint32_t) * std::size_t(kClusterCount) * kClusterStride,
+					VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VMA_MEMORY_USAGE_GPU_ONLY
+				));
+			}
+
+			clusterDescriptors[i] = lut::alloc_desc_set(context, frames[i].descriptorPool.handle, clusterLayout.handle);
+
+			VkDescriptorBufferInfo bufferInfos[2]{};
+			bufferInfos[0].buffer = lightBuffers.back().buffer;
+			bufferInfos[0].range = VK_WHOLE_SIZE;
+			if (clustered)
+			{
+				bufferInfos[1].buffer = clusterBuffers.back().buffer;
+				bufferInfos[1].range = VK_WHOLE_SIZE;
+			}
+
+			std::uint32_t const bindingCount = clustered ? 2 : 1;
+
+			VkWriteDescriptorSet desc[2]{};
+			for (std::uint32_t b = 0; b < bindingCount; ++b)
+			{
+				desc[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				desc[b].dstSet = clusterDescriptors[i];
+				desc[b].dstBinding = b;
+				desc[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				desc[b].descriptorCount = 1;
+				desc[b].pBufferInfo = &bufferInfos[b];
+			}
+
+			vkUpdateDescriptorSets(context.device, bindingCount, desc, 0, nullptr);
+		}
+
+		if (clustered)
+			std::printf("Clustered lighting: %u point lights, %ux%ux%u clusters with up to %u lights each\n", options.pointLights, kClusterGridX, kClusterGridY, kClusterGridZ, kMaxLightsPerCluster);
+		else if (options.lightVolumes)
+			std::printf("Light volumes: %u point lights\n", options.pointLights);
+		else
+			std::printf("Tiled lighting: %u point lights, %ux%u pixel tiles\n", options.pointLights, deferred::kLightingTileSize, deferred::kLightingTileSize);
+	}
+
+	// Proxy geometry of the light volumes, shared by all lights
+	lut::Buffer volumeVertices, volumeIndices;
+	std::uint32_t volumeIndexCount = 0;
+	if (options.lightVolumes)
+	{
+		LightVolumeMesh const volumeMesh = make_light_volume_mesh();
+		std::tie(volumeVertices, volumeIndices) = create_light_volume_buffers(context, allocator, timeline, deletionQueue, volumeMesh);
+		volumeIndexCount = std::uint32_t(volumeMesh.indices.size());
 	}
 #pragma endregion
 
@@ -452,7 +1563,7 @@ int main() try
 			VMA_MEMORY_USAGE_GPU_ONLY
 		);
 
-		pbrDescriptors[i] = lut::alloc_desc_set(window, dpool.handle, advancedLayout.handle);
+		pbrDescriptors[i] = lut::alloc_desc_set(context, dpool.handle, advancedLayout);
 		{
 			VkWriteDescriptorSet desc[1]{};
 			VkDescriptorBufferInfo materialInfo{};
@@ -467,980 +1578,3645 @@ int main() try
 			desc[0].pBufferInfo = &materialInfo;
 
 			constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
-			vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
+			vkUpdateDescriptorSets(context.device, numSets, desc, 0, nullptr);
 		}
 	}
+
+	// The materials never change, so they are uploaded once, up front.
+	upload_material_uniforms(context, timeline, deletionQueue, pbrBuffers, &gpuProfiler, cfg::kMaterialUploadProfilerSlot);
 #pragma endregion
-	bool recreateSwapchain = false;
 
-	while (!glfwWindowShouldClose(window.window))
+	// The scene draws each mesh once, in order. With frustum culling, the
+	// list is narrowed down to the visible meshes every frame (see
+	// update_draw_list below).
+	std::vector<std::uint32_t> drawList(materialMesh.positions.size());
+	for (std::size_t i = 0; i < drawList.size(); ++i)
+		drawList[i] = std::uint32_t(i);
+
+	BoundingBoxes const meshBounds = compute_mesh_bounds(newShip);
+	assert(meshBounds.size() == drawList.size());
+
+#pragma region GPU-driven draws (--gpu-culling)
+	// The draw records (one per mesh), the materials and the vertices of all
+	// meshes are static. Each frame in flight has its own indirect commands
+	// and counters, which its culling pass writes. The counters are host
+	// visible, such that the number of drawn meshes can be read back for
+	// the statistics once the frame has completed.
+	// The occlusion culling adds the visibility of each mesh and the Hi-Z
+	// pyramid, which are shared by all frames in flight (like the
+	// G-buffer), and the Hi-Z build's counter of finished workgroups.
+	// The instanced draws use the same vertices and materials.
+	lut::Buffer gpuPositions, gpuNormals, drawRecordBuffer, gpuMaterialBuffer;
+	std::vector<lut::Buffer> indirectCommands, drawCounts;
+	std::vector<std::uint32_t*> drawCountData;
+	std::vector<VkDescriptorSet> drawCullDescriptors(frames.size(), VK_NULL_HANDLE);
+	VkDescriptorSet materialBufferDescriptors = VK_NULL_HANDLE;
+
+	lut::Buffer visibilityBuffer, hizCounterBuffer;
+	HiZPyramid hiz;
+	VkDescriptorSet hizDescriptors = VK_NULL_HANDLE;
+
+	if (options.gpuCulling || instanced)
 	{
-		// Let GLFW process events.
-		// glfwPollEvents() checks for events, processes them. If there are no
-		// events, it will return immediately. Alternatively, glfwWaitEvents()
-		// will wait for any event to occur, process it, and only return at
-		// that point. The former is useful for applications where you want to
-		// render as fast as possible, whereas the latter is useful for
-		// input-driven applications, where redrawing is only needed in
-		// reaction to user input (or similar).
-		glfwPollEvents(); // or: glfwWaitEvents()
+		// All meshes draw from the model's vertex arrays, at their offsets
+		auto const vertexBytes = sizeof(glm::vec3) * newShip.vertexPositions.size();
+		gpuPositions = create_static_buffer(context, allocator, timeline, deletionQueue, newShip.vertexPositions.data(), vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+		gpuNormals = create_static_buffer(context, allocator, timeline, deletionQueue, newShip.vertexNormals.data(), vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 
-		// Recreate swap chain
-		if (recreateSwapchain)
+		std::vector<glsl::GpuMaterial> materials(newShip.materials.size());
+		for (std::size_t i = 0; i < materials.size(); ++i)
 		{
-			// re-create swapchain and associated resources - see Exercise 3!
-			vkDeviceWaitIdle(window.device);
-			auto const changes = lut::recreate_swapchain(window);
-			if (changes.changedFormat)
-			{
-				deferred_first_pass = create_deferred_first_pass(window);
-				deferred_second_pass = create_deferred_second_pass(window);
-			}
-
-			if (changes.changedSize)
-			{
-				lut::Pipeline fullScreenPipe = create_deferred_first_pipeline(window, deferred_first_pass.handle, deferred_first_layout.handle);
-				lut::Pipeline secondPipe = create_deferred_second_pipeline(window, deferred_second_pass.handle, deferred_second_layout.handle);
-			}
-			//TODO: (Section 6) re-create depth buffer image
-			if (changes.changedSize)
-			{
-				std::tie(depthBuffer, depthBufferView) = create_depth_buffer(window, allocator);
-			}
-
-			framebuffers.clear();
-			//vkDestroyFramebuffer(window.device,intermediateBuff.handle,allocator.allocator);
-			create_deferred_framebuffers(window, deferred_first_pass.handle, deferredBuff, depthBufferView.handle, normView.handle, emissiveView.handle ,albedoView.handle, depthBufferView.handle);
-			create_swapchain_framebuffers(window, deferred_second_pass.handle, framebuffers, depthBufferView.handle);
-			
-			recreateSwapchain = false;
-			continue;
+			materials[i].albedo = glm::vec4(newShip.materials[i].albedo, 1.f);
+			materials[i].emissive = glm::vec4(newShip.materials[i].emissive, 1.f);
+			materials[i].metalness = newShip.materials[i].metalness;
+			materials[i].shininess = newShip.materials[i].shininess;
 		}
 
-		//acquire swapchain image.
-		unsigned int imageIndex = 0;
-		auto const acquireRes = vkAcquireNextImageKHR(window.device, window.swapchain,
-			std::numeric_limits<std::uint64_t>::max(),
-			imageAvailable.handle,
-			VK_NULL_HANDLE,
-			&imageIndex);
-		if (VK_SUBOPTIMAL_KHR == acquireRes || VK_ERROR_OUT_OF_DATE_KHR == acquireRes)
-		{
-			recreateSwapchain = true;
-			continue;
-		}
+		gpuMaterialBuffer = create_static_buffer(context, allocator, timeline, deletionQueue, materials.data(), sizeof(glsl::GpuMaterial) * materials.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
-		if (VK_SUCCESS != acquireRes)
+		materialBufferDescriptors = lut::alloc_desc_set(context, dpool.handle, materialBufferLayout.handle);
 		{
-			throw lut::Error("Unable to acquire enxt swapchain image\n" "vkAcquireNextImageKHR() returned %s", lut::to_string(acquireRes).c_str());
-		}
+			VkDescriptorBufferInfo materialInfo{};
+			materialInfo.buffer = gpuMaterialBuffer.buffer;
+			materialInfo.range = VK_WHOLE_SIZE;
 
-		// wait for command buffer to be available
-		assert(std::size_t(imageIndex) < cbfences.size());
-		if (auto const res = vkWaitForFences(window.device, 1, &cbfences[imageIndex].handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to wait for command buffer fence %u\n" "vkWaitForFences() returned %s", imageIndex, lut::to_string(res).c_str());
+			VkWriteDescriptorSet desc[1]{};
+			desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[0].dstSet = materialBufferDescriptors;
+			desc[0].dstBinding = 0;
+			desc[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			desc[0].descriptorCount = 1;
+			desc[0].pBufferInfo = &materialInfo;
+
+			vkUpdateDescriptorSets(context.device, 1, desc, 0, nullptr);
 		}
+	}
+
+	if (options.gpuCulling)
+	{
+		// Bounding spheres around the meshes' boxes
+		auto const cones = compute_normal_cones(newShip);
 
-		if (auto const res = vkResetFences(window.device, 1, &cbfences[imageIndex].handle); VK_SUCCESS != res)
+		std::vector<glsl::DrawRecord> records(newShip.meshes.size());
+		for (std::size_t i = 0; i < records.size(); ++i)
 		{
-			throw lut::Error("Unable to reset command buffer fence %u\n" "vkResetFences() returned %s", imageIndex, lut::to_string(res).c_str());
+			auto const& mesh = newShip.meshes[i];
+			glm::vec3 const centre(meshBounds.centreX[i], meshBounds.centreY[i], meshBounds.centreZ[i]);
+			glm::vec3 const extent(meshBounds.extentX[i], meshBounds.extentY[i], meshBounds.extentZ[i]);
+
+			records[i].sphere = glm::vec4(centre, glm::length(extent));
+			records[i].cone = glm::vec4(cones[i].axis, cones[i].cutoff);
+			records[i].firstVertex = std::uint32_t(mesh.vertexStartIndex);
+			records[i].vertexCount = std::uint32_t(mesh.numberOfVertices);
+			records[i].material = mesh.materialIndex;
 		}
 
-		update_scene_uniforms(camera, sceneUniforms, window.swapchainExtent.width, window.swapchainExtent.height);
+		drawRecordBuffer = create_static_buffer(context, allocator, timeline, deletionQueue, records.data(), sizeof(glsl::DrawRecord) * records.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-		// record and submit commands
-		assert(std::size_t(imageIndex) < cbuffers.size());
-		assert(std::size_t(imageIndex) < framebuffers.size());
+		// Nothing is visible before the first frame, so its early phase
+		// draws nothing. The build's counter starts at zero, and the last
+		// workgroup of each build resets it.
+		if (options.occlusionCulling)
+		{
+			std::vector<std::uint32_t> const zeros(records.size(), 0);
+			visibilityBuffer = create_static_buffer(context, allocator, timeline, deletionQueue, zeros.data(), sizeof(std::uint32_t) * zeros.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+			hizCounterBuffer = create_static_buffer(context, allocator, timeline, deletionQueue, zeros.data(), sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-		record_commands(
-			cbuffers[imageIndex],
-			deferred_first_pass.handle,
-			deferred_second_pass.handle,
-			framebuffers[imageIndex].handle,
-			deferredBuff.handle,
+			hiz = create_hiz_pyramid(context, allocator, target.extent);
+			hizDescriptors = lut::alloc_desc_set(context, dpool.handle, hizDescriptorLayout.handle);
+		}
 
-			deferred_first_pipe.handle,
-			deferred_second_pipe.handle,
-			window.swapchainExtent,
-			materialMesh,
+		// The occlusion culling's late phase writes its commands after the
+		// early phase's
+		std::size_t const commandLists = options.occlusionCulling ? 2 : 1;
 
-			sceneUBO.buffer,
-			pbrBuffers,
+		for (std::size_t i = 0; i < frames.size(); ++i)
+		{
+			indirectCommands.emplace_back(lut::create_buffer(
+				allocator,
+				sizeof(VkDrawIndirectCommand) * records.size() * commandLists,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY
+			));
+
+			drawCounts.emplace_back(lut::create_buffer(
+				allocator,
+				sizeof(std::uint32_t) * deferred::kDrawCounterCount,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VMA_MEMORY_USAGE_GPU_TO_CPU,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT
+			));
+
+			VmaAllocationInfo allocInfo{};
+			vmaGetAllocationInfo(allocator.allocator, drawCounts.back().allocation, &allocInfo);
+			drawCountData.emplace_back(static_cast<std::uint32_t*>(allocInfo.pMappedData));
+
+			// Read before the frame's first submission
+			std::fill_n(drawCountData.back(), deferred::kDrawCounterCount, 0u);
+
+			drawCullDescriptors[i] = lut::alloc_desc_set(context, frames[i].descriptorPool.handle, drawCullLayout.handle);
+
+			// The Hi-Z pyramid (binding 4) is written by
+			// update_hiz_descriptors()
+			VkDescriptorBufferInfo bufferInfos[4]{};
+			bufferInfos[0].buffer = drawRecordBuffer.buffer;
+			bufferInfos[1].buffer = indirectCommands.back().buffer;
+			bufferInfos[2].buffer = drawCounts.back().buffer;
+			bufferInfos[3].buffer = visibilityBuffer.buffer;
+
+			std::uint32_t const bindingCount = options.occlusionCulling ? 4 : 3;
+
+			VkWriteDescriptorSet desc[4]{};
+			for (std::uint32_t b = 0; b < bindingCount; ++b)
+			{
+				bufferInfos[b].range = VK_WHOLE_SIZE;
+
+				desc[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				desc[b].dstSet = drawCullDescriptors[i];
+				desc[b].dstBinding = b;
+				desc[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				desc[b].descriptorCount = 1;
+				desc[b].pBufferInfo = &bufferInfos[b];
+			}
 
-			sceneUniforms,
+			vkUpdateDescriptorSets(context.device, bindingCount, desc, 0, nullptr);
+		}
 
-			deferred_first_layout.handle,
-			deferred_second_layout.handle,
-			sceneDescriptors,
-			deferredDescriptors,
-			pbrDescriptors
+		if (options.occlusionCulling)
+			update_hiz_descriptors(context, hizDescriptors, drawCullDescriptors, gbufferSampler.handle, gbuffer, hiz, hizCounterBuffer.buffer);
+
+		std::printf("GPU culling: %zu meshes, %s\n", records.size(),
+			context.drawIndirectCount ? "compacted with vkCmdDrawIndirectCount()" : context.multiDrawIndirect ? "vkCmdDrawIndirect() (no drawIndirectCount)" : "one vkCmdDrawIndirect() per mesh (no multiDrawIndirect)"
 		);
 
-		submit_commands(
-			window,
-			cbuffers[imageIndex],
-			cbfences[imageIndex].handle,
-			imageAvailable.handle,
-			renderFinished.handle);
+		if (options.occlusionCulling)
+			std::printf("Occlusion culling: two phases, Hi-Z pyramid of %ux%u with %u levels\n", hiz.extent.width, hiz.extent.height, hiz.levels);
+	}
+#pragma endregion
 
-		//present rendered images (note: use the present_results() method)
-		present_results(window.presentQueue,
-			window.swapchain,
-			imageIndex,
-			renderFinished.handle,
-			recreateSwapchain
-		);
+#pragma region Instanced draws (--instances)
+	// The copies of the model are static, so their data is uploaded once
+	lut::Buffer instanceBuffer;
+	if (instanced)
+	{
+		auto const [modelMin, modelMax] = compute_model_bounds(newShip);
+		auto const instances = make_instance_grid(options.instances, modelMin, modelMax, std::uint32_t(newShip.materials.size()));
 
-		camera.updateCameraPosition();
+		instanceBuffer = create_static_buffer(context, allocator, timeline, deletionQueue, instances.data(), sizeof(InstanceData) * instances.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+		std::printf("Instancing: %u copies of %zu meshes, %s\n", options.instances, newShip.meshes.size(),
+			options.drawPerInstance ? "one draw per copy and mesh" : "one instanced draw per mesh"
+		);
 	}
+#pragma endregion
 
-	// Cleanup takes place automatically in the destructors, but we sill need
-	// to ensure that all Vulkan commands have finished before that.
-	vkDeviceWaitIdle(window.device);
-	return 0;
-}
-catch( std::exception const& eErr )
-{
-	std::fprintf( stderr, "\n" );
-	std::fprintf( stderr, "Error: %s\n", eErr.what() );
-	return 1;
-}
+	// Dynamic resolution: the G-buffer and lighting passes render the
+	// top-left renderExtent of their attachments. Without it, this is the
+	// target's extent.
+	ResolutionController resolution(options.targetGpuMs, cfg::kMinRenderScale);
+	VkExtent2D renderExtent = target.extent;
 
-//glfw functions and scene uniform update
-namespace
-{
-	void glfw_callback_key_press(GLFWwindow* aWindow, int aKey, int /*aScanCode*/, int aAction, int /*aModifierFlags*/)
+	if (options.dynamicResolution)
 	{
-		if (GLFW_KEY_ESCAPE == aKey && GLFW_PRESS == aAction)
-		{
-			glfwSetWindowShouldClose(aWindow, GLFW_TRUE);
-		}
+		if (gpuProfiler.enabled())
+			std::printf("Dynamic resolution: target GPU time %.2f ms, scale %.2f to 1\n", resolution.target_ms(), cfg::kMinRenderScale);
+		else
+			std::printf("Dynamic resolution: GPU timestamps are not supported, the scale stays at 1\n");
+	}
 
-		auto* uniforms = reinterpret_cast<glsl::SceneUniform*>(glfwGetWindowUserPointer(aWindow));
+	// Wait for the pipelines that the first frame uses; the builds have
+	// overlapped with the setup above. A build that failed rethrows its
+	// exception here. The other light counts' variants are not waited for
+	// (see lightingVariantJobs).
+	auto const pipelinesWaitStart = std::chrono::steady_clock::now();
+
+	VkPipeline deferred_first_pipe = deferredFirstPipeJob.get();
+	VkPipeline deferred_second_pipe = deferredSecondPipeJob.get();
+	VkPipeline const depthPrepassPipe = lut::take_result(depthPrepassPipeJob);
+	VkPipeline const clusterPipe = lut::take_result(clusterPipeJob);
+	VkPipeline volumeStencilPipe = lut::take_result(volumeStencilPipeJob);
+	VkPipeline volumeLightPipe = lut::take_result(volumeLightPipeJob);
+	VkPipeline indirectGBufferPipe = lut::take_result(indirectGBufferPipeJob);
+	VkPipeline const drawCullPipe = lut::take_result(drawCullPipeJob);
+	VkPipeline const hizPipe = lut::take_result(hizPipeJob);
+	VkPipeline instancedGBufferPipe = lut::take_result(instancedGBufferPipeJob);
 
-		//For user control different light numbers
-		if (GLFW_KEY_0 == aKey && GLFW_PRESS == aAction)
-		{
-			uniforms->constant = 0;
-		}
-		if (GLFW_KEY_1 == aKey && GLFW_PRESS == aAction)
-		{
-			uniforms->constant = 1;
-		}
-		else if (GLFW_KEY_2 == aKey && GLFW_PRESS == aAction)
+	{
+		auto const waitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pipelinesWaitStart).count();
+		auto const stats = pipelineBuilder.stats();
+		auto const registryStats = pipelineRegistry.stats();
+		std::printf("Pipelines: %zu builds (%zu distinct) in %.3f ms on %zu threads (%.3f ms compiling, longest %s %.3f ms), waited %.3f ms after setup (%s)\n", stats.count, registryStats.pipelines, stats.wallMs, options.serialPipelines ? std::size_t(1) : recordWorkers.thread_count(), stats.totalMs, stats.longest ? stats.longest : "-", stats.longestMs, waitMs, !options.pipelineCachePath ? "no pipeline cache" : pipelineCacheBytes > 0 ? "warm pipeline cache" : "cold pipeline cache");
+	}
+
+	// Record the scene into aCmdBuff, for the given frame in flight and
+	// target image (=framebuffer). Returns the binds of the G-buffer draws.
+	auto const record_frame = [&](VkCommandBuffer aCmdBuff, VkCommandBufferUsageFlags aUsage, std::size_t aFrameIndex, std::uint32_t aImageIndex, std::vector<std::uint32_t> const& aDraws, lut::ThreadPool* aWorkers, lut::GpuProfiler* aProfiler)
+	{
+		ClusterPass clusterPass;
+		if (clustered)
 		{
-			uniforms->constant = 2;
+			clusterPass.pipe = clusterPipe;
+			clusterPass.descriptors = clusterDescriptors[aFrameIndex];
+			clusterPass.clusters = clusterBuffers[aFrameIndex].buffer;
+			clusterPass.params = glsl::ClusterParams{ cfg::kCameraNear, cfg::kCameraFar, options.pointLights };
 		}
-		else if (GLFW_KEY_3 == aKey && GLFW_PRESS == aAction)
+
+		LightingBlit lightingBlit;
+		if (usesLightingImage)
 		{
-			uniforms->constant = 3;
+			lightingBlit.image = lightingImage.image;
+			lightingBlit.target = target.images[aImageIndex];
+			lightingBlit.targetLayout = target.finalLayout;
 		}
-		else if (GLFW_KEY_4 == aKey && GLFW_PRESS == aAction)
+
+		ComputeLighting computeLighting;
+		if (options.computeLighting)
 		{
-			uniforms->constant = 4;
+			computeLighting.output = lightingDescriptors;
+			if (tiledLights)
+				computeLighting.lights = clusterDescriptors[aFrameIndex];
+			computeLighting.params = glsl::ClusterParams{ cfg::kCameraNear, cfg::kCameraFar, options.pointLights };
 		}
 
-		//For moveable light
-		if (GLFW_KEY_SPACE == aKey && GLFW_PRESS == aAction)
+		LightVolumes lightVolumes;
+		if (options.lightVolumes)
 		{
-			cfg::moveable = !cfg::moveable;
+			lightVolumes.stencilPipe = volumeStencilPipe;
+			lightVolumes.lightPipe = volumeLightPipe;
+			lightVolumes.vertices = volumeVertices.buffer;
+			lightVolumes.indices = volumeIndices.buffer;
+			lightVolumes.indexCount = volumeIndexCount;
+			lightVolumes.lights = clusterDescriptors[aFrameIndex];
+			lightVolumes.lightCount = options.pointLights;
 		}
 
-		// forward/backward
-		if (glfwGetKey(aWindow, GLFW_KEY_W) == GLFW_PRESS)
-			camera.speedZ = 1.0f;
-		else if (glfwGetKey(aWindow, GLFW_KEY_S) == GLFW_PRESS)
-			camera.speedZ = -1.0f;
-		else
+		GpuDrivenDraws gpuDraws;
+		if (options.gpuCulling)
 		{
-			camera.speedZ = 0.f;
+			gpuDraws.cullPipe = drawCullPipe;
+			gpuDraws.cullLayout = drawCullPipeLayout.handle;
+			gpuDraws.cullDescriptors = drawCullDescriptors[aFrameIndex];
+			gpuDraws.params = glsl::DrawCullParams{ std::uint32_t(meshBounds.size()), context.drawIndirectCount ? 1u : 0u, 0u, 0u, glm::uvec2(0) };
+			gpuDraws.commands = indirectCommands[aFrameIndex].buffer;
+			gpuDraws.count = drawCounts[aFrameIndex].buffer;
+			gpuDraws.gbufferPipe = indirectGBufferPipe;
+			gpuDraws.gbufferLayout = indirectGBufferLayout.handle;
+			gpuDraws.materials = materialBufferDescriptors;
+			gpuDraws.positions = gpuPositions.buffer;
+			gpuDraws.normals = gpuNormals.buffer;
+			gpuDraws.multiDraw = context.multiDrawIndirect;
+
+			if (options.occlusionCulling)
+			{
+				gpuDraws.hizPipe = hizPipe;
+				gpuDraws.hizLayout = hizPipeLayout.handle;
+				gpuDraws.hizDescriptors = hizDescriptors;
+				gpuDraws.hizImage = hiz.image.image;
+				gpuDraws.hizCounter = hizCounterBuffer.buffer;
+				gpuDraws.visibility = visibilityBuffer.buffer;
+				gpuDraws.latePass = lateGBufferPass.handle;
+			}
 		}
 
-		// left/right
-		if (glfwGetKey(aWindow, GLFW_KEY_A) == GLFW_PRESS)
-			camera.speedX = -1.f;
-		else if (glfwGetKey(aWindow, GLFW_KEY_D) == GLFW_PRESS)
-			camera.speedX = 1.f;
-		else
+		InstancedDraws instancedDraws;
+		if (instanced)
 		{
-			camera.speedX = 0.f;
+			instancedDraws.pipe = instancedGBufferPipe;
+			instancedDraws.layout = instancedGBufferLayout.handle;
+			instancedDraws.materials = materialBufferDescriptors;
+			instancedDraws.positions = gpuPositions.buffer;
+			instancedDraws.normals = gpuNormals.buffer;
+			instancedDraws.instances = instanceBuffer.buffer;
+			instancedDraws.instanceCount = options.instances;
+			instancedDraws.perInstance = options.drawPerInstance;
 		}
 
-		// up/down
-		if (glfwGetKey(aWindow, GLFW_KEY_Q) == GLFW_PRESS)
-			camera.speedY = 1.f;
-		else if (glfwGetKey(aWindow, GLFW_KEY_E) == GLFW_PRESS)
-			camera.speedY = -1.f;
-		else
+		DepthPrepass prepass;
+		if (options.depthPrepass)
 		{
-			camera.speedY = 0.f;
+			prepass.pass = depthPrepassPass.handle;
+			prepass.framebuffer = depthPrepassBuff.handle;
+			prepass.pipe = depthPrepassPipe;
 		}
 
-		// speed up/down
-		if (glfwGetKey(aWindow, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-			camera.speedScalar = 2.f;
-		else if (glfwGetKey(aWindow, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-			camera.speedScalar = 0.05f;
-	}
+		return record_commands(
+			aCmdBuff,
+			aUsage,
+			deferred_first_pass.handle,
+			deferred_second_pass.handle,
+			framebuffers.empty() ? VK_NULL_HANDLE : framebuffers[options.dynamicResolution ? 0 : aImageIndex].handle,
+			deferredBuff.handle,
 
-	void glfw_callback_cursor_pos(GLFWwindow* window, double xPos, double yPos)
-	{
+			deferred_first_pipe,
+			deferred_second_pipe,
+			target.extent,
+			renderExtent,
+			gbufferDesc,
+			materialMesh,
+			aDraws,
 
-		if (cfg::enableMouse == true)
-		{
-			if (cfg::firstMouse)
+			deferred_first_layout.handle,
+			deferred_second_layout.handle,
+			sceneDescriptors[aFrameIndex],
+			deferredDescriptors,
+			pbrDescriptors,
+			clusterPass,
+			lightingBlit,
+			computeLighting,
+			lightVolumes,
+			gpuDraws,
+			instancedDraws,
+			prepass,
+			aWorkers,
+			frames[aFrameIndex].workerCommandBuffers,
+			aProfiler,
+			std::uint32_t(aFrameIndex)
+		);
+	};
+
+	if (options.benchRecord)
+	{
+		// No frame has been submitted yet, so the first frame's command
+		// buffers can be used freely. (The uploads may still be running.)
+		// The remaining pipeline builds would compete for the workers.
+		pipelineBuilder.wait_idle();
+
+		auto& frame = frames[0];
+		run_record_benchmark(context, timeline, frame, options.benchDraws, materialMesh.positions.size(), recordWorkers.thread_count(),
+			[&](std::vector<std::uint32_t> const& aDraws, lut::ThreadPool* aWorkers)
 			{
-				cfg::lastX = (float)xPos;
-				cfg::lastY = (float)yPos;
-				cfg::firstMouse = false;
+				record_frame(frame.commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, 0, 0, aDraws, aWorkers, nullptr);
 			}
+		);
 
-			float deltaX, deltaY;
-			deltaX = (float)xPos - cfg::lastX;
-			deltaY = cfg::lastY - (float)yPos;
-
-			cfg::lastX = (float)xPos;
-			cfg::lastY = (float)yPos;
-
-			camera.processMouseMovement(deltaX, deltaY);
-		}
+		// The uploads' staging buffers are released by the destructors
+		timeline.wait(timeline.last_submitted());
+		return 0;
 	}
 
-	void glfw_callback_mouse_button(GLFWwindow* window, int aButton, int aAction, int)
-	{
-		if (GLFW_MOUSE_BUTTON_RIGHT == aButton && GLFW_PRESS == aAction)
-		{
-			cfg::enableMouse = !cfg::enableMouse;
-		}
-	}
+	// Pre-recorded command buffers, one per combination of frame in flight
+	// and swapchain image (=framebuffer). The generation is bumped whenever
+	// something that is baked into the command buffers changes.
+	lut::CommandBufferCache commandCache(context, frames.size() * target.views.size());
+	std::uint64_t sceneGeneration = 1;
 
+	// Binds of the G-buffer draws in the last recording
+	BindCounts lastRecordBinds;
 
-	void update_scene_uniforms(Camera& camera,
-		glsl::SceneUniform& aSceneUniforms,
-		std::uint32_t aFramebufferWidth,
-		std::uint32_t aFramebufferHeight)
+	// Return the command buffer with the frame's commands, either freshly
+	// recorded or from the cache.
+	auto const prepare_commands = [&](std::size_t aFrameIndex, std::uint32_t aImageIndex) -> VkCommandBuffer
 	{
-		//delta time
-		float now = (float)glfwGetTime();
-		cfg::delta = now - cfg::last;
-		cfg::last = now;
-		//initilize SceneUniform members
-		float const aspect = aFramebufferWidth / float(aFramebufferHeight);
+		assert(std::size_t(aImageIndex) < target.views.size());
 
-		aSceneUniforms.projection = glm::perspectiveRH_ZO(   //right hand clip space      z-axis from 0 to 1
-			lut::Radians(cfg::kCameraFov).value(),
-			aspect,
-			cfg::kCameraNear,
-			cfg::kCameraFar
-		);
-		aSceneUniforms.projection[1][1] *= -1.f;
-		aSceneUniforms.camera = camera.getViewMatrix();
-		aSceneUniforms.camPos = camera.position;
-		aSceneUniforms.viewInv = glm::inverse(aSceneUniforms.camera);
-		aSceneUniforms.projectionInv = glm::inverse(aSceneUniforms.projection);
-		//aSceneUniforms.camPos = aSceneUniforms.projection * aSceneUniforms.view * aSceneUniforms.model;
-		aSceneUniforms.projCam = aSceneUniforms.projection * aSceneUniforms.camera;
+		// Secondary command buffers are reset with their frame, so
+		// parallel recording cannot be combined with the cache.
+		bool const useCache = cfg::cacheCommands && !cfg::parallelRecording;
 
-		if (cfg::moveable)
+		VkCommandBuffer cmdBuff = frames[aFrameIndex].commandBuffer;
+		bool needsRecording = true;
+		if (useCache)
+			cmdBuff = commandCache.acquire(aFrameIndex * target.views.size() + aImageIndex, sceneGeneration, needsRecording);
+
+		if (needsRecording)
 		{
-			glm::mat4 trans = glm::mat4(1.f);
-			glm::mat4 rotate = glm::rotate(trans, glm::radians(20.f * cfg::delta), glm::vec3(0.f, 1.f, 0.f));
-			for (int i = 0; i < 4; i++)
-				aSceneUniforms.lights[i].position = rotate * aSceneUniforms.lights[i].position;
+			lastRecordBinds = record_frame(cmdBuff,
+				useCache ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+				aFrameIndex,
+				aImageIndex,
+				drawList,
+				cfg::parallelRecording ? &recordWorkers : nullptr,
+				&gpuProfiler
+			);
 		}
-	}
-}
 
-//deferred first pass
-namespace
-{
-	lut::RenderPass create_deferred_first_pass(lut::VulkanWindow const& aWindow)
-	{
-		//Render Pass attachments
-		VkAttachmentDescription attachments[5]{};
-		attachments[0].format = deferred::kDepthViewFormat;
-		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		return cmdBuff;
+	};
 
-		attachments[1].format = deferred::kNormalFormat;
-		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		attachments[2].format = deferred::kEmissiveFormat;
-		attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[2].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		attachments[3].format = deferred::kAlbedoFormat;
-		attachments[3].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachments[3].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[3].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attachments[3].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[3].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		attachments[4].format = deferred::kDepthFormat;
-		attachments[4].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachments[4].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[4].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachments[4].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[4].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	bool recreateSwapchain = false;
 
-		//Supass Definition
-		VkAttachmentReference colourAttachments[4]{};
-		colourAttachments[0].attachment = 0; // this refers to attachments[0]
-		colourAttachments[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	std::uint64_t frameNumber = 0;
+
+	// Frame statistics (see cfg::kStatsInterval)
+	using Clock_ = std::chrono::steady_clock;
+	auto statsStart = Clock_::now();
+	float statsWaitMs = 0.f;
+	float statsRecordMs = 0.f;
+	std::uint32_t statsFrames = 0;
 
-		colourAttachments[1].attachment = 1; // this refers to attachments[0]
-		colourAttachments[1].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	// Advance the scene by aDelta seconds. During a replay, the camera and
+	// lights follow the path; otherwise they follow the user's input.
+	float sceneTime = 0.f;
+	auto const advance_scene = [&](float aDelta)
+	{
+		cfg::delta = aDelta;
 
-		colourAttachments[2].attachment = 2; // this refers to attachments[0]
-		colourAttachments[2].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		if (options.replayPath)
+		{
+			auto const pose = sample_camera_pose(replayPath, sceneTime);
+			camera.position = pose.position;
+			camera.yaw = pose.yaw;
+			camera.pitch = pose.pitch;
+			camera.updateCameraAngle();
 
-		colourAttachments[3].attachment = 3; // this refers to attachments[0]
-		colourAttachments[3].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			cfg::lightAngle = sample_light_angle(replayPath, sceneTime);
+		}
+		else if (cfg::moveable)
+		{
+			cfg::lightAngle += cfg::kLightSpeed * aDelta;
+		}
 
-		VkAttachmentReference depthAttachment{};
-		depthAttachment.attachment = 4; // this refers to attachments[1]
-		depthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		if (pathRecorder)
+			pathRecorder.record(sceneTime, CameraPose{ camera.position, camera.yaw, camera.pitch }, cfg::lightAngle);
 
-		VkSubpassDescription subpasses[1]{};
-		subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpasses[0].colorAttachmentCount = sizeof(colourAttachments) / sizeof(colourAttachments[0]);
-		subpasses[0].pColorAttachments = colourAttachments;
-		subpasses[0].pDepthStencilAttachment = &depthAttachment;
+		sceneTime += aDelta;
+	};
 
-		//RenderPass Creation
-		VkSubpassDependency dependencies[1]{};
-		dependencies[0].srcSubpass = 0;
-		dependencies[0].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	// Animate the point lights into the frame's light buffer. Like the scene
+	// uniforms, this must happen after begin_frame().
+	auto const update_point_lights = [&](std::size_t aFrameIndex)
+	{
+		if (!hasPointLights)
+			return;
 
-		//reference the structures above 
-		VkRenderPassCreateInfo passInfo{};
-		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		passInfo.attachmentCount = sizeof(attachments) / sizeof(attachments[0]);
-		passInfo.pAttachments = attachments; //Render Pass attachments
-		passInfo.subpassCount = 1;
-		passInfo.pSubpasses = subpasses;     //Supass Definition
-		passInfo.dependencyCount = sizeof(dependencies) / sizeof(dependencies[0]);
-		passInfo.pDependencies = dependencies;
+		LUT_CPU_ZONE("update_point_lights");
 
-		VkRenderPass rpass = VK_NULL_HANDLE;
-		if (auto const res = vkCreateRenderPass(aWindow.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
+		animate_lights(pointLights, sceneTime, lightData[aFrameIndex]);
+
+		// See lut::update_frame_uniforms()
+		if (auto const res = vmaFlushAllocation(allocator.allocator, lightBuffers[aFrameIndex].allocation, 0, VK_WHOLE_SIZE); VK_SUCCESS != res)
 		{
-			throw lut::Error("Unable to create render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str());
+			throw lut::Error("Unable to flush point lights\n" "vmaFlushAllocation() returned %s", lut::to_string(res).c_str());
 		}
+	};
 
-		return lut::RenderPass(aWindow.device, rpass);
-	}
-
-	lut::PipelineLayout create_deferred_first_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout advancedLayout)
+	// Frame times for the replay report. A frame is timed from the end of
+	// the previous one, so this includes any waiting for the GPU.
+	std::vector<float> replayFrameMs;
+	auto lastFrameEnd = Clock_::now();
+	auto const end_frame = [&]
 	{
+		auto const now = Clock_::now();
+		if (options.replayPath)
+			replayFrameMs.emplace_back(std::chrono::duration<float, std::milli>(now - lastFrameEnd).count());
 
-		VkDescriptorSetLayout layouts[] = { aSceneLayout, advancedLayout };
+		lastFrameEnd = now;
+	};
 
-		//Creating the pipeline layout
-		VkPipelineLayoutCreateInfo layoutInfo{};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
-		layoutInfo.pSetLayouts = layouts;
-		layoutInfo.pushConstantRangeCount = 0;
-		layoutInfo.pPushConstantRanges = nullptr;
+	// Cull the meshes against the frame's view frustum. If the visible set
+	// changes, the cached command buffers are out of date. With GPU
+	// culling, the draw list is unused; the number of drawn meshes is then
+	// read back from the frame in flight's previous submission.
+	//
+	// With --sort-draws, the visible meshes are ordered by material and then
+	// front to back (see render_queue.hpp). The depth is bucketed coarsely
+	// (cfg::kSortDepthBuckets), such that small camera movements do not
+	// reorder the draws, which would invalidate the cached command buffers.
+	std::vector<std::uint32_t> visibleDraws;
+	std::size_t statsVisibleDraws = 0;
+	RenderQueue drawQueue;
+	float statsSortMs = 0.f;
+
+	// Occlusion culling: the drawn meshes by phase, and the rejection rate
+	// (occluded / tested meshes) of each frame
+	std::size_t statsLateDraws = 0;
+	std::vector<float> statsOcclusionRates;
+	auto const update_draw_list = [&](std::size_t aFrameIndex)
+	{
+		// The instanced draws always draw all copies of all meshes
+		if (instanced)
+			return;
 
-		VkPipelineLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		if (options.gpuCulling)
 		{
-			throw lut::Error("Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str());
-		}
-		return lut::PipelineLayout(aContext.device, layout);
-	}
+			// See update_point_lights(): the memory may not be coherent
+			if (auto const res = vmaInvalidateAllocation(allocator.allocator, drawCounts[aFrameIndex].allocation, 0, VK_WHOLE_SIZE); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to invalidate draw count\n" "vmaInvalidateAllocation() returned %s", lut::to_string(res).c_str());
+			}
 
-	lut::Pipeline create_deferred_first_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipeLayout)
-	{
-		//first step  : load shader modules
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, deferred::kVertShaderPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, deferred::kFragShaderPath);
-
-		//Shader stages in the pipeline
-		//We need two here, vert and frag
-		VkPipelineShaderStageCreateInfo  stages[2]{};
-		//vertex  [0]
-		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
-		stages[0].pName = "main";
-
-		//fragment [1]
-		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
-		stages[1].pName = "main";
-
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo
-		VkVertexInputBindingDescription vertexInputs[2]{};
-		//position
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		//normal
-		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 3;
-		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		VkVertexInputAttributeDescription vertexAttributes[2]{};
-		//position
-		vertexAttributes[0].binding = 0;
-		vertexAttributes[0].location = 0;
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[0].offset = 0;
-		//normal
-		vertexAttributes[1].binding = 1;
-		vertexAttributes[1].location = 1;
-		vertexAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[1].offset = 0;
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo 
-
-		VkPipelineVertexInputStateCreateInfo inputInfo{};
-		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 2;
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 2;
-		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
-
-
-		//for rasterization
-		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
-		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		assemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-		//todo list...   Tessellation State   not now
-
-		//viewport state
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = float(aWindow.swapchainExtent.width);
-		viewport.height = float(aWindow.swapchainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+			auto const* counts = drawCountData[aFrameIndex];
+			statsVisibleDraws += counts[0] + counts[1];
 
-		VkRect2D scissor{};
-		scissor.extent = VkExtent2D{ aWindow.swapchainExtent.width,
-									 aWindow.swapchainExtent.height };
-		scissor.offset = VkOffset2D{ 0,0 };
+			// The rate is undefined without any meshes in the frustum (or
+			// before the frame in flight's first submission)
+			statsLateDraws += counts[1];
+			if (options.occlusionCulling && counts[2] > 0)
+				statsOcclusionRates.emplace_back(float(counts[3]) / float(counts[2]));
+			return;
+		}
 
-		VkPipelineViewportStateCreateInfo viewportInfo{};
-		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
-		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
-
-		//Rasterization State
-		VkPipelineRasterizationStateCreateInfo rasterInfo{};
-		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterInfo.depthClampEnable = VK_FALSE;
-		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // like OpenGL
-		rasterInfo.depthBiasEnable = VK_FALSE;
-		rasterInfo.lineWidth = 1.0f;
-
-
-		//Mulitisampling 
-		VkPipelineMultisampleStateCreateInfo sampleInfo{};
-		sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		sampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		//Depth/Stencil State    not now
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
-
-		//Color Blend State  
-		//mask 
-		VkPipelineColorBlendAttachmentState blendStates[4]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		blendStates[1].blendEnable = VK_FALSE;
-		blendStates[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		blendStates[2].blendEnable = VK_FALSE;
-		blendStates[2].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		blendStates[3].blendEnable = VK_FALSE;
-		blendStates[3].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		VkPipelineColorBlendStateCreateInfo blendInfo{};
-		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		blendInfo.attachmentCount = sizeof(blendStates) / sizeof(blendStates[0]);
-		blendInfo.pAttachments = blendStates;
-
-		//Dynamic States  not now
-
-		//Create pipeline
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;  //vert frag
-		pipelineInfo.pStages = stages;
-		pipelineInfo.pVertexInputState = &inputInfo;
-		pipelineInfo.pInputAssemblyState = &assemblyInfo;
-		pipelineInfo.pViewportState = &viewportInfo;
-		pipelineInfo.pRasterizationState = &rasterInfo;
-		pipelineInfo.pMultisampleState = &sampleInfo;
-		pipelineInfo.pColorBlendState = &blendInfo;
-		pipelineInfo.layout = aPipeLayout;
-		pipelineInfo.renderPass = aRenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.pTessellationState = nullptr;
-		pipelineInfo.pDepthStencilState = &depthInfo;
-		pipelineInfo.pDynamicState = nullptr;
+		LUT_CPU_ZONE("frustum_culling");
 
-		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
+		if (cfg::frustumCulling)
 		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
+			cull_boxes(extract_frustum_planes(sceneUniforms.projCam), meshBounds, visibleDraws);
+		}
+		else
+		{
+			visibleDraws.resize(meshBounds.size());
+			for (std::size_t i = 0; i < visibleDraws.size(); ++i)
+				visibleDraws[i] = std::uint32_t(i);
 		}
 
-		return lut::Pipeline(aWindow.device, pipe);
-	}
+		if (options.sortDraws)
+		{
+			auto const start = Clock_::now();
+
+			drawQueue.clear();
+			drawQueue.reserve(visibleDraws.size());
+			for (auto const i : visibleDraws)
+			{
+				glm::vec3 const centre(meshBounds.centreX[i], meshBounds.centreY[i], meshBounds.centreZ[i]);
+				auto const depth = depth_bucket(glm::length(centre - camera.position), cfg::kCameraNear, cfg::kCameraFar, cfg::kSortDepthBuckets);
+				drawQueue.push(make_draw_key(0, 0, newShip.meshes[i].materialIndex, depth), i);
+			}
+			drawQueue.sort();
+			visibleDraws.assign(drawQueue.values().begin(), drawQueue.values().end());
+
+			statsSortMs += std::chrono::duration<float, std::milli>(Clock_::now() - start).count();
+		}
+
+		if (visibleDraws != drawList)
+		{
+			drawList.swap(visibleDraws);
+			++sceneGeneration;
+		}
+
+		statsVisibleDraws += drawList.size();
+	};
 
-	void create_deferred_framebuffers(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, lut::Framebuffer& aFramebuffers, VkImageView aPosView, VkImageView aNormView, VkImageView aEmissiveView, VkImageView aAlbedoView, VkImageView aDepthView)
+	// Feed the GPU time of the frame in flight's previous submission (just
+	// collected) to the resolution controller. A new scale only changes
+	// the viewports, so the command buffers are re-recorded.
+	auto const update_render_scale = [&](std::size_t aFrameIndex)
 	{
-		VkImageView attachments[5] = {
-			aPosView,
-			aNormView,
-			aEmissiveView,
-			aAlbedoView,
-			aDepthView
-		};
+		if (!options.dynamicResolution)
+			return;
 
-		VkFramebufferCreateInfo fbInfo{};
-		fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		fbInfo.flags = 0;      // normal framebuffer
-		fbInfo.renderPass = aRenderPass;
-		fbInfo.attachmentCount = sizeof(attachments) / sizeof(attachments[0]); //updated
-		fbInfo.pAttachments = attachments;
-		fbInfo.width = aWindow.swapchainExtent.width;
-		fbInfo.height = aWindow.swapchainExtent.height;
-		fbInfo.layers = 1;
+		auto const time = gpuProfiler.latest(std::uint32_t(aFrameIndex));
+		if (!resolution.update(time.frame, time.ms))
+			return;
 
-		VkFramebuffer fb = VK_NULL_HANDLE;
-		if (auto const res = vkCreateFramebuffer(aWindow.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
+		renderExtent = scaled_extent(target.extent, resolution.scale());
+		resolution.set_first_frame(frameNumber);
+		++sceneGeneration;
+	};
+
+	// Switch the lighting pipeline to the variant of the light count that
+	// was selected with the number keys. The variants were started at
+	// startup, so this looks them up, or waits for a build that has not
+	// finished yet. The pipeline is baked into the command buffers, so they
+	// are re-recorded.
+	auto const update_shading_variant = [&]
+	{
+		if (hasPointLights)
+			return;
+
+		assert(sceneUniforms.constant >= 0 && std::uint32_t(sceneUniforms.constant) <= glsl::kSceneLightCount);
+		auto const count = std::uint32_t(sceneUniforms.constant);
+		if (count == shadingVariant.lightCount)
+			return;
+
+		shadingVariant.lightCount = count;
+		deferred_second_pipe = lightingVariants.get(specialization_constants(shadingVariant));
+		++sceneGeneration;
+	};
+
+	// Average number of drawn meshes over the last aFrames frames
+	auto const print_draw_stats = [&](double aFrames)
+	{
+		if (options.occlusionCulling && !statsOcclusionRates.empty())
 		{
-			throw lut::Error("Unable to create framebuffer" "vkCreateFramebuffer() returned %s", lut::to_string(res).c_str());
+			auto const [minRate, maxRate] = std::minmax_element(statsOcclusionRates.begin(), statsOcclusionRates.end());
+			double sumRate = 0.;
+			for (auto const rate : statsOcclusionRates)
+				sumRate += rate;
+
+			std::printf("  %.1f of %zu meshes drawn (GPU frustum, normal cone and occlusion culling), %.1f of these in the late phase\n", double(statsVisibleDraws) / aFrames, meshBounds.size(), double(statsLateDraws) / aFrames);
+			std::printf("  occlusion rejection rate per frame: %.1f%% mean, %.1f%% min, %.1f%% max (of the meshes in the frustum)\n", 100. * sumRate / double(statsOcclusionRates.size()), 100. * *minRate, 100. * *maxRate);
+		}
+		else if (options.gpuCulling)
+			std::printf("  %.1f of %zu meshes drawn (GPU frustum and normal cone culling)\n", double(statsVisibleDraws) / aFrames, meshBounds.size());
+		else if (instanced)
+		{
+			auto const& binds = lastRecordBinds;
+			std::printf("  %zu meshes x %u copies drawn with %u draws (%s), %u descriptor set and %u vertex buffer binds per recording\n", meshBounds.size(), options.instances, binds.draws, options.drawPerInstance ? "one per copy" : "instanced", binds.descriptorSets, binds.vertexBuffers);
+		}
+		else
+		{
+			std::printf("  %.1f of %zu meshes drawn (frustum culling %s, %s)\n", double(statsVisibleDraws) / aFrames, meshBounds.size(), cfg::frustumCulling ? "on" : "off", culling_isa());
+
+			// Recordings may be rare with the command cache, hence the binds
+			// of the latest one rather than an average
+			auto const& binds = lastRecordBinds;
+			std::printf("  last recording: %u pipeline, %u descriptor set and %u vertex buffer binds for %u draws (%s, %.3f ms/frame sorting)\n", binds.pipelines, binds.descriptorSets, binds.vertexBuffers, binds.draws, options.sortDraws ? "sorted by material and depth" : "file order", statsSortMs / aFrames);
+		}
+	};
+
+	if (options.headless)
+	{
+		// Frames are copied to host-visible buffers by an extra command
+		// buffer per frame, and written out once the frame's timeline value
+		// has been reached. The command buffers are allocated from the
+		// frame's pool, and are thus reset with it in begin_frame().
+		bool const writeFrames = nullptr != options.outputDir;
+
+		std::vector<lut::Buffer> readbackBuffers;
+		std::vector<VkCommandBuffer> readbackCmds;
+		if (writeFrames)
+		{
+			for (auto const& frame : frames)
+			{
+				readbackBuffers.emplace_back(lut::create_readback_buffer(allocator, target.extent));
+				readbackCmds.emplace_back(lut::alloc_command_buffer(context, frame.commandPool.handle));
+			}
+		}
+
+		// Number of the frame whose pixels are pending in the frame's
+		// readback buffer, plus one. Zero if there is nothing to write.
+		std::vector<std::uint64_t> pendingWrites(frames.size(), 0);
+
+		auto const write_pending = [&](std::size_t aFrameIndex)
+		{
+			if (0 == pendingWrites[aFrameIndex])
+				return;
+
+			LUT_CPU_ZONE("write_png");
+
+			char path[1024];
+			std::snprintf(path, sizeof(path), "%s/frame_%05llu.png", options.outputDir, static_cast<unsigned long long>(pendingWrites[aFrameIndex] - 1));
+			lut::write_png(path, allocator, readbackBuffers[aFrameIndex], target.extent);
+
+			pendingWrites[aFrameIndex] = 0;
+		};
+
+		std::uint64_t const frameLimit = options.replayPath ? replayPath.frameCount : options.headlessFrames;
+		for (; frameNumber < frameLimit; ++frameNumber)
+		{
+			LUT_CPU_ZONE("frame");
+			lut::cpu_profiler::set_frame(frameNumber);
+
+			std::size_t const frameIndex = std::size_t(frameNumber % frames.size());
+			auto& frame = frames[frameIndex];
+
+			statsWaitMs += lut::begin_frame(context, timeline, frame, frameNumber);
+
+			deletionQueue.collect(timeline);
+			gpuProfiler.collect(timeline);
+			update_render_scale(frameIndex);
+
+			// the frame's previous submission has completed
+			write_pending(frameIndex);
+
+			// A fixed time step makes runs reproducible, independently of how
+			// fast the device renders.
+			advance_scene(options.replayPath ? replayPath.timestep : cfg::kHeadlessFrameTime);
+
+			update_scene_uniforms(camera, sceneUniforms, target.extent.width, target.extent.height);
+			sceneUniforms.renderExtent = glm::uvec2(renderExtent.width, renderExtent.height);
+			lut::update_frame_uniforms(allocator, frame, &sceneUniforms, sizeof(glsl::SceneUniform));
+			update_point_lights(frameIndex);
+			update_draw_list(frameIndex);
+
+			// Each frame in flight has its own offscreen image.
+			auto const imageIndex = std::uint32_t(frameIndex);
+
+			auto const recordStart = Clock_::now();
+
+			VkCommandBuffer cmdBuffs[2] = { prepare_commands(frameIndex, imageIndex), VK_NULL_HANDLE };
+			std::uint32_t cmdCount = 1;
+
+			if (writeFrames)
+			{
+				VkCommandBufferBeginInfo beginInfo{};
+				beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+				if (auto const res = vkBeginCommandBuffer(readbackCmds[frameIndex], &beginInfo); VK_SUCCESS != res)
+				{
+					throw lut::Error("Unable to begin recording readback command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+				}
+
+				lut::record_image_readback(readbackCmds[frameIndex], offscreen.images[imageIndex].image, target.extent, readbackBuffers[frameIndex].buffer);
+
+				if (auto const res = vkEndCommandBuffer(readbackCmds[frameIndex]); VK_SUCCESS != res)
+				{
+					throw lut::Error("Unable to end recording readback command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+				}
+
+				cmdBuffs[cmdCount++] = readbackCmds[frameIndex];
+				pendingWrites[frameIndex] = frameNumber + 1;
+			}
+
+			statsRecordMs += std::chrono::duration<float, std::milli>(Clock_::now() - recordStart).count();
+
+			// No swapchain, so no binary semaphores to wait for or signal.
+			{
+				LUT_CPU_ZONE("submit");
+				frame.timelineValue = timeline.submit(context.graphicsQueue, cmdCount, cmdBuffs);
+			}
+			gpuProfiler.submitted(std::uint32_t(frameIndex), frame.timelineValue, frameNumber);
+
+			camera.updateCameraPosition();
+
+			end_frame();
 		}
-		aFramebuffers = lut::Framebuffer(aWindow.device, fb);
 
+		timeline.wait(timeline.last_submitted());
+
+		for (std::size_t i = 0; i < pendingWrites.size(); ++i)
+			write_pending(i);
+
+		auto const totalMs = std::chrono::duration<float, std::milli>(Clock_::now() - statsStart).count();
+		auto const frameCount = float(std::max<std::uint64_t>(frameNumber, 1));
+		std::printf("Headless: %llu frames at %ux%u: %.3f ms/frame, %.3f ms/frame waiting for the GPU, %.3f ms/frame recording%s\n", static_cast<unsigned long long>(frameNumber), target.extent.width, target.extent.height, totalMs / frameCount, statsWaitMs / frameCount, statsRecordMs / frameCount, writeFrames ? " (including readback)" : "");
+
+		print_draw_stats(frameCount);
+
+		gpuProfiler.collect(timeline);
+		print_gpu_stats(gpuProfiler);
+
+		vkDeviceWaitIdle(context.device);
+		write_traces(options, timeline, gpuProfiler);
+
+		if (options.pipelineCachePath)
+			lut::save_pipeline_cache(context, options.pipelineCachePath);
+
+		if (options.replayPath)
+			write_replay_report(options, replayPath, target.extent, replayFrameMs, gpuProfiler, resolution);
+
+		return 0;
 	}
 
-	void create_swapchain_framebuffers(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, std::vector<lut::Framebuffer>& aFramebuffers, VkImageView aDepthView)
+	// Signalled by a frame's submission, and waited for by the present of
+	// its swapchain image
+	std::vector<lut::Semaphore> renderFinished = lut::create_present_semaphores(context, window.swapImages.size());
+
+	while (!glfwWindowShouldClose(window.window))
 	{
-		assert(aFramebuffers.empty());
+		if (options.replayPath && frameNumber >= replayPath.frameCount)
+			break;
+
+		LUT_CPU_ZONE("frame");
+		lut::cpu_profiler::set_frame(frameNumber);
+
+		// Let GLFW process events.
+		// glfwPollEvents() checks for events, processes them. If there are no
+		// events, it will return immediately. Alternatively, glfwWaitEvents()
+		// will wait for any event to occur, process it, and only return at
+		// that point. The former is useful for applications where you want to
+		// render as fast as possible, whereas the latter is useful for
+		// input-driven applications, where redrawing is only needed in
+		// reaction to user input (or similar).
+		glfwPollEvents(); // or: glfwWaitEvents()
 
-		for (int i = 0; i < aWindow.swapViews.size(); i++)
+		// Recreate swap chain
+		if (recreateSwapchain)
 		{
-			VkImageView attachments[2] = {
-				aWindow.swapViews[i],
-				aDepthView
-			};
+			// re-create swapchain and associated resources - see Exercise 3!
+			// All rendering work has been submitted via the timeline, but
+			// the presents may be on a separate queue. The old swapchain's
+			// images and the present semaphores must no longer be in use.
+			timeline.wait(timeline.last_submitted());
+			if (auto const res = vkQueueWaitIdle(window.presentQueue); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to wait for present queue\n" "vkQueueWaitIdle() returned %s", lut::to_string(res).c_str());
+			}
 
-			VkFramebufferCreateInfo fbInfo{};
-			fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			fbInfo.flags = 0;      // normal framebuffer
-			fbInfo.renderPass = aRenderPass;
-			fbInfo.attachmentCount = 2; //updated
-			fbInfo.pAttachments = attachments;
-			fbInfo.width = aWindow.swapchainExtent.width;
-			fbInfo.height = aWindow.swapchainExtent.height;
-			fbInfo.layers = 1;
+			auto const changes = lut::recreate_swapchain(window);
+			target = make_render_target(window);
+			renderFinished = lut::create_present_semaphores(context, window.swapImages.size());
+
+			// Only the passes that render to the target depend on its
+			// format: the merged pass, or the lighting pass (unless it
+			// renders to the lighting image, whose format is fixed). The
+			// old pass' pipelines go first, as the new pass may reuse its
+			// handle.
+			if (changes.changedFormat && (gbufferDesc.transient || (needsSecondPass && !options.dynamicResolution)))
+			{
+				// Variants may still be building for the old pass
+				pipelineBuilder.wait_idle();
+
+				if (gbufferDesc.transient)
+				{
+					pipelineRegistry.evict(deferred_first_pass.handle);
+					deferred_first_pass = create_deferred_merged_pass(context, gbufferDesc, target);
+					lightingPass = deferred_first_pass.handle;
+
+					// The G-buffer pipelines are in the merged pass' first
+					// subpass
+					deferred_first_pipe = pipelineRegistry.get(deferred_first_pipeline_desc(deferred_first_pass.handle, deferred_first_layout.handle, gbufferDesc));
+					if (options.gpuCulling)
+						indirectGBufferPipe = pipelineRegistry.get(deferred_first_pipeline_desc(deferred_first_pass.handle, indirectGBufferLayout.handle, gbufferDesc, true));
+					if (instanced)
+						instancedGBufferPipe = pipelineRegistry.get(deferred_first_pipeline_desc(deferred_first_pass.handle, instancedGBufferLayout.handle, gbufferDesc, true, true));
+				}
+				else
+				{
+					pipelineRegistry.evict(deferred_second_pass.handle);
+					deferred_second_pass = create_deferred_second_pass(context, target, gbufferDesc);
+					lightingPass = deferred_second_pass.handle;
+
+					if (options.lightVolumes)
+					{
+						auto [stencilDesc, lightDesc] = light_volume_pipeline_descs(lightingPass, deferred_second_layout.handle, gbufferDesc);
+						lightDesc.specialization = specialization_constants(shadingVariant);
+						volumeStencilPipe = pipelineRegistry.get(stencilDesc);
+						volumeLightPipe = pipelineRegistry.get(lightDesc);
+					}
+				}
+
+				// Variants of the other light counts are built when they are
+				// first selected
+				lightingVariants.reset(deferred_second_pipeline_desc(lightingPass, deferred_second_layout.handle, gbufferDesc, clustered));
+				deferred_second_pipe = lightingVariants.get(specialization_constants(shadingVariant));
+			}
 
-			VkFramebuffer fb = VK_NULL_HANDLE;
-			if (auto const res = vkCreateFramebuffer(aWindow.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
+			// The pipelines' viewports are dynamic, so a new size does not
+			// require new pipelines
+			//TODO: (Section 6) re-create depth buffer image
+			if (changes.changedSize)
 			{
-				throw lut::Error("Unable to create framebuffer for swap chain image %zu\n" "vkCreateFramebuffer() returned %s", i, lut::to_string(res).c_str());
+				if (needsSecondPass && !gbufferDesc.stencil)
+					std::tie(depthBuffer, depthBufferView) = create_depth_buffer(context, allocator, target.extent);
+
+				gbuffer = create_gbuffer(context, allocator, gbufferDesc, target.extent);
+				update_deferred_descriptors(context, deferredDescriptors, gbufferSampler.handle, gbuffer, gbufferDesc);
+
+				if (options.occlusionCulling)
+				{
+					hiz = create_hiz_pyramid(context, allocator, target.extent);
+					update_hiz_descriptors(context, hizDescriptors, drawCullDescriptors, gbufferSampler.handle, gbuffer, hiz, hizCounterBuffer.buffer);
+				}
+
+				if (usesLightingImage)
+				{
+					std::tie(lightingImage, lightingView) = create_lighting_image(context, allocator, target);
+					lightingTarget.extent = target.extent;
+					lightingTarget.images = { lightingImage.image };
+					lightingTarget.views = { lightingView.handle };
+				}
+
+				if (options.computeLighting)
+					update_lighting_output_descriptors(context, lightingDescriptors, lightingView.handle);
+
+				renderExtent = scaled_extent(target.extent, resolution.scale());
+			}
+
+			framebuffers.clear();
+			//vkDestroyFramebuffer(window.device,intermediateBuff.handle,allocator.allocator);
+			if (gbufferDesc.transient)
+			{
+				create_merged_framebuffers(context, target, deferred_first_pass.handle, framebuffers, gbuffer);
+			}
+			else
+			{
+				create_deferred_framebuffers(context, target.extent, deferred_first_pass.handle, deferredBuff, gbuffer);
+				if (options.depthPrepass)
+					create_depth_prepass_framebuffer(context, target.extent, depthPrepassPass.handle, depthPrepassBuff, gbuffer);
+				if (needsSecondPass)
+					create_swapchain_framebuffers(context, lightingPassTarget, deferred_second_pass.handle, framebuffers, gbufferDesc.stencil ? gbuffer.depthView.handle : depthBufferView.handle);
 			}
-			aFramebuffers.emplace_back(lut::Framebuffer(aWindow.device, fb));
+
+			// framebuffers (and possibly their number) changed
+			commandCache.resize(frames.size() * target.views.size());
+			++sceneGeneration;
+			
+			recreateSwapchain = false;
+			continue;
+		}
+
+		// wait for the frame context to be available; this is where the CPU
+		// blocks if it gets more than kFramesInFlight frames ahead of the GPU
+		std::size_t const frameIndex = std::size_t(frameNumber % frames.size());
+		auto& frame = frames[frameIndex];
+
+		statsWaitMs += lut::begin_frame(context, timeline, frame, frameNumber);
+
+		// release resources that the GPU has finished with
+		deletionQueue.collect(timeline);
+		gpuProfiler.collect(timeline);
+		update_render_scale(frameIndex);
+
+		//acquire swapchain image.
+		unsigned int imageIndex = 0;
+		VkResult acquireRes = VK_SUCCESS;
+		{
+			LUT_CPU_ZONE("acquire");
+			acquireRes = vkAcquireNextImageKHR(window.device, window.swapchain,
+				std::numeric_limits<std::uint64_t>::max(),
+				frame.imageAvailable.handle,
+				VK_NULL_HANDLE,
+				&imageIndex);
+		}
+		if (VK_SUBOPTIMAL_KHR == acquireRes || VK_ERROR_OUT_OF_DATE_KHR == acquireRes)
+		{
+			recreateSwapchain = true;
+			continue;
+		}
+
+		if (VK_SUCCESS != acquireRes)
+		{
+			throw lut::Error("Unable to acquire enxt swapchain image\n" "vkAcquireNextImageKHR() returned %s", lut::to_string(acquireRes).c_str());
 		}
 
-		assert(aWindow.swapViews.size() == aFramebuffers.size());
+		//delta time; a replay uses the path's fixed time step instead
+		float const now = (float)glfwGetTime();
+		advance_scene(options.replayPath ? replayPath.timestep : now - cfg::last);
+		cfg::last = now;
+
+		update_scene_uniforms(camera, sceneUniforms, target.extent.width, target.extent.height);
+		sceneUniforms.renderExtent = glm::uvec2(renderExtent.width, renderExtent.height);
+		lut::update_frame_uniforms(allocator, frame, &sceneUniforms, sizeof(glsl::SceneUniform));
+		update_point_lights(frameIndex);
+		update_draw_list(frameIndex);
+		update_shading_variant();
+
+		// record and submit commands
+		auto const recordStart = Clock_::now();
+
+		VkCommandBuffer cmdBuff = prepare_commands(frameIndex, imageIndex);
+
+		statsRecordMs += std::chrono::duration<float, std::milli>(Clock_::now() - recordStart).count();
+
+		assert(std::size_t(imageIndex) < renderFinished.size());
+		frame.timelineValue = submit_commands(
+			context,
+			timeline,
+			cmdBuff,
+			frame.imageAvailable.handle,
+			renderFinished[imageIndex].handle);
+
+		gpuProfiler.submitted(std::uint32_t(frameIndex), frame.timelineValue, frameNumber);
+
+		//present rendered images (note: use the present_results() method)
+		present_results(window.presentQueue,
+			window.swapchain,
+			imageIndex,
+			renderFinished[imageIndex].handle,
+			recreateSwapchain
+		);
+
+		camera.updateCameraPosition();
+
+		++frameNumber;
+		end_frame();
+
+		// The time spent waiting in begin_frame() shows how CPU and GPU
+		// overlap: close to zero means that we are CPU bound, whereas a wait
+		// close to the frame time means that the GPU is the bottleneck.
+		if (++statsFrames == cfg::kStatsInterval)
+		{
+			bool const useCache = cfg::cacheCommands && !cfg::parallelRecording;
+
+			auto const statsNow = Clock_::now();
+			auto const totalMs = std::chrono::duration<float, std::milli>(statsNow - statsStart).count();
+			std::printf("%u frames in flight: %.3f ms/frame, %.3f ms/frame waiting for the GPU, %.3f ms/frame recording (command cache %s, %llu recordings, %zu recording threads)\n", cfg::kFramesInFlight, totalMs / statsFrames, statsWaitMs / statsFrames, statsRecordMs / statsFrames, useCache ? "on" : "off", static_cast<unsigned long long>(commandCache.recordCount), cfg::parallelRecording ? recordWorkers.thread_count() : std::size_t(1));
+			print_draw_stats(statsFrames);
+			print_gpu_stats(gpuProfiler);
+
+			statsStart = statsNow;
+			statsWaitMs = 0.f;
+			statsRecordMs = 0.f;
+			statsVisibleDraws = 0;
+			statsSortMs = 0.f;
+			statsLateDraws = 0;
+			statsOcclusionRates.clear();
+			statsFrames = 0;
+		}
 	}
+
+	// Cleanup takes place automatically in the destructors, but we sill need
+	// to ensure that all Vulkan commands have finished before that.
+	vkDeviceWaitIdle(context.device);
+
+	write_traces(options, timeline, gpuProfiler);
+
+	if (options.pipelineCachePath)
+		lut::save_pipeline_cache(context, options.pipelineCachePath);
+
+	if (options.replayPath)
+		write_replay_report(options, replayPath, target.extent, replayFrameMs, gpuProfiler, resolution);
+
+	return 0;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "\n" );
+	std::fprintf( stderr, "Error: %s\n", eErr.what() );
+	return 1;
 }
 
-//deferred second pass
+//glfw functions and scene uniform update
 namespace
 {
-	lut::RenderPass create_deferred_second_pass(lut::VulkanWindow const& aWindow)
+	void glfw_callback_key_press(GLFWwindow* aWindow, int aKey, int /*aScanCode*/, int aAction, int /*aModifierFlags*/)
 	{
-		//Render Pass attachments
-		VkAttachmentDescription attachments[2]{};
-		attachments[0].format = aWindow.swapchainFormat;
-		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		if (GLFW_KEY_ESCAPE == aKey && GLFW_PRESS == aAction)
+		{
+			glfwSetWindowShouldClose(aWindow, GLFW_TRUE);
+		}
 
-		attachments[1].format = deferred::kDepthFormat;
-		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-		//Supass Definition
-		VkAttachmentReference subpassAttachments[1]{};
-		subpassAttachments[0].attachment = 0; // this refers to attachments[0]
-		subpassAttachments[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		auto* uniforms = reinterpret_cast<glsl::SceneUniform*>(glfwGetWindowUserPointer(aWindow));
 
-		VkSubpassDescription subpasses[1]{};
-		subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpasses[0].colorAttachmentCount = 1;
-		subpasses[0].pColorAttachments = subpassAttachments;
-		subpasses[0].pDepthStencilAttachment = nullptr;
+		//For user control different light numbers
+		if (GLFW_KEY_0 == aKey && GLFW_PRESS == aAction)
+		{
+			uniforms->constant = 0;
+		}
+		if (GLFW_KEY_1 == aKey && GLFW_PRESS == aAction)
+		{
+			uniforms->constant = 1;
+		}
+		else if (GLFW_KEY_2 == aKey && GLFW_PRESS == aAction)
+		{
+			uniforms->constant = 2;
+		}
+		else if (GLFW_KEY_3 == aKey && GLFW_PRESS == aAction)
+		{
+			uniforms->constant = 3;
+		}
+		else if (GLFW_KEY_4 == aKey && GLFW_PRESS == aAction)
+		{
+			uniforms->constant = 4;
+		}
 
-		//RenderPass Creation
-		//reference the structures above 
-		VkRenderPassCreateInfo passInfo{};
-		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		passInfo.attachmentCount = sizeof(attachments) / sizeof(attachments[0]);
-		passInfo.pAttachments = attachments; //Render Pass attachments
-		passInfo.subpassCount = 1;
-		passInfo.pSubpasses = subpasses;     //Supass Definition
-		passInfo.dependencyCount = 0;
-		passInfo.pDependencies = nullptr;
+		//For moveable light
+		if (GLFW_KEY_SPACE == aKey && GLFW_PRESS == aAction)
+		{
+			cfg::moveable = !cfg::moveable;
+		}
 
-		VkRenderPass rpass = VK_NULL_HANDLE;
-		if (auto const res = vkCreateRenderPass(aWindow.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
+		//For comparing cached and per-frame recorded command buffers
+		if (GLFW_KEY_C == aKey && GLFW_PRESS == aAction)
+		{
+			cfg::cacheCommands = !cfg::cacheCommands;
+			std::printf("Command buffer cache %s\n", cfg::cacheCommands ? "enabled" : "disabled");
+		}
+
+		//For comparing drawing all meshes and the visible ones
+		if (GLFW_KEY_F == aKey && GLFW_PRESS == aAction)
+		{
+			cfg::frustumCulling = !cfg::frustumCulling;
+			std::printf("Frustum culling %s\n", cfg::frustumCulling ? "enabled" : "disabled");
+		}
+
+		//For comparing serial and parallel command recording
+		if (GLFW_KEY_P == aKey && GLFW_PRESS == aAction)
+		{
+			cfg::parallelRecording = !cfg::parallelRecording;
+			std::printf("Parallel command recording %s\n", cfg::parallelRecording ? "enabled" : "disabled");
+		}
+
+		// forward/backward
+		if (glfwGetKey(aWindow, GLFW_KEY_W) == GLFW_PRESS)
+			camera.speedZ = 1.0f;
+		else if (glfwGetKey(aWindow, GLFW_KEY_S) == GLFW_PRESS)
+			camera.speedZ = -1.0f;
+		else
+		{
+			camera.speedZ = 0.f;
+		}
+
+		// left/right
+		if (glfwGetKey(aWindow, GLFW_KEY_A) == GLFW_PRESS)
+			camera.speedX = -1.f;
+		else if (glfwGetKey(aWindow, GLFW_KEY_D) == GLFW_PRESS)
+			camera.speedX = 1.f;
+		else
+		{
+			camera.speedX = 0.f;
+		}
+
+		// up/down
+		if (glfwGetKey(aWindow, GLFW_KEY_Q) == GLFW_PRESS)
+			camera.speedY = 1.f;
+		else if (glfwGetKey(aWindow, GLFW_KEY_E) == GLFW_PRESS)
+			camera.speedY = -1.f;
+		else
+		{
+			camera.speedY = 0.f;
+		}
+
+		// speed up/down
+		if (glfwGetKey(aWindow, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+			camera.speedScalar = 2.f;
+		else if (glfwGetKey(aWindow, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
+			camera.speedScalar = 0.05f;
+	}
+
+	void glfw_callback_cursor_pos(GLFWwindow* window, double xPos, double yPos)
+	{
+
+		if (cfg::enableMouse == true)
+		{
+			if (cfg::firstMouse)
+			{
+				cfg::lastX = (float)xPos;
+				cfg::lastY = (float)yPos;
+				cfg::firstMouse = false;
+			}
+
+			float deltaX, deltaY;
+			deltaX = (float)xPos - cfg::lastX;
+			deltaY = cfg::lastY - (float)yPos;
+
+			cfg::lastX = (float)xPos;
+			cfg::lastY = (float)yPos;
+
+			camera.processMouseMovement(deltaX, deltaY);
+		}
+	}
+
+	void glfw_callback_mouse_button(GLFWwindow* window, int aButton, int aAction, int)
+	{
+		if (GLFW_MOUSE_BUTTON_RIGHT == aButton && GLFW_PRESS == aAction)
+		{
+			cfg::enableMouse = !cfg::enableMouse;
+		}
+	}
+
+
+	void update_scene_uniforms(Camera& camera,
+		glsl::SceneUniform& aSceneUniforms,
+		std::uint32_t aFramebufferWidth,
+		std::uint32_t aFramebufferHeight)
+	{
+		LUT_CPU_ZONE("update_scene_uniforms");
+
+		//initilize SceneUniform members
+		float const aspect = aFramebufferWidth / float(aFramebufferHeight);
+
+		aSceneUniforms.projection = glm::perspectiveRH_ZO(   //right hand clip space      z-axis from 0 to 1
+			lut::Radians(cfg::kCameraFov).value(),
+			aspect,
+			cfg::kCameraNear,
+			cfg::kCameraFar
+		);
+		aSceneUniforms.projection[1][1] *= -1.f;
+		aSceneUniforms.camera = camera.getViewMatrix();
+		aSceneUniforms.camPos = camera.position;
+		aSceneUniforms.viewInv = glm::inverse(aSceneUniforms.camera);
+		aSceneUniforms.projectionInv = glm::inverse(aSceneUniforms.projection);
+		//aSceneUniforms.camPos = aSceneUniforms.projection * aSceneUniforms.view * aSceneUniforms.model;
+		aSceneUniforms.projCam = aSceneUniforms.projection * aSceneUniforms.camera;
+
+		if (cfg::lightAngle != cfg::appliedLightAngle)
+		{
+			glm::mat4 trans = glm::mat4(1.f);
+			glm::mat4 rotate = glm::rotate(trans, glm::radians(cfg::lightAngle - cfg::appliedLightAngle), glm::vec3(0.f, 1.f, 0.f));
+			for (int i = 0; i < 4; i++)
+				aSceneUniforms.lights[i].position = rotate * aSceneUniforms.lights[i].position;
+
+			cfg::appliedLightAngle = cfg::lightAngle;
+		}
+	}
+}
+
+//deferred first pass
+namespace
+{
+	lut::RenderPass create_deferred_first_pass(lut::VulkanContext const& aContext, GBufferDesc const& aGBuffer, bool aLoad)
+	{
+		auto const colourCount = std::uint32_t(aGBuffer.colourFormats.size());
+
+		// A continued pass finds the images where the first one left them
+		auto const loadOp = aLoad ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+
+		//Render Pass attachments: the colour targets, followed by depth
+		std::vector<VkAttachmentDescription> attachments(colourCount + 1);
+		std::vector<VkAttachmentReference> colourAttachments(colourCount);
+		for (std::uint32_t i = 0; i < colourCount; ++i)
+		{
+			attachments[i].format = aGBuffer.colourFormats[i];
+			attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachments[i].loadOp = loadOp;
+			attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachments[i].initialLayout = aLoad ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+			attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			colourAttachments[i].attachment = i;
+			colourAttachments[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+
+		// The depth buffer is only kept if the lighting pass reconstructs
+		// positions from it, or uses it for the light volumes (stencil), or
+		// if the Hi-Z pyramid is built from it. The depth pre-pass leaves
+		// it (and the cleared stencil) in the attachment layout.
+		auto const depthLoadOp = aGBuffer.depthPrepass ? VK_ATTACHMENT_LOAD_OP_LOAD : loadOp;
+
+		auto& depth = attachments[colourCount];
+		depth.format = aGBuffer.depthFormat;
+		depth.samples = VK_SAMPLE_COUNT_1_BIT;
+		depth.loadOp = depthLoadOp;
+		depth.storeOp = aGBuffer.readDepth || aGBuffer.stencil || aGBuffer.sampleDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth.stencilLoadOp = aGBuffer.stencil ? depthLoadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depth.stencilStoreOp = aGBuffer.stencil ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth.initialLayout = aLoad ? gbuffer_depth_layout(aGBuffer) : aGBuffer.depthPrepass ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		depth.finalLayout = gbuffer_depth_layout(aGBuffer);
+
+		VkAttachmentReference depthAttachment{};
+		depthAttachment.attachment = colourCount;
+		depthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpasses[1]{};
+		subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[0].colorAttachmentCount = colourCount;
+		subpasses[0].pColorAttachments = colourAttachments.data();
+		subpasses[0].pDepthStencilAttachment = &depthAttachment;
+
+		//RenderPass Creation
+		VkSubpassDependency dependencies[2]{};
+		dependencies[0].srcSubpass = 0;
+		dependencies[0].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		// The light volumes test against the depth and update the stencil
+		if (aGBuffer.stencil)
+		{
+			dependencies[0].dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[0].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		}
+
+		// With several frames in flight, the G-buffer images are shared
+		// between frames. The previous frame's second pass must have finished
+		// reading them before this pass overwrites them (write-after-read).
+		// The lighting pass reads them in either the fragment or the compute
+		// shader (--compute-lighting).
+		dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].dstSubpass = 0;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = 0;
+		dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		// ... and the previous frame's light volumes must be done with the
+		// stencil (write-after-write)
+		if (aGBuffer.stencil)
+		{
+			dependencies[1].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		}
+
+		// A continued pass reads and writes what the first pass wrote, after
+		// the Hi-Z build (compute) has read the depth
+		if (aLoad)
+		{
+			dependencies[1].srcStageMask |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
+
+		// The depth pre-pass' depth is tested against (read-after-write)
+		if (aGBuffer.depthPrepass)
+		{
+			dependencies[1].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
+
+		//reference the structures above 
+		VkRenderPassCreateInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		passInfo.attachmentCount = std::uint32_t(attachments.size());
+		passInfo.pAttachments = attachments.data(); //Render Pass attachments
+		passInfo.subpassCount = 1;
+		passInfo.pSubpasses = subpasses;     //Supass Definition
+		passInfo.dependencyCount = sizeof(dependencies) / sizeof(dependencies[0]);
+		passInfo.pDependencies = dependencies;
+
+		VkRenderPass rpass = VK_NULL_HANDLE;
+		if (auto const res = vkCreateRenderPass(aContext.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::RenderPass(aContext.device, rpass);
+	}
+
+	lut::RenderPass create_depth_prepass(lut::VulkanContext const& aContext, GBufferDesc const& aGBuffer)
+	{
+		// The stencil is cleared here, as the G-buffer pass loads it
+		VkAttachmentDescription attachments[1]{};
+		attachments[0].format = aGBuffer.depthFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = aGBuffer.stencil ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = aGBuffer.stencil ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachment{};
+		depthAttachment.attachment = 0;
+		depthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpasses[1]{};
+		subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[0].colorAttachmentCount = 0;
+		subpasses[0].pDepthStencilAttachment = &depthAttachment;
+
+		// The G-buffer pass tests against the depth (see
+		// create_deferred_first_pass()). Before that, the previous frame must
+		// have finished reading the depth (write-after-read): the lighting
+		// pass or the light volumes.
+		VkSubpassDependency dependencies[2]{};
+		dependencies[0].srcSubpass = 0;
+		dependencies[0].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].dstSubpass = 0;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		passInfo.attachmentCount = 1;
+		passInfo.pAttachments = attachments;
+		passInfo.subpassCount = 1;
+		passInfo.pSubpasses = subpasses;
+		passInfo.dependencyCount = sizeof(dependencies) / sizeof(dependencies[0]);
+		passInfo.pDependencies = dependencies;
+
+		VkRenderPass rpass = VK_NULL_HANDLE;
+		if (auto const res = vkCreateRenderPass(aContext.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create depth pre-pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::RenderPass(aContext.device, rpass);
+	}
+
+	lut::PipelineLayout create_deferred_first_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout advancedLayout)
+	{
+
+		VkDescriptorSetLayout layouts[] = { aSceneLayout, advancedLayout };
+
+		//Creating the pipeline layout
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = 0;
+		layoutInfo.pPushConstantRanges = nullptr;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str());
+		}
+		return lut::PipelineLayout(aContext.device, layout);
+	}
+
+	lut::PipelineDesc deferred_first_pipeline_desc(VkRenderPass aRenderPass, VkPipelineLayout aPipeLayout, GBufferDesc const& aGBuffer, bool aMaterialBuffer, bool aInstanced)
+	{
+		assert(aMaterialBuffer || !aInstanced);
+		bool const compact = GBufferLayout::compact == aGBuffer.layout;
+
+		// Indexed by [material buffer][compact]
+		char const* const fragPaths[2][2] = {
+			{ deferred::kFragShaderPath, deferred::kCompactFragShaderPath },
+			{ deferred::kIndirectFragShaderPath, deferred::kCompactIndirectFragShaderPath }
+		};
+
+		lut::PipelineDesc desc;
+		desc.vertexShader = aInstanced ? deferred::kInstancedVertShaderPath : aMaterialBuffer ? deferred::kIndirectVertShaderPath : deferred::kVertShaderPath;
+		desc.fragmentShader = fragPaths[aMaterialBuffer][compact];
+
+		// Position and normal
+		desc.vertexBindings = {
+			lut::vertex_binding(0, sizeof(float) * 3),
+			lut::vertex_binding(1, sizeof(float) * 3)
+		};
+		desc.vertexAttributes = {
+			lut::vertex_attribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT),
+			lut::vertex_attribute(1, 1, VK_FORMAT_R32G32B32_SFLOAT)
+		};
+
+		// Per-instance data (instanced draws only): the transform rows and
+		// the material override
+		if (aInstanced)
+		{
+			desc.vertexBindings.emplace_back(lut::vertex_binding(2, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE));
+			for (std::uint32_t row = 0; row < 3; ++row)
+				desc.vertexAttributes.emplace_back(lut::vertex_attribute(2 + row, 2, VK_FORMAT_R32G32B32A32_SFLOAT, std::uint32_t(offsetof(InstanceData, rows) + sizeof(glm::vec4) * row)));
+			desc.vertexAttributes.emplace_back(lut::vertex_attribute(5, 2, VK_FORMAT_R32_UINT, std::uint32_t(offsetof(InstanceData, material))));
+		}
+
+		// After a depth pre-pass, the depth is final: only the fragments of
+		// the visible surfaces pass the test, and are shaded exactly once
+		desc.depthWrite = !aGBuffer.depthPrepass;
+		desc.depthCompare = aGBuffer.depthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		// Mark the covered pixels for the light volumes
+		if (aGBuffer.stencil)
+		{
+			VkStencilOpState mark{};
+			mark.failOp = VK_STENCIL_OP_KEEP;
+			mark.passOp = VK_STENCIL_OP_REPLACE;
+			mark.depthFailOp = VK_STENCIL_OP_KEEP;
+			mark.compareOp = VK_COMPARE_OP_ALWAYS;
+			mark.compareMask = 0xff;
+			mark.writeMask = 0xff;
+			mark.reference = deferred::kGeometryStencilBit;
+
+			desc.stencilTest = true;
+			desc.stencilFront = mark;
+			desc.stencilBack = mark;
+		}
+
+		// One per G-buffer target
+		desc.blendAttachments.assign(aGBuffer.colourFormats.size(), lut::opaque_attachment());
+
+		desc.layout = aPipeLayout;
+		desc.renderPass = aRenderPass;
+		desc.subpass = 0;
+		return desc;
+	}
+
+	lut::PipelineDesc depth_prepass_pipeline_desc(VkRenderPass aRenderPass, VkPipelineLayout aPipeLayout, GBufferDesc const& aGBuffer)
+	{
+		// Must rasterize exactly like the G-buffer pipeline (the defaults,
+		// as in deferred_first_pipeline_desc()), but without colour
+		// attachments
+		lut::PipelineDesc desc = deferred_first_pipeline_desc(aRenderPass, aPipeLayout, aGBuffer);
+		desc.fragmentShader.clear();
+		desc.vertexShader = deferred::kDepthPrepassVertPath;
+
+		// Positions only, from the same buffers as the G-buffer pass
+		desc.vertexBindings.resize(1);
+		desc.vertexAttributes.resize(1);
+
+		desc.depthWrite = true;
+		desc.depthCompare = VK_COMPARE_OP_LESS_OR_EQUAL;
+		desc.stencilTest = false;
+		desc.stencilFront = desc.stencilBack = VkStencilOpState{};
+		desc.blendAttachments.clear();
+		return desc;
+	}
+
+	void create_deferred_framebuffers(lut::VulkanContext const& aContext, VkExtent2D const& aExtent, VkRenderPass aRenderPass, lut::Framebuffer& aFramebuffers, GBuffer const& aGBuffer)
+	{
+		// Same order as in create_deferred_first_pass()
+		std::vector<VkImageView> attachments;
+		for (auto const& view : aGBuffer.views)
+			attachments.emplace_back(view.handle);
+		attachments.emplace_back(aGBuffer.depthView.handle);
+
+		VkFramebufferCreateInfo fbInfo{};
+		fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		fbInfo.flags = 0;      // normal framebuffer
+		fbInfo.renderPass = aRenderPass;
+		fbInfo.attachmentCount = std::uint32_t(attachments.size()); //updated
+		fbInfo.pAttachments = attachments.data();
+		fbInfo.width = aExtent.width;
+		fbInfo.height = aExtent.height;
+		fbInfo.layers = 1;
+
+		VkFramebuffer fb = VK_NULL_HANDLE;
+		if (auto const res = vkCreateFramebuffer(aContext.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create framebuffer" "vkCreateFramebuffer() returned %s", lut::to_string(res).c_str());
+		}
+		aFramebuffers = lut::Framebuffer(aContext.device, fb);
+
+	}
+
+	void create_depth_prepass_framebuffer(lut::VulkanContext const& aContext, VkExtent2D const& aExtent, VkRenderPass aRenderPass, lut::Framebuffer& aFramebuffer, GBuffer const& aGBuffer)
+	{
+		VkImageView attachments[1] = { aGBuffer.depthView.handle };
+
+		VkFramebufferCreateInfo fbInfo{};
+		fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		fbInfo.renderPass = aRenderPass;
+		fbInfo.attachmentCount = 1;
+		fbInfo.pAttachments = attachments;
+		fbInfo.width = aExtent.width;
+		fbInfo.height = aExtent.height;
+		fbInfo.layers = 1;
+
+		VkFramebuffer fb = VK_NULL_HANDLE;
+		if (auto const res = vkCreateFramebuffer(aContext.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create depth pre-pass framebuffer\n" "vkCreateFramebuffer() returned %s", lut::to_string(res).c_str());
+		}
+		aFramebuffer = lut::Framebuffer(aContext.device, fb);
+	}
+
+	void create_swapchain_framebuffers(lut::VulkanContext const& aContext, RenderTarget const& aTarget, VkRenderPass aRenderPass, std::vector<lut::Framebuffer>& aFramebuffers, VkImageView aDepthView)
+	{
+		assert(aFramebuffers.empty());
+
+		for (std::size_t i = 0; i < aTarget.views.size(); i++)
+		{
+			VkImageView attachments[2] = {
+				aTarget.views[i],
+				aDepthView
+			};
+
+			VkFramebufferCreateInfo fbInfo{};
+			fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			fbInfo.flags = 0;      // normal framebuffer
+			fbInfo.renderPass = aRenderPass;
+			fbInfo.attachmentCount = 2; //updated
+			fbInfo.pAttachments = attachments;
+			fbInfo.width = aTarget.extent.width;
+			fbInfo.height = aTarget.extent.height;
+			fbInfo.layers = 1;
+
+			VkFramebuffer fb = VK_NULL_HANDLE;
+			if (auto const res = vkCreateFramebuffer(aContext.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to create framebuffer for swap chain image %zu\n" "vkCreateFramebuffer() returned %s", i, lut::to_string(res).c_str());
+			}
+			aFramebuffers.emplace_back(lut::Framebuffer(aContext.device, fb));
+		}
+
+		assert(aTarget.views.size() == aFramebuffers.size());
+	}
+
+	void create_merged_framebuffers(lut::VulkanContext const& aContext, RenderTarget const& aTarget, VkRenderPass aRenderPass, std::vector<lut::Framebuffer>& aFramebuffers, GBuffer const& aGBuffer)
+	{
+		assert(aFramebuffers.empty());
+
+		// Same order as in create_deferred_merged_pass()
+		std::vector<VkImageView> attachments;
+		for (auto const& view : aGBuffer.views)
+			attachments.emplace_back(view.handle);
+		attachments.emplace_back(aGBuffer.depthView.handle);
+		attachments.emplace_back(VK_NULL_HANDLE);
+
+		for (std::size_t i = 0; i < aTarget.views.size(); i++)
+		{
+			attachments.back() = aTarget.views[i];
+
+			VkFramebufferCreateInfo fbInfo{};
+			fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			fbInfo.flags = 0;      // normal framebuffer
+			fbInfo.renderPass = aRenderPass;
+			fbInfo.attachmentCount = std::uint32_t(attachments.size());
+			fbInfo.pAttachments = attachments.data();
+			fbInfo.width = aTarget.extent.width;
+			fbInfo.height = aTarget.extent.height;
+			fbInfo.layers = 1;
+
+			VkFramebuffer fb = VK_NULL_HANDLE;
+			if (auto const res = vkCreateFramebuffer(aContext.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to create merged framebuffer for image %zu\n" "vkCreateFramebuffer() returned %s", i, lut::to_string(res).c_str());
+			}
+			aFramebuffers.emplace_back(lut::Framebuffer(aContext.device, fb));
+		}
+
+		assert(aTarget.views.size() == aFramebuffers.size());
+	}
+}
+
+//deferred second pass
+namespace
+{
+	lut::RenderPass create_deferred_second_pass(lut::VulkanContext const& aContext, RenderTarget const& aTarget, GBufferDesc const& aGBuffer)
+	{
+		//Render Pass attachments
+		VkAttachmentDescription attachments[2]{};
+		attachments[0].format = aTarget.format;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[0].finalLayout = aTarget.finalLayout;
+
+		attachments[1].format = deferred::kDepthFormat;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		// Light volumes: the G-buffer's depth/stencil, as left by the first
+		// pass. Its stencil is cleared by the next frame's first pass.
+		VkAttachmentReference depthAttachment{};
+		if (aGBuffer.stencil)
+		{
+			auto const depthLayout = gbuffer_depth_layout(aGBuffer);
+
+			attachments[1].format = aGBuffer.depthFormat;
+			attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[1].initialLayout = depthLayout;
+			attachments[1].finalLayout = depthLayout;
+
+			depthAttachment.attachment = 1;
+			depthAttachment.layout = depthLayout;
+		}
+
+		//Supass Definition
+		VkAttachmentReference subpassAttachments[1]{};
+		subpassAttachments[0].attachment = 0; // this refers to attachments[0]
+		subpassAttachments[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpasses[1]{};
+		subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[0].colorAttachmentCount = 1;
+		subpasses[0].pColorAttachments = subpassAttachments;
+		subpasses[0].pDepthStencilAttachment = aGBuffer.stencil ? &depthAttachment : nullptr;
+
+		// Offscreen images are copied out right after the pass, so the
+		// color writes must be made available to the transfer stage. (The
+		// implicit dependency to VK_SUBPASS_EXTERNAL does not cover this.)
+		VkSubpassDependency deps[1]{};
+		deps[0].srcSubpass = 0;
+		deps[0].dstSubpass = VK_SUBPASS_EXTERNAL;
+		deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		deps[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		deps[0].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		deps[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		bool const readback = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL == aTarget.finalLayout;
+
+		//RenderPass Creation
+		//reference the structures above 
+		VkRenderPassCreateInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		passInfo.attachmentCount = sizeof(attachments) / sizeof(attachments[0]);
+		passInfo.pAttachments = attachments; //Render Pass attachments
+		passInfo.subpassCount = 1;
+		passInfo.pSubpasses = subpasses;     //Supass Definition
+		passInfo.dependencyCount = readback ? 1 : 0;
+		passInfo.pDependencies = readback ? deps : nullptr;
+
+		VkRenderPass rpass = VK_NULL_HANDLE;
+		if (auto const res = vkCreateRenderPass(aContext.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::RenderPass(aContext.device, rpass);
+	}
+
+	lut::RenderPass create_deferred_merged_pass(lut::VulkanContext const& aContext, GBufferDesc const& aGBuffer, RenderTarget const& aTarget)
+	{
+		assert(aGBuffer.transient);
+
+		auto const colourCount = std::uint32_t(aGBuffer.colourFormats.size());
+		std::uint32_t const depthIndex = colourCount;
+		std::uint32_t const targetIndex = colourCount + 1;
+
+		//Render Pass attachments: the G-buffer, its depth, then the target.
+		//The G-buffer is consumed within the pass and never stored.
+		std::vector<VkAttachmentDescription> attachments(colourCount + 2);
+		std::vector<VkAttachmentReference> gbufferAttachments(colourCount);
+		for (std::uint32_t i = 0; i < colourCount; ++i)
+		{
+			attachments[i].format = aGBuffer.colourFormats[i];
+			attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			gbufferAttachments[i].attachment = i;
+			gbufferAttachments[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+
+		attachments[depthIndex].format = aGBuffer.depthFormat;
+		attachments[depthIndex].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[depthIndex].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[depthIndex].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[depthIndex].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[depthIndex].finalLayout = aGBuffer.readDepth ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		attachments[targetIndex].format = aTarget.format;
+		attachments[targetIndex].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[targetIndex].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[targetIndex].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[targetIndex].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[targetIndex].finalLayout = aTarget.finalLayout;
+
+		VkAttachmentReference depthAttachment{};
+		depthAttachment.attachment = depthIndex;
+		depthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		// The lighting subpass reads the G-buffer in binding order (see
+		// gbuffer.hpp); input_attachment_index i is binding i.
+		std::vector<VkAttachmentReference> inputAttachments;
+		if (aGBuffer.readDepth)
+			inputAttachments.push_back({ depthIndex, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+		for (std::uint32_t i = 0; i < colourCount; ++i)
+			inputAttachments.push_back({ i, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+
+		VkAttachmentReference targetAttachment{};
+		targetAttachment.attachment = targetIndex;
+		targetAttachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpasses[2]{};
+		subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[0].colorAttachmentCount = colourCount;
+		subpasses[0].pColorAttachments = gbufferAttachments.data();
+		subpasses[0].pDepthStencilAttachment = &depthAttachment;
+
+		subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[1].inputAttachmentCount = std::uint32_t(inputAttachments.size());
+		subpasses[1].pInputAttachments = inputAttachments.data();
+		subpasses[1].colorAttachmentCount = 1;
+		subpasses[1].pColorAttachments = &targetAttachment;
+
+		VkSubpassDependency deps[4]{};
+
+		// G-buffer writes -> lighting reads. Each pixel only reads its own
+		// G-buffer texels, so the dependency is by region (which keeps the
+		// data in tile memory on tile-based GPUs).
+		deps[0].srcSubpass = 0;
+		deps[0].dstSubpass = 1;
+		deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		deps[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		deps[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		deps[0].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		deps[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		// The G-buffer images are shared between frames in flight: the
+		// previous frame's lighting subpass must be done reading them
+		// (write-after-read)
+		deps[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+		deps[1].dstSubpass = 0;
+		deps[1].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		deps[1].srcAccessMask = 0;
+		deps[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		deps[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		deps[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		// The target is first used by the lighting subpass. Its layout
+		// transition must wait for the image to be acquired (the submission
+		// waits for that at the color attachment output stage).
+		deps[2].srcSubpass = VK_SUBPASS_EXTERNAL;
+		deps[2].dstSubpass = 1;
+		deps[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		deps[2].srcAccessMask = 0;
+		deps[2].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		deps[2].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		// Offscreen images are copied out right after the pass (see
+		// create_deferred_second_pass())
+		deps[3].srcSubpass = 1;
+		deps[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+		deps[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		deps[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		deps[3].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		deps[3].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		bool const readback = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL == aTarget.finalLayout;
+
+		VkRenderPassCreateInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		passInfo.attachmentCount = std::uint32_t(attachments.size());
+		passInfo.pAttachments = attachments.data();
+		passInfo.subpassCount = sizeof(subpasses) / sizeof(subpasses[0]);
+		passInfo.pSubpasses = subpasses;
+		passInfo.dependencyCount = readback ? 4 : 3;
+		passInfo.pDependencies = deps;
+
+		VkRenderPass rpass = VK_NULL_HANDLE;
+		if (auto const res = vkCreateRenderPass(aContext.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create merged render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::RenderPass(aContext.device, rpass);
+	}
+
+	lut::PipelineLayout create_deferred_second_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aSceneDescriptorLayout, VkDescriptorSetLayout aDescriptorLayout, VkDescriptorSetLayout aClusterLayout, VkDescriptorSetLayout aOutputLayout)
+	{
+		bool const clustered = VK_NULL_HANDLE != aClusterLayout;
+		bool const computeOutput = VK_NULL_HANDLE != aOutputLayout;
+		assert(clustered || !computeOutput);
+
+		VkDescriptorSetLayout layouts[] = { aSceneDescriptorLayout, aDescriptorLayout, aClusterLayout, aOutputLayout };
+
+		VkPushConstantRange pushConstants{};
+		pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstants.offset = 0;
+		pushConstants.size = sizeof(glsl::ClusterParams);
+
+		//Creating the pipeline layout
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = computeOutput ? 4 : clustered ? 3 : 2;
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = clustered ? 1 : 0;
+		layoutInfo.pPushConstantRanges = clustered ? &pushConstants : nullptr;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str());
+		}
+		return lut::PipelineLayout(aContext.device, layout);
+	}
+
+	lut::PipelineDesc deferred_second_pipeline_desc(VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, GBufferDesc const& aGBuffer, bool aClustered)
+	{
+		bool const compact = GBufferLayout::compact == aGBuffer.layout;
+
+		// Indexed by [transient][compact][clustered]
+		char const* const fragPaths[2][2][2] = {
+			{
+				{ deferred::kPostFragPath, deferred::kClusteredPostFragPath },
+				{ deferred::kCompactPostFragPath, deferred::kCompactClusteredPostFragPath }
+			},
+			{
+				{ deferred::kSubpassPostFragPath, deferred::kSubpassClusteredPostFragPath },
+				{ deferred::kCompactSubpassPostFragPath, deferred::kCompactSubpassClusteredPostFragPath }
+			}
+		};
+
+		char const* fragPath = fragPaths[aGBuffer.transient][compact][aClustered];
+		if (aGBuffer.stencil)
+			fragPath = compact ? deferred::kCompactAmbientPostFragPath : deferred::kAmbientPostFragPath;
+
+		// Full-screen triangle, without vertex inputs
+		lut::PipelineDesc desc;
+		desc.vertexShader = deferred::kPostVertPath;
+		desc.fragmentShader = fragPath;
+		desc.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+		// Ambient pass of the light volumes: only the pixels covered by the
+		// G-buffer pass. The depth buffer is the G-buffer's, and read-only.
+		if (aGBuffer.stencil)
+		{
+			VkStencilOpState covered{};
+			covered.failOp = VK_STENCIL_OP_KEEP;
+			covered.passOp = VK_STENCIL_OP_KEEP;
+			covered.depthFailOp = VK_STENCIL_OP_KEEP;
+			covered.compareOp = VK_COMPARE_OP_EQUAL;
+			covered.compareMask = deferred::kGeometryStencilBit;
+			covered.writeMask = 0;
+			covered.reference = deferred::kGeometryStencilBit;
+
+			desc.depthTest = false;
+			desc.depthWrite = false;
+			desc.stencilTest = true;
+			desc.stencilFront = covered;
+			desc.stencilBack = covered;
+		}
+
+		desc.blendAttachments = { lut::opaque_attachment() };
+
+		desc.layout = aPipelineLayout;
+		desc.renderPass = aRenderPass;
+		desc.subpass = aGBuffer.transient ? 1 : 0; // lighting subpass of the merged pass
+		return desc;
+	}
+
+	std::vector<std::uint32_t> specialization_constants(ShadingVariant const& aVariant)
+	{
+		assert(aVariant.lightCount <= glsl::kSceneLightCount);
+
+		// SHADE_* in deferred_shading.glsl
+		std::uint32_t features = 0;
+		if (aVariant.emissive)
+			features |= 1u;
+		if (aVariant.ambient)
+			features |= 2u;
+
+		// Indexed by constant_id
+		return { aVariant.lightCount, std::uint32_t(aVariant.brdf), features };
+	}
+
+	lut::PipelineDesc cluster_pipeline_desc(VkPipelineLayout aPipelineLayout)
+	{
+		lut::PipelineDesc desc;
+		desc.computeShader = deferred::kClusterCompPath;
+		desc.layout = aPipelineLayout;
+		return desc;
+	}
+
+	lut::PipelineLayout create_draw_cull_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aCullLayout)
+	{
+		VkDescriptorSetLayout layouts[] = { aSceneLayout, aCullLayout };
+
+		VkPushConstantRange pushConstants{};
+		pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstants.offset = 0;
+		pushConstants.size = sizeof(glsl::DrawCullParams);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstants;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str());
+		}
+		return lut::PipelineLayout(aContext.device, layout);
+	}
+
+	lut::PipelineDesc draw_cull_pipeline_desc(VkPipelineLayout aPipelineLayout, bool aOcclusion)
+	{
+		lut::PipelineDesc desc;
+		desc.computeShader = aOcclusion ? deferred::kDrawCullOcclusionCompPath : deferred::kDrawCullCompPath;
+		desc.layout = aPipelineLayout;
+		return desc;
+	}
+
+	lut::PipelineLayout create_instanced_gbuffer_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aMaterialLayout)
+	{
+		VkDescriptorSetLayout layouts[] = { aSceneLayout, aMaterialLayout };
+
+		VkPushConstantRange pushConstants{};
+		pushConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstants.offset = 0;
+		pushConstants.size = sizeof(glsl::InstancedMeshParams);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstants;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str());
+		}
+		return lut::PipelineLayout(aContext.device, layout);
+	}
+
+	VkExtent2D hiz_extent(VkExtent2D const& aRenderExtent)
+	{
+		// Largest power of two that fits, such that each level halves the
+		// previous one exactly
+		auto const fit = [] (std::uint32_t aSize) {
+			std::uint32_t size = 1;
+			while (size * 2 <= aSize && size * 2 <= deferred::kMaxHiZExtent)
+				size *= 2;
+			return size;
+		};
+
+		return VkExtent2D{ fit(aRenderExtent.width), fit(aRenderExtent.height) };
+	}
+
+	std::uint32_t hiz_levels(VkExtent2D const& aHiZExtent)
+	{
+		std::uint32_t levels = 1;
+		while ((std::max(aHiZExtent.width, aHiZExtent.height) >> levels) > 0)
+			++levels;
+
+		assert(levels <= deferred::kMaxHiZLevels);
+		return levels;
+	}
+
+	HiZPyramid create_hiz_pyramid(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, VkExtent2D const& aExtent)
+	{
+		HiZPyramid hiz;
+		hiz.extent = hiz_extent(aExtent);
+		hiz.levels = hiz_levels(hiz.extent);
+
+		hiz.image = lut::create_image(aAllocator, hiz.extent.width, hiz.extent.height, deferred::kHiZFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, hiz.levels);
+		hiz.view = lut::create_image_view(aContext, hiz.image.image, deferred::kHiZFormat);
+
+		for (std::uint32_t level = 0; level < hiz.levels; ++level)
+		{
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = hiz.image.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = deferred::kHiZFormat;
+			viewInfo.components = VkComponentMapping{};
+			viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+			VkImageView view = VK_NULL_HANDLE;
+			if (auto const res = vkCreateImageView(aContext.device, &viewInfo, nullptr, &view); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to create Hi-Z level view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str());
+			}
+
+			hiz.levelViews.emplace_back(aContext.device, view);
+		}
+
+		return hiz;
+	}
+
+	lut::DescriptorSetLayout create_hiz_descriptor_layout(lut::VulkanContext const& aContext)
+	{
+		// 0: G-buffer depth, 1: one storage image per level, 2: counter
+		VkDescriptorSetLayoutBinding bindings[3]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = deferred::kMaxHiZLevels;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[2].binding = 2;
+		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[2].descriptorCount = 1;
+		bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		//descriptor set layout
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreateDescriptorSetLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::DescriptorSetLayout(aContext.device, layout);
+	}
+
+	lut::PipelineLayout create_hiz_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aHiZLayout)
+	{
+		VkPushConstantRange pushConstants{};
+		pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstants.offset = 0;
+		pushConstants.size = sizeof(glsl::HiZParams);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &aHiZLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstants;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str());
+		}
+		return lut::PipelineLayout(aContext.device, layout);
+	}
+
+	lut::PipelineDesc hiz_pipeline_desc(VkPipelineLayout aPipelineLayout)
+	{
+		lut::PipelineDesc desc;
+		desc.computeShader = deferred::kHiZBuildCompPath;
+		desc.layout = aPipelineLayout;
+		return desc;
+	}
+
+	void update_hiz_descriptors(lut::VulkanContext const& aContext, VkDescriptorSet aHiZDescriptors, std::vector<VkDescriptorSet> const& aCullDescriptors, VkSampler aSampler, GBuffer const& aGBuffer, HiZPyramid const& aHiZ, VkBuffer aCounter)
+	{
+		VkDescriptorImageInfo depthInfo{};
+		depthInfo.sampler = aSampler;
+		depthInfo.imageView = aGBuffer.depthView.handle;
+		depthInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		// Every element must be valid; those past the pyramid's levels are
+		// never accessed
+		VkDescriptorImageInfo levelInfos[deferred::kMaxHiZLevels]{};
+		for (std::uint32_t i = 0; i < deferred::kMaxHiZLevels; ++i)
+		{
+			levelInfos[i].imageView = aHiZ.levelViews[std::min(i, aHiZ.levels - 1)].handle;
+			levelInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+
+		VkDescriptorBufferInfo counterInfo{};
+		counterInfo.buffer = aCounter;
+		counterInfo.range = VK_WHOLE_SIZE;
+
+		VkDescriptorImageInfo pyramidInfo{};
+		pyramidInfo.sampler = aSampler;
+		pyramidInfo.imageView = aHiZ.view.handle;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::vector<VkWriteDescriptorSet> desc(3 + aCullDescriptors.size());
+		for (auto& write : desc)
+		{
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.descriptorCount = 1;
+		}
+
+		desc[0].dstSet = aHiZDescriptors;
+		desc[0].dstBinding = 0;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[0].pImageInfo = &depthInfo;
+
+		desc[1].dstSet = aHiZDescriptors;
+		desc[1].dstBinding = 1;
+		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		desc[1].descriptorCount = deferred::kMaxHiZLevels;
+		desc[1].pImageInfo = levelInfos;
+
+		desc[2].dstSet = aHiZDescriptors;
+		desc[2].dstBinding = 2;
+		desc[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[2].pBufferInfo = &counterInfo;
+
+		for (std::size_t i = 0; i < aCullDescriptors.size(); ++i)
+		{
+			desc[3 + i].dstSet = aCullDescriptors[i];
+			desc[3 + i].dstBinding = 4;
+			desc[3 + i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[3 + i].pImageInfo = &pyramidInfo;
+		}
+
+		vkUpdateDescriptorSets(aContext.device, std::uint32_t(desc.size()), desc.data(), 0, nullptr);
+	}
+
+	lut::Buffer create_static_buffer(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, lut::GpuTimeline& aTimeline, lut::DeletionQueue& aDeletionQueue, void const* aData, VkDeviceSize aSize, VkBufferUsageFlags aUsage, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage)
+	{
+		assert(aSize > 0);
+
+		lut::Buffer buffer = lut::create_buffer(
+			aAllocator,
+			aSize,
+			aUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY
+		);
+
+		lut::Buffer staging = lut::create_buffer(
+			aAllocator,
+			aSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU
+		);
+
+		void* stagingPtr = nullptr;
+		if (auto const res = vmaMapMemory(aAllocator.allocator, staging.allocation, &stagingPtr); VK_SUCCESS != res)
+		{
+			throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+		}
+		std::memcpy(stagingPtr, aData, std::size_t(aSize));
+		vmaUnmapMemory(aAllocator.allocator, staging.allocation);
+
+		lut::CommandPool uploadPool = lut::create_command_pool(aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		VkCommandBuffer uploadCmd = lut::alloc_command_buffer(aContext, uploadPool.handle);
+
+		VkCommandBufferBeginInfo begInfo{};
+		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		begInfo.pInheritanceInfo = nullptr;
+
+		if (auto const res = vkBeginCommandBuffer(uploadCmd, &begInfo); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to begin recording command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		VkBufferCopy copy{};
+		copy.size = aSize;
+		vkCmdCopyBuffer(uploadCmd, staging.buffer, buffer.buffer, 1, &copy);
+
+		lut::buffer_barrier(uploadCmd, buffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, aDstAccess, VK_PIPELINE_STAGE_TRANSFER_BIT, aDstStage);
+
+		if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to end recording command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		// See createObjBuffer(): no need to wait for the upload
+		auto const uploadValue = aTimeline.submit(aContext.graphicsQueue, 1, &uploadCmd);
+		aDeletionQueue.defer(uploadValue, std::move(staging));
+		aDeletionQueue.defer(uploadValue, std::move(uploadPool));
+
+		return buffer;
+	}
+
+	std::tuple<lut::PipelineDesc, lut::PipelineDesc> light_volume_pipeline_descs(VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, GBufferDesc const& aGBuffer)
+	{
+		assert(aGBuffer.stencil && !aGBuffer.transient);
+		bool const compact = GBufferLayout::compact == aGBuffer.layout;
+
+		// Unit sphere (see make_light_volume_mesh()), positions only. Both
+		// faces are needed: the stencil pipeline counts front and back
+		// faces, and the light pipeline must still draw when the camera is
+		// inside a volume (where only back faces are left).
+		lut::PipelineDesc base;
+		base.vertexShader = deferred::kVolumeVertPath;
+		base.vertexBindings = { lut::vertex_binding(0, sizeof(float) * 3) };
+		base.vertexAttributes = { lut::vertex_attribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT) };
+		base.cullMode = VK_CULL_MODE_NONE;
+		base.depthWrite = false;
+		base.stencilTest = true;
+		base.layout = aPipelineLayout;
+		base.renderPass = aRenderPass;
+		base.subpass = 0;
+
+		// Stencil pass: faces behind the surface count up (back faces) or
+		// down (front faces). A surface inside the volume ends up with a
+		// non-zero count, as it has only the back face behind it. The
+		// geometry bit is left alone. The stencil pipeline only uses the
+		// vertex shader, and does not write colour; the lights are added to
+		// the ambient pass.
+		lut::PipelineDesc stencil = base;
+		stencil.depthCompare = VK_COMPARE_OP_LESS;
+
+		stencil.stencilFront.failOp = VK_STENCIL_OP_KEEP;
+		stencil.stencilFront.passOp = VK_STENCIL_OP_KEEP;
+		stencil.stencilFront.depthFailOp = VK_STENCIL_OP_DECREMENT_AND_WRAP;
+		stencil.stencilFront.compareOp = VK_COMPARE_OP_ALWAYS;
+		stencil.stencilFront.compareMask = 0;
+		stencil.stencilFront.writeMask = deferred::kVolumeStencilMask;
+		stencil.stencilFront.reference = 0;
+
+		stencil.stencilBack = stencil.stencilFront;
+		stencil.stencilBack.depthFailOp = VK_STENCIL_OP_INCREMENT_AND_WRAP;
+
+		VkPipelineColorBlendAttachmentState noColour{};
+		noColour.blendEnable = VK_FALSE;
+		noColour.colorWriteMask = 0;
+		stencil.blendAttachments = { noColour };
+
+		// Light pass: shade where the count is non-zero, and reset it for
+		// the next light. The reset also keeps the second face of a pixel
+		// from shading it twice.
+		lut::PipelineDesc light = base;
+		light.fragmentShader = compact ? deferred::kCompactVolumeFragPath : deferred::kVolumeFragPath;
+		light.depthTest = false;
+
+		light.stencilFront.failOp = VK_STENCIL_OP_KEEP;
+		light.stencilFront.passOp = VK_STENCIL_OP_ZERO;
+		light.stencilFront.depthFailOp = VK_STENCIL_OP_KEEP;
+		light.stencilFront.compareOp = VK_COMPARE_OP_NOT_EQUAL;
+		light.stencilFront.compareMask = deferred::kVolumeStencilMask;
+		light.stencilFront.writeMask = deferred::kVolumeStencilMask;
+		light.stencilFront.reference = 0;
+
+		light.stencilBack = light.stencilFront;
+
+		VkPipelineColorBlendAttachmentState additive{};
+		additive.blendEnable = VK_TRUE;
+		additive.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		additive.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		additive.colorBlendOp = VK_BLEND_OP_ADD;
+		additive.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		additive.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		additive.alphaBlendOp = VK_BLEND_OP_ADD;
+		additive.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		light.blendAttachments = { additive };
+
+		return { std::move(stencil), std::move(light) };
+	}
+
+	std::tuple<lut::Buffer, lut::Buffer> create_light_volume_buffers(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, lut::GpuTimeline& aTimeline, lut::DeletionQueue& aDeletionQueue, LightVolumeMesh const& aMesh)
+	{
+		auto const vertexBytes = sizeof(glm::vec3) * aMesh.positions.size();
+		auto const indexBytes = sizeof(std::uint32_t) * aMesh.indices.size();
+
+		// The mesh is small enough to be uploaded with vkCmdUpdateBuffer()
+		// (see upload_material_uniforms())
+		assert(vertexBytes <= 65536 && indexBytes <= 65536);
+
+		lut::Buffer vertices = lut::create_buffer(
+			aAllocator,
+			vertexBytes,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY
+		);
+		lut::Buffer indices = lut::create_buffer(
+			aAllocator,
+			indexBytes,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY
+		);
+
+		lut::CommandPool uploadPool = lut::create_command_pool(aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		VkCommandBuffer uploadCmd = lut::alloc_command_buffer(aContext, uploadPool.handle);
+
+		VkCommandBufferBeginInfo begInfo{};
+		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		begInfo.pInheritanceInfo = nullptr;
+
+		if (auto const res = vkBeginCommandBuffer(uploadCmd, &begInfo); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to begin recording command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		vkCmdUpdateBuffer(uploadCmd, vertices.buffer, 0, vertexBytes, aMesh.positions.data());
+		lut::buffer_barrier(uploadCmd, vertices.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+		vkCmdUpdateBuffer(uploadCmd, indices.buffer, 0, indexBytes, aMesh.indices.data());
+		lut::buffer_barrier(uploadCmd, indices.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+		if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to end recording command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		auto const uploadValue = aTimeline.submit(aContext.graphicsQueue, 1, &uploadCmd);
+		aDeletionQueue.defer(uploadValue, std::move(uploadPool));
+
+		return { std::move(vertices), std::move(indices) };
+	}
+
+	lut::PipelineDesc compute_lighting_pipeline_desc(VkPipelineLayout aPipelineLayout, GBufferDesc const& aGBuffer, bool aTiledLights)
+	{
+		assert(!aGBuffer.transient);
+		bool const compact = GBufferLayout::compact == aGBuffer.layout;
+
+		char const* compPath = compact ? deferred::kCompactTiledCompPath : deferred::kTiledCompPath;
+		if (aTiledLights)
+			compPath = compact ? deferred::kCompactTiledLightsCompPath : deferred::kTiledLightsCompPath;
+
+		lut::PipelineDesc desc;
+		desc.computeShader = compPath;
+		desc.layout = aPipelineLayout;
+		return desc;
+	}
+
+	std::tuple<lut::Image, lut::ImageView> create_lighting_image(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, RenderTarget const& aTarget)
+	{
+		// Storage images of kLightingFormat and blits from it are required
+		// by the spec, blits to the target's format are not.
+		VkFormatProperties props{};
+		vkGetPhysicalDeviceFormatProperties(aContext.physicalDevice, aTarget.format, &props);
+		if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT))
+			throw lut::Error("Lighting image: the target format (%d) does not support blits", int(aTarget.format));
+
+		// Written by the compute lighting pass, or rendered to by the
+		// lighting pass (dynamic resolution)
+		lut::Image image = lut::create_image(aAllocator, aTarget.extent.width, aTarget.extent.height, deferred::kLightingFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		lut::ImageView view = lut::create_image_view(aContext, image.image, deferred::kLightingFormat);
+
+		return { std::move(image), std::move(view) };
+	}
+
+	void upload_material_uniforms(lut::VulkanContext const& aContext, lut::GpuTimeline& aTimeline, lut::DeletionQueue& aDeletionQueue, std::vector<lut::Buffer>& aPBR, lut::GpuProfiler* aProfiler, std::uint32_t aProfilerSlot)
+	{
+		lut::CommandPool uploadPool = lut::create_command_pool(aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		VkCommandBuffer uploadCmd = lut::alloc_command_buffer(aContext, uploadPool.handle);
+
+		VkCommandBufferBeginInfo begInfo{};
+		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		begInfo.pInheritanceInfo = nullptr;
+
+		if (auto const res = vkBeginCommandBuffer(uploadCmd, &begInfo); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to begin recording command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		if (aProfiler)
+			aProfiler->begin(uploadCmd, aProfilerSlot);
+
+		{
+			lut::GpuScope uploadScope(aProfiler, uploadCmd, aProfilerSlot, "material_upload");
+
+			for (std::size_t i = 0; i < aPBR.size(); i++)
+			{
+				glsl::PBRuniform pbrUniforms{};
+				pbrUniforms.albedo = glm::vec4(newShip.materials[i].albedo, 1.f);
+				pbrUniforms.emissive = glm::vec4(newShip.materials[i].emissive, 1.f);
+				pbrUniforms.metalness = newShip.materials[i].metalness;
+				pbrUniforms.shininess = newShip.materials[i].shininess;
+
+				vkCmdUpdateBuffer(uploadCmd, aPBR[i].buffer, 0, sizeof(glsl::PBRuniform), &pbrUniforms);
+				lut::buffer_barrier(uploadCmd, aPBR[i].buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			}
+		}
+
+		if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to end recording command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		// The barriers make the data visible to later submissions, so there
+		// is no need to wait. The pool is released once the upload is done.
+		auto const uploadValue = aTimeline.submit(aContext.graphicsQueue, 1, &uploadCmd);
+		aDeletionQueue.defer(uploadValue, std::move(uploadPool));
+
+		if (aProfiler)
+			aProfiler->submitted(aProfilerSlot, uploadValue, 0);
+	}
+
+	BindCounts record_commands(
+		VkCommandBuffer aCmdBuff,
+		VkCommandBufferUsageFlags aUsage,
+		VkRenderPass aFullscreenPass,
+		VkRenderPass aPostPass,
+		VkFramebuffer aSwapChainFramebuffer,
+		VkFramebuffer aIntermediatebuff,
+		VkPipeline aFullscreenPipe,
+		VkPipeline aPostPipe,
+		VkExtent2D const& aImageExtent,
+		VkExtent2D const& aRenderExtent,
+		GBufferDesc const& aGBuffer,
+		ColourMesh const& aColourMesh,
+		std::vector<std::uint32_t> const& aDrawList,
+
+		VkPipelineLayout aFullscreenLayout,
+		VkPipelineLayout aPostLayout,
+		VkDescriptorSet aSceneDescriptors,
+		VkDescriptorSet aImageDescriptors,
+		std::vector<VkDescriptorSet> const& aPBRDescriptors,
+		ClusterPass const& aClusters,
+		LightingBlit const& aBlit,
+		ComputeLighting const& aCompute,
+		LightVolumes const& aVolumes,
+		GpuDrivenDraws const& aGpuDraws,
+		InstancedDraws const& aInstancedDraws,
+		DepthPrepass const& aPrepass,
+		///------------------------------------
+		lut::ThreadPool* aWorkers,
+		std::vector<VkCommandBuffer> const& aSecondaries,
+		lut::GpuProfiler* aProfiler,
+		std::uint32_t aProfilerSlot
+	)
+	{
+		LUT_CPU_ZONE("record_commands");
+
+		BindCounts binds;
+
+		// Note: per-frame data (the scene uniforms) is not recorded into the
+		// command buffer, but written to the frame's uniform buffer instead.
+		// This allows the command buffer to be recorded once and reused.
+		VkCommandBufferBeginInfo begInfo{};
+		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begInfo.flags = aUsage;
+		begInfo.pInheritanceInfo = nullptr;
+
+		if (auto const res = vkBeginCommandBuffer(aCmdBuff, &begInfo); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to begin recording command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		if (aProfiler)
+			aProfiler->begin(aCmdBuff, aProfilerSlot);
+
+		// Light assignment. Only the lighting reads the clusters, so this
+		// could overlap with the G-buffer pass. The push constants are shared
+		// with the lighting pipeline, which uses the same layout.
+		if (aClusters.pipe)
+		{
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "light_culling");
+
+			vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aClusters.pipe);
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPostLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPostLayout, 2, 1, &aClusters.descriptors, 0, nullptr);
+			vkCmdPushConstants(aCmdBuff, aPostLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glsl::ClusterParams), &aClusters.params);
+
+			vkCmdDispatch(aCmdBuff, (kClusterCount + kClusterGroupSize - 1) / kClusterGroupSize, 1, 1);
+
+			lut::buffer_barrier(aCmdBuff, aClusters.clusters, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		}
+
+		// GPU-driven draws: cull the meshes into the frame's indirect
+		// commands. The frame's previous submission, which read them, has
+		// completed (see lut::begin_frame()). With occlusion culling, this
+		// is the early phase.
+		if (aGpuDraws.cullPipe)
+		{
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "draw_culling");
+			record_draw_culling(aCmdBuff, aGpuDraws, aSceneDescriptors, aGpuDraws.hizPipe ? 1 : 0);
+		}
+
+		// G-buffer targets and depth, followed by the target in the merged pass
+		auto const gbufferTargets = aGBuffer.colourFormats.size();
+		std::vector<VkClearValue> clearValues(gbufferTargets + (aGBuffer.transient ? 2 : 1));
+		for (std::size_t i = 0; i < gbufferTargets; ++i)
+			clearValues[i].color = { {0.1f, 0.1f, 0.1f, 1.f} };
+		clearValues[gbufferTargets].depthStencil.depth = 1.0f;
+		if (aGBuffer.transient)
+			clearValues.back().color = { {0.1f, 0.1f, 0.1f, 1.f} };
+
+		// Merged pass: both passes are subpasses, the G-buffer stays in the
+		// render pass. Timestamps cannot be written in the G-buffer subpass
+		// when it executes secondary command buffers, so the pass is timed
+		// as a whole, with the lighting subpass nested in it.
+		if (aGBuffer.transient)
+		{
+			// Renders straight to the target image, at full resolution
+			assert(aRenderExtent.width == aImageExtent.width && aRenderExtent.height == aImageExtent.height);
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "deferred_pass");
+
+			VkRenderPassBeginInfo passInfo{};
+			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			passInfo.renderPass = aFullscreenPass;
+			passInfo.framebuffer = aSwapChainFramebuffer;
+			passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
+			passInfo.renderArea.extent = aImageExtent;
+			passInfo.clearValueCount = std::uint32_t(clearValues.size());
+			passInfo.pClearValues = clearValues.data();
+
+			if (aGpuDraws.cullPipe)
+			{
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				record_gbuffer_indirect(aCmdBuff, aGpuDraws, aRenderExtent, aSceneDescriptors);
+			}
+			else if (aInstancedDraws.pipe)
+			{
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				binds = record_gbuffer_instanced(aCmdBuff, aInstancedDraws, aRenderExtent, aSceneDescriptors);
+			}
+			else if (aWorkers)
+			{
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+				auto const count = record_gbuffer_secondaries(*aWorkers, aSecondaries, aFullscreenPass, aSwapChainFramebuffer, aFullscreenPipe, aFullscreenLayout, aRenderExtent, aSceneDescriptors, aColourMesh, aPBRDescriptors, aDrawList, binds);
+				vkCmdExecuteCommands(aCmdBuff, count, aSecondaries.data());
+			}
+			else
+			{
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				binds = record_gbuffer_draws(aCmdBuff, aFullscreenPipe, aFullscreenLayout, aRenderExtent, aSceneDescriptors, aColourMesh, aPBRDescriptors, aDrawList, 0, aDrawList.size());
+			}
+
+			vkCmdNextSubpass(aCmdBuff, VK_SUBPASS_CONTENTS_INLINE);
+			{
+				lut::GpuScope lightingScope(aProfiler, aCmdBuff, aProfilerSlot, "lighting_subpass");
+
+				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 1, 1, &aImageDescriptors, 0, nullptr);
+				if (aClusters.pipe)
+					vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 2, 1, &aClusters.descriptors, 0, nullptr);
+
+				vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostPipe);
+				set_render_viewport(aCmdBuff, aRenderExtent);
+				vkCmdDraw(aCmdBuff, 3, 1, 0, 0);
+			}
+
+			vkCmdEndRenderPass(aCmdBuff);
+		}
+
+		// Depth pre-pass: lays down the final depth, so that the G-buffer
+		// pass shades each pixel once
+		if (aPrepass.pass)
+		{
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "depth_prepass");
+
+			VkClearValue depthClear{};
+			depthClear.depthStencil.depth = 1.f;
+			depthClear.depthStencil.stencil = 0;
+
+			VkRenderPassBeginInfo passInfo{};
+			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			passInfo.renderPass = aPrepass.pass;
+			passInfo.framebuffer = aPrepass.framebuffer;
+			passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
+			passInfo.renderArea.extent = aRenderExtent;
+			passInfo.clearValueCount = 1;
+			passInfo.pClearValues = &depthClear;
+
+			vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+			record_depth_prepass(aCmdBuff, aPrepass.pipe, aFullscreenLayout, aRenderExtent, aSceneDescriptors, aColourMesh, aDrawList);
+			vkCmdEndRenderPass(aCmdBuff);
+		}
+
+		//first render pass
+
+		if (!aGBuffer.transient)
+		{
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "gbuffer_pass");
+
+			//Render Pass
+			VkRenderPassBeginInfo passInfo{};
+			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			passInfo.renderPass = aFullscreenPass;
+			passInfo.framebuffer = aIntermediatebuff;
+			passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
+			passInfo.renderArea.extent = aRenderExtent;
+			passInfo.clearValueCount = std::uint32_t(clearValues.size());
+			passInfo.pClearValues = clearValues.data();
+
+			if (aGpuDraws.cullPipe)
+			{
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				record_gbuffer_indirect(aCmdBuff, aGpuDraws, aRenderExtent, aSceneDescriptors);
+			}
+			else if (aInstancedDraws.pipe)
+			{
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				binds = record_gbuffer_instanced(aCmdBuff, aInstancedDraws, aRenderExtent, aSceneDescriptors);
+			}
+			else if (aWorkers)
+			{
+				// Only vkCmdExecuteCommands() is permitted in the subpass
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+				auto const count = record_gbuffer_secondaries(*aWorkers, aSecondaries, aFullscreenPass, aIntermediatebuff, aFullscreenPipe, aFullscreenLayout, aRenderExtent, aSceneDescriptors, aColourMesh, aPBRDescriptors, aDrawList, binds);
+				vkCmdExecuteCommands(aCmdBuff, count, aSecondaries.data());
+			}
+			else
+			{
+				vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				binds = record_gbuffer_draws(aCmdBuff, aFullscreenPipe, aFullscreenLayout, aRenderExtent, aSceneDescriptors, aColourMesh, aPBRDescriptors, aDrawList, 0, aDrawList.size());
+			}
+
+			vkCmdEndRenderPass(aCmdBuff);
+		}
+
+		// Occlusion culling: build the Hi-Z pyramid from the early draws'
+		// depth, cull the remaining meshes against it and add them to the
+		// G-buffer
+		if (aGpuDraws.hizPipe)
+		{
+			assert(!aGBuffer.transient);
+
+			{
+				lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "hiz_build");
+				record_hiz_build(aCmdBuff, aGpuDraws, aRenderExtent);
+			}
+
+			{
+				lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "occlusion_culling");
+
+				auto lateDraws = aGpuDraws;
+				auto const hizExtent = hiz_extent(aRenderExtent);
+				lateDraws.params.hizExtent = glm::uvec2(hizExtent.width, hizExtent.height);
+				lateDraws.params.hizLevels = hiz_levels(hizExtent);
+
+				record_draw_culling(aCmdBuff, lateDraws, aSceneDescriptors, 2);
+			}
+
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "gbuffer_late_pass");
+
+			VkRenderPassBeginInfo passInfo{};
+			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			passInfo.renderPass = aGpuDraws.latePass;
+			passInfo.framebuffer = aIntermediatebuff;
+			passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
+			passInfo.renderArea.extent = aRenderExtent;
+
+			vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+			record_gbuffer_indirect(aCmdBuff, aGpuDraws, aRenderExtent, aSceneDescriptors, 1);
+			vkCmdEndRenderPass(aCmdBuff);
+		}
+
+		// Compute lighting: shade into the lighting image (blitted below)
+		if (aCompute.output)
+		{
+			assert(aBlit.image);
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "lighting_compute");
+
+			// The previous frame's blit must have finished reading the image
+			lut::image_barrier(aCmdBuff, aBlit.image,
+				VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+			);
+
+			vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPostPipe);
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPostLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPostLayout, 1, 1, &aImageDescriptors, 0, nullptr);
+			if (aCompute.lights)
+				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPostLayout, 2, 1, &aCompute.lights, 0, nullptr);
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPostLayout, 3, 1, &aCompute.output, 0, nullptr);
+			vkCmdPushConstants(aCmdBuff, aPostLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glsl::ClusterParams), &aCompute.params);
+
+			auto const tile = deferred::kLightingTileSize;
+			vkCmdDispatch(aCmdBuff, (aRenderExtent.width + tile - 1) / tile, (aRenderExtent.height + tile - 1) / tile, 1);
+
+			lut::image_barrier(aCmdBuff, aBlit.image,
+				VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+			);
+		}
+
+		//second render pass
+		if (!aGBuffer.transient && !aCompute.output)
+		{
+			// Rendering to the lighting image: the previous frame's blit must
+			// have finished reading it (write-after-read, so an execution
+			// dependency is enough). The render pass leaves the image ready
+			// for the blit.
+			if (aBlit.image)
+			{
+				vkCmdPipelineBarrier(aCmdBuff,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					0, 0, nullptr, 0, nullptr, 0, nullptr
+				);
+			}
+
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "lighting_pass");
+
+			//Render Pass
+			VkClearValue postClearValues[2]{};
+			postClearValues[0].color = { {0.1f, 0.1f, 0.1f, 1.f} };
+			postClearValues[1].depthStencil.depth = 1.0f;
+
+			VkRenderPassBeginInfo passInfo{};
+			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			passInfo.renderPass = aPostPass;
+			passInfo.framebuffer = aSwapChainFramebuffer;
+			passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
+			passInfo.renderArea.extent = aRenderExtent;
+			passInfo.clearValueCount = 2;
+			passInfo.pClearValues = postClearValues;
+
+			vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			// Set 0 is bound with the lighting layout: with clustered lighting,
+			// it is not compatible with the G-buffer layout (push constants).
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 1, 1, &aImageDescriptors, 0, nullptr);
+			if (aClusters.pipe)
+				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 2, 1, &aClusters.descriptors, 0, nullptr);
+			//----------------------------------
+
+			vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostPipe);
+			set_render_viewport(aCmdBuff, aRenderExtent);
+
+			vkCmdDraw(aCmdBuff, 3, 1, 0, 0);
+
+			// Light volumes: each light marks its pixels in the stencil, then
+			// shades them. The instance index selects the light.
+			if (aVolumes.stencilPipe)
+			{
+				lut::GpuScope volumeScope(aProfiler, aCmdBuff, aProfilerSlot, "light_volumes");
+
+				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 2, 1, &aVolumes.lights, 0, nullptr);
+
+				VkDeviceSize const offset = 0;
+				vkCmdBindVertexBuffers(aCmdBuff, 0, 1, &aVolumes.vertices, &offset);
+				vkCmdBindIndexBuffer(aCmdBuff, aVolumes.indices, 0, VK_INDEX_TYPE_UINT32);
+
+				for (std::uint32_t i = 0; i < aVolumes.lightCount; ++i)
+				{
+					vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aVolumes.stencilPipe);
+					vkCmdDrawIndexed(aCmdBuff, aVolumes.indexCount, 1, 0, 0, i);
+
+					vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aVolumes.lightPipe);
+					vkCmdDrawIndexed(aCmdBuff, aVolumes.indexCount, 1, 0, 0, i);
+				}
+			}
+
+			vkCmdEndRenderPass(aCmdBuff);
+		}
+
+		// Copy the lighting image to the target image, scaling the rendered
+		// part up to the full extent
+		if (aBlit.image)
+		{
+			lut::GpuScope gpuScope(aProfiler, aCmdBuff, aProfilerSlot, "lighting_blit");
+
+			// The wait for the swapchain image happens in the transfer stage
+			// (see submit_commands())
+			lut::image_barrier(aCmdBuff, aBlit.target,
+				0, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+			);
+
+			VkImageBlit blit{};
+			blit.srcSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			blit.srcOffsets[1] = VkOffset3D{ std::int32_t(aRenderExtent.width), std::int32_t(aRenderExtent.height), 1 };
+			blit.dstSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			blit.dstOffsets[1] = VkOffset3D{ std::int32_t(aImageExtent.width), std::int32_t(aImageExtent.height), 1 };
+
+			// At full resolution, this only converts the format
+			bool const scaled = aRenderExtent.width != aImageExtent.width || aRenderExtent.height != aImageExtent.height;
+			vkCmdBlitImage(aCmdBuff, aBlit.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, aBlit.target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, scaled ? VK_FILTER_LINEAR : VK_FILTER_NEAREST);
+
+			// Offscreen images are read back by the transfer stage, like
+			// after the second render pass
+			bool const readback = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL == aBlit.targetLayout;
+			lut::image_barrier(aCmdBuff, aBlit.target,
+				VK_ACCESS_TRANSFER_WRITE_BIT, readback ? VK_ACCESS_TRANSFER_READ_BIT : 0,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, aBlit.targetLayout,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, readback ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+			);
+		}
+
+		//end recording
+		if (auto const res = vkEndCommandBuffer(aCmdBuff); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to end recording command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		return binds;
+	}
+
+	void set_render_viewport(VkCommandBuffer aCmdBuff, VkExtent2D const& aRenderExtent)
+	{
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = float(aRenderExtent.width);
+		viewport.height = float(aRenderExtent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor{};
+		scissor.extent = aRenderExtent;
+		scissor.offset = VkOffset2D{ 0,0 };
+
+		vkCmdSetViewport(aCmdBuff, 0, 1, &viewport);
+		vkCmdSetScissor(aCmdBuff, 0, 1, &scissor);
+	}
+
+	BindCounts record_gbuffer_draws(
+		VkCommandBuffer aCmdBuff,
+		VkPipeline aPipe,
+		VkPipelineLayout aLayout,
+		VkExtent2D const& aRenderExtent,
+		VkDescriptorSet aSceneDescriptors,
+		ColourMesh const& aColourMesh,
+		std::vector<VkDescriptorSet> const& aPBRDescriptors,
+		std::vector<std::uint32_t> const& aDrawList,
+		std::size_t aFirst,
+		std::size_t aLast
+	)
+	{
+		assert(aFirst <= aLast && aLast <= aDrawList.size());
+
+		// The G-buffer pass has a single pipeline; the scene set is bound
+		// along with it
+		BindTracker binds;
+		binds.change(BindTracker::Slot::pipeline, 0);
+
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPipe);
+		set_render_viewport(aCmdBuff, aRenderExtent);
+
+		auto& pos = aColourMesh.positions;
+		auto& norm = aColourMesh.normals;
+		for (std::size_t d = aFirst; d < aLast; ++d)
+		{
+			auto const i = aDrawList[d];
+			assert(i < pos.size());
+
+			auto const material = newShip.meshes[i].materialIndex;
+			if (binds.change(BindTracker::Slot::descriptorSet, material))
+				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aLayout, 1, 1, &aPBRDescriptors[material], 0, nullptr);
+
+			// Bind vertex input. Each mesh has its own buffers.
+			if (binds.change(BindTracker::Slot::vertexBuffers, i))
+			{
+				VkBuffer buffers[2] = { pos[i].buffer, norm[i].buffer };
+				VkDeviceSize offsets[2]{};
+				vkCmdBindVertexBuffers(aCmdBuff, 0, 2, buffers, offsets);
+			}
+
+			vkCmdDraw(aCmdBuff, aColourMesh.vertexCount[i], 1, 0, 0);
+			binds.draw();
+		}
+
+		return binds.counts();
+	}
+
+	void record_depth_prepass(VkCommandBuffer aCmdBuff, VkPipeline aPipe, VkPipelineLayout aLayout, VkExtent2D const& aRenderExtent, VkDescriptorSet aSceneDescriptors, ColourMesh const& aColourMesh, std::vector<std::uint32_t> const& aDrawList)
+	{
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPipe);
+		set_render_viewport(aCmdBuff, aRenderExtent);
+
+		// Same draws, in the same order, as record_gbuffer_draws(), but
+		// without materials or normals
+		auto& pos = aColourMesh.positions;
+		for (auto const i : aDrawList)
+		{
+			assert(i < pos.size());
+
+			VkDeviceSize const offset = 0;
+			vkCmdBindVertexBuffers(aCmdBuff, 0, 1, &pos[i].buffer, &offset);
+			vkCmdDraw(aCmdBuff, aColourMesh.vertexCount[i], 1, 0, 0);
+		}
+	}
+
+	void record_draw_culling(VkCommandBuffer aCmdBuff, GpuDrivenDraws const& aDraws, VkDescriptorSet aSceneDescriptors, std::uint32_t aPhase)
+	{
+		auto params = aDraws.params;
+		params.phase = aPhase;
+
+		// The first (or only) phase starts the counters. The late phase adds
+		// to them after the early phase's G-buffer pass has read its count
+		// (see the barriers below).
+		if (2 != aPhase)
+		{
+			vkCmdFillBuffer(aCmdBuff, aDraws.count, 0, sizeof(std::uint32_t) * deferred::kDrawCounterCount, 0);
+			lut::buffer_barrier(aCmdBuff, aDraws.count, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+
+		// The previous submission's late phase wrote the visibility
+		if (1 == aPhase)
+			lut::buffer_barrier(aCmdBuff, aDraws.visibility, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aDraws.cullPipe);
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aDraws.cullLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aDraws.cullLayout, 1, 1, &aDraws.cullDescriptors, 0, nullptr);
+		vkCmdPushConstants(aCmdBuff, aDraws.cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glsl::DrawCullParams), &params);
+
+		auto const group = deferred::kDrawCullGroupSize;
+		vkCmdDispatch(aCmdBuff, (params.drawCount + group - 1) / group, 1, 1);
+
+		// The counters are also read back by the host, for the statistics,
+		// and the early phase's are updated again by the late phase
+		VkAccessFlags countAccess = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		VkPipelineStageFlags countStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT;
+		if (1 == aPhase)
+		{
+			countAccess |= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			countStages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		}
+
+		lut::buffer_barrier(aCmdBuff, aDraws.commands, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+		lut::buffer_barrier(aCmdBuff, aDraws.count, VK_ACCESS_SHADER_WRITE_BIT, countAccess, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, countStages);
+	}
+
+	void record_hiz_build(VkCommandBuffer aCmdBuff, GpuDrivenDraws const& aDraws, VkExtent2D const& aRenderExtent)
+	{
+		auto const hizExtent = hiz_extent(aRenderExtent);
+
+		glsl::HiZParams params{};
+		params.depthExtent = glm::uvec2(aRenderExtent.width, aRenderExtent.height);
+		params.hizExtent = glm::uvec2(hizExtent.width, hizExtent.height);
+		params.levels = hiz_levels(hizExtent);
+
+		// The previous contents are not needed, but the previous submission's
+		// late culling must be done reading them. The G-buffer pass'
+		// dependency makes the depth available to the compute shader.
+		VkImageSubresourceRange const levels{ VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+		lut::image_barrier(aCmdBuff, aDraws.hizImage,
+			0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			levels
+		);
+
+		// The previous build's last workgroup reset the counter
+		lut::buffer_barrier(aCmdBuff, aDraws.hizCounter, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aDraws.hizPipe);
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aDraws.hizLayout, 0, 1, &aDraws.hizDescriptors, 0, nullptr);
+		vkCmdPushConstants(aCmdBuff, aDraws.hizLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glsl::HiZParams), &params);
+
+		auto const tile = deferred::kHiZTileSize;
+		vkCmdDispatch(aCmdBuff, (hizExtent.width + tile - 1) / tile, (hizExtent.height + tile - 1) / tile, 1);
+
+		lut::image_barrier(aCmdBuff, aDraws.hizImage,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			levels
+		);
+	}
+
+	void record_gbuffer_indirect(VkCommandBuffer aCmdBuff, GpuDrivenDraws const& aDraws, VkExtent2D const& aRenderExtent, VkDescriptorSet aSceneDescriptors, std::uint32_t aList)
+	{
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aDraws.gbufferLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aDraws.gbufferLayout, 1, 1, &aDraws.materials, 0, nullptr);
+		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aDraws.gbufferPipe);
+		set_render_viewport(aCmdBuff, aRenderExtent);
+
+		VkBuffer buffers[2] = { aDraws.positions, aDraws.normals };
+		VkDeviceSize offsets[2]{};
+		vkCmdBindVertexBuffers(aCmdBuff, 0, 2, buffers, offsets);
+
+		// Each list holds up to drawCount commands, with its own counter
+		auto const stride = std::uint32_t(sizeof(VkDrawIndirectCommand));
+		VkDeviceSize const first = VkDeviceSize(aList) * aDraws.params.drawCount * stride;
+		if (aDraws.params.compact)
+		{
+			vkCmdDrawIndirectCount(aCmdBuff, aDraws.commands, first, aDraws.count, sizeof(std::uint32_t) * aList, aDraws.params.drawCount, stride);
+		}
+		else if (aDraws.multiDraw)
+		{
+			vkCmdDrawIndirect(aCmdBuff, aDraws.commands, first, aDraws.params.drawCount, stride);
+		}
+		else
+		{
+			for (std::uint32_t i = 0; i < aDraws.params.drawCount; ++i)
+				vkCmdDrawIndirect(aCmdBuff, aDraws.commands, first + VkDeviceSize(i) * stride, 1, stride);
+		}
+	}
+
+	BindCounts record_gbuffer_instanced(VkCommandBuffer aCmdBuff, InstancedDraws const& aDraws, VkExtent2D const& aRenderExtent, VkDescriptorSet aSceneDescriptors)
+	{
+		// The state is the same for all draws, apart from the mesh's material
+		BindTracker binds;
+		binds.change(BindTracker::Slot::pipeline, 0);
+		binds.change(BindTracker::Slot::descriptorSet, 0);
+		binds.change(BindTracker::Slot::vertexBuffers, 0);
+
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aDraws.layout, 0, 1, &aSceneDescriptors, 0, nullptr);
+		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aDraws.layout, 1, 1, &aDraws.materials, 0, nullptr);
+		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aDraws.pipe);
+		set_render_viewport(aCmdBuff, aRenderExtent);
+
+		VkBuffer buffers[3] = { aDraws.positions, aDraws.normals, aDraws.instances };
+		VkDeviceSize offsets[3]{};
+		vkCmdBindVertexBuffers(aCmdBuff, 0, 3, buffers, offsets);
+
+		for (auto const& mesh : newShip.meshes)
+		{
+			glsl::InstancedMeshParams const params{ mesh.materialIndex };
+			vkCmdPushConstants(aCmdBuff, aDraws.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(params), &params);
+
+			auto const first = std::uint32_t(mesh.vertexStartIndex);
+			auto const count = std::uint32_t(mesh.numberOfVertices);
+
+			// The copy is selected by the first instance
+			if (aDraws.perInstance)
+			{
+				for (std::uint32_t i = 0; i < aDraws.instanceCount; ++i)
+				{
+					vkCmdDraw(aCmdBuff, count, 1, first, i);
+					binds.draw();
+				}
+			}
+			else
+			{
+				vkCmdDraw(aCmdBuff, count, aDraws.instanceCount, first, 0);
+				binds.draw();
+			}
+		}
+
+		return binds.counts();
+	}
+
+	std::uint32_t record_gbuffer_secondaries(
+		lut::ThreadPool& aWorkers,
+		std::vector<VkCommandBuffer> const& aSecondaries,
+		VkRenderPass aPass,
+		VkFramebuffer aFramebuffer,
+		VkPipeline aPipe,
+		VkPipelineLayout aLayout,
+		VkExtent2D const& aRenderExtent,
+		VkDescriptorSet aSceneDescriptors,
+		ColourMesh const& aColourMesh,
+		std::vector<VkDescriptorSet> const& aPBRDescriptors,
+		std::vector<std::uint32_t> const& aDrawList,
+		BindCounts& aBinds
+	)
+	{
+		// Chunk i is recorded into aSecondaries[i]. Each of these comes from
+		// a separate command pool, so no two jobs ever touch the same pool.
+		std::size_t const chunks = std::min(aWorkers.thread_count(), aSecondaries.size());
+		assert(chunks > 0);
+
+		std::size_t const perChunk = (aDrawList.size() + chunks - 1) / chunks;
+
+		std::vector<std::future<BindCounts>> recorded;
+		recorded.reserve(chunks);
+		for (std::size_t i = 0; i < chunks; ++i)
+		{
+			std::size_t const first = std::min(i * perChunk, aDrawList.size());
+			std::size_t const last = std::min(first + perChunk, aDrawList.size());
+			VkCommandBuffer const cmdBuff = aSecondaries[i];
+
+			recorded.emplace_back(aWorkers.submit([=, &aColourMesh, &aPBRDescriptors, &aDrawList]
+			{
+				LUT_CPU_ZONE("record_gbuffer_chunk");
+
+				VkCommandBufferInheritanceInfo inheritInfo{};
+				inheritInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+				inheritInfo.renderPass = aPass;
+				inheritInfo.subpass = 0;
+				inheritInfo.framebuffer = aFramebuffer;
+
+				VkCommandBufferBeginInfo begInfo{};
+				begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				begInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				begInfo.pInheritanceInfo = &inheritInfo;
+
+				if (auto const res = vkBeginCommandBuffer(cmdBuff, &begInfo); VK_SUCCESS != res)
+				{
+					throw lut::Error("Unable to begin recording secondary command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+				}
+
+				auto const binds = record_gbuffer_draws(cmdBuff, aPipe, aLayout, aRenderExtent, aSceneDescriptors, aColourMesh, aPBRDescriptors, aDrawList, first, last);
+
+				if (auto const res = vkEndCommandBuffer(cmdBuff); VK_SUCCESS != res)
+				{
+					throw lut::Error("Unable to end recording secondary command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+				}
+
+				return binds;
+			}));
+		}
+
+		// The jobs refer to our arguments, so all of them must have finished
+		// before an exception from one of them may be rethrown by get().
+		for (auto& job : recorded)
+			job.wait();
+		for (auto& job : recorded)
+			aBinds += job.get();
+
+		return std::uint32_t(chunks);
+	}
+
+	void run_record_benchmark(
+		lut::VulkanContext const& aContext,
+		lut::GpuTimeline& aTimeline,
+		lut::FrameContext& aFrame,
+		std::size_t aDrawCount,
+		std::size_t aMeshCount,
+		std::size_t aMaxThreads,
+		std::function<void(std::vector<std::uint32_t> const&, lut::ThreadPool*)> const& aRecord
+	)
+	{
+		assert(aMeshCount > 0);
+
+		// Synthetic scene: cycle through the meshes until there are
+		// aDrawCount draws.
+		std::vector<std::uint32_t> draws(aDrawCount);
+		for (std::size_t i = 0; i < aDrawCount; ++i)
+			draws[i] = std::uint32_t(i % aMeshCount);
+
+		using Clock_ = std::chrono::steady_clock;
+		auto const time_recording = [&](lut::ThreadPool* aWorkers)
 		{
-			throw lut::Error("Unable to create render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str());
-		}
+			float totalMs = 0.f;
 
-		return lut::RenderPass(aWindow.device, rpass);
-	}
+			// One untimed warm-up round
+			for (std::uint32_t iter = 0; iter <= cfg::kBenchIterations; ++iter)
+			{
+				lut::begin_frame(aContext, aTimeline, aFrame, iter);
 
-	lut::PipelineLayout create_deferred_second_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aSceneDescriptorLayout, VkDescriptorSetLayout aDescriptorLayout)
-	{
+				auto const start = Clock_::now();
+				aRecord(draws, aWorkers);
+				auto const ms = std::chrono::duration<float, std::milli>(Clock_::now() - start).count();
 
-		VkDescriptorSetLayout layouts[] = { aSceneDescriptorLayout, aDescriptorLayout };
+				if (iter > 0)
+					totalMs += ms;
+			}
 
-		//Creating the pipeline layout
-		VkPipelineLayoutCreateInfo layoutInfo{};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
-		layoutInfo.pSetLayouts = layouts;
-		layoutInfo.pushConstantRangeCount = 0;
-		layoutInfo.pPushConstantRanges = nullptr;
+			return totalMs / cfg::kBenchIterations;
+		};
 
-		VkPipelineLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		std::printf("Recording %zu draws (%zu meshes), average of %u frames:\n", aDrawCount, aMeshCount, cfg::kBenchIterations);
+
+		float const inlineMs = time_recording(nullptr);
+		std::printf("  inline     : %8.3f ms\n", inlineMs);
+
+		// Powers of two, plus the maximum
+		std::vector<std::size_t> threadCounts;
+		for (std::size_t threads = 1; threads < aMaxThreads; threads *= 2)
+			threadCounts.emplace_back(threads);
+		threadCounts.emplace_back(aMaxThreads);
+
+		for (auto const threads : threadCounts)
 		{
-			throw lut::Error("Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str());
+			lut::ThreadPool workers(threads);
+
+			float const ms = time_recording(&workers);
+			std::printf("  %2zu threads : %8.3f ms (%.2fx)\n", threads, ms, inlineMs / ms);
 		}
-		return lut::PipelineLayout(aContext.device, layout);
 	}
 
-	lut::Pipeline create_deferred_second_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	Options parse_options(int aArgc, char** aArgv)
 	{
-		//first step  : load shader modules
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, deferred::kPostVertPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, deferred::kPostFragPath);
+		Options options;
+		for (int i = 1; i < aArgc; ++i)
+		{
+			if (0 == std::strcmp(aArgv[i], "--bench-record"))
+			{
+				options.benchRecord = true;
+
+				// Optional draw count
+				if (i + 1 < aArgc && aArgv[i+1][0] != '-')
+				{
+					char* end = nullptr;
+					auto const count = std::strtoull(aArgv[i+1], &end, 10);
+					if (*end != '\0' || 0 == count)
+						throw lut::Error("--bench-record: invalid draw count '%s'", aArgv[i+1]);
+
+					options.benchDraws = std::size_t(count);
+					++i;
+				}
+			}
+			else if (0 == std::strcmp(aArgv[i], "--bench-cull"))
+			{
+				options.benchCull = true;
+
+				// Optional box count
+				if (i + 1 < aArgc && aArgv[i+1][0] != '-')
+				{
+					char* end = nullptr;
+					auto const count = std::strtoull(aArgv[i+1], &end, 10);
+					if (*end != '\0' || 0 == count || count > std::numeric_limits<std::uint32_t>::max())
+						throw lut::Error("--bench-cull: invalid box count '%s'", aArgv[i+1]);
+
+					options.benchCullBoxes = std::size_t(count);
+					++i;
+				}
+			}
+			else if (0 == std::strcmp(aArgv[i], "--bench-sort"))
+			{
+				options.benchSort = true;
+
+				// Optional draw count
+				if (i + 1 < aArgc && aArgv[i+1][0] != '-')
+				{
+					char* end = nullptr;
+					auto const count = std::strtoull(aArgv[i+1], &end, 10);
+					if (*end != '\0' || 0 == count || count > std::numeric_limits<std::uint32_t>::max())
+						throw lut::Error("--bench-sort: invalid draw count '%s'", aArgv[i+1]);
+
+					options.benchSortDraws = std::size_t(count);
+					++i;
+				}
+			}
+			else if (0 == std::strcmp(aArgv[i], "--sort-draws"))
+			{
+				options.sortDraws = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--headless"))
+			{
+				options.headless = true;
+
+				// Optional frame count
+				if (i + 1 < aArgc && aArgv[i+1][0] != '-')
+				{
+					char* end = nullptr;
+					auto const count = std::strtoull(aArgv[i+1], &end, 10);
+					if (*end != '\0' || 0 == count)
+						throw lut::Error("--headless: invalid frame count '%s'", aArgv[i+1]);
+
+					options.headlessFrames = std::uint64_t(count);
+					++i;
+				}
+			}
+			else if (0 == std::strcmp(aArgv[i], "--output"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--output: missing directory");
 
-		//Shader stages in the pipeline
-		//We need two here, vert and frag
-		VkPipelineShaderStageCreateInfo  stages[2]{};
-		//vertex  [0]
-		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
-		stages[0].pName = "main";
+				options.outputDir = aArgv[++i];
+			}
+			else if (0 == std::strcmp(aArgv[i], "--trace"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--trace: missing file name");
 
-		//fragment [1]
-		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
-		stages[1].pName = "main";
+				options.tracePath = aArgv[++i];
+			}
+			else if (0 == std::strcmp(aArgv[i], "--replay"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--replay: missing file name");
 
-		//----------------------------------------------------VkPipelineVertexInputStateCreateInfo 
+				options.replayPath = aArgv[++i];
+			}
+			else if (0 == std::strcmp(aArgv[i], "--report"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--report: missing file name");
 
-		VkPipelineVertexInputStateCreateInfo emptyInfo{};
-		emptyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		emptyInfo.vertexBindingDescriptionCount = 0;
-		emptyInfo.pVertexBindingDescriptions = nullptr;
-		emptyInfo.vertexAttributeDescriptionCount = 0;
-		emptyInfo.pVertexAttributeDescriptions = nullptr;
-		emptyInfo.flags = 0;
+				options.reportPath = aArgv[++i];
+			}
+			else if (0 == std::strcmp(aArgv[i], "--record-path"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--record-path: missing file name");
 
+				options.recordPath = aArgv[++i];
+			}
+			else if (0 == std::strcmp(aArgv[i], "--gbuffer"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--gbuffer: missing layout");
 
-		//for rasterization
-		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
-		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		assemblyInfo.primitiveRestartEnable = VK_FALSE;
+				if (!parse_gbuffer_layout(aArgv[i+1], options.gbufferLayout))
+					throw lut::Error("--gbuffer: unknown layout '%s' (expected 'classic' or 'compact')", aArgv[i+1]);
+				++i;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--merge-passes"))
+			{
+				options.mergePasses = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--lights"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--lights: missing light count");
 
-		//todo list...   Tessellation State   not now
+				char* end = nullptr;
+				auto const count = std::strtoull(aArgv[i+1], &end, 10);
+				if (*end != '\0' || 0 == count || count > cfg::kMaxPointLights)
+					throw lut::Error("--lights: invalid light count '%s' (expected 1 to %u)", aArgv[i+1], cfg::kMaxPointLights);
 
+				options.pointLights = std::uint32_t(count);
+				++i;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--check-clusters"))
+			{
+				options.checkClusters = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--compute-lighting"))
+			{
+				options.computeLighting = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--light-volumes"))
+			{
+				options.lightVolumes = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--dynamic-resolution"))
+			{
+				options.dynamicResolution = true;
+
+				// Optional target GPU time
+				if (i + 1 < aArgc && aArgv[i+1][0] != '-')
+				{
+					char* end = nullptr;
+					auto const ms = std::strtof(aArgv[i+1], &end);
+					if (*end != '\0' || !(ms > 0.f))
+						throw lut::Error("--dynamic-resolution: invalid frame time '%s'", aArgv[i+1]);
+
+					options.targetGpuMs = ms;
+					++i;
+				}
+			}
+			else if (0 == std::strcmp(aArgv[i], "--gpu-culling"))
+			{
+				options.gpuCulling = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--occlusion-culling"))
+			{
+				options.occlusionCulling = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--instances"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--instances: missing copy count");
 
-		//viewport state
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = float(aWindow.swapchainExtent.width);
-		viewport.height = float(aWindow.swapchainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+				char* end = nullptr;
+				auto const count = std::strtoull(aArgv[i+1], &end, 10);
+				if (*end != '\0' || 0 == count || count > cfg::kMaxInstances)
+					throw lut::Error("--instances: invalid copy count '%s' (expected 1 to %u)", aArgv[i+1], cfg::kMaxInstances);
 
-		VkRect2D scissor{};
-		scissor.extent = VkExtent2D{ aWindow.swapchainExtent.width,
-									 aWindow.swapchainExtent.height };
-		scissor.offset = VkOffset2D{ 0,0 };
+				options.instances = std::uint32_t(count);
+				++i;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--draw-per-instance"))
+			{
+				options.drawPerInstance = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--depth-prepass"))
+			{
+				options.depthPrepass = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--pipeline-cache"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--pipeline-cache: missing file name");
 
-		VkPipelineViewportStateCreateInfo viewportInfo{};
-		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
-		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
-
-		//Rasterization State
-		VkPipelineRasterizationStateCreateInfo rasterInfo{};
-		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterInfo.depthClampEnable = VK_FALSE;
-		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;  // like OpenGL
-		rasterInfo.depthBiasEnable = VK_FALSE;
-		rasterInfo.lineWidth = 1.0f;
-
-
-		//Mulitisampling 
-		VkPipelineMultisampleStateCreateInfo sampleInfo{};
-		sampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		sampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		//Depth/Stencil State    not now
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
-
-		//Color Blend State  
-		//mask 
-		VkPipelineColorBlendAttachmentState blendStates[1]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		VkPipelineColorBlendStateCreateInfo blendInfo{};
-		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		blendInfo.attachmentCount = 1;
-		blendInfo.pAttachments = blendStates;
-
-		//Dynamic States
-
-		//Create pipeline
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;  //vert frag
-		pipelineInfo.pStages = stages;
-		pipelineInfo.pVertexInputState = &emptyInfo;
-		pipelineInfo.pInputAssemblyState = &assemblyInfo;
-		pipelineInfo.pViewportState = &viewportInfo;
-		pipelineInfo.pRasterizationState = &rasterInfo;
-		pipelineInfo.pMultisampleState = &sampleInfo;
-		pipelineInfo.pColorBlendState = &blendInfo;
-		pipelineInfo.layout = aPipelineLayout;
-		pipelineInfo.renderPass = aRenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.pTessellationState = nullptr;
-		pipelineInfo.pDepthStencilState = &depthInfo;
-		pipelineInfo.pDynamicState = nullptr;
+				options.pipelineCachePath = aArgv[++i];
+			}
+			else if (0 == std::strcmp(aArgv[i], "--no-pipeline-cache"))
+			{
+				options.pipelineCachePath = nullptr;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--serial-pipelines"))
+			{
+				options.serialPipelines = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--brdf"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--brdf: missing model");
+
+				if (0 == std::strcmp(aArgv[i+1], "microfacet"))
+					options.brdf = BrdfModel::microfacet;
+				else if (0 == std::strcmp(aArgv[i+1], "lambert"))
+					options.brdf = BrdfModel::lambert;
+				else
+					throw lut::Error("--brdf: unknown model '%s' (expected 'microfacet' or 'lambert')", aArgv[i+1]);
+				++i;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--no-emissive"))
+			{
+				options.emissive = false;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--no-ambient"))
+			{
+				options.ambient = false;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--trace-csv"))
+			{
+				if (i + 1 >= aArgc)
+					throw lut::Error("--trace-csv: missing file name");
 
-		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipe); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
+				options.traceCsvPath = aArgv[++i];
+			}
+			else
+			{
+				throw lut::Error("Unknown option '%s'\n" "Usage: %s [--bench-record [draws]] [--bench-cull [boxes]] [--bench-sort [draws]] [--headless [frames] [--output <dir>]] [--trace <file>] [--trace-csv <file>] [--replay <file> [--report <file>]] [--record-path <file>] [--gbuffer classic|compact] [--merge-passes] [--lights <count>] [--check-clusters] [--compute-lighting] [--light-volumes] [--dynamic-resolution [ms]] [--gpu-culling] [--occlusion-culling] [--sort-draws] [--instances <count> [--draw-per-instance]] [--depth-prepass] [--pipeline-cache <file> | --no-pipeline-cache] [--serial-pipelines] [--brdf microfacet|lambert] [--no-emissive] [--no-ambient]", aArgv[i], aArgv[0]);
+			}
 		}
 
-		return lut::Pipeline(aWindow.device, pipe);
-	}
-
-	void record_commands(
-		VkCommandBuffer aCmdBuff,
-		VkRenderPass aFullscreenPass,
-		VkRenderPass aPostPass,
-		VkFramebuffer aSwapChainFramebuffer,
-		VkFramebuffer aIntermediatebuff,
-		VkPipeline aFullscreenPipe,
-		VkPipeline aPostPipe,
-		VkExtent2D const& aImageExtent,
-		ColourMesh& aColourMesh,
+		if (options.outputDir && !options.headless)
+			throw lut::Error("--output requires --headless");
 
-		VkBuffer aSceneUBO,
-		std::vector<lut::Buffer>& aPBR,
-		glsl::SceneUniform const& aSceneUniform,
+		if (options.reportPath && !options.replayPath)
+			throw lut::Error("--report requires --replay");
 
-		VkPipelineLayout aFullscreenLayout,
-		VkPipelineLayout aPostLayout,
-		VkDescriptorSet aSceneDescriptors,
-		VkDescriptorSet aImageDescriptors,
-		std::vector<VkDescriptorSet> aPBRDescriptors
-		///------------------------------------
-	)
-	{
-		VkCommandBufferBeginInfo begInfo{};
-		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		begInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;  // we use one time here
-		begInfo.pInheritanceInfo = nullptr;
+		// The compute shader cannot read input attachments
+		if (options.computeLighting && options.mergePasses)
+			throw lut::Error("--compute-lighting cannot be combined with --merge-passes");
 
-		if (auto const res = vkBeginCommandBuffer(aCmdBuff, &begInfo); VK_SUCCESS != res)
+		if (options.lightVolumes)
 		{
-			throw lut::Error("Unable to begin recording command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+			if (0 == options.pointLights)
+				throw lut::Error("--light-volumes requires --lights");
+			if (options.mergePasses || options.computeLighting)
+				throw lut::Error("--light-volumes cannot be combined with --merge-passes or --compute-lighting");
 		}
 
-		//upload scene uniforms
-		//we need two barriers here
-		lut::buffer_barrier(aCmdBuff, aSceneUBO, VK_ACCESS_UNIFORM_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-		vkCmdUpdateBuffer(aCmdBuff, aSceneUBO, 0, sizeof(glsl::SceneUniform), &aSceneUniform);
-		lut::buffer_barrier(aCmdBuff, aSceneUBO, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+		// The merged pass renders straight to the target image
+		if (options.dynamicResolution && options.mergePasses)
+			throw lut::Error("--dynamic-resolution cannot be combined with --merge-passes");
 
-		for (int i = 0; i < aPBR.size(); i++)
+		// The Hi-Z pyramid is built between two G-buffer passes, from a
+		// depth buffer without stencil
+		if (options.occlusionCulling)
 		{
-			glsl::PBRuniform pbrUniforms{};
-			pbrUniforms.albedo = glm::vec4(newShip.materials[i].albedo, 1.f);
-			pbrUniforms.emissive = glm::vec4(newShip.materials[i].emissive, 1.f);
-			pbrUniforms.metalness = newShip.materials[i].metalness;
-			pbrUniforms.shininess = newShip.materials[i].shininess;
-
-			lut::buffer_barrier(aCmdBuff, aPBR[i].buffer, VK_ACCESS_UNIFORM_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-			vkCmdUpdateBuffer(aCmdBuff, aPBR[i].buffer, 0, sizeof(glsl::PBRuniform), &pbrUniforms);
-			lut::buffer_barrier(aCmdBuff, aPBR[i].buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			if (!options.gpuCulling)
+				throw lut::Error("--occlusion-culling requires --gpu-culling");
+			if (options.mergePasses || options.lightVolumes)
+				throw lut::Error("--occlusion-culling cannot be combined with --merge-passes or --light-volumes");
 		}
-		//first render pass
 
-		{
-			//Render Pass
-			VkClearValue clearValues[5]{};
-			clearValues[0].color = { {0.1f, 0.1f, 0.1f, 1.f} };
-			clearValues[1].color = { {0.1f, 0.1f, 0.1f, 1.f} };
-			clearValues[2].color = { {0.1f, 0.1f, 0.1f, 1.f} };
-			clearValues[3].color = { {0.1f, 0.1f, 0.1f, 1.f} };
-			clearValues[4].depthStencil.depth = 1.0f;
+		if (options.drawPerInstance && 0 == options.instances)
+			throw lut::Error("--draw-per-instance requires --instances");
 
-			VkRenderPassBeginInfo passInfo{};
-			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			passInfo.renderPass = aFullscreenPass;
-			passInfo.framebuffer = aIntermediatebuff;
-			passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
-			passInfo.renderArea.extent = aImageExtent;
-			passInfo.clearValueCount = sizeof(clearValues) / sizeof(clearValues[0]);
-			passInfo.pClearValues = clearValues;
+		// The GPU-driven draws cull the meshes of the single model
+		if (options.instances > 0 && options.gpuCulling)
+			throw lut::Error("--instances cannot be combined with --gpu-culling");
 
-			vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// The pre-pass draws the CPU draw list into the separate G-buffer
+		// depth
+		if (options.depthPrepass && (options.mergePasses || options.gpuCulling || options.instances > 0))
+			throw lut::Error("--depth-prepass cannot be combined with --merge-passes, --gpu-culling or --instances");
 
-			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aFullscreenLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
-			//----------------------------------
+		return options;
+	}
 
-			vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aFullscreenPipe);
-			// Bind vertex input
-			for (int i = 0; i < aColourMesh.positions.size(); i++)
-			{
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aFullscreenLayout, 1, 1, &aPBRDescriptors[newShip.meshes[i].materialIndex], 0, nullptr);
+	std::tuple<glm::vec3, glm::vec3> compute_model_bounds(ModelData const& aModel)
+	{
+		glm::vec3 bmin(std::numeric_limits<float>::max());
+		glm::vec3 bmax(-std::numeric_limits<float>::max());
+		for (auto const& pos : aModel.vertexPositions)
+		{
+			bmin = glm::min(bmin, pos);
+			bmax = glm::max(bmax, pos);
+		}
 
-				auto& pos = aColourMesh.positions;
-				auto& norm = aColourMesh.normals;
-				VkBuffer buffers[2] = { pos[i].buffer, norm[i].buffer };
-				VkDeviceSize offsets[2]{};
-				vkCmdBindVertexBuffers(aCmdBuff, 0, 2, buffers, offsets);
-				vkCmdDraw(aCmdBuff, aColourMesh.vertexCount[i], 1, 0, 0);
-			}
+		return { bmin, bmax };
+	}
 
-			vkCmdEndRenderPass(aCmdBuff);
-		}
+	void print_gpu_stats(lut::GpuProfiler const& aProfiler)
+	{
+		if (!aProfiler.enabled())
+			return;
 
-		//second render pass
-		{
-			//Render Pass
-			VkClearValue clearValues[2]{};
-			clearValues[0].color = { {0.1f, 0.1f, 0.1f, 1.f} };
-			clearValues[1].depthStencil.depth = 1.0f;
+		std::printf("  GPU:");
+		for (auto const& scope : aProfiler.stats())
+			std::printf(" %s %.3f ms (%.3f-%.3f),", scope.name, scope.meanMs, scope.minMs, scope.maxMs);
+		std::printf("\n");
+	}
 
-			VkRenderPassBeginInfo passInfo{};
-			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			passInfo.renderPass = aPostPass;
-			passInfo.framebuffer = aSwapChainFramebuffer;
-			passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
-			passInfo.renderArea.extent = aImageExtent;
-			passInfo.clearValueCount = 2;
-			passInfo.pClearValues = clearValues;
+	void write_traces(Options const& aOptions, lut::GpuTimeline& aTimeline, lut::GpuProfiler& aProfiler)
+	{
+		if (!aOptions.tracePath && !aOptions.traceCsvPath)
+			return;
 
-			vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+		aProfiler.collect(aTimeline);
 
-			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aFullscreenLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+		std::vector<lut::TraceEvent> events;
+		aProfiler.append_trace_events(events, cfg::kGpuTraceThread);
+		lut::cpu_profiler::append_trace_events(events, cfg::kFirstCpuTraceThread);
 
-			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostLayout, 1, 1, &aImageDescriptors, 0, nullptr);
-			//----------------------------------
+		std::vector<lut::TraceThread> threads{ { cfg::kGpuTraceThread, "GPU (graphics queue)" } };
+		for (auto& thread : lut::cpu_profiler::threads(cfg::kFirstCpuTraceThread))
+			threads.emplace_back(std::move(thread));
 
-			vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPostPipe);
+		if (aOptions.tracePath)
+			lut::write_chrome_trace(aOptions.tracePath, events, threads);
 
-			vkCmdDraw(aCmdBuff, 3, 1, 0, 0);
-			vkCmdEndRenderPass(aCmdBuff);
+		if (aOptions.traceCsvPath)
+			lut::write_trace_csv(aOptions.traceCsvPath, events);
+
+		std::printf("Wrote %zu trace events\n", events.size());
+	}
+
+	void write_replay_report(Options const& aOptions, CameraPath const& aPath, VkExtent2D const& aExtent, std::vector<float> const& aFrameMs, lut::GpuProfiler const& aProfiler, ResolutionController const& aResolution)
+	{
+		auto const warmup = std::size_t(std::min<std::uint64_t>(cfg::kReplayWarmupFrames, aFrameMs.size() / 2));
+		auto const stats = lut::compute_frame_time_stats(std::vector<float>(aFrameMs.begin() + warmup, aFrameMs.end()));
+
+		std::FILE* out = stdout;
+		if (aOptions.reportPath)
+		{
+			out = std::fopen(aOptions.reportPath, "w");
+			if (!out)
+				throw lut::Error("Unable to open '%s' for writing", aOptions.reportPath);
 		}
 
-		//end recording
-		if (auto const res = vkEndCommandBuffer(aCmdBuff); VK_SUCCESS != res)
+		std::fprintf(out, "{\n");
+		// The path is the only string that is not under our control
+		std::fprintf(out, "  \"path\": \"");
+		for (char const* ch = aOptions.replayPath; *ch; ++ch)
 		{
-			throw lut::Error("Unable to end recording command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+			if ('"' == *ch || '\\' == *ch)
+				std::fputc('\\', out);
+			std::fputc(*ch, out);
+		}
+		std::fprintf(out, "\",\n");
+		std::fprintf(out, "  \"mode\": \"%s\",\n", aOptions.headless ? "headless" : "window");
+		std::fprintf(out, "  \"extent\": [%u, %u],\n", aExtent.width, aExtent.height);
+		std::fprintf(out, "  \"gbuffer\": { \"layout\": \"%s\", \"bytes_per_pixel\": %u, \"merged_passes\": %s, \"depth_prepass\": %s },\n", to_string(aOptions.gbufferLayout), gbuffer_bytes_per_pixel(make_gbuffer_desc(aOptions.gbufferLayout)), aOptions.mergePasses ? "true" : "false", aOptions.depthPrepass ? "true" : "false");
+		std::fprintf(out, "  \"point_lights\": %u,\n", aOptions.pointLights);
+		if (aOptions.instances > 0)
+			std::fprintf(out, "  \"instances\": { \"copies\": %u, \"draw_per_instance\": %s },\n", aOptions.instances, aOptions.drawPerInstance ? "true" : "false");
+		else
+			std::fprintf(out, "  \"instances\": null,\n");
+		std::fprintf(out, "  \"lighting\": \"%s\",\n", aOptions.computeLighting ? "compute" : aOptions.lightVolumes ? "volumes" : "fragment");
+		if (aOptions.dynamicResolution)
+			std::fprintf(out, "  \"render_scale\": { \"target_gpu_ms\": %.3f, \"final\": %.3f, \"min\": %.3f, \"changes\": %u },\n", aResolution.target_ms(), aResolution.scale(), aResolution.min_scale_seen(), aResolution.change_count());
+		else
+			std::fprintf(out, "  \"render_scale\": null,\n");
+		std::fprintf(out, "  \"timestep\": %.6f,\n", aPath.timestep);
+		std::fprintf(out, "  \"frames\": %zu,\n", aFrameMs.size());
+		std::fprintf(out, "  \"warmup_frames\": %zu,\n", warmup);
+		std::fprintf(out, "  \"frame_ms\": { \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n", stats.meanMs, stats.minMs, stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs);
+
+		// Rolling statistics over the last frames of the run
+		std::fprintf(out, "  \"gpu_ms\": {");
+		bool first = true;
+		for (auto const& scope : aProfiler.stats())
+		{
+			std::fprintf(out, "%s\n    \"%s\": { \"mean\": %.4f, \"min\": %.4f, \"max\": %.4f }", first ? "" : ",", scope.name, scope.meanMs, scope.minMs, scope.maxMs);
+			first = false;
 		}
+		std::fprintf(out, "%s}\n}\n", first ? "" : "\n  ");
+
+		if (out != stdout)
+			std::fclose(out);
+	}
 
+	RenderTarget make_render_target(lut::VulkanWindow const& aWindow)
+	{
+		RenderTarget target{};
+		target.format = aWindow.swapchainFormat;
+		target.extent = aWindow.swapchainExtent;
+		target.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
+		target.images = aWindow.swapImages;
+		for (auto const view : aWindow.swapViews)
+			target.views.emplace_back(view);
 
+		return target;
 	}
 
-	void submit_commands(lut::VulkanWindow const& aWindow, VkCommandBuffer aCmdBuff, VkFence aFence, VkSemaphore aWaitSemaphore, VkSemaphore aSignalSemaphore)
+	RenderTarget make_render_target(lut::OffscreenTarget const& aOffscreen)
 	{
-		//throw lut::Error( "Not yet implemented" ); //TODO: (Section 1/Exercise 3) implement me!
-		VkPipelineStageFlags waitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &aCmdBuff;
+		RenderTarget target{};
+		target.format = aOffscreen.format;
+		target.extent = aOffscreen.extent;
+		target.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = &aWaitSemaphore;
-		submitInfo.pWaitDstStageMask = &waitPipelineStages;
+		for (auto const& image : aOffscreen.images)
+			target.images.emplace_back(image.image);
+		for (auto const& view : aOffscreen.views)
+			target.views.emplace_back(view.handle);
 
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &aSignalSemaphore;
-		if (auto const res = vkQueueSubmit(aWindow.graphicsQueue, 1, &submitInfo, aFence); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to submit command buffer to queue\n" "vkQueueSubmit() returned %s", lut::to_string(res).c_str());
-		}
+		return target;
+	}
+
+	std::uint64_t submit_commands(lut::VulkanContext const& aContext, lut::GpuTimeline& aTimeline, VkCommandBuffer aCmdBuff, VkSemaphore aWaitSemaphore, VkSemaphore aSignalSemaphore)
+	{
+		LUT_CPU_ZONE("submit");
+
+		// Wait for the swapchain image before writing to it (by rendering, or
+		// by the blit of the compute lighting pass); the binary semaphore
+		// aSignalSemaphore is waited for by the present. The timeline value
+		// tells us when the frame's resources can be reused.
+		return aTimeline.submit(
+			aContext.graphicsQueue,
+			1, &aCmdBuff,
+			aWaitSemaphore, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			aSignalSemaphore
+		);
 	}
 
 	void present_results(VkQueue aPresentQueue, VkSwapchainKHR aSwapchain, std::uint32_t aImageIndex, VkSemaphore aRenderFinished, bool& aNeedToRecreateSwapchain)
 	{
+		LUT_CPU_ZONE("present");
+
 		//throw lut::Error( "Not yet implemented" ); //TODO: (Section 1/Exercise 3) implement me!
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1467,13 +5243,120 @@ namespace
 //DescriptorSet Layout
 namespace
 {
-	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const& aWindow)
+	VkDescriptorSetLayout scene_set_layout(lut::DescriptorLayoutCache& aCache)
 	{
-		VkDescriptorSetLayoutBinding bindings[1]{};
-		bindings[0].binding = 0;
-		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		bindings[0].descriptorCount = 1;
-		bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		// Used by the vertex shaders of the G-buffer pass, and by the
+		// lighting pass as fragment or compute shader
+		auto const shaders = lut::reflect_shaders({ deferred::kVertShaderPath, deferred::kPostFragPath, deferred::kTiledCompPath });
+
+		auto const bindings = lut::set_layout_bindings(shaders, 0);
+		if (1 != bindings.size() || VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER != bindings[0].descriptorType)
+			throw lut::Error("Scene set: expected a single uniform buffer, the shaders declare %zu bindings", bindings.size());
+
+		return aCache.get(bindings);
+	}
+
+	VkDescriptorSetLayout advanced_set_layout(lut::DescriptorLayoutCache& aCache)
+	{
+		// Both G-buffer layouts read the material the same way
+		auto const shaders = lut::reflect_shaders({ deferred::kFragShaderPath, deferred::kCompactFragShaderPath });
+
+		auto const bindings = lut::set_layout_bindings(shaders, 1);
+		if (1 != bindings.size() || VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER != bindings[0].descriptorType)
+			throw lut::Error("Material set: expected a single uniform buffer, the shaders declare %zu bindings", bindings.size());
+
+		return aCache.get(bindings);
+	}
+
+	VkDescriptorSetLayout deferred_set_layout(lut::DescriptorLayoutCache& aCache, GBufferDesc const& aGBuffer)
+	{
+		bool const compact = GBufferLayout::compact == aGBuffer.layout;
+
+		// A transient G-buffer is read as input attachments by the merged
+		// pass' fragment shader; otherwise, the images are sampled by the
+		// fragment or compute shader of the lighting pass
+		lut::ShaderInterface shaders;
+		if (aGBuffer.transient)
+			shaders = lut::reflect_spirv_file(compact ? deferred::kCompactSubpassPostFragPath : deferred::kSubpassPostFragPath);
+		else if (compact)
+			shaders = lut::reflect_shaders({ deferred::kCompactPostFragPath, deferred::kCompactTiledCompPath });
+		else
+			shaders = lut::reflect_shaders({ deferred::kPostFragPath, deferred::kTiledCompPath });
+
+		// update_deferred_descriptors() writes all four
+		auto const bindings = lut::set_layout_bindings(shaders, 1);
+		if (4 != bindings.size())
+			throw lut::Error("G-buffer set: expected 4 bindings, the shaders declare %zu", bindings.size());
+
+		return aCache.get(bindings);
+	}
+
+	void check_shader_interfaces()
+	{
+		// The lighting pass declares the full UScene (scene_uniform.glsl),
+		// the G-buffer pass a prefix of it
+		for (auto const path : { deferred::kPostFragPath, deferred::kVertShaderPath })
+		{
+			auto const shader = lut::reflect_spirv_file(path);
+			auto const* scene = lut::find_binding(shader, 0, 0);
+			if (!scene)
+				throw lut::Error("%s: no scene uniforms (set 0, binding 0)", path);
+
+			lut::check_block_layout(scene->block, "glsl::SceneUniform", sizeof(glsl::SceneUniform), {
+				offsetof(glsl::SceneUniform, camera),
+				offsetof(glsl::SceneUniform, projection),
+				offsetof(glsl::SceneUniform, projCam),
+				offsetof(glsl::SceneUniform, viewInv),
+				offsetof(glsl::SceneUniform, projectionInv),
+				offsetof(glsl::SceneUniform, lights),
+				offsetof(glsl::SceneUniform, camPos),
+				offsetof(glsl::SceneUniform, constant),
+				offsetof(glsl::SceneUniform, renderExtent)
+			});
+		}
+
+		{
+			auto const shader = lut::reflect_spirv_file(deferred::kFragShaderPath);
+			auto const* material = lut::find_binding(shader, 1, 0);
+			if (!material)
+				throw lut::Error("%s: no material uniforms (set 1, binding 0)", deferred::kFragShaderPath);
+
+			lut::check_block_layout(material->block, "glsl::PBRuniform", sizeof(glsl::PBRuniform), {
+				offsetof(glsl::PBRuniform, emissive),
+				offsetof(glsl::PBRuniform, albedo),
+				offsetof(glsl::PBRuniform, shininess),
+				offsetof(glsl::PBRuniform, metalness)
+			});
+		}
+
+		{
+			auto const shader = lut::reflect_spirv_file(deferred::kClusterCompPath);
+			if (shader.pushConstants.empty())
+				throw lut::Error("%s: no push constants", deferred::kClusterCompPath);
+
+			lut::check_block_layout(shader.pushConstants[0].block, "glsl::ClusterParams", sizeof(glsl::ClusterParams), {
+				offsetof(glsl::ClusterParams, near),
+				offsetof(glsl::ClusterParams, far),
+				offsetof(glsl::ClusterParams, lightCount)
+			});
+		}
+	}
+
+	lut::DescriptorSetLayout create_cluster_descriptor_layout(lut::VulkanContext const& aContext)
+	{
+		// 0: lights, 1: clusters. Written by the compute pass, read by the
+		// lighting pass.
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		for (std::uint32_t i = 0; i < 2; ++i)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+
+		// The light volumes are placed by the vertex shader
+		bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
 
 		//descriptor set layout
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
@@ -1482,19 +5365,19 @@ namespace
 		layoutInfo.pBindings = bindings;
 
 		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		if (auto const res = vkCreateDescriptorSetLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
 		}
 
-		return lut::DescriptorSetLayout(aWindow.device, layout);
+		return lut::DescriptorSetLayout(aContext.device, layout);
 	}
 
-	lut::DescriptorSetLayout create_advanced_descriptor_layout(lut::VulkanWindow const& aWindow)
+	lut::DescriptorSetLayout create_material_buffer_layout(lut::VulkanContext const& aContext)
 	{
 		VkDescriptorSetLayoutBinding bindings[1]{};
 		bindings[0].binding = 0;
-		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 		bindings[0].descriptorCount = 1;
 		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
@@ -1505,36 +5388,50 @@ namespace
 		layoutInfo.pBindings = bindings;
 
 		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		if (auto const res = vkCreateDescriptorSetLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
 		}
 
-		return lut::DescriptorSetLayout(aWindow.device, layout);
+		return lut::DescriptorSetLayout(aContext.device, layout);
 	}
 
-	lut::DescriptorSetLayout create_deferred_descriptor_layout(lut::VulkanWindow const& aWindow)
+	lut::DescriptorSetLayout create_draw_cull_descriptor_layout(lut::VulkanContext const& aContext, bool aOcclusion)
 	{
-		VkDescriptorSetLayoutBinding bindings[4]{};
-		bindings[0].binding = 0;
-		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		bindings[0].descriptorCount = 1;
-		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		// 0: draw records, 1: indirect commands, 2: counters, and for the
+		// occlusion culling 3: visibility, 4: Hi-Z pyramid
+		VkDescriptorSetLayoutBinding bindings[5]{};
+		for (std::uint32_t i = 0; i < 5; ++i)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
-		bindings[1].binding = 1;
-		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		bindings[1].descriptorCount = 1;
-		bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		//descriptor set layout
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = aOcclusion ? 5 : 3;
+		layoutInfo.pBindings = bindings;
 
-		bindings[2].binding = 2;
-		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		bindings[2].descriptorCount = 1;
-		bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreateDescriptorSetLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::DescriptorSetLayout(aContext.device, layout);
+	}
 
-		bindings[3].binding = 3;
-		bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		bindings[3].descriptorCount = 1;
-		bindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	lut::DescriptorSetLayout create_lighting_output_layout(lut::VulkanContext const& aContext)
+	{
+		VkDescriptorSetLayoutBinding bindings[1]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
 		//descriptor set layout
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
@@ -1543,12 +5440,58 @@ namespace
 		layoutInfo.pBindings = bindings;
 
 		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		if (auto const res = vkCreateDescriptorSetLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
 		}
 
-		return lut::DescriptorSetLayout(aWindow.device, layout);
+		return lut::DescriptorSetLayout(aContext.device, layout);
+	}
+
+	void update_lighting_output_descriptors(lut::VulkanContext const& aContext, VkDescriptorSet aSet, VkImageView aView)
+	{
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageInfo.imageView = aView;
+
+		VkWriteDescriptorSet desc[1]{};
+		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[0].dstSet = aSet;
+		desc[0].dstBinding = 0;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		desc[0].descriptorCount = 1;
+		desc[0].pImageInfo = &imageInfo;
+
+		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
+		vkUpdateDescriptorSets(aContext.device, numSets, desc, 0, nullptr);
+	}
+
+	void update_deferred_descriptors(lut::VulkanContext const& aContext, VkDescriptorSet aSet, VkSampler aSampler, GBuffer const& aGBuffer, GBufferDesc const& aDesc)
+	{
+		VkDescriptorImageInfo imageInfos[4]{};
+		VkWriteDescriptorSet desc[4]{};
+		assert(aGBuffer.lightingInputs.size() == sizeof(desc) / sizeof(desc[0]));
+
+		for (std::uint32_t i = 0; i < 4; ++i)
+		{
+			// Input attachments do not use a sampler. A depth buffer with
+			// stencil stays attached while it is read (light volumes).
+			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			if (0 == i && aDesc.readDepth)
+				imageInfos[i].imageLayout = gbuffer_depth_layout(aDesc);
+			imageInfos[i].imageView = aGBuffer.lightingInputs[i];
+			imageInfos[i].sampler = aDesc.transient ? VK_NULL_HANDLE : aSampler;
+
+			desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[i].dstSet = aSet;
+			desc[i].dstBinding = i;
+			desc[i].descriptorType = aDesc.transient ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[i].descriptorCount = 1;
+			desc[i].pImageInfo = &imageInfos[i];
+		}
+
+		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
+		vkUpdateDescriptorSets(aContext.device, numSets, desc, 0, nullptr);
 	}
 
 }
@@ -1609,14 +5552,14 @@ namespace
 //depth image view
 namespace
 {
-	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator)
+	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, VkExtent2D const& aExtent)
 	{
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
 		imageInfo.format = deferred::kDepthFormat;
-		imageInfo.extent.width = aWindow.swapchainExtent.width;
-		imageInfo.extent.height = aWindow.swapchainExtent.height;
+		imageInfo.extent.width = aExtent.width;
+		imageInfo.extent.height = aExtent.height;
 		imageInfo.extent.depth = 1;
 		imageInfo.mipLevels = 1;
 		imageInfo.arrayLayers = 1;
@@ -1653,12 +5596,12 @@ namespace
 		};
 
 		VkImageView view = VK_NULL_HANDLE;
-		if (auto const res = vkCreateImageView(aWindow.device, &viewInfo, nullptr, &view); VK_SUCCESS != res)
+		if (auto const res = vkCreateImageView(aContext.device, &viewInfo, nullptr, &view); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str());
 		}
 
-		return { std::move(depthImage), lut::ImageView(aWindow.device, view) };
+		return { std::move(depthImage), lut::ImageView(aContext.device, view) };
 	}
 
 }
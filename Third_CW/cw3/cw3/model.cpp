@@ -7,6 +7,7 @@
 
 #include "../labutils/error.hpp"
 #include "../labutils/to_string.hpp"
+#include "../labutils/cpu_profiler.hpp"
 namespace lut = labutils;
 
 
@@ -239,13 +240,42 @@ ModelData load_obj_model( std::string_view const& aOBJPath )
 	return model;
 }
 
-ColourMesh createObjBuffer(ModelData const& aCar, lut::VulkanContext const& aContext, lut::Allocator const& aAllocator)
+ColourMesh createObjBuffer(ModelData const& aCar, lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, lut::GpuTimeline& aTimeline, lut::DeletionQueue& aDeletionQueue, lut::GpuProfiler* aProfiler, std::uint32_t aProfilerSlot)
 {
+	LUT_CPU_ZONE("upload_meshes");
+
 	ColourMesh temp;
 
 	std::vector<glm::vec3> meshVertices;
 	std::vector<glm::vec3> meshNormals;
 
+	// All meshes are uploaded with a single command buffer. The staging
+	// buffers must stay alive until the upload has completed on the GPU.
+	std::vector<lut::Buffer> staging;
+
+	lut::CommandPool uploadPool = create_command_pool(aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+	VkCommandBuffer uploadCmd = alloc_command_buffer(aContext, uploadPool.handle);
+
+	/// <summary>
+	/// record the copy commands into the command buffer
+	/// </summary>
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	if (auto const res = vkBeginCommandBuffer(uploadCmd, &beginInfo); VK_SUCCESS != res)
+	{
+		throw lut::Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+	}
+
+	std::uint32_t uploadScope = lut::GpuProfiler::kNoScope;
+	if (aProfiler)
+	{
+		aProfiler->begin(uploadCmd, aProfilerSlot);
+		uploadScope = aProfiler->begin_scope(uploadCmd, aProfilerSlot, "mesh_upload");
+	}
+
 	for (int i = 0; i < aCar.meshes.size(); i++)
 	{
 		for (int j = 0; j < aCar.meshes[i].numberOfVertices; j++)
@@ -301,24 +331,6 @@ ColourMesh createObjBuffer(ModelData const& aCar, lut::VulkanContext const& aCon
 		std::memcpy(normPtr, meshNormals.data(), sizeof(glm::vec3) * meshNormals.size());
 		vmaUnmapMemory(aAllocator.allocator, normStaging.allocation);
 
-		lut::Fence uploadComplete = create_fence(aContext);
-
-		lut::CommandPool uploadPool = create_command_pool(aContext);
-		VkCommandBuffer uploadCmd = alloc_command_buffer(aContext, uploadPool.handle);
-
-		/// <summary>
-		/// record the copy commands into the command buffer
-		/// </summary>
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0;
-		beginInfo.pInheritanceInfo = nullptr;
-
-		if (auto const res = vkBeginCommandBuffer(uploadCmd, &beginInfo); VK_SUCCESS != res)
-		{
-			throw lut::Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
-		}
-
 		VkBufferCopy pcopy{};
 		pcopy.size = sizeof(glm::vec3) * meshVertices.size();
 
@@ -347,29 +359,8 @@ ColourMesh createObjBuffer(ModelData const& aCar, lut::VulkanContext const& aCon
 			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
 		);
 
-		if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res)
-		{
-			throw lut::Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
-		}
-
-
-		/// <summary>
-		/// submit transfer commands
-		/// </summary>
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &uploadCmd;
-
-		if (auto const res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle); VK_SUCCESS != res)
-		{
-			throw lut::Error("Submitting commands\n" "vkQueueSubmit() reuturned %s", lut::to_string(res).c_str());
-		}
-
-		if (auto const res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
-		{
-			throw lut::Error("Waiting for upload to complete\n" "vkWaitForFences() returned %s", lut::to_string(res).c_str());
-		}
+		staging.emplace_back(std::move(posStaging));
+		staging.emplace_back(std::move(normStaging));
 
 		temp.positions.emplace_back(std::move(vertexPosGPU));
 		temp.normals.emplace_back(std::move(vertexNormGPU));
@@ -379,5 +370,26 @@ ColourMesh createObjBuffer(ModelData const& aCar, lut::VulkanContext const& aCon
 		meshNormals.clear();
 	}
 
+	if (aProfiler)
+		aProfiler->end_scope(uploadCmd, aProfilerSlot, uploadScope);
+
+	if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res)
+	{
+		throw lut::Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+	}
+
+	/// <summary>
+	/// submit transfer commands
+	/// </summary>
+	// No need to wait: the barriers above make the copies visible to the
+	// vertex input of all later submissions to the same queue.
+	auto const uploadValue = aTimeline.submit(aContext.graphicsQueue, 1, &uploadCmd);
+
+	if (aProfiler)
+		aProfiler->submitted(aProfilerSlot, uploadValue, 0);
+
+	aDeletionQueue.defer(uploadValue, std::move(staging));
+	aDeletionQueue.defer(uploadValue, std::move(uploadPool));
+
 	return temp;
 }
\ No newline at end of file
@@ -17,6 +17,8 @@
 #include "../labutils/vkobject.hpp"
 #include "../labutils/vkbuffer.hpp"
 #include "../labutils/allocator.hpp" 
+#include "../labutils/gpu_timeline.hpp"
+#include "../labutils/gpu_profiler.hpp"
 namespace lut = labutils;
 
 /* The structures here are intended to be used during loading only. At runtime,
@@ -111,4 +113,7 @@ struct ColourMesh
 
 ModelData load_obj_model( std::string_view const& aOBJPath );
 
-ColourMesh createObjBuffer(ModelData const& aCar, lut::VulkanContext const& aContext, lut::Allocator const& aAllocator);
\ No newline at end of file
+// The uploads are submitted on aTimeline, without waiting for them to
+// complete. The staging resources are handed to aDeletionQueue. If
+// aProfiler is non-null, the upload is timed in its slot aProfilerSlot.
+ColourMesh createObjBuffer(ModelData const& aCar, lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, lut::GpuTimeline& aTimeline, lut::DeletionQueue& aDeletionQueue, lut::GpuProfiler* aProfiler = nullptr, std::uint32_t aProfilerSlot = 0);
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "point_lights.hpp"
+
+#include <random>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+namespace
+{
+	// Light radii of the stress scene. Together with the size of the scene,
+	// these determine how many lights end up in a cluster (see
+	// kMaxLightsPerCluster).
+	constexpr float kMinLightRadius = 0.5f;
+	constexpr float kMaxLightRadius = 1.5f;
+
+	constexpr float kMaxOrbitRadius = 2.f;
+	constexpr float kMaxOrbitSpeed = 1.f;
+
+	// Up to this many lights are at full intensity
+	constexpr float kFullIntensityLights = 64.f;
+}
+
+std::vector<AnimatedLight> make_stress_lights(std::uint32_t aCount, glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aSeed)
+{
+	// std::mt19937 is fully specified, so the lights are the same on every
+	// platform. (The distributions are not, but that is good enough here.)
+	std::mt19937 rng(aSeed);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	float const intensity = std::min(1.f, kFullIntensityLights / std::max(1.f, float(aCount)));
+
+	std::vector<AnimatedLight> lights(aCount);
+	for (auto& light : lights)
+	{
+		light.centre = aMin + (aMax - aMin) * glm::vec3(unit(rng), unit(rng), unit(rng));
+		light.orbitRadius = kMaxOrbitRadius * unit(rng);
+		light.speed = kMaxOrbitSpeed * (2.f * unit(rng) - 1.f);
+		light.phase = 6.2831853f * unit(rng);
+
+		light.radius = kMinLightRadius + (kMaxLightRadius - kMinLightRadius) * unit(rng);
+
+		// Saturated colours: one channel at full strength
+		glm::vec3 colour(unit(rng), unit(rng), unit(rng));
+		colour /= std::max({ colour.r, colour.g, colour.b, 1e-3f });
+		light.colour = colour * intensity;
+	}
+
+	return lights;
+}
+
+void animate_lights(std::vector<AnimatedLight> const& aLights, float aTime, PointLight* aOut)
+{
+	assert(aOut || aLights.empty());
+
+	for (std::size_t i = 0; i < aLights.size(); ++i)
+	{
+		auto const& light = aLights[i];
+
+		float const angle = light.phase + light.speed * aTime;
+		glm::vec3 const pos = light.centre + light.orbitRadius * glm::vec3(std::cos(angle), 0.f, std::sin(angle));
+
+		aOut[i].positionRadius = glm::vec4(pos, light.radius);
+		aOut[i].colour = glm::vec4(light.colour, 1.f);
+	}
+}
+
+LightVolumeMesh make_light_volume_mesh(std::uint32_t aSegments, std::uint32_t aRings)
+{
+	assert(aSegments >= 3 && aRings >= 2);
+
+	LightVolumeMesh mesh;
+
+	// Poles and aRings-1 rings of aSegments vertices each, on the unit
+	// sphere. Scaled below.
+	float const pi = 3.14159265358979f;
+	mesh.positions.emplace_back(0.f, 1.f, 0.f);
+	for (std::uint32_t ring = 1; ring < aRings; ++ring)
+	{
+		float const theta = pi * float(ring) / float(aRings);
+		for (std::uint32_t seg = 0; seg < aSegments; ++seg)
+		{
+			float const phi = 2.f * pi * float(seg) / float(aSegments);
+			mesh.positions.emplace_back(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+		}
+	}
+	mesh.positions.emplace_back(0.f, -1.f, 0.f);
+
+	auto const ring_vertex = [&] (std::uint32_t aRing, std::uint32_t aSeg) {
+		return 1 + (aRing - 1) * aSegments + aSeg % aSegments;
+	};
+
+	auto const add_triangle = [&] (std::uint32_t aA, std::uint32_t aB, std::uint32_t aC) {
+		mesh.indices.insert(mesh.indices.end(), { aA, aB, aC });
+	};
+
+	auto const bottom = std::uint32_t(mesh.positions.size() - 1);
+	for (std::uint32_t seg = 0; seg < aSegments; ++seg)
+	{
+		add_triangle(0, ring_vertex(1, seg), ring_vertex(1, seg + 1));
+
+		for (std::uint32_t ring = 1; ring + 1 < aRings; ++ring)
+		{
+			add_triangle(ring_vertex(ring, seg), ring_vertex(ring + 1, seg), ring_vertex(ring + 1, seg + 1));
+			add_triangle(ring_vertex(ring, seg), ring_vertex(ring + 1, seg + 1), ring_vertex(ring, seg + 1));
+		}
+
+		add_triangle(ring_vertex(aRings - 1, seg), bottom, ring_vertex(aRings - 1, seg + 1));
+	}
+
+	// The triangles cut into the unit sphere. Scale the mesh such that
+	// the plane of every triangle is at least at distance one.
+	float minDistance = 1.f;
+	for (std::size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		auto const& a = mesh.positions[mesh.indices[i]];
+		auto const& b = mesh.positions[mesh.indices[i+1]];
+		auto const& c = mesh.positions[mesh.indices[i+2]];
+
+		auto const normal = glm::normalize(glm::cross(b - a, c - a));
+		assert(glm::dot(normal, a) > 0.f); // outward-facing
+		minDistance = std::min(minDistance, glm::dot(normal, a));
+	}
+
+	for (auto& position : mesh.positions)
+		position /= minDistance;
+
+	return mesh;
+}
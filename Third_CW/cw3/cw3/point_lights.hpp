@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+/* Point lights with a bounded range, for the clustered lighting (see
+ * clusters.hpp and the --lights option). A light's contribution falls off
+ * smoothly to zero at its radius, so lights only need to be evaluated for
+ * the pixels within that radius.
+ *
+ * PointLight matches the std430 layout of PointLight in
+ * shaders/clusters.glsl.
+ */
+struct PointLight
+{
+	glm::vec4 positionRadius; // world-space position, radius in w
+	glm::vec4 colour;
+};
+
+static_assert(sizeof(PointLight) == 32, "PointLight must match the std430 layout in clusters.glsl");
+
+// A light of the stress scene, circling around a fixed centre in the xz
+// plane
+struct AnimatedLight
+{
+	glm::vec3 centre;
+	float orbitRadius;
+	float speed; // radians per second
+	float phase; // radians
+
+	float radius;
+	glm::vec3 colour;
+};
+
+// aCount lights with random centres in the box [aMin, aMax], random
+// colours, radii and orbits. The same seed always gives the same lights.
+// The intensity is scaled with the count, such that the overall brightness
+// stays roughly the same, independently of how many lights overlap.
+std::vector<AnimatedLight> make_stress_lights(std::uint32_t aCount, glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aSeed = 1);
+
+// The lights at time aTime (in seconds). aLights must have room for all of
+// them.
+void animate_lights(std::vector<AnimatedLight> const&, float aTime, PointLight* aLights);
+
+// Proxy geometry of a light volume (--light-volumes): a triangulated sphere
+// that contains the unit sphere, with outward-facing triangles (counter-
+// clockwise when seen from outside).
+struct LightVolumeMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<std::uint32_t> indices;
+};
+
+LightVolumeMesh make_light_volume_mesh(std::uint32_t aSegments = 16, std::uint32_t aRings = 8);
@@ -0,0 +1,285 @@
+#include "render_queue.hpp"
+
+#include <chrono>
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+namespace
+{
+	constexpr unsigned kPassShift_ = 56;
+	constexpr unsigned kPipelineShift_ = 40;
+	constexpr unsigned kMaterialShift_ = 16;
+
+	constexpr std::uint64_t kPassMask_ = 0xff;
+	constexpr std::uint64_t kPipelineMask_ = 0xffff;
+	constexpr std::uint64_t kMaterialMask_ = 0xffffff;
+	constexpr std::uint64_t kDepthMask_ = 0xffff;
+
+	constexpr std::size_t kRadixBits_ = 8;
+	constexpr std::size_t kRadixSize_ = std::size_t(1) << kRadixBits_;
+	constexpr std::size_t kRadixPasses_ = 64 / kRadixBits_;
+}
+
+std::uint64_t make_draw_key(std::uint32_t aPass, std::uint32_t aPipeline, std::uint32_t aMaterial, std::uint32_t aDepthBucket) noexcept
+{
+	assert(aPass <= kPassMask_ && aPipeline <= kPipelineMask_ && aMaterial <= kMaterialMask_ && aDepthBucket <= kDepthMask_);
+
+	return (std::uint64_t(aPass) << kPassShift_)
+		| (std::uint64_t(aPipeline) << kPipelineShift_)
+		| (std::uint64_t(aMaterial) << kMaterialShift_)
+		| std::uint64_t(aDepthBucket);
+}
+
+std::uint32_t draw_key_pipeline(std::uint64_t aKey) noexcept
+{
+	return std::uint32_t((aKey >> kPipelineShift_) & kPipelineMask_);
+}
+
+std::uint32_t draw_key_material(std::uint64_t aKey) noexcept
+{
+	return std::uint32_t((aKey >> kMaterialShift_) & kMaterialMask_);
+}
+
+std::uint32_t depth_bucket(float aDistance, float aNear, float aFar, std::uint32_t aBuckets) noexcept
+{
+	assert(aNear > 0.f && aFar > aNear);
+	assert(aBuckets > 0 && aBuckets <= kDrawKeyDepthBuckets);
+
+	float const t = std::log(std::max(aDistance, aNear) / aNear) / std::log(aFar / aNear);
+	auto const bucket = std::uint32_t(std::clamp(t, 0.f, 1.f) * float(aBuckets - 1) + 0.5f);
+
+	// Spread over the full field, such that keys with fewer buckets order
+	// the same way
+	return bucket * ((kDrawKeyDepthBuckets - 1) / std::max(aBuckets - 1, 1u));
+}
+
+void RenderQueue::clear() noexcept
+{
+	mKeys.clear();
+	mValues.clear();
+}
+
+void RenderQueue::reserve(std::size_t aCount)
+{
+	mKeys.reserve(aCount);
+	mValues.reserve(aCount);
+}
+
+void RenderQueue::push(std::uint64_t aKey, std::uint32_t aValue)
+{
+	mKeys.emplace_back(aKey);
+	mValues.emplace_back(aValue);
+}
+
+void RenderQueue::sort()
+{
+	radix_sort(mKeys, mValues, mKeyScratch, mValueScratch);
+}
+
+std::size_t RenderQueue::size() const noexcept
+{
+	return mKeys.size();
+}
+
+std::vector<std::uint64_t> const& RenderQueue::keys() const noexcept
+{
+	return mKeys;
+}
+
+std::vector<std::uint32_t> const& RenderQueue::values() const noexcept
+{
+	return mValues;
+}
+
+void radix_sort(std::vector<std::uint64_t>& aKeys, std::vector<std::uint32_t>& aValues, std::vector<std::uint64_t>& aKeyScratch, std::vector<std::uint32_t>& aValueScratch)
+{
+	assert(aKeys.size() == aValues.size());
+
+	std::size_t const count = aKeys.size();
+	if (count < 2)
+		return;
+
+	aKeyScratch.resize(count);
+	aValueScratch.resize(count);
+
+	// Histograms of all bytes in a single pass over the keys
+	std::vector<std::uint32_t> histograms(kRadixPasses_ * kRadixSize_, 0);
+	for (auto const key : aKeys)
+	{
+		for (std::size_t pass = 0; pass < kRadixPasses_; ++pass)
+			++histograms[pass * kRadixSize_ + ((key >> (pass * kRadixBits_)) & (kRadixSize_ - 1))];
+	}
+
+	for (std::size_t pass = 0; pass < kRadixPasses_; ++pass)
+	{
+		auto* const histogram = histograms.data() + pass * kRadixSize_;
+
+		// All keys have the same byte: the pass would not move anything
+		auto const first = (aKeys.front() >> (pass * kRadixBits_)) & (kRadixSize_ - 1);
+		if (histogram[first] == count)
+			continue;
+
+		// Exclusive prefix sum: the first output slot of each byte value
+		std::uint32_t offset = 0;
+		for (std::size_t i = 0; i < kRadixSize_; ++i)
+		{
+			auto const n = histogram[i];
+			histogram[i] = offset;
+			offset += n;
+		}
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			auto const slot = histogram[(aKeys[i] >> (pass * kRadixBits_)) & (kRadixSize_ - 1)]++;
+			aKeyScratch[slot] = aKeys[i];
+			aValueScratch[slot] = aValues[i];
+		}
+
+		aKeys.swap(aKeyScratch);
+		aValues.swap(aValueScratch);
+	}
+}
+
+BindCounts& BindCounts::operator+= (BindCounts const& aOther) noexcept
+{
+	pipelines += aOther.pipelines;
+	descriptorSets += aOther.descriptorSets;
+	vertexBuffers += aOther.vertexBuffers;
+	draws += aOther.draws;
+	return *this;
+}
+
+bool BindTracker::change(Slot aSlot, std::uint64_t aState) noexcept
+{
+	auto const slot = std::size_t(aSlot);
+	assert(slot < kSlotCount_);
+
+	if (mBound[slot] && mState[slot] == aState)
+		return false;
+
+	mBound[slot] = true;
+	mState[slot] = aState;
+
+	switch (aSlot)
+	{
+		case Slot::pipeline: ++mCounts.pipelines; break;
+		case Slot::descriptorSet: ++mCounts.descriptorSets; break;
+		case Slot::vertexBuffers: ++mCounts.vertexBuffers; break;
+	}
+
+	return true;
+}
+
+void BindTracker::reset() noexcept
+{
+	for (auto& bound : mBound)
+		bound = false;
+}
+
+void BindTracker::draw() noexcept
+{
+	++mCounts.draws;
+}
+
+BindCounts const& BindTracker::counts() const noexcept
+{
+	return mCounts;
+}
+
+bool check_render_queue(std::size_t aMaxDraws, std::uint32_t aPipelines, std::uint32_t aMaterials)
+{
+	using Clock_ = std::chrono::steady_clock;
+
+	// Draw counts from 10k up to aMaxDraws
+	std::vector<std::size_t> counts;
+	for (std::size_t count = 10000; count < aMaxDraws; count *= 10)
+	{
+		counts.emplace_back(count);
+		if (3 * count < aMaxDraws)
+			counts.emplace_back(3 * count);
+	}
+	counts.emplace_back(aMaxDraws);
+
+	// Timed runs per case, after one untimed warm-up run
+	constexpr std::uint32_t kIterations = 10;
+
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<std::uint32_t> pipelineDist(0, std::max(aPipelines, 1u) - 1);
+	std::uniform_int_distribution<std::uint32_t> materialDist(0, std::max(aMaterials, 1u) - 1);
+	std::uniform_int_distribution<std::uint32_t> depthDist(0, kDrawKeyDepthBuckets - 1);
+
+	// Bind elision over the draws in the given order. Each draw has its
+	// own vertex buffers, as in cw3.
+	auto const count_binds_ = [] (std::vector<std::uint64_t> const& aKeys, std::vector<std::uint32_t> const& aOrder) {
+		BindTracker tracker;
+		for (auto const draw : aOrder)
+		{
+			tracker.change(BindTracker::Slot::pipeline, draw_key_pipeline(aKeys[draw]));
+			tracker.change(BindTracker::Slot::descriptorSet, draw_key_material(aKeys[draw]));
+			tracker.change(BindTracker::Slot::vertexBuffers, draw);
+			tracker.draw();
+		}
+		return tracker.counts();
+	};
+
+	std::printf("Render queue (%u pipelines, %u materials), average of %u runs:\n", aPipelines, aMaterials, kIterations);
+
+	bool ok = true;
+	for (auto const count : counts)
+	{
+		std::vector<std::uint64_t> drawKeys(count);
+		for (auto& key : drawKeys)
+			key = make_draw_key(0, pipelineDist(rng), materialDist(rng), depthDist(rng));
+
+		std::vector<std::uint32_t> fileOrder(count);
+		std::iota(fileOrder.begin(), fileOrder.end(), 0u);
+
+		auto const time_ = [&] (auto&& aSort) {
+			aSort();
+
+			float ms = 0.f;
+			for (std::uint32_t iter = 0; iter < kIterations; ++iter)
+			{
+				auto const start = Clock_::now();
+				aSort();
+				ms += std::chrono::duration<float, std::milli>(Clock_::now() - start).count();
+			}
+			return ms / kIterations;
+		};
+
+		// Both runs start from the draws in file order, as a frame would
+		RenderQueue queue;
+		queue.reserve(count);
+		float const radixMs = time_([&] {
+			queue.clear();
+			for (std::uint32_t i = 0; i < count; ++i)
+				queue.push(drawKeys[i], i);
+			queue.sort();
+		});
+
+		std::vector<std::uint32_t> reference;
+		float const stdMs = time_([&] {
+			reference = fileOrder;
+			std::stable_sort(reference.begin(), reference.end(), [&] (std::uint32_t aA, std::uint32_t aB) {
+				return drawKeys[aA] < drawKeys[aB];
+			});
+		});
+
+		bool const same = reference == queue.values();
+		ok = ok && same;
+
+		auto const unsorted = count_binds_(drawKeys, fileOrder);
+		auto const sorted = count_binds_(drawKeys, queue.values());
+
+		std::printf("  %8zu draws: radix %.3f ms, std::stable_sort %.3f ms (%.1fx)%s\n", count, radixMs, stdMs, stdMs / std::max(radixMs, 1e-6f), same ? "" : "  ORDER DIFFERS");
+		std::printf("  %8s binds: file order %u pipelines, %u descriptor sets; sorted %u pipelines, %u descriptor sets (%u vertex buffers each)\n", "", unsorted.pipelines, unsorted.descriptorSets, sorted.pipelines, sorted.descriptorSets, sorted.vertexBuffers);
+	}
+
+	std::printf("Render queue check %s\n", ok ? "passed" : "FAILED");
+	return ok;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+/* Render queue: draws are ordered by a packed 64-bit state key, such that
+ * draws that share state end up next to each other, and the executor
+ * (see BindTracker) only binds state when it actually changes.
+ *
+ * From the most to the least significant bits, a key holds
+ *   pass         8 bits
+ *   pipeline    16 bits
+ *   material    24 bits
+ *   depth       16 bits   (front to back within a material)
+ * The queue sorts the keys with an LSD radix sort, one byte per pass. Bytes
+ * that are the same in all keys (e.g., the pass, when there is only one)
+ * are skipped. The sort is stable, so draws with equal keys keep the order
+ * in which they were pushed.
+ */
+constexpr std::uint32_t kDrawKeyDepthBuckets = 1u << 16;
+
+std::uint64_t make_draw_key(std::uint32_t aPass, std::uint32_t aPipeline, std::uint32_t aMaterial, std::uint32_t aDepthBucket) noexcept;
+
+// Fields of a key, e.g., for the executor to find the state of a draw
+std::uint32_t draw_key_pipeline(std::uint64_t aKey) noexcept;
+std::uint32_t draw_key_material(std::uint64_t aKey) noexcept;
+
+// Depth bucket of a draw at view distance aDistance, for a camera that sees
+// up to aFar. Distances are bucketed logarithmically from aNear on, so that
+// near draws, which occlude the most, are ordered most finely. aBuckets
+// (at most kDrawKeyDepthBuckets) limits how finely the draws are ordered.
+std::uint32_t depth_bucket(float aDistance, float aNear, float aFar, std::uint32_t aBuckets = kDrawKeyDepthBuckets) noexcept;
+
+class RenderQueue
+{
+	public:
+		void clear() noexcept;
+		void reserve(std::size_t);
+
+		// Queue the draw aValue (e.g., an index into the caller's draws)
+		void push(std::uint64_t aKey, std::uint32_t aValue);
+
+		// Sort the draws by key (radix_sort())
+		void sort();
+
+		std::size_t size() const noexcept;
+
+		std::vector<std::uint64_t> const& keys() const noexcept;
+		std::vector<std::uint32_t> const& values() const noexcept;
+
+	private:
+		std::vector<std::uint64_t> mKeys, mKeyScratch;
+		std::vector<std::uint32_t> mValues, mValueScratch;
+};
+
+// Sort aKeys, and aValues along with them, with a stable LSD radix sort.
+// The scratch vectors are resized as needed; keeping them between calls
+// avoids the allocations.
+void radix_sort(std::vector<std::uint64_t>& aKeys, std::vector<std::uint32_t>& aValues, std::vector<std::uint64_t>& aKeyScratch, std::vector<std::uint32_t>& aValueScratch);
+
+
+// Binds issued by an executor, and the draws that they were issued for
+struct BindCounts
+{
+	std::uint32_t pipelines = 0;
+	std::uint32_t descriptorSets = 0;
+	std::uint32_t vertexBuffers = 0;
+	std::uint32_t draws = 0;
+
+	BindCounts& operator+= (BindCounts const&) noexcept;
+};
+
+// Bind elision: remembers the state that was bound last in each slot, and
+// reports whether a new state needs to be bound. Each bind is counted.
+class BindTracker
+{
+	public:
+		enum class Slot
+		{
+			pipeline,
+			descriptorSet,
+			vertexBuffers
+		};
+
+		// True if aState differs from the state bound in aSlot, which is
+		// then updated. Initially, nothing is bound.
+		bool change(Slot, std::uint64_t aState) noexcept;
+
+		// Forget the bound state, e.g., after the pipeline layout changed
+		void reset() noexcept;
+
+		void draw() noexcept;
+
+		BindCounts const& counts() const noexcept;
+
+	private:
+		static constexpr std::size_t kSlotCount_ = 3;
+
+		std::uint64_t mState[kSlotCount_]{};
+		bool mBound[kSlotCount_]{};
+		BindCounts mCounts;
+};
+
+
+// Time radix_sort() against std::stable_sort() for up to aMaxDraws random
+// draws (from 10k), check that both give the same order, and count the
+// binds that bind elision saves in file order and in sorted order, for
+// draws with aPipelines pipelines and aMaterials materials. Prints the
+// results to stdout and returns false if any check failed.
+bool check_render_queue(std::size_t aMaxDraws, std::uint32_t aPipelines, std::uint32_t aMaterials);
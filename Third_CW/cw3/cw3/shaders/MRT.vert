@@ -25,6 +25,10 @@ layout(location = 1) in vec3 iNormal;
 
 layout(location = 0) out vec3 v2fPos;
 layout(location = 1) out vec3 v2fNormal;
+
+// Must match the depth pre-pass (see depth_prepass.vert)
+invariant gl_Position;
+
 void main()
 {
 	gl_Position = uScene.projCam * vec4(iPosition, 1.f);
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// G-buffer pass: compact G-buffer, one uniform buffer per material (see
+// gbuffer_main.glsl)
+
+#define COMPACT_GBUFFER
+
+#include "gbuffer_main.glsl"
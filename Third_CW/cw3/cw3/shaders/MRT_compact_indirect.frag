@@ -0,0 +1,10 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// G-buffer pass: compact G-buffer, GPU-driven or instanced draws (see
+// gbuffer_main.glsl)
+
+#define COMPACT_GBUFFER
+#define MATERIAL_BUFFER
+
+#include "gbuffer_main.glsl"
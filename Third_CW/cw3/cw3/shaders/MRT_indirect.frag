@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// G-buffer pass: classic G-buffer, GPU-driven or instanced draws (see
+// gbuffer_main.glsl)
+
+#define MATERIAL_BUFFER
+
+#include "gbuffer_main.glsl"
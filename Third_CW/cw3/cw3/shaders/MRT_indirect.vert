@@ -0,0 +1,25 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// G-buffer vertex shader of the GPU-driven draws (--gpu-culling). The draws
+// are written by cull_draws.comp, one instance each, with the mesh's
+// material index as the first instance. All meshes share one pair of
+// vertex buffers.
+
+#include "scene_uniform.glsl"
+
+layout(location = 0) in vec3 iPosition;
+layout(location = 1) in vec3 iNormal;
+
+layout(location = 0) out vec3 v2fPos;
+layout(location = 1) out vec3 v2fNormal;
+layout(location = 2) flat out uint v2fMaterial;
+
+void main()
+{
+	gl_Position = uScene.projCam * vec4(iPosition, 1.f);
+
+	v2fNormal = iNormal;
+	v2fPos = iPosition;
+	v2fMaterial = uint(gl_InstanceIndex);
+}
@@ -0,0 +1,46 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// G-buffer vertex shader of the instanced draws (--instances). Each mesh is
+// drawn once for all copies of the model, with the per-instance data
+// (InstanceData in instances.hpp) in vertex binding 2. As with the
+// GPU-driven draws, all meshes share one pair of vertex buffers, and the
+// materials are in one buffer (see gbuffer_main.glsl).
+
+#include "scene_uniform.glsl"
+
+// Must match kNoMaterialOverride
+#define NO_MATERIAL_OVERRIDE 0xffffffffu
+
+layout(location = 0) in vec3 iPosition;
+layout(location = 1) in vec3 iNormal;
+
+// Rows of the copy's affine transform, and its material override
+layout(location = 2) in vec4 iTransformRow0;
+layout(location = 3) in vec4 iTransformRow1;
+layout(location = 4) in vec4 iTransformRow2;
+layout(location = 5) in uint iMaterial;
+
+// glsl::InstancedMeshParams: the mesh's own material
+layout(push_constant) uniform UMesh
+{
+	uint material;
+} uMesh;
+
+layout(location = 0) out vec3 v2fPos;
+layout(location = 1) out vec3 v2fNormal;
+layout(location = 2) flat out uint v2fMaterial;
+
+void main()
+{
+	vec4 position = vec4(iPosition, 1.f);
+	vec3 world = vec3(dot(iTransformRow0, position), dot(iTransformRow1, position), dot(iTransformRow2, position));
+
+	// The transforms do not scale non-uniformly (see make_instance()), so
+	// the normals are transformed with the same matrix
+	v2fNormal = vec3(dot(iTransformRow0.xyz, iNormal), dot(iTransformRow1.xyz, iNormal), dot(iTransformRow2.xyz, iNormal));
+	v2fPos = world;
+	v2fMaterial = NO_MATERIAL_OVERRIDE == iMaterial ? uMesh.material : iMaterial;
+
+	gl_Position = uScene.projCam * vec4(world, 1.f);
+}
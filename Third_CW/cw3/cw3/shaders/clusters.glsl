@@ -0,0 +1,79 @@
+// Cluster grid of the clustered lighting. The constants and the math must
+// match clusters.hpp, which has a CPU reference of the light assignment.
+
+#define CLUSTER_GRID_X 16u
+#define CLUSTER_GRID_Y 9u
+#define CLUSTER_GRID_Z 24u
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+#define MAX_LIGHTS_PER_CLUSTER 255u
+#define CLUSTER_STRIDE (MAX_LIGHTS_PER_CLUSTER + 1u)
+
+// Workgroup size of cluster_lights.comp
+#define CLUSTER_GROUP_SIZE 64u
+
+struct PointLight
+{
+	vec4 positionRadius; // world-space position, radius in w
+	vec4 colour;
+};
+
+// glsl::ClusterParams
+layout(push_constant) uniform ClusterParams
+{
+	float near;
+	float far;
+	uint lightCount;
+} uCluster;
+
+// Distance from the camera where slice aSlice starts
+float cluster_slice_depth(uint aSlice)
+{
+	return uCluster.near * pow(uCluster.far / uCluster.near, float(aSlice) / float(CLUSTER_GRID_Z));
+}
+
+uint cluster_index(uvec3 aCluster)
+{
+	return aCluster.x + CLUSTER_GRID_X * (aCluster.y + CLUSTER_GRID_Y * aCluster.z);
+}
+
+// Cluster of the point with clip-space position aClipPos and view-space
+// position aViewPos. Points outside of the frustum are clamped.
+uint find_cluster(vec4 aClipPos, vec3 aViewPos)
+{
+	vec2 ndc = aClipPos.xy / max(aClipPos.w, 1e-6f);
+	vec2 tile = floor((ndc * 0.5f + 0.5f) * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y));
+	tile = clamp(tile, vec2(0.f), vec2(CLUSTER_GRID_X - 1u, CLUSTER_GRID_Y - 1u));
+
+	float depth = -aViewPos.z;
+	float slice = 0.f;
+	if (depth > uCluster.near)
+		slice = floor(log(depth / uCluster.near) * (float(CLUSTER_GRID_Z) / log(uCluster.far / uCluster.near)));
+	slice = clamp(slice, 0.f, float(CLUSTER_GRID_Z - 1u));
+
+	return cluster_index(uvec3(uvec2(tile), uint(slice)));
+}
+
+// View-space bounding box of a cluster. aScale is 1/P[0][0] and 1/P[1][1]
+// of the (symmetric) projection matrix P.
+void cluster_bounds(uvec3 aCluster, vec2 aScale, out vec3 aMin, out vec3 aMax)
+{
+	float d0 = cluster_slice_depth(aCluster.z);
+	float d1 = cluster_slice_depth(aCluster.z + 1u);
+
+	vec2 grid = vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y);
+	vec2 a = (2.f * vec2(aCluster.xy) / grid - 1.f) * aScale;
+	vec2 b = (2.f * vec2(aCluster.xy + 1u) / grid - 1.f) * aScale;
+
+	aMin = vec3(min(min(a * d0, a * d1), min(b * d0, b * d1)), -d1);
+	aMax = vec3(max(max(a * d0, a * d1), max(b * d0, b * d1)), -d0);
+}
+
+// Smooth window that takes a light's contribution to zero at its radius:
+// (1 - (d/r)^4)^2
+float light_falloff(float aDistanceSq, float aRadius)
+{
+	float x = aDistanceSq / (aRadius * aRadius);
+	float window = clamp(1.f - x * x, 0.f, 1.f);
+	return window * window;
+}
@@ -0,0 +1,219 @@
+// GPU-driven culling (--gpu-culling), with one invocation per draw record.
+// A draw is culled if its bounding sphere is outside of the view frustum,
+// or if all of its triangles face away from the camera (normal cone). The
+// surviving draws are written to the indirect commands as
+// VkDrawIndirectCommand, with the material index as the first instance
+// (see MRT_indirect.vert).
+//
+// With uCull.compact, the commands are compacted with an atomic counter,
+// which vkCmdDrawIndirectCount() reads. Otherwise, every draw keeps its
+// slot, and culled draws get zero instances (for vkCmdDrawIndirect()). The
+// counter then only counts the visible draws, for the statistics.
+//
+// With OCCLUSION_CULLING (--occlusion-culling), the culling runs twice per
+// frame, and each phase writes its own list of commands:
+//
+// phase 1 (early): the draws that were visible in the previous frame and
+//   are still in the frustum. These are drawn first, and the Hi-Z pyramid
+//   is built from the resulting depth (see hiz_build.comp).
+// phase 2 (late): all draws in the frustum are tested against the Hi-Z
+//   pyramid. Those that pass, but were not drawn in the early phase, are
+//   drawn by the second G-buffer pass. The result is the visibility that
+//   the next frame's early phase uses.
+//
+// Without OCCLUSION_CULLING, the single phase is 0.
+
+#include "scene_uniform.glsl"
+
+// Must match deferred::kDrawCullGroupSize
+#define DRAW_CULL_GROUP_SIZE 64
+
+layout(local_size_x = DRAW_CULL_GROUP_SIZE) in;
+
+// glsl::DrawRecord
+struct DrawRecord
+{
+	vec4 sphere;      // centre, radius
+	vec4 cone;        // axis, cutoff (see NormalCone in frustum_culling.hpp)
+	uint firstVertex;
+	uint vertexCount;
+	uint material;
+	uint pad;
+};
+
+struct DrawCommand
+{
+	uint vertexCount;
+	uint instanceCount;
+	uint firstVertex;
+	uint firstInstance;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Draws
+{
+	DrawRecord draws[];
+};
+
+// With OCCLUSION_CULLING, the late phase's commands follow the early
+// phase's, at uCull.drawCount
+layout(std430, set = 1, binding = 1) writeonly buffer Commands
+{
+	DrawCommand commands[];
+};
+
+// Counters (kDrawCounterCount): the number of commands of the early and
+// the late phase, and, for the statistics, the draws that the late phase
+// tested against the Hi-Z pyramid and how many of these were occluded
+layout(std430, set = 1, binding = 2) buffer Count
+{
+	uint visibleCount[2];
+	uint testedCount;
+	uint occludedCount;
+};
+
+#ifdef OCCLUSION_CULLING
+// Per draw record: non-zero if the draw was visible in the last late phase
+layout(std430, set = 1, binding = 3) buffer Visibility
+{
+	uint visibility[];
+};
+
+// Farthest depth per texel (see hiz_build.comp)
+layout(set = 1, binding = 4) uniform sampler2D uHiZ;
+#endif
+
+layout(push_constant) uniform UCull
+{
+	uint drawCount;
+	uint compact;
+	uint phase;
+	uint hizLevels;
+	uvec2 hizExtent;
+} uCull;
+
+bool sphere_in_frustum(vec3 aCentre, float aRadius)
+{
+	// Planes of the frustum from the rows of projCam, with the normals
+	// pointing inwards (see extract_frustum_planes()). Depth is in [0,1].
+	mat4 m = transpose(uScene.projCam);
+	vec4 planes[6] = vec4[6](
+		m[3] + m[0], m[3] - m[0],
+		m[3] + m[1], m[3] - m[1],
+		m[2], m[3] - m[2]
+	);
+
+	for (int i = 0; i < 6; ++i)
+	{
+		vec4 plane = planes[i] / length(planes[i].xyz);
+		if (dot(plane.xyz, aCentre) + plane.w < -aRadius)
+			return false;
+	}
+
+	return true;
+}
+
+bool facing_away(vec4 aSphere, vec4 aCone)
+{
+	vec3 view = aSphere.xyz - uScene.camPos;
+	return dot(view, aCone.xyz) >= aCone.w * length(view) + aSphere.w;
+}
+
+#ifdef OCCLUSION_CULLING
+bool occluded(vec4 aSphere)
+{
+	// Screen rectangle and nearest depth of the sphere's bounding cube
+	vec2 rectMin = vec2(1.f), rectMax = vec2(0.f);
+	float nearest = 1.f;
+	for (int i = 0; i < 8; ++i)
+	{
+		vec3 corner = aSphere.xyz + aSphere.w * vec3((i & 1) != 0 ? 1.f : -1.f, (i & 2) != 0 ? 1.f : -1.f, (i & 4) != 0 ? 1.f : -1.f);
+		vec4 clip = uScene.projCam * vec4(corner, 1.f);
+
+		// Reaches behind the camera: cannot be tested
+		if (clip.w <= 1e-4f)
+			return false;
+
+		vec3 ndc = clip.xyz / clip.w;
+		vec2 uv = ndc.xy * 0.5f + 0.5f;
+		rectMin = min(rectMin, uv);
+		rectMax = max(rectMax, uv);
+		nearest = min(nearest, ndc.z);
+	}
+
+	if (nearest <= 0.f)
+		return false;
+
+	// The level on which the rectangle covers at most 2x2 texels
+	vec2 texMin = clamp(rectMin, 0.f, 1.f) * vec2(uCull.hizExtent);
+	vec2 texMax = clamp(rectMax, 0.f, 1.f) * vec2(uCull.hizExtent);
+	float size = max(max(texMax.x - texMin.x, texMax.y - texMin.y), 1.f);
+	int level = min(int(ceil(log2(size))), int(uCull.hizLevels) - 1);
+
+	ivec2 levelSize = max(ivec2(uCull.hizExtent) >> level, ivec2(1));
+	ivec2 lo = min(ivec2(texMin) >> level, levelSize - 1);
+	ivec2 hi = min(ivec2(texMax) >> level, levelSize - 1);
+
+	float farthest = max(
+		max(texelFetch(uHiZ, lo, level).r, texelFetch(uHiZ, ivec2(hi.x, lo.y), level).r),
+		max(texelFetch(uHiZ, ivec2(lo.x, hi.y), level).r, texelFetch(uHiZ, hi, level).r)
+	);
+
+	return nearest > farthest;
+}
+#endif
+
+void emit(uint aIndex, DrawRecord aDraw, bool aVisible, uint aList)
+{
+	uint first = aList * uCull.drawCount;
+
+	if (uCull.compact != 0u)
+	{
+		if (aVisible)
+		{
+			uint slot = atomicAdd(visibleCount[aList], 1u);
+			commands[first + slot] = DrawCommand(aDraw.vertexCount, 1u, aDraw.firstVertex, aDraw.material);
+		}
+	}
+	else
+	{
+		commands[first + aIndex] = DrawCommand(aDraw.vertexCount, aVisible ? 1u : 0u, aDraw.firstVertex, aDraw.material);
+		if (aVisible)
+			atomicAdd(visibleCount[aList], 1u);
+	}
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= uCull.drawCount)
+		return;
+
+	DrawRecord draw = draws[index];
+	bool visible = draw.vertexCount > 0u && sphere_in_frustum(draw.sphere.xyz, draw.sphere.w) && !facing_away(draw.sphere, draw.cone);
+
+#ifdef OCCLUSION_CULLING
+	bool wasVisible = visibility[index] != 0u;
+
+	if (1u == uCull.phase)
+	{
+		emit(index, draw, visible && wasVisible, 0u);
+		return;
+	}
+
+	if (visible)
+	{
+		atomicAdd(testedCount, 1u);
+		if (occluded(draw.sphere))
+		{
+			atomicAdd(occludedCount, 1u);
+			visible = false;
+		}
+	}
+
+	// The early phase has drawn the others already
+	emit(index, draw, visible && !wasVisible, 1u);
+	visibility[index] = visible ? 1u : 0u;
+#else
+	emit(index, draw, visible, 0u);
+#endif
+}
@@ -0,0 +1,10 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+#extension GL_GOOGLE_include_directive : require
+
+// Ambient pass of the light volumes: classic G-buffer, sampled (see
+// deferred_main.glsl)
+
+#define LIGHT_VOLUMES
+
+#include "deferred_main.glsl"
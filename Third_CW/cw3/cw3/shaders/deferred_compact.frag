@@ -0,0 +1,9 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+#extension GL_GOOGLE_include_directive : require
+
+// Lighting pass: compact G-buffer, sampled (see deferred_main.glsl)
+
+#define COMPACT_GBUFFER
+
+#include "deferred_main.glsl"
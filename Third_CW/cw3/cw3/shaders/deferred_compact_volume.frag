@@ -0,0 +1,9 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+#extension GL_GOOGLE_include_directive : require
+
+// Light volume: compact G-buffer (see deferred_volume.glsl)
+
+#define COMPACT_GBUFFER
+
+#include "deferred_volume.glsl"
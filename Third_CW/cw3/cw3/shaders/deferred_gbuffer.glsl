@@ -0,0 +1,53 @@
+// G-buffer inputs of the lighting passes (set 1, see gbuffer.hpp) and their
+// decoding. Shared by deferred_main.glsl and deferred_tiled.glsl, with the
+// same COMPACT_GBUFFER and SUBPASS_INPUT defines.
+
+#if defined(COMPACT_GBUFFER)
+#include "gbuffer_compact.glsl"
+#endif
+
+// The G-buffer in binding order; input_attachment_index i is binding i
+#if defined(SUBPASS_INPUT)
+layout(input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput InDepth;
+layout(input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput InNorm;
+layout(input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput InEmissive;
+layout(input_attachment_index = 3, set = 1, binding = 3) uniform subpassInput InAlbedo;
+#else
+layout(set = 1, binding = 0) uniform sampler2D InDepth;
+layout(set = 1, binding = 1) uniform sampler2D InNorm;
+layout(set = 1, binding = 2) uniform sampler2D InEmissive;
+layout(set = 1, binding = 3) uniform sampler2D InAlbedo;
+#endif
+
+struct GBufferSample
+{
+	vec3 position; // world space
+	vec3 normal;
+	vec3 emissive;
+	float shininess;
+	vec3 albedo;
+	float metalness;
+};
+
+// Decode the raw G-buffer values of the pixel at aUV
+GBufferSample decode_gbuffer(vec2 aUV, vec4 aDepth, vec4 aNorm, vec4 aEmissive, vec4 aAlbedo)
+{
+	GBufferSample g;
+
+#if defined(COMPACT_GBUFFER)
+	// The projection maps z to [0,1] (perspectiveRH_ZO)
+	g.position = GetWorldPos(aUV, aDepth.x);
+	g.normal = decode_octahedral(aNorm.xy);
+	g.emissive = decode_emissive(aEmissive);
+	g.shininess = decode_shininess(aEmissive);
+#else
+	g.position = GetWorldPos(aUV, aDepth.x * 2.0 - 1.0);
+	g.normal = aNorm.xyz;
+	g.emissive = aEmissive.xyz;
+	g.shininess = aEmissive.w;
+#endif
+
+	g.albedo = aAlbedo.xyz;
+	g.metalness = aAlbedo.w;
+	return g;
+}
@@ -0,0 +1,37 @@
+// Body of the lighting pass. The deferred*.frag variants select what it
+// reads with these defines:
+//
+//   COMPACT_GBUFFER   compact G-buffer layout (see gbuffer.hpp); binding 0
+//                     is the depth buffer of the first pass
+//   SUBPASS_INPUT     read the G-buffer from input attachments of the merged
+//                     render pass, instead of sampling it
+//   CLUSTERED_LIGHTS  shade with the clustered point lights (see
+//                     clusters.hpp) instead of the scene's four lights
+//   LIGHT_VOLUMES     only the emissive and ambient terms; the point lights
+//                     are drawn as volumes (see deferred_volume.glsl)
+//
+// deferred_tiled.glsl is the compute shader version of this pass.
+
+#include "deferred_shading.glsl"
+#include "deferred_gbuffer.glsl"
+
+#if defined(SUBPASS_INPUT)
+#	define LOAD_GBUFFER(aInput) subpassLoad(aInput)
+#else
+// With dynamic resolution, the G-buffer only covers the top-left part of
+// the images, so the pixel is fetched rather than sampled at inUV (which
+// spans the viewport)
+#	define LOAD_GBUFFER(aInput) texelFetch(aInput, ivec2(gl_FragCoord.xy), 0)
+#endif
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 oColour;
+
+void main()
+{
+	//pass info from G-buffer
+	GBufferSample g = decode_gbuffer(inUV, LOAD_GBUFFER(InDepth), LOAD_GBUFFER(InNorm), LOAD_GBUFFER(InEmissive), LOAD_GBUFFER(InAlbedo));
+
+	oColour = shade(g.position, g.normal, g.emissive, g.shininess, g.albedo, g.metalness);
+}
@@ -0,0 +1,176 @@
+// Lighting shared by the deferred*.frag variants (see deferred_main.glsl)
+// and the compute lighting pass (deferred_tiled.glsl). With
+// CLUSTERED_LIGHTS, shade() evaluates the point lights of the pixel's
+// cluster instead of the scene's four lights; with TILED_LIGHTS, those that
+// the compute pass found for the pixel's tile. With LIGHT_VOLUMES, shade()
+// only adds the emissive and ambient terms, and each light is drawn
+// separately with shade_volume_light() (see deferred_volume.glsl).
+//
+// The shading variant is selected with specialization constants, such that
+// each pipeline only contains the code it uses (see ShadingVariant in
+// main.cpp, which must match).
+
+#include "scene_uniform.glsl"
+
+// Number of the scene's lights that are shaded (0 to 4), in place of the
+// uScene.constant loop bound. The loop is unrolled per variant.
+layout(constant_id = 0) const int LIGHT_COUNT = 4;
+
+// BRDF of the lights: 0 = microfacet (specular and diffuse), 1 = Lambert
+// (diffuse only)
+layout(constant_id = 1) const int BRDF_MODEL = 0;
+
+// Terms added by shade(), see SHADE_* below
+layout(constant_id = 2) const uint SHADE_FEATURES = 3u;
+
+#define SHADE_EMISSIVE 1u
+#define SHADE_AMBIENT  2u
+
+#if defined(CLUSTERED_LIGHTS) || defined(TILED_LIGHTS) || defined(LIGHT_VOLUMES)
+#include "clusters.glsl"
+
+layout(std430, set = 2, binding = 0) readonly buffer Lights
+{
+	PointLight lights[];
+};
+#endif
+
+#if defined(CLUSTERED_LIGHTS)
+layout(std430, set = 2, binding = 1) readonly buffer Clusters
+{
+	uint clusterData[];
+};
+#endif
+
+#if defined(TILED_LIGHTS)
+// Lights of the workgroup's tile, filled in by deferred_tiled.glsl. The
+// count may exceed the limit, in which case the rest were dropped.
+#define MAX_LIGHTS_PER_TILE 256u
+
+shared uint sTileLightCount;
+shared uint sTileLights[MAX_LIGHTS_PER_TILE];
+#endif
+
+// World position of the pixel at aUV with clip-space depth aClipZ
+vec3 GetWorldPos(vec2 aUV, float aClipZ) {
+    vec4 clipSpacePosition = vec4(aUV * 2.0 - 1.0, aClipZ, 1.0);
+    vec4 viewSpacePosition = uScene.projectionInv * clipSpacePosition;
+
+    // Perspective division
+    viewSpacePosition /= viewSpacePosition.w;
+
+    vec4 worldSpacePosition = uScene.viewInv * viewSpacePosition;
+
+    return worldSpacePosition.xyz;
+}
+
+// Reflected light from a single light at aLightPos
+vec3 shade_light(vec3 aLightPos, vec3 aLightColour, vec3 fragPos, vec3 normal, vec3 viewDir, float nv, vec3 F0, vec3 fragAlbedo, float fragShininess, float fragMetalness)
+{
+	const float PI = 3.1415926f;
+
+	vec3 lightDir = normalize(aLightPos - fragPos);
+	float nl = max(dot(normal, lightDir), 0.f);
+
+	if (BRDF_MODEL == 1)
+		return (fragAlbedo/PI) * (1 - fragMetalness) * aLightColour * nl;
+
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+	float nh = max(dot(normal, halfwayDir), 0.f);
+	float vh = dot(viewDir, halfwayDir);
+
+	//Fresnel Term
+	vec3 F = F0 + (1 - F0) * pow((1-dot(halfwayDir, viewDir)), 5);
+
+	//Ldiffuse
+	vec3 Ldiffuse = (fragAlbedo/PI) * (vec3(1.f, 1.f, 1.f) - F) * (1 -fragMetalness);
+
+	//normal distribution function
+	float D = ((fragShininess+2) / 2*PI) * pow(nh, fragShininess);
+
+	//masking term
+	float G = min(1, min(2*nh*nv/vh, 2*nh*nl/vh));
+
+	//BRDF
+	vec3 BRDF = Ldiffuse + (D * F * G / 4 * nv * nl);
+
+	//specular
+	return BRDF * aLightColour * nl;
+}
+
+#if defined(CLUSTERED_LIGHTS) || defined(TILED_LIGHTS) || defined(LIGHT_VOLUMES)
+// Reflected light from a point light, which fades out towards its radius
+vec3 shade_point_light(PointLight aLight, vec3 fragPos, vec3 normal, vec3 viewDir, float nv, vec3 F0, vec3 fragAlbedo, float fragShininess, float fragMetalness)
+{
+	vec3 toLight = aLight.positionRadius.xyz - fragPos;
+	float falloff = light_falloff(dot(toLight, toLight), aLight.positionRadius.w);
+
+	return shade_light(aLight.positionRadius.xyz, aLight.colour.xyz * falloff, fragPos, normal, viewDir, nv, F0, fragAlbedo, fragShininess, fragMetalness);
+}
+#endif
+
+vec4 shade(vec3 fragPos, vec3 fragNorm, vec3 fragEmissive, float fragShininess, vec3 fragAlbedo, float fragMetalness)
+{
+	//modular code
+	vec3 normal = normalize(fragNorm);
+	vec3 viewDir = normalize(uScene.camPos - fragPos);
+	float nv = max(dot(normal, viewDir), 0.f);
+
+	//Le
+	vec3 Lemit = (SHADE_FEATURES & SHADE_EMISSIVE) != 0u ? fragEmissive : vec3(0.f);
+
+	//Lamibent
+	vec3 Lamibent = (SHADE_FEATURES & SHADE_AMBIENT) != 0u ? vec3(0.02f, 0.02f, 0.02f) * fragAlbedo : vec3(0.f);
+
+	//Fresnel Term
+	vec3 F0 = (1 - fragMetalness) * vec3(0.04f, 0.04f, 0.04f) + fragMetalness * fragAlbedo;
+	//multiple lights
+
+	vec4 fragColour = vec4((Lemit + Lamibent),1.f);
+
+#if defined(CLUSTERED_LIGHTS)
+	vec4 clipPos = uScene.projCam * vec4(fragPos, 1.f);
+	vec3 viewPos = (uScene.camera * vec4(fragPos, 1.f)).xyz;
+
+	uint base = find_cluster(clipPos, viewPos) * CLUSTER_STRIDE;
+	uint count = clusterData[base];
+
+	for(uint i = 0u; i < count; i++)
+	{
+		vec3 Lspec = shade_point_light(lights[clusterData[base + 1u + i]], fragPos, normal, viewDir, nv, F0, fragAlbedo, fragShininess, fragMetalness);
+		fragColour += vec4(Lspec, 1.f);
+	}
+#elif defined(TILED_LIGHTS)
+	uint count = min(sTileLightCount, MAX_LIGHTS_PER_TILE);
+
+	for(uint i = 0u; i < count; i++)
+	{
+		vec3 Lspec = shade_point_light(lights[sTileLights[i]], fragPos, normal, viewDir, nv, F0, fragAlbedo, fragShininess, fragMetalness);
+		fragColour += vec4(Lspec, 1.f);
+	}
+#elif defined(LIGHT_VOLUMES)
+	// The lights are added by their volumes
+#else
+	for(int i = 0; i < LIGHT_COUNT; i++)
+	{
+		vec3 Lspec = shade_light(uScene.light[i].position.xyz, uScene.light[i].colour.xyz, fragPos, normal, viewDir, nv, F0, fragAlbedo, fragShininess, fragMetalness);
+		fragColour += vec4(Lspec, 1.f);
+	}
+#endif
+
+	return fragColour;
+}
+
+#if defined(LIGHT_VOLUMES)
+// Reflected light from a single point light, without the terms of shade()
+vec3 shade_volume_light(PointLight aLight, vec3 fragPos, vec3 fragNorm, float fragShininess, vec3 fragAlbedo, float fragMetalness)
+{
+	vec3 normal = normalize(fragNorm);
+	vec3 viewDir = normalize(uScene.camPos - fragPos);
+	float nv = max(dot(normal, viewDir), 0.f);
+
+	vec3 F0 = (1 - fragMetalness) * vec3(0.04f, 0.04f, 0.04f) + fragMetalness * fragAlbedo;
+
+	return shade_point_light(aLight, fragPos, normal, viewDir, nv, F0, fragAlbedo, fragShininess, fragMetalness);
+}
+#endif
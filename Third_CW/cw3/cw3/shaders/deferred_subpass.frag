@@ -0,0 +1,10 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+#extension GL_GOOGLE_include_directive : require
+
+// Lighting pass: classic G-buffer, from input attachments of the merged
+// render pass (see deferred_main.glsl)
+
+#define SUBPASS_INPUT
+
+#include "deferred_main.glsl"
@@ -0,0 +1,95 @@
+// Compute shader version of the lighting pass (--compute-lighting). Each
+// workgroup shades a TILE_SIZE x TILE_SIZE tile of the G-buffer into a
+// storage image, which is then blitted to the target image. The
+// deferred_tiled*.comp variants select the G-buffer layout with
+// COMPACT_GBUFFER, as in deferred_main.glsl.
+//
+// With TILED_LIGHTS, the workgroup first finds the depth range of its tile,
+// and culls the point lights (see point_lights.hpp) against the tile's
+// view-space bounding box into shared memory. The pixels then only evaluate
+// the tile's lights. The order in which lights are added to a tile varies
+// between runs, so results may differ in the last bits.
+
+#include "deferred_shading.glsl"
+#include "deferred_gbuffer.glsl"
+
+// Must match deferred::kLightingTileSize
+#define TILE_SIZE 16u
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(set = 3, binding = 0, rgba16f) uniform writeonly image2D oColour;
+
+#if defined(TILED_LIGHTS)
+// View-space depth range of the tile, as float bits (non-negative floats
+// order like their bit patterns)
+shared uint sDepthMin;
+shared uint sDepthMax;
+#endif
+
+void main()
+{
+	// With dynamic resolution, only the top-left part of the images is
+	// rendered
+	ivec2 size = ivec2(uScene.renderExtent);
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+
+	// Invocations past the edge of the image still take part in the light
+	// culling (and its barriers), with the nearest pixel's depth.
+	bool inside = all(lessThan(pixel, size));
+	ivec2 texel = min(pixel, size - 1);
+
+	vec2 uv = (vec2(texel) + 0.5f) / vec2(size);
+	GBufferSample g = decode_gbuffer(uv, texelFetch(InDepth, texel, 0), texelFetch(InNorm, texel, 0), texelFetch(InEmissive, texel, 0), texelFetch(InAlbedo, texel, 0));
+
+#if defined(TILED_LIGHTS)
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		sDepthMin = floatBitsToUint(uCluster.far);
+		sDepthMax = 0u;
+		sTileLightCount = 0u;
+	}
+
+	barrier();
+
+	float depth = clamp(-(uScene.camera * vec4(g.position, 1.f)).z, 0.f, uCluster.far);
+	atomicMin(sDepthMin, floatBitsToUint(depth));
+	atomicMax(sDepthMax, floatBitsToUint(depth));
+
+	barrier();
+
+	// Bounding box of the tile between the depths d0 and d1, as in
+	// cluster_bounds()
+	float d0 = uintBitsToFloat(sDepthMin);
+	float d1 = uintBitsToFloat(sDepthMax);
+
+	vec2 scale = vec2(1.f / uScene.projection[0][0], 1.f / uScene.projection[1][1]);
+	vec2 a = (2.f * vec2(gl_WorkGroupID.xy * TILE_SIZE) / vec2(size) - 1.f) * scale;
+	vec2 b = (2.f * vec2((gl_WorkGroupID.xy + 1u) * TILE_SIZE) / vec2(size) - 1.f) * scale;
+
+	vec3 boundsMin = vec3(min(min(a * d0, a * d1), min(b * d0, b * d1)), -d1);
+	vec3 boundsMax = vec3(max(max(a * d0, a * d1), max(b * d0, b * d1)), -d0);
+
+	for (uint i = gl_LocalInvocationIndex; i < uCluster.lightCount; i += TILE_SIZE * TILE_SIZE)
+	{
+		vec4 light = lights[i].positionRadius;
+		vec3 centre = (uScene.camera * vec4(light.xyz, 1.f)).xyz;
+		vec3 d = max(max(boundsMin - centre, vec3(0.f)), centre - boundsMax);
+
+		if (dot(d, d) <= light.w * light.w)
+		{
+			// Lights past the limit are dropped
+			uint slot = atomicAdd(sTileLightCount, 1u);
+			if (slot < MAX_LIGHTS_PER_TILE)
+				sTileLights[slot] = i;
+		}
+	}
+
+	barrier();
+#endif
+
+	vec4 colour = shade(g.position, g.normal, g.emissive, g.shininess, g.albedo, g.metalness);
+
+	if (inside)
+		imageStore(oColour, pixel, colour);
+}
@@ -0,0 +1,7 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+#extension GL_GOOGLE_include_directive : require
+
+// Light volume: classic G-buffer (see deferred_volume.glsl)
+
+#include "deferred_volume.glsl"
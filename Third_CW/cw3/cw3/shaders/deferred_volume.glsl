@@ -0,0 +1,25 @@
+// Lighting of a single point light within its volume (--light-volumes).
+// The stencil limits the draw to the pixels whose surface lies inside the
+// light's sphere, and the result is added to the ambient pass. The
+// deferred_*volume.frag variants select the G-buffer layout with
+// COMPACT_GBUFFER, as in deferred_main.glsl.
+
+#define LIGHT_VOLUMES
+
+#include "deferred_shading.glsl"
+#include "deferred_gbuffer.glsl"
+
+layout(location = 0) flat in uint v2fLight;
+
+layout(location = 0) out vec4 oColour;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	vec2 uv = gl_FragCoord.xy / vec2(uScene.renderExtent);
+
+	GBufferSample g = decode_gbuffer(uv, texelFetch(InDepth, texel, 0), texelFetch(InNorm, texel, 0), texelFetch(InEmissive, texel, 0), texelFetch(InAlbedo, texel, 0));
+
+	// Alpha is left as written by the ambient pass
+	oColour = vec4(shade_volume_light(lights[v2fLight], g.position, g.normal, g.shininess, g.albedo, g.metalness), 0.f);
+}
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Proxy sphere of a point light (--light-volumes). The unit sphere is
+// scaled to the light's radius; the light is selected by the instance index,
+// i.e., by firstInstance of the draw.
+
+#include "scene_uniform.glsl"
+#include "clusters.glsl"
+
+layout(std430, set = 2, binding = 0) readonly buffer Lights
+{
+	PointLight lights[];
+};
+
+layout(location = 0) in vec3 iPosition;
+
+layout(location = 0) flat out uint v2fLight;
+
+void main()
+{
+	vec4 light = lights[gl_InstanceIndex].positionRadius;
+
+	v2fLight = uint(gl_InstanceIndex);
+	gl_Position = uScene.projCam * vec4(light.xyz + light.w * iPosition, 1.f);
+}
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Depth pre-pass (--depth-prepass): positions only, and no fragment shader.
+// The G-buffer pass then only keeps the fragments at the depth written
+// here (VK_COMPARE_OP_EQUAL), so gl_Position must come out exactly as in
+// MRT.vert, hence the invariant.
+
+#include "scene_uniform.glsl"
+
+layout(location = 0) in vec3 iPosition;
+
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = uScene.projCam * vec4(iPosition, 1.f);
+}
@@ -0,0 +1,43 @@
+// Encodings of the compact G-buffer layout (see gbuffer.hpp). Shared by
+// gbuffer_main.glsl, which writes the G-buffer, and the compact lighting
+// variants, which read it.
+
+const float kEmissiveRange = 16.f;
+const float kMaxShininess = 2047.f;
+
+// Octahedral normal encoding: project onto the octahedron |x|+|y|+|z| = 1
+// and fold the lower half over the upper one. Result is in [-1,1]^2.
+vec2 encode_octahedral(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+
+	vec2 folded = (1.f - abs(n.yx)) * vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+	return n.z >= 0.f ? n.xy : folded;
+}
+
+vec3 decode_octahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+	float t = clamp(-n.z, 0.f, 1.f);
+	n.xy += vec2(n.x >= 0.f ? -t : t, n.y >= 0.f ? -t : t);
+	return normalize(n);
+}
+
+// Emissive is stored with a square-root curve, such that the 8 bits favour
+// dark values; the shininess exponent logarithmically.
+vec4 encode_emissive_shininess(vec3 emissive, float shininess)
+{
+	vec3 e = clamp(emissive / kEmissiveRange, 0.f, 1.f);
+	float s = log2(1.f + clamp(shininess, 0.f, kMaxShininess)) / log2(1.f + kMaxShininess);
+	return vec4(sqrt(e), s);
+}
+
+vec3 decode_emissive(vec4 raw)
+{
+	return raw.xyz * raw.xyz * kEmissiveRange;
+}
+
+float decode_shininess(vec4 raw)
+{
+	return exp2(raw.w * log2(1.f + kMaxShininess)) - 1.f;
+}
@@ -0,0 +1,72 @@
+// Body of the G-buffer pass. The MRT*.frag variants select what it writes
+// and where the material comes from with these defines:
+//
+//   COMPACT_GBUFFER   compact G-buffer layout (see gbuffer.hpp). The world
+//                     position is not stored; the lighting pass
+//                     reconstructs it from depth.
+//   MATERIAL_BUFFER   GPU-driven (--gpu-culling) and instanced (--instances)
+//                     draws: all materials are in one storage buffer,
+//                     indexed by the draw's material (see MRT_indirect.vert
+//                     and MRT_instanced.vert), instead of one uniform buffer
+//                     per material
+
+#if defined(COMPACT_GBUFFER)
+#	include "gbuffer_compact.glsl"
+#endif
+
+#if defined(MATERIAL_BUFFER)
+// glsl::GpuMaterial; the same members as UMaterial below
+struct Material
+{
+	vec4 emissive;
+	vec4 albedo;
+	float shininess;
+	float metalness;
+};
+
+layout( set = 1, binding = 0, std430 ) readonly buffer Materials
+{
+	Material materials[];
+};
+
+layout(location = 2) flat in uint v2fMaterial;
+
+#	define uMaterial materials[v2fMaterial]
+#else
+// PBR material (example):
+layout( set = 1, binding = 0, std140 ) uniform UMaterial
+{
+	vec4 emissive;
+	vec4 albedo;
+	float shininess;
+	float metalness;
+} uMaterial;
+#endif
+
+// In and Out
+layout(location = 0) in vec3 v2fPos;
+layout(location = 1) in vec3 v2fNormal;
+
+#if defined(COMPACT_GBUFFER)
+layout(location = 0) out vec2 oNormal;
+layout(location = 1) out vec4 oEmissive;
+layout(location = 2) out vec4 oAlbedo;
+#else
+layout(location = 0) out vec4 oPosition;
+layout(location = 1) out vec4 oNormal;
+layout(location = 2) out vec4 oEmissive;
+layout(location = 3) out vec4 oAlbedo;
+#endif
+
+void main()
+{
+#if defined(COMPACT_GBUFFER)
+	oNormal = encode_octahedral(normalize(v2fNormal));
+	oEmissive = encode_emissive_shininess(uMaterial.emissive.xyz, uMaterial.shininess);
+#else
+	oPosition = vec4(v2fPos, 1.f);
+	oNormal = vec4(v2fNormal, 1.f);
+	oEmissive = vec4(uMaterial.emissive.xyz, uMaterial.shininess);
+#endif
+	oAlbedo = vec4(uMaterial.albedo.xyz, uMaterial.metalness);
+}
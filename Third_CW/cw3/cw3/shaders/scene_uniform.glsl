@@ -0,0 +1,23 @@
+// Scene uniforms (glsl::SceneUniform), shared by the lighting pass and the
+// light clustering
+
+struct Light
+{
+	vec4 position;
+	vec4 colour;
+};
+
+// Light and Uniform Buffer
+layout(set = 0, binding = 0) uniform UScene
+{
+			mat4 camera;
+			mat4 projection;
+			mat4 projCam;
+			mat4 viewInv;
+			mat4 projectionInv;
+			Light light[4];
+			vec3 camPos;
+			int constant;
+			uvec2 renderExtent; // part of the G-buffer that is rendered
+
+} uScene;
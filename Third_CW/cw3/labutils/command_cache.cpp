@@ -0,0 +1,76 @@
+#include "command_cache.hpp"
+
+#include <cassert>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	CommandBufferCache::CommandBufferCache( VulkanContext const& aContext, std::size_t aSlotCount )
+		: mDevice( aContext.device )
+		, mPool( create_command_pool( aContext, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT ) )
+	{
+		resize( aSlotCount );
+	}
+
+	void CommandBufferCache::resize( std::size_t aSlotCount )
+	{
+		assert( VK_NULL_HANDLE != mDevice );
+
+		if( !mBuffers.empty() )
+		{
+			vkFreeCommandBuffers( mDevice, mPool.handle, std::uint32_t(mBuffers.size()), mBuffers.data() );
+			mBuffers.clear();
+		}
+
+		if( aSlotCount )
+		{
+			VkCommandBufferAllocateInfo cbufInfo{};
+			cbufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			cbufInfo.commandPool = mPool.handle;
+			cbufInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			cbufInfo.commandBufferCount = std::uint32_t(aSlotCount);
+
+			mBuffers.resize( aSlotCount, VK_NULL_HANDLE );
+			if( auto const res = vkAllocateCommandBuffers( mDevice, &cbufInfo, mBuffers.data() ); VK_SUCCESS != res )
+			{
+				mBuffers.clear();
+				throw Error( "Unable to allocate cached command buffers\n"
+					"vkAllocateCommandBuffers() returned %s", to_string(res).c_str()
+				);
+			}
+		}
+
+		mGenerations.assign( aSlotCount, 0 );
+		mValid.assign( aSlotCount, false );
+	}
+
+	void CommandBufferCache::invalidate() noexcept
+	{
+		mValid.assign( mValid.size(), false );
+	}
+
+	VkCommandBuffer CommandBufferCache::acquire( std::size_t aSlot, std::uint64_t aGeneration, bool& aNeedsRecording )
+	{
+		assert( aSlot < mBuffers.size() );
+
+		aNeedsRecording = !mValid[aSlot] || mGenerations[aSlot] != aGeneration;
+		if( aNeedsRecording )
+		{
+			mValid[aSlot] = true;
+			mGenerations[aSlot] = aGeneration;
+			++recordCount;
+		}
+
+		return mBuffers[aSlot];
+	}
+
+	std::size_t CommandBufferCache::slot_count() const noexcept
+	{
+		return mBuffers.size();
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// CommandBufferCache keeps pre-recorded command buffers for scenes where
+	// the sequence of commands does not change between frames. Each "slot"
+	// (e.g., a combination of frame-in-flight and swapchain image, which
+	// determines the framebuffer and per-frame descriptor sets to use) has its
+	// own command buffer.
+	//
+	// A command buffer is recorded with the generation value that was current
+	// at the time. When the caller's generation counter has moved on (because
+	// the scene or the swapchain changed), acquire() reports that the slot
+	// must be re-recorded.
+	//
+	// Note: the cache does not synchronize with the GPU. The caller must
+	// ensure that a slot's command buffer is not pending execution when it is
+	// re-recorded (e.g., by waiting for the corresponding frame's GPU
+	// timeline value).
+	class CommandBufferCache
+	{
+		public:
+			CommandBufferCache() noexcept = default;
+			explicit CommandBufferCache( VulkanContext const&, std::size_t aSlotCount = 0 );
+
+		public:
+			// Change the number of slots. All slots are invalidated.
+			void resize( std::size_t aSlotCount );
+
+			// Invalidate all slots such that they are re-recorded on next use.
+			void invalidate() noexcept;
+
+			// Return the command buffer for aSlot. aNeedsRecording is set to
+			// true if the buffer has never been recorded or was recorded for
+			// a different generation. In that case, the caller must record the
+			// commands (with vkBeginCommandBuffer(), which implicitly resets
+			// the buffer) before submitting it.
+			VkCommandBuffer acquire( std::size_t aSlot, std::uint64_t aGeneration, bool& aNeedsRecording );
+
+			std::size_t slot_count() const noexcept;
+
+		public:
+			// Number of times a command buffer had to be (re-)recorded. Useful
+			// to verify that the cache actually hits.
+			std::uint64_t recordCount = 0;
+
+		private:
+			VkDevice mDevice = VK_NULL_HANDLE;
+			CommandPool mPool;
+
+			std::vector<VkCommandBuffer> mBuffers;
+			std::vector<std::uint64_t> mGenerations;
+			std::vector<bool> mValid;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
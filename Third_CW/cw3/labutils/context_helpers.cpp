@@ -163,4 +163,31 @@ namespace labutils::detail
 
 		return ret;
 	}
+
+	VkPhysicalDeviceVulkan12Features get_device_features12( VkPhysicalDevice aPhysicalDev )
+	{
+		VkPhysicalDeviceVulkan12Features features12{};
+		features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &features12;
+
+		vkGetPhysicalDeviceFeatures2( aPhysicalDev, &features );
+
+		features12.pNext = nullptr;
+		return features12;
+	}
+
+	OptionalFeatures get_optional_features( VkPhysicalDevice aPhysicalDev )
+	{
+		VkPhysicalDeviceFeatures features{};
+		vkGetPhysicalDeviceFeatures( aPhysicalDev, &features );
+
+		OptionalFeatures ret;
+		ret.drawIndirectFirstInstance = VK_TRUE == features.drawIndirectFirstInstance;
+		ret.multiDrawIndirect = VK_TRUE == features.multiDrawIndirect;
+		ret.drawIndirectCount = VK_TRUE == get_device_features12( aPhysicalDev ).drawIndirectCount;
+		return ret;
+	}
 }
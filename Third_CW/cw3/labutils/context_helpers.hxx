@@ -30,5 +30,21 @@ namespace labutils
 
 
 		std::unordered_set<std::string> get_device_extensions( VkPhysicalDevice );
+
+		// Query the Vulkan 1.2 features of the device. The pNext member of
+		// the returned structure is reset to nullptr. Requires a Vulkan 1.1+
+		// device (vkGetPhysicalDeviceFeatures2() is core in 1.1).
+		VkPhysicalDeviceVulkan12Features get_device_features12( VkPhysicalDevice );
+
+		// Optional features of VulkanContext: the ones that the device
+		// supports are enabled by create_device().
+		struct OptionalFeatures
+		{
+			bool drawIndirectFirstInstance = false;
+			bool multiDrawIndirect = false;
+			bool drawIndirectCount = false;
+		};
+
+		OptionalFeatures get_optional_features( VkPhysicalDevice );
 	}
 }
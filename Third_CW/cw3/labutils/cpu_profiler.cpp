@@ -0,0 +1,177 @@
+#include "cpu_profiler.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstddef>
+
+namespace
+{
+	// Events per thread. At 32 bytes per event, this is 2 MB per thread
+	// that records zones.
+	constexpr std::size_t kRingSize = std::size_t(1) << 16;
+
+	struct Event_
+	{
+		char const* name;
+		std::uint64_t beginNs;
+		std::uint64_t endNs;
+		std::uint64_t frame;
+	};
+
+	// Written only by the owning thread. head counts all events ever
+	// written; event i is stored at events[i % kRingSize].
+	struct ThreadRing_
+	{
+		std::string name;
+		std::unique_ptr<Event_[]> events{ new Event_[kRingSize] };
+		std::atomic<std::uint64_t> head{ 0 };
+	};
+
+	// Rings are never destroyed, such that the events of threads that have
+	// exited (e.g., of a destroyed thread pool) can still be exported.
+	struct Registry_
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadRing_>> rings;
+	};
+
+	Registry_& registry_()
+	{
+		static Registry_ registry;
+		return registry;
+	}
+
+	std::atomic<std::uint64_t> gFrame_{ 0 };
+
+	thread_local ThreadRing_* tRing_ = nullptr;
+
+	// Name given before the thread's first zone. The ring is only created
+	// once it is needed, so naming a thread (e.g., a pool worker) that never
+	// records a zone costs nothing.
+	thread_local std::string tPendingName_;
+
+	ThreadRing_& this_thread_ring_()
+	{
+		if( !tRing_ )
+		{
+			auto& reg = registry_();
+			std::lock_guard<std::mutex> lock( reg.mutex );
+
+			reg.rings.emplace_back( std::make_unique<ThreadRing_>() );
+			tRing_ = reg.rings.back().get();
+
+			if( tPendingName_.empty() )
+			{
+				char name[32];
+				std::snprintf( name, sizeof(name), "thread %zu", reg.rings.size() );
+				tRing_->name = name;
+			}
+			else
+			{
+				tRing_->name = std::move( tPendingName_ );
+			}
+		}
+
+		return *tRing_;
+	}
+}
+
+namespace labutils
+{
+	namespace cpu_profiler
+	{
+		void set_thread_name( char const* aName )
+		{
+			if( !tRing_ )
+			{
+				tPendingName_ = aName;
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock( registry_().mutex );
+			tRing_->name = aName;
+		}
+
+		void set_frame( std::uint64_t aFrame ) noexcept
+		{
+			gFrame_.store( aFrame, std::memory_order_relaxed );
+		}
+
+		void append_trace_events( std::vector<TraceEvent>& aEvents, std::uint32_t aFirstThread )
+		{
+			auto& reg = registry_();
+			std::lock_guard<std::mutex> lock( reg.mutex );
+
+			for( std::size_t i = 0; i < reg.rings.size(); ++i )
+			{
+				auto const& ring = *reg.rings[i];
+
+				auto const head = ring.head.load( std::memory_order_acquire );
+				auto const first = head > kRingSize ? head - kRingSize : 0;
+
+				std::size_t const start = aEvents.size();
+				for( auto j = first; j < head; ++j )
+				{
+					auto const& ev = ring.events[j % kRingSize];
+
+					TraceEvent out{};
+					out.name = ev.name;
+					out.category = "cpu";
+					out.beginNs = ev.beginNs;
+					out.durationNs = ev.endNs - ev.beginNs;
+					out.thread = aFirstThread + std::uint32_t(i);
+					out.frame = ev.frame;
+					aEvents.emplace_back( out );
+				}
+
+				// The owner may have overwritten the oldest events while they
+				// were copied, and may still be writing the slot of event
+				// newHead - kRingSize. Drop the ones that may be torn,
+				// including that one (i.e., events before
+				// newHead - kRingSize + 1).
+				auto const newHead = ring.head.load( std::memory_order_acquire );
+				if( newHead + 1 > kRingSize + first )
+				{
+					auto const torn = std::size_t(std::min<std::uint64_t>( newHead + 1 - kRingSize - first, head - first ));
+					aEvents.erase( aEvents.begin() + start, aEvents.begin() + start + torn );
+				}
+			}
+		}
+
+		std::vector<TraceThread> threads( std::uint32_t aFirstThread )
+		{
+			auto& reg = registry_();
+			std::lock_guard<std::mutex> lock( reg.mutex );
+
+			std::vector<TraceThread> ret;
+			for( std::size_t i = 0; i < reg.rings.size(); ++i )
+				ret.emplace_back( TraceThread{ aFirstThread + std::uint32_t(i), reg.rings[i]->name } );
+
+			return ret;
+		}
+	}
+
+	CpuZone::CpuZone( char const* aName ) noexcept
+		: mName( aName )
+		, mBeginNs( trace_now_ns() )
+	{}
+
+	CpuZone::~CpuZone()
+	{
+		auto const endNs = trace_now_ns();
+
+		// Allocates the ring on the thread's first zone
+		auto& ring = this_thread_ring_();
+
+		auto const head = ring.head.load( std::memory_order_relaxed );
+		ring.events[head % kRingSize] = Event_{ mName, mBeginNs, endNs, gFrame_.load( std::memory_order_relaxed ) };
+		ring.head.store( head + 1, std::memory_order_release );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
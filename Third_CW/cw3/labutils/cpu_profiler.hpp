@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include "trace.hpp"
+
+// CPU profiling zones are compiled in by default in debug builds only.
+// Define LUT_CPU_PROFILING=1 (or =0) to override this, e.g., to profile an
+// optimized build. With LUT_CPU_PROFILING=0, LUT_CPU_ZONE() expands to
+// nothing.
+#if !defined(LUT_CPU_PROFILING)
+#	if defined(NDEBUG)
+#		define LUT_CPU_PROFILING 0
+#	else
+#		define LUT_CPU_PROFILING 1
+#	endif
+#endif
+
+namespace labutils
+{
+	// The CPU profiler records scoped zones (see LUT_CPU_ZONE) into one ring
+	// buffer per thread. Recording a zone takes two clock reads and a store
+	// into the thread's own buffer: there are no locks and no allocations
+	// (except for the buffer itself, on the first zone of each thread). When
+	// a buffer is full, the oldest events are overwritten.
+	//
+	// Zones use trace_now_ns(), so they line up with the GPU events of the
+	// GpuProfiler in a trace.
+	namespace cpu_profiler
+	{
+		// Name shown for the calling thread in traces. aName is copied.
+		void set_thread_name( char const* aName );
+
+		// Frame number that is attached to subsequently recorded zones (of
+		// all threads).
+		void set_frame( std::uint64_t ) noexcept;
+
+		// Append the events that are currently held by the ring buffers.
+		// Threads are numbered from aFirstThread in order of their first
+		// zone. Events that are overwritten while being read are skipped, so
+		// this may be called while other threads are recording.
+		void append_trace_events( std::vector<TraceEvent>&, std::uint32_t aFirstThread );
+
+		// Names of the threads, numbered as in append_trace_events()
+		std::vector<TraceThread> threads( std::uint32_t aFirstThread );
+	}
+
+	// RAII zone. Use through LUT_CPU_ZONE, such that it can be compiled out.
+	// aName must outlive the profiler (e.g., a string literal).
+	class CpuZone
+	{
+		public:
+			explicit CpuZone( char const* aName ) noexcept;
+			~CpuZone();
+
+			CpuZone( CpuZone const& ) = delete;
+			CpuZone& operator= (CpuZone const&) = delete;
+
+		private:
+			char const* mName;
+			std::uint64_t mBeginNs;
+	};
+}
+
+#define LUT_CPU_ZONE_CAT2_(a,b) a##b
+#define LUT_CPU_ZONE_CAT_(a,b) LUT_CPU_ZONE_CAT2_(a,b)
+
+#if LUT_CPU_PROFILING
+#	define LUT_CPU_ZONE( name ) ::labutils::CpuZone LUT_CPU_ZONE_CAT_(lutCpuZone_, __LINE__)( name )
+#else
+#	define LUT_CPU_ZONE( name ) static_cast<void>(0)
+#endif
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
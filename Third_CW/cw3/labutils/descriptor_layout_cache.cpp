@@ -0,0 +1,67 @@
+#include "descriptor_layout_cache.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	bool same_bindings_( std::vector<VkDescriptorSetLayoutBinding> const& aX, std::vector<VkDescriptorSetLayoutBinding> const& aY )
+	{
+		return aX.size() == aY.size()
+			&& std::equal( aX.begin(), aX.end(), aY.begin(), [] (VkDescriptorSetLayoutBinding const& aA, VkDescriptorSetLayoutBinding const& aB) {
+				return aA.binding == aB.binding
+					&& aA.descriptorType == aB.descriptorType
+					&& aA.descriptorCount == aB.descriptorCount
+					&& aA.stageFlags == aB.stageFlags
+				;
+			} )
+		;
+	}
+}
+
+namespace labutils
+{
+	DescriptorLayoutCache::DescriptorLayoutCache( VulkanContext const& aContext )
+		: mContext( &aContext )
+	{}
+
+	VkDescriptorSetLayout DescriptorLayoutCache::get( std::vector<VkDescriptorSetLayoutBinding> const& aBindings )
+	{
+		for( auto const& [bindings, layout] : mLayouts )
+		{
+			if( same_bindings_( bindings, aBindings ) )
+				return layout.handle;
+		}
+
+		assert( std::none_of( aBindings.begin(), aBindings.end(), [] (VkDescriptorSetLayoutBinding const& aBinding) {
+			return aBinding.pImmutableSamplers;
+		} ) );
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = std::uint32_t(aBindings.size());
+		layoutInfo.pBindings = aBindings.data();
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( mContext->device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create descriptor set layout\n"
+				"vkCreateDescriptorSetLayout() returned %s", to_string(res).c_str()
+			);
+		}
+
+		mLayouts.emplace_back( aBindings, DescriptorSetLayout( mContext->device, layout ) );
+		return layout;
+	}
+
+	std::size_t DescriptorLayoutCache::size() const
+	{
+		return mLayouts.size();
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
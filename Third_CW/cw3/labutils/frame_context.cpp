@@ -0,0 +1,114 @@
+#include "frame_context.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+#include "cpu_profiler.hpp"
+
+namespace labutils
+{
+	std::vector<FrameContext> create_frame_contexts( VulkanContext const& aContext, Allocator const& aAllocator, std::uint32_t aFramesInFlight, VkDeviceSize aUniformSize, std::uint32_t aWorkerCount )
+	{
+		assert( aFramesInFlight > 0 );
+
+		std::vector<FrameContext> frames( aFramesInFlight );
+		for( auto& frame : frames )
+		{
+			// The pool is reset as a whole at the start of each frame, so the
+			// individual command buffers do not need to be resettable.
+			frame.commandPool = create_command_pool( aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT );
+			frame.commandBuffer = alloc_command_buffer( aContext, frame.commandPool.handle );
+
+			frame.imageAvailable = create_semaphore( aContext );
+
+			frame.uniformSize = aUniformSize;
+			frame.uniforms = create_buffer(
+				aAllocator,
+				aUniformSize,
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT
+			);
+
+			VmaAllocationInfo allocInfo{};
+			vmaGetAllocationInfo( aAllocator.allocator, frame.uniforms.allocation, &allocInfo );
+			frame.uniformData = allocInfo.pMappedData;
+			assert( frame.uniformData );
+
+			// Only a handful of per-frame descriptor sets are needed.
+			frame.descriptorPool = create_descriptor_pool( aContext, 16, 8 );
+
+			frame.workerPools.reserve( aWorkerCount );
+			frame.workerCommandBuffers.reserve( aWorkerCount );
+			for( std::uint32_t i = 0; i < aWorkerCount; ++i )
+			{
+				frame.workerPools.emplace_back( create_command_pool( aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT ) );
+				frame.workerCommandBuffers.emplace_back( alloc_command_buffer( aContext, frame.workerPools.back().handle, VK_COMMAND_BUFFER_LEVEL_SECONDARY ) );
+			}
+		}
+
+		return frames;
+	}
+
+	std::vector<Semaphore> create_present_semaphores( VulkanContext const& aContext, std::size_t aImageCount )
+	{
+		std::vector<Semaphore> semaphores;
+		semaphores.reserve( aImageCount );
+		for( std::size_t i = 0; i < aImageCount; ++i )
+			semaphores.emplace_back( create_semaphore( aContext ) );
+
+		return semaphores;
+	}
+
+	float begin_frame( VulkanContext const& aContext, GpuTimeline& aTimeline, FrameContext& aFrame, std::uint64_t aFrameNumber )
+	{
+		LUT_CPU_ZONE( "begin_frame" );
+
+		// A value of zero (never submitted) is always reached
+		float const waitMs = aTimeline.wait( aFrame.timelineValue );
+
+		if( auto const res = vkResetCommandPool( aContext.device, aFrame.commandPool.handle, 0 ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to reset frame command pool\n"
+				"vkResetCommandPool() returned %s", to_string(res).c_str()
+			);
+		}
+
+		for( auto const& pool : aFrame.workerPools )
+		{
+			if( auto const res = vkResetCommandPool( aContext.device, pool.handle, 0 ); VK_SUCCESS != res )
+			{
+				throw Error( "Unable to reset frame worker command pool\n"
+					"vkResetCommandPool() returned %s", to_string(res).c_str()
+				);
+			}
+		}
+
+		aFrame.frameNumber = aFrameNumber;
+		aFrame.lastWaitMs = waitMs;
+		return aFrame.lastWaitMs;
+	}
+
+	void update_frame_uniforms( Allocator const& aAllocator, FrameContext& aFrame, void const* aData, VkDeviceSize aSize )
+	{
+		assert( aFrame.uniformData );
+		assert( aSize <= aFrame.uniformSize );
+
+		std::memcpy( aFrame.uniformData, aData, std::size_t(aSize) );
+
+		// CPU_TO_GPU memory is not necessarily HOST_COHERENT. The flush is a
+		// no-op if it is. (Host writes are made visible to the device by the
+		// subsequent vkQueueSubmit(); no further barriers are needed.)
+		if( auto const res = vmaFlushAllocation( aAllocator.allocator, aFrame.uniforms.allocation, 0, aSize ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to flush frame uniforms\n"
+				"vmaFlushAllocation() returned %s", to_string(res).c_str()
+			);
+		}
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
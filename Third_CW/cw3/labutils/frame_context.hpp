@@ -0,0 +1,99 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vkbuffer.hpp"
+#include "allocator.hpp"
+#include "gpu_timeline.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// FrameContext holds all resources that the CPU touches while recording
+	// and submitting a single frame. Keeping several of these around ("frames
+	// in flight") lets the CPU prepare frame N+1 while the GPU is still busy
+	// with frame N, independently of how many swapchain images the driver
+	// decides to hand out.
+	//
+	// A frame context may only be reused once the GPU has finished with it,
+	// i.e., once the GPU timeline has reached the value of the frame's last
+	// submission. This is what begin_frame() waits for.
+	struct FrameContext
+	{
+		CommandPool commandPool;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+		// Binary semaphore for the swapchain's acquire (acquire/present do
+		// not support timeline semaphores). The semaphores that the present
+		// waits for are per swapchain image; see create_present_semaphores().
+		Semaphore imageAvailable;
+
+		// GPU timeline value of the frame's last submission. Zero if the
+		// frame has not been submitted yet.
+		std::uint64_t timelineValue = 0;
+
+		// Per-frame slice of uniform data (e.g., the scene uniforms). Since
+		// each frame has its own copy, updating it never races with the GPU
+		// reading an earlier frame's values.
+		//
+		// The buffer is host visible and persistently mapped. Writing it with
+		// update_frame_uniforms() instead of recording a vkCmdUpdateBuffer()
+		// keeps per-frame data out of the command buffers, which can then be
+		// recorded once and reused.
+		Buffer uniforms;
+		VkDeviceSize uniformSize = 0;
+		void* uniformData = nullptr;
+
+		// Descriptor sets that refer to per-frame data are allocated from the
+		// frame's own pool.
+		DescriptorPool descriptorPool;
+
+		// Secondary command buffers for parallel recording. Each has its own
+		// pool, such that different threads can record into them at the same
+		// time (command pools are externally synchronized). A pool must only
+		// be used by one thread at a time; the buffers are reset along with
+		// their pools in begin_frame().
+		std::vector<CommandPool> workerPools;
+		std::vector<VkCommandBuffer> workerCommandBuffers;
+
+		// Bookkeeping: the number of the frame that last used this context,
+		// and how long the CPU had to wait for it in begin_frame().
+		std::uint64_t frameNumber = 0;
+		float lastWaitMs = 0.f;
+	};
+
+	std::vector<FrameContext> create_frame_contexts(
+		VulkanContext const&,
+		Allocator const&,
+		std::uint32_t aFramesInFlight,
+		VkDeviceSize aUniformSize,
+		std::uint32_t aWorkerCount = 0
+	);
+
+	// Semaphores that the presents wait for, one per swapchain image. A
+	// present holds on to its semaphore until the image is acquired again,
+	// which need not happen within kFramesInFlight frames. With one
+	// semaphore per image, a semaphore is only signalled again once its
+	// image's previous present has completed. Re-create them along with the
+	// swapchain.
+	std::vector<Semaphore> create_present_semaphores( VulkanContext const&, std::size_t aImageCount );
+
+	// Wait until the GPU has finished the previous frame that used aFrame,
+	// then reset its command pools such that the frame can be recorded again.
+	// Returns the time spent waiting in milliseconds.
+	//
+	// The caller must store the timeline value of the frame's submission in
+	// aFrame.timelineValue.
+	float begin_frame( VulkanContext const&, GpuTimeline&, FrameContext& aFrame, std::uint64_t aFrameNumber );
+
+	// Copy aSize bytes to the frame's uniform buffer. Must only be called
+	// after begin_frame(), when the GPU is no longer reading the buffer.
+	void update_frame_uniforms( Allocator const&, FrameContext&, void const* aData, VkDeviceSize aSize );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
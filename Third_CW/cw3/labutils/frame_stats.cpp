@@ -0,0 +1,41 @@
+#include "frame_stats.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+
+namespace
+{
+	float percentile_( std::vector<float> const& aSorted, float aPercent )
+	{
+		auto const rank = std::size_t(std::ceil( aPercent / 100.f * float(aSorted.size()) ));
+		return aSorted[std::clamp<std::size_t>( rank, 1, aSorted.size() ) - 1];
+	}
+}
+
+namespace labutils
+{
+	FrameTimeStats compute_frame_time_stats( std::vector<float> aFrameMs )
+	{
+		FrameTimeStats ret;
+		if( aFrameMs.empty() )
+			return ret;
+
+		std::sort( aFrameMs.begin(), aFrameMs.end() );
+
+		double sum = 0.0;
+		for( auto const ms : aFrameMs )
+			sum += ms;
+
+		ret.frames = aFrameMs.size();
+		ret.meanMs = float(sum / double(aFrameMs.size()));
+		ret.minMs = aFrameMs.front();
+		ret.p50Ms = percentile_( aFrameMs, 50.f );
+		ret.p95Ms = percentile_( aFrameMs, 95.f );
+		ret.p99Ms = percentile_( aFrameMs, 99.f );
+		ret.maxMs = aFrameMs.back();
+		return ret;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
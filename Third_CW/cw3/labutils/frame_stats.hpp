@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+
+namespace labutils
+{
+	// Summary of a series of frame times. Percentiles use the nearest-rank
+	// method, i.e., p95 is a frame time that was actually measured and that
+	// at least 95% of the frames did not exceed.
+	struct FrameTimeStats
+	{
+		std::size_t frames = 0;
+
+		float meanMs = 0.f;
+		float minMs = 0.f;
+		float p50Ms = 0.f;
+		float p95Ms = 0.f;
+		float p99Ms = 0.f;
+		float maxMs = 0.f;
+	};
+
+	FrameTimeStats compute_frame_time_stats( std::vector<float> aFrameMs );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
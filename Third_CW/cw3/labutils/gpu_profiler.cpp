@@ -0,0 +1,284 @@
+#include "gpu_profiler.hpp"
+
+#include <iterator>
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	GpuProfiler::GpuProfiler( VulkanContext const& aContext, std::uint32_t aSlotCount, std::uint32_t aMaxScopes, std::size_t aHistoryLength, std::size_t aMaxTraceEvents )
+		: mDevice( aContext.device )
+		, mMaxScopes( aMaxScopes )
+		, mHistoryLength( aHistoryLength )
+		, mMaxEvents( aMaxTraceEvents )
+	{
+		assert( aMaxScopes > 0 );
+		assert( aHistoryLength > 0 );
+
+		// Timestamps are only meaningful if the queue that we submit to
+		// supports them
+		std::uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties( aContext.physicalDevice, &familyCount, nullptr );
+
+		std::vector<VkQueueFamilyProperties> families( familyCount );
+		vkGetPhysicalDeviceQueueFamilyProperties( aContext.physicalDevice, &familyCount, families.data() );
+
+		assert( aContext.graphicsFamilyIndex < familyCount );
+		std::uint32_t const validBits = families[aContext.graphicsFamilyIndex].timestampValidBits;
+		if( 0 == validBits )
+			return;
+
+		mValidMask = validBits >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << validBits) - 1;
+
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties( aContext.physicalDevice, &props );
+		mNsPerTick = double(props.limits.timestampPeriod);
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = 2 * aMaxScopes;
+
+		mSlots.resize( aSlotCount );
+		for( auto& slot : mSlots )
+		{
+			VkQueryPool pool = VK_NULL_HANDLE;
+			if( auto const res = vkCreateQueryPool( mDevice, &poolInfo, nullptr, &pool ); VK_SUCCESS != res )
+			{
+				throw Error( "Unable to create timestamp query pool\n"
+					"vkCreateQueryPool() returned %s", to_string(res).c_str()
+				);
+			}
+
+			slot.pool = QueryPool( mDevice, pool );
+			slot.scopes.reserve( aMaxScopes );
+		}
+
+		mResults.resize( 2 * std::size_t(aMaxScopes) );
+	}
+
+	bool GpuProfiler::enabled() const noexcept
+	{
+		return !mSlots.empty();
+	}
+
+	void GpuProfiler::begin( VkCommandBuffer aCmdBuff, std::uint32_t aSlot )
+	{
+		if( !enabled() )
+			return;
+
+		assert( aSlot < mSlots.size() );
+		auto& slot = mSlots[aSlot];
+
+		// Recording over a slot that has not been collected yet would mix up
+		// the scopes of two submissions.
+		assert( 0 == slot.pendingValue );
+
+		vkCmdResetQueryPool( aCmdBuff, slot.pool.handle, 0, 2 * mMaxScopes );
+		slot.scopes.clear();
+	}
+
+	std::uint32_t GpuProfiler::begin_scope( VkCommandBuffer aCmdBuff, std::uint32_t aSlot, char const* aName )
+	{
+		if( !enabled() )
+			return kNoScope;
+
+		assert( aSlot < mSlots.size() );
+		auto& slot = mSlots[aSlot];
+
+		if( slot.scopes.size() >= mMaxScopes )
+			return kNoScope;
+
+		auto const scope = std::uint32_t(slot.scopes.size());
+		slot.scopes.emplace_back( aName );
+
+		vkCmdWriteTimestamp( aCmdBuff, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.pool.handle, 2 * scope );
+		return scope;
+	}
+
+	void GpuProfiler::end_scope( VkCommandBuffer aCmdBuff, std::uint32_t aSlot, std::uint32_t aScope )
+	{
+		if( !enabled() || kNoScope == aScope )
+			return;
+
+		assert( aSlot < mSlots.size() );
+		assert( aScope < mSlots[aSlot].scopes.size() );
+
+		vkCmdWriteTimestamp( aCmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mSlots[aSlot].pool.handle, 2 * aScope + 1 );
+	}
+
+	void GpuProfiler::submitted( std::uint32_t aSlot, std::uint64_t aTimelineValue, std::uint64_t aFrame )
+	{
+		if( !enabled() )
+			return;
+
+		assert( aSlot < mSlots.size() );
+		auto& slot = mSlots[aSlot];
+
+		slot.pendingValue = aTimelineValue;
+		slot.frame = aFrame;
+		slot.submitNs = trace_now_ns();
+	}
+
+	void GpuProfiler::collect( GpuTimeline& aTimeline )
+	{
+		for( auto& slot : mSlots )
+		{
+			if( 0 == slot.pendingValue || !aTimeline.retired( slot.pendingValue ) )
+				continue;
+
+			slot.pendingValue = 0;
+
+			auto const queryCount = std::uint32_t(2 * slot.scopes.size());
+			if( 0 == queryCount )
+				continue;
+
+			// The submission has completed, so this does not block. Should
+			// the results not be available anyway, the frame is dropped.
+			auto const res = vkGetQueryPoolResults( mDevice, slot.pool.handle, 0, queryCount, queryCount * sizeof(std::uint64_t), mResults.data(), sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT );
+			if( VK_NOT_READY == res )
+				continue;
+
+			if( VK_SUCCESS != res )
+			{
+				throw Error( "Unable to read timestamp queries\n"
+					"vkGetQueryPoolResults() returned %s", to_string(res).c_str()
+				);
+			}
+
+			// Span of all scopes, relative to the first one's begin
+			auto const first = mResults[0] & mValidMask;
+			std::uint64_t spanTicks = 0;
+
+			for( std::size_t i = 0; i < slot.scopes.size(); ++i )
+			{
+				auto const begin = mResults[2*i+0] & mValidMask;
+				auto const end = mResults[2*i+1] & mValidMask;
+				auto const ticks = (end - begin) & mValidMask; // handles wrap-around
+
+				spanTicks = std::max( spanTicks, (end - first) & mValidMask );
+
+				auto const beginNs = std::uint64_t(double(begin) * mNsPerTick);
+				auto const durationNs = std::uint64_t(double(ticks) * mNsPerTick);
+
+				// The GPU cannot start the work before it was submitted; the
+				// largest such difference is the best estimate of the offset.
+				auto const offset = std::int64_t(slot.submitNs) - std::int64_t(beginNs);
+				if( !mHaveOffset || offset > mOffsetNs )
+				{
+					mOffsetNs = offset;
+					mHaveOffset = true;
+				}
+
+				record_( slot.scopes[i], beginNs, durationNs, slot.frame );
+			}
+
+			slot.latest = SlotTime{ slot.frame, float(double(spanTicks) * mNsPerTick / 1e6) };
+		}
+	}
+
+	GpuProfiler::SlotTime GpuProfiler::latest( std::uint32_t aSlot ) const
+	{
+		if( !enabled() )
+			return SlotTime{ 0, -1.f };
+
+		assert( aSlot < mSlots.size() );
+		return mSlots[aSlot].latest;
+	}
+
+	std::vector<GpuProfiler::ScopeStats> GpuProfiler::stats() const
+	{
+		std::vector<ScopeStats> ret;
+		ret.reserve( mHistory.size() );
+
+		for( auto const& hist : mHistory )
+		{
+			ScopeStats st{};
+			st.name = hist.name;
+			st.samples = hist.samples.size();
+
+			if( !hist.samples.empty() )
+			{
+				float sum = 0.f;
+				st.minMs = st.maxMs = hist.samples.front();
+				for( auto const ms : hist.samples )
+				{
+					sum += ms;
+					st.minMs = std::min( st.minMs, ms );
+					st.maxMs = std::max( st.maxMs, ms );
+				}
+
+				st.meanMs = sum / float(hist.samples.size());
+			}
+
+			ret.emplace_back( st );
+		}
+
+		return ret;
+	}
+
+	void GpuProfiler::append_trace_events( std::vector<TraceEvent>& aEvents, std::uint32_t aThread ) const
+	{
+		aEvents.reserve( aEvents.size() + mEvents.size() );
+		for( auto const& ev : mEvents )
+		{
+			TraceEvent out{};
+			out.name = ev.name;
+			out.category = "gpu";
+			out.beginNs = std::uint64_t(std::max<std::int64_t>( 0, std::int64_t(ev.beginNs) + mOffsetNs ));
+			out.durationNs = ev.durationNs;
+			out.thread = aThread;
+			out.frame = ev.frame;
+
+			aEvents.emplace_back( out );
+		}
+	}
+
+	void GpuProfiler::record_( char const* aName, std::uint64_t aBeginNs, std::uint64_t aDurationNs, std::uint64_t aFrame )
+	{
+		// Scopes are identified by name rather than by pointer, since equal
+		// string literals are not guaranteed to share storage.
+		auto it = std::find_if( mHistory.begin(), mHistory.end(), [aName] (History_ const& aHist) {
+			return 0 == std::strcmp( aHist.name, aName );
+		} );
+
+		if( mHistory.end() == it )
+		{
+			mHistory.emplace_back( History_{ aName, {}, 0 } );
+			it = std::prev( mHistory.end() );
+			it->samples.reserve( mHistoryLength );
+		}
+
+		float const ms = float(double(aDurationNs) / 1e6);
+		if( it->samples.size() < mHistoryLength )
+			it->samples.emplace_back( ms );
+		else
+			it->samples[it->next] = ms;
+
+		it->next = (it->next + 1) % mHistoryLength;
+
+		if( mEvents.size() < mMaxEvents )
+			mEvents.emplace_back( Event_{ aName, aBeginNs, aDurationNs, aFrame } );
+	}
+
+
+	GpuScope::GpuScope( GpuProfiler* aProfiler, VkCommandBuffer aCmdBuff, std::uint32_t aSlot, char const* aName )
+		: mProfiler( aProfiler )
+		, mCmdBuff( aCmdBuff )
+		, mSlot( aSlot )
+		, mScope( aProfiler ? aProfiler->begin_scope( aCmdBuff, aSlot, aName ) : GpuProfiler::kNoScope )
+	{}
+
+	GpuScope::~GpuScope()
+	{
+		if( mProfiler )
+			mProfiler->end_scope( mCmdBuff, mSlot, mScope );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
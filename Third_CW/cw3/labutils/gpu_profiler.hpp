@@ -0,0 +1,166 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "trace.hpp"
+#include "vkobject.hpp"
+#include "gpu_timeline.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// GpuProfiler measures GPU time of scopes (e.g., render passes or upload
+	// batches) with pairs of vkCmdWriteTimestamp(). Each "slot" has its own
+	// query pool; typically there is one slot per frame in flight, plus
+	// extra slots for one-off work such as uploads.
+	//
+	// Usage:
+	//  - begin() at the start of the slot's command buffer (resets its
+	//    queries; must be outside of a render pass),
+	//  - begin_scope()/end_scope() (or GpuScope) around the work,
+	//  - submitted() with the timeline value of the submission,
+	//  - collect() once per frame.
+	// collect() only reads slots whose submissions have completed, so it
+	// never stalls. The results of a frame thus become available a few
+	// frames later, when its frame context is reused.
+	//
+	// A command buffer that is submitted repeatedly without being
+	// re-recorded (see CommandBufferCache) measures the same scopes again;
+	// the scopes of the most recent begin() for the slot are used.
+	//
+	// If the graphics queue does not support timestamps, the profiler is
+	// disabled and all methods do nothing.
+	class GpuProfiler
+	{
+		public:
+			static constexpr std::uint32_t kNoScope = ~std::uint32_t(0);
+
+			struct ScopeStats
+			{
+				char const* name;
+				float meanMs, minMs, maxMs;
+				std::size_t samples;
+			};
+
+			struct SlotTime
+			{
+				std::uint64_t frame; // as passed to submitted()
+				float ms; // negative: nothing collected yet
+			};
+
+		public:
+			GpuProfiler() noexcept = default;
+			explicit GpuProfiler(
+				VulkanContext const&,
+				std::uint32_t aSlotCount,
+				std::uint32_t aMaxScopes = 32,
+				std::size_t aHistoryLength = 128,
+				std::size_t aMaxTraceEvents = std::size_t(1) << 20
+			);
+
+		public:
+			bool enabled() const noexcept;
+
+			void begin( VkCommandBuffer, std::uint32_t aSlot );
+
+			// aName is not copied (see TraceEvent). Returns kNoScope if the
+			// slot has no free queries left; end_scope() ignores kNoScope.
+			std::uint32_t begin_scope( VkCommandBuffer, std::uint32_t aSlot, char const* aName );
+			void end_scope( VkCommandBuffer, std::uint32_t aSlot, std::uint32_t aScope );
+
+			void submitted( std::uint32_t aSlot, std::uint64_t aTimelineValue, std::uint64_t aFrame );
+
+			void collect( GpuTimeline& );
+
+			// Rolling statistics over the last aHistoryLength samples of
+			// each scope, in order of first appearance.
+			std::vector<ScopeStats> stats() const;
+
+			// GPU time of the most recently collected submission of aSlot,
+			// from its first to its last timestamp. Intended as a measure
+			// of a frame's GPU cost, e.g., for dynamic resolution.
+			SlotTime latest( std::uint32_t aSlot ) const;
+
+			// Append all collected events (up to aMaxTraceEvents). GPU
+			// timestamps are mapped to trace_now_ns() with an offset that is
+			// estimated from the submission times, so the events line up
+			// with CPU events only approximately (to within the submission
+			// latency).
+			void append_trace_events( std::vector<TraceEvent>&, std::uint32_t aThread ) const;
+
+		private:
+			struct Slot_
+			{
+				QueryPool pool;
+				std::vector<char const*> scopes;
+
+				std::uint64_t pendingValue = 0; // zero: nothing to collect
+				std::uint64_t frame = 0;
+				std::uint64_t submitNs = 0;
+
+				SlotTime latest{ 0, -1.f };
+			};
+
+			struct History_
+			{
+				char const* name;
+				std::vector<float> samples;
+				std::size_t next = 0;
+			};
+
+			struct Event_
+			{
+				char const* name;
+				std::uint64_t beginNs, durationNs; // GPU time
+				std::uint64_t frame;
+			};
+
+			void record_( char const*, std::uint64_t aBeginNs, std::uint64_t aDurationNs, std::uint64_t aFrame );
+
+		private:
+			VkDevice mDevice = VK_NULL_HANDLE;
+
+			std::vector<Slot_> mSlots;
+			std::uint32_t mMaxScopes = 0;
+
+			double mNsPerTick = 1.0;
+			std::uint64_t mValidMask = 0;
+
+			std::vector<History_> mHistory;
+			std::size_t mHistoryLength = 0;
+
+			std::vector<Event_> mEvents;
+			std::size_t mMaxEvents = 0;
+
+			// CPU time = GPU time + mOffsetNs; see append_trace_events()
+			std::int64_t mOffsetNs = 0;
+			bool mHaveOffset = false;
+
+			std::vector<std::uint64_t> mResults; // scratch
+	};
+
+	// RAII helper for GpuProfiler::begin_scope()/end_scope(). Does nothing
+	// if aProfiler is null.
+	class GpuScope
+	{
+		public:
+			GpuScope( GpuProfiler*, VkCommandBuffer, std::uint32_t aSlot, char const* aName );
+			~GpuScope();
+
+			GpuScope( GpuScope const& ) = delete;
+			GpuScope& operator= (GpuScope const&) = delete;
+
+		private:
+			GpuProfiler* mProfiler;
+			VkCommandBuffer mCmdBuff;
+			std::uint32_t mSlot;
+			std::uint32_t mScope;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
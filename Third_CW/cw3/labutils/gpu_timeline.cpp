@@ -0,0 +1,161 @@
+#include "gpu_timeline.hpp"
+
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+#include "cpu_profiler.hpp"
+
+namespace labutils
+{
+	GpuTimeline::GpuTimeline( VulkanContext const& aContext )
+		: mDevice( aContext.device )
+		, mSemaphore( create_timeline_semaphore( aContext, 0 ) )
+	{}
+
+	std::uint64_t GpuTimeline::submit( VkQueue aQueue, std::uint32_t aCommandBufferCount, VkCommandBuffer const* aCommandBuffers, VkSemaphore aWait, VkPipelineStageFlags aWaitStages, VkSemaphore aSignal )
+	{
+		assert( VK_NULL_HANDLE != mDevice );
+
+		std::uint64_t const signalValue = mSubmitted + 1;
+
+		// Binary semaphores ignore their entry in the value arrays, but the
+		// arrays must still have one entry per semaphore.
+		VkSemaphore signalSemaphores[2] = { mSemaphore.handle, aSignal };
+		std::uint64_t const signalValues[2] = { signalValue, 0 };
+		std::uint64_t const waitValue = 0;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = VK_NULL_HANDLE != aWait ? 1 : 0;
+		timelineInfo.pWaitSemaphoreValues = &waitValue;
+		timelineInfo.signalSemaphoreValueCount = VK_NULL_HANDLE != aSignal ? 2 : 1;
+		timelineInfo.pSignalSemaphoreValues = signalValues;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = aCommandBufferCount;
+		submitInfo.pCommandBuffers = aCommandBuffers;
+
+		if( VK_NULL_HANDLE != aWait )
+		{
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &aWait;
+			submitInfo.pWaitDstStageMask = &aWaitStages;
+		}
+
+		submitInfo.signalSemaphoreCount = timelineInfo.signalSemaphoreValueCount;
+		submitInfo.pSignalSemaphores = signalSemaphores;
+
+		if( auto const res = vkQueueSubmit( aQueue, 1, &submitInfo, VK_NULL_HANDLE ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to submit command buffers to queue\n"
+				"vkQueueSubmit() returned %s", to_string(res).c_str()
+			);
+		}
+
+		mSubmitted = signalValue;
+		return signalValue;
+	}
+
+	std::uint64_t GpuTimeline::last_submitted() const noexcept
+	{
+		return mSubmitted;
+	}
+
+	std::uint64_t GpuTimeline::completed_value()
+	{
+		assert( VK_NULL_HANDLE != mDevice );
+
+		std::uint64_t value = 0;
+		if( auto const res = vkGetSemaphoreCounterValue( mDevice, mSemaphore.handle, &value ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to query GPU timeline\n"
+				"vkGetSemaphoreCounterValue() returned %s", to_string(res).c_str()
+			);
+		}
+
+		mCompleted = value;
+		return value;
+	}
+
+	bool GpuTimeline::retired( std::uint64_t aValue )
+	{
+		if( aValue <= mCompleted )
+			return true;
+
+		return aValue <= completed_value();
+	}
+
+	float GpuTimeline::wait( std::uint64_t aValue )
+	{
+		assert( aValue <= mSubmitted );
+
+		if( aValue <= mCompleted )
+			return 0.f;
+
+		// A separate zone, such that GPU-bound frames are easy to spot
+		LUT_CPU_ZONE( "gpu_wait" );
+
+		using Clock_ = std::chrono::steady_clock;
+		auto const waitStart = Clock_::now();
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &mSemaphore.handle;
+		waitInfo.pValues = &aValue;
+
+		if( auto const res = vkWaitSemaphores( mDevice, &waitInfo, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to wait for GPU timeline value %llu\n"
+				"vkWaitSemaphores() returned %s", static_cast<unsigned long long>(aValue), to_string(res).c_str()
+			);
+		}
+
+		mCompleted = std::max( mCompleted, aValue );
+		return std::chrono::duration<float, std::milli>( Clock_::now() - waitStart ).count();
+	}
+
+	VkSemaphore GpuTimeline::handle() const noexcept
+	{
+		return mSemaphore.handle;
+	}
+
+
+	std::size_t DeletionQueue::collect( std::uint64_t aCompletedValue )
+	{
+		auto const it = std::remove_if( mEntries.begin(), mEntries.end(), [aCompletedValue] (Entry_ const& aEntry) {
+			return aEntry.retireValue <= aCompletedValue;
+		} );
+
+		auto const count = std::size_t(mEntries.end() - it);
+		mEntries.erase( it, mEntries.end() );
+		return count;
+	}
+	std::size_t DeletionQueue::collect( GpuTimeline& aTimeline )
+	{
+		if( mEntries.empty() )
+			return 0;
+
+		return collect( aTimeline.completed_value() );
+	}
+
+	void DeletionQueue::flush() noexcept
+	{
+		mEntries.clear();
+	}
+
+	std::size_t DeletionQueue::size() const noexcept
+	{
+		return mEntries.size();
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
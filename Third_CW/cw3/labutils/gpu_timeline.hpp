@@ -0,0 +1,123 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// GpuTimeline is a monotonically increasing "GPU work counter", backed by
+	// a single timeline semaphore (Vulkan 1.2). Every submission made through
+	// submit() signals the next value of the counter when it completes. Any
+	// subsystem can thus remember the value of the submission that uses a
+	// resource and later ask whether that value has been reached, without
+	// blocking and without needing a fence per operation.
+	//
+	// Submissions to a single queue complete in order, so reaching value N
+	// implies that all submissions with values <= N have completed.
+	//
+	// Note: swapchain acquire and present still require binary semaphores.
+	class GpuTimeline
+	{
+		public:
+			GpuTimeline() noexcept = default;
+			explicit GpuTimeline( VulkanContext const& );
+
+		public:
+			// Submit command buffers to aQueue. The submission optionally
+			// waits for the binary semaphore aWait (at aWaitStages) and
+			// signals the binary semaphore aSignal. Returns the timeline value
+			// that is signalled when the submission has completed.
+			std::uint64_t submit(
+				VkQueue aQueue,
+				std::uint32_t aCommandBufferCount,
+				VkCommandBuffer const* aCommandBuffers,
+				VkSemaphore aWait = VK_NULL_HANDLE,
+				VkPipelineStageFlags aWaitStages = 0,
+				VkSemaphore aSignal = VK_NULL_HANDLE
+			);
+
+			// Value that the most recent submit() will signal.
+			std::uint64_t last_submitted() const noexcept;
+
+			// Query the current value of the counter (does not block).
+			std::uint64_t completed_value();
+
+			// Has the submission with aValue completed? Only queries the
+			// device if the cached completed value is not sufficient.
+			bool retired( std::uint64_t aValue );
+
+			// Block until the counter reaches aValue. Returns the time spent
+			// waiting in milliseconds.
+			float wait( std::uint64_t aValue );
+
+			VkSemaphore handle() const noexcept;
+
+		private:
+			VkDevice mDevice = VK_NULL_HANDLE;
+			Semaphore mSemaphore;
+
+			std::uint64_t mSubmitted = 0;
+			std::uint64_t mCompleted = 0;
+	};
+
+	// DeletionQueue keeps objects alive until the GPU is done with them. An
+	// object is handed over together with the timeline value of the last
+	// submission that uses it; collect() destroys all objects whose values
+	// have been reached. This replaces waiting (e.g., on a fence or with
+	// vkDeviceWaitIdle()) before destroying resources that may still be in
+	// use.
+	//
+	// The queue must be collected or flushed before the device is destroyed.
+	class DeletionQueue
+	{
+		public:
+			DeletionQueue() noexcept = default;
+			~DeletionQueue() = default;
+
+			DeletionQueue( DeletionQueue const& ) = delete;
+			DeletionQueue& operator= (DeletionQueue const&) = delete;
+
+			DeletionQueue( DeletionQueue&& ) noexcept = default;
+			DeletionQueue& operator= (DeletionQueue&&) noexcept = default;
+
+		public:
+			// Take ownership of aObject (e.g., a Buffer or CommandPool) and
+			// destroy it once the timeline has reached aRetireValue.
+			template< typename tObject >
+			void defer( std::uint64_t aRetireValue, tObject&& aObject );
+
+			// Destroy the objects whose values are <= aCompletedValue.
+			// Returns the number of objects that were destroyed.
+			std::size_t collect( std::uint64_t aCompletedValue );
+			std::size_t collect( GpuTimeline& );
+
+			// Destroy all objects. The caller must ensure that the GPU is
+			// no longer using them.
+			void flush() noexcept;
+
+			std::size_t size() const noexcept;
+
+		private:
+			struct Entry_
+			{
+				std::uint64_t retireValue;
+				std::shared_ptr<void> object;
+			};
+
+			std::vector<Entry_> mEntries;
+	};
+}
+
+#include "gpu_timeline.inl"
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
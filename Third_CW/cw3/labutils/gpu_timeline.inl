@@ -0,0 +1,13 @@
+namespace labutils
+{
+	template< typename tObject >
+	inline
+	void DeletionQueue::defer( std::uint64_t aRetireValue, tObject&& aObject )
+	{
+		static_assert( !std::is_lvalue_reference_v<tObject>, "DeletionQueue::defer() takes ownership: pass an rvalue (std::move())" );
+
+		// shared_ptr<void> remembers the correct deleter, which saves us
+		// from having to type-erase the objects ourselves.
+		mEntries.emplace_back( Entry_{ aRetireValue, std::make_shared<std::decay_t<tObject>>( std::move(aObject) ) } );
+	}
+}
@@ -0,0 +1,88 @@
+#include "offscreen.hpp"
+
+#include <cassert>
+
+#include <stb_image_write.h>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	OffscreenTarget create_offscreen_target( VulkanContext const& aContext, Allocator const& aAllocator, VkExtent2D const& aExtent, VkFormat aFormat, std::uint32_t aImageCount, VkImageUsageFlags aUsage )
+	{
+		assert( aImageCount > 0 );
+
+		OffscreenTarget ret;
+		ret.format = aFormat;
+		ret.extent = aExtent;
+
+		ret.images.reserve( aImageCount );
+		ret.views.reserve( aImageCount );
+		for( std::uint32_t i = 0; i < aImageCount; ++i )
+		{
+			ret.images.emplace_back( create_image( aAllocator, aExtent.width, aExtent.height, aFormat, aUsage ) );
+			ret.views.emplace_back( create_image_view( aContext, ret.images.back().image, aFormat ) );
+		}
+
+		return ret;
+	}
+
+	Buffer create_readback_buffer( Allocator const& aAllocator, VkExtent2D const& aExtent, std::uint32_t aBytesPerPixel )
+	{
+		return create_buffer(
+			aAllocator,
+			VkDeviceSize(aExtent.width) * aExtent.height * aBytesPerPixel,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_TO_CPU,
+			VMA_ALLOCATION_CREATE_MAPPED_BIT
+		);
+	}
+
+	void record_image_readback( VkCommandBuffer aCmdBuff, VkImage aImage, VkExtent2D const& aExtent, VkBuffer aBuffer )
+	{
+		VkBufferImageCopy copy{};
+		copy.bufferOffset = 0;
+		copy.bufferRowLength = 0; // tightly packed
+		copy.bufferImageHeight = 0;
+		copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copy.imageOffset = VkOffset3D{ 0, 0, 0 };
+		copy.imageExtent = VkExtent3D{ aExtent.width, aExtent.height, 1 };
+
+		vkCmdCopyImageToBuffer( aCmdBuff, aImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, aBuffer, 1, &copy );
+
+		buffer_barrier(
+			aCmdBuff,
+			aBuffer,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_HOST_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_HOST_BIT
+		);
+	}
+
+	void write_png( char const* aPath, Allocator const& aAllocator, Buffer const& aBuffer, VkExtent2D const& aExtent )
+	{
+		assert( aPath );
+
+		VmaAllocationInfo allocInfo{};
+		vmaGetAllocationInfo( aAllocator.allocator, aBuffer.allocation, &allocInfo );
+		assert( allocInfo.pMappedData );
+
+		// GPU_TO_CPU memory is not necessarily HOST_COHERENT
+		if( auto const res = vmaInvalidateAllocation( aAllocator.allocator, aBuffer.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to invalidate readback buffer\n"
+				"vmaInvalidateAllocation() returned %s", to_string(res).c_str()
+			);
+		}
+
+		auto const width = int(aExtent.width);
+		auto const height = int(aExtent.height);
+		if( !stbi_write_png( aPath, width, height, 4, allocInfo.pMappedData, width * 4 ) )
+			throw Error( "Unable to write image to '%s'", aPath );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
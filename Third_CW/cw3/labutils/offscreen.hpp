@@ -0,0 +1,57 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstdint>
+
+#include "vkimage.hpp"
+#include "vkobject.hpp"
+#include "vkbuffer.hpp"
+#include "allocator.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// OffscreenTarget stands in for the swapchain when rendering without a
+	// window (e.g., with a VulkanContext from make_vulkan_context()). It owns
+	// a number of color images that are used round-robin, like swapchain
+	// images. Since there is no presentation, the images are typically left
+	// in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL by the last render pass, such
+	// that they can be read back with record_image_readback().
+	struct OffscreenTarget
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent{};
+
+		std::vector<Image> images;
+		std::vector<ImageView> views;
+	};
+
+	OffscreenTarget create_offscreen_target(
+		VulkanContext const&,
+		Allocator const&,
+		VkExtent2D const&,
+		VkFormat,
+		std::uint32_t aImageCount,
+		VkImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+	);
+
+	// Host-visible, persistently mapped buffer that can hold a tightly packed
+	// copy of an image with the given extent and bytes per pixel.
+	Buffer create_readback_buffer( Allocator const&, VkExtent2D const&, std::uint32_t aBytesPerPixel = 4 );
+
+	// Record a copy of aImage to aBuffer. The image must be in
+	// VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, and prior writes to it must have
+	// been made available to the transfer stage (e.g., by a subpass
+	// dependency). The copy is made visible to the host; the data may be
+	// read once the submission has completed.
+	void record_image_readback( VkCommandBuffer, VkImage, VkExtent2D const&, VkBuffer );
+
+	// Write the contents of a readback buffer to a PNG file. The data must
+	// be 8-bit RGBA (e.g., VK_FORMAT_R8G8B8A8_SRGB or _UNORM).
+	void write_png( char const* aPath, Allocator const&, Buffer const&, VkExtent2D const& );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,72 @@
+#include "pipeline_builder.hpp"
+
+#include <cassert>
+
+namespace labutils
+{
+	PipelineBuilder::PipelineBuilder( ThreadPool* aPool )
+		: mPool( aPool )
+	{}
+
+	PipelineBuilder::~PipelineBuilder()
+	{
+		// The builds refer to `this`
+		wait_idle();
+	}
+
+	void PipelineBuilder::wait_idle()
+	{
+		std::unique_lock<std::mutex> lock( mMutex );
+		mIdle.wait( lock, [this] { return 0 == mPending; } );
+	}
+
+	PipelineBuilder::Stats PipelineBuilder::stats() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		Stats ret = mStats;
+		if( ret.count > 0 )
+			ret.wallMs = std::chrono::duration<float, std::milli>( mLastEnd - mFirstStart ).count();
+
+		return ret;
+	}
+
+	void PipelineBuilder::started_()
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		if( 0 == mPending && 0 == mStats.count )
+			mFirstStart = Clock_::now();
+
+		++mPending;
+	}
+
+	void PipelineBuilder::finished_( char const* aName, Clock_::time_point aStart )
+	{
+		auto const end = Clock_::now();
+		auto const ms = std::chrono::duration<float, std::milli>( end - aStart ).count();
+
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			assert( mPending > 0 );
+
+			++mStats.count;
+			mStats.totalMs += ms;
+			if( ms > mStats.longestMs || !mStats.longest )
+			{
+				mStats.longestMs = ms;
+				mStats.longest = aName;
+			}
+
+			if( end > mLastEnd )
+				mLastEnd = end;
+
+			// Notify under the lock: once mPending is zero, the destructor
+			// may return as soon as the lock is released
+			--mPending;
+			mIdle.notify_all();
+		}
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
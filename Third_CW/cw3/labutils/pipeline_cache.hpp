@@ -0,0 +1,34 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <cstddef>
+
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Persistent pipeline cache. load_pipeline_cache() creates the context's
+	// VulkanContext::pipelineCache, which all pipelines are created with, and
+	// seeds it with the data saved by an earlier run. The driver can then
+	// skip compiling the pipelines that it has seen before.
+	//
+	// The data is only valid for the driver that produced it. The file
+	// therefore starts with the vendor and device IDs, the driver version
+	// and UUID, and the pipeline cache UUID; a file that does not match the
+	// current device and driver (or that is truncated) is ignored, and the
+	// cache starts out empty.
+	//
+	// Returns the number of bytes of cache data loaded from aPath, zero if
+	// the cache starts out empty ("cold").
+	std::size_t load_pipeline_cache( VulkanContext&, char const* aPath );
+
+	// Write the contents of the context's pipeline cache to aPath. The data
+	// is written to a temporary file first, which then replaces aPath, so an
+	// interrupted save never leaves a partial file behind. Returns the number
+	// of bytes of cache data written; zero if there was nothing to save or
+	// the file could not be written (a warning is printed to stderr).
+	std::size_t save_pipeline_cache( VulkanContext const&, char const* aPath );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Declarative description of a pipeline. Only the state that differs
+	// between the pipelines is described; everything else is fixed:
+	//  - entry point "main" in all shaders
+	//  - no tessellation, no primitive restart, no depth bias or clamping
+	//  - a single viewport and scissor, both dynamic state (the pipelines
+	//    do not depend on the render extent)
+	//
+	// A description with a compute shader describes a compute pipeline,
+	// which uses only computeShader, specialization and layout.
+	//
+	// Descriptions are values: they can be compared and hashed, such that
+	// identical descriptions map to the same pipeline (see PipelineRegistry).
+	// The render pass and layout are referred to by handle.
+	struct PipelineDesc
+	{
+		// SPIR-V files; an empty path means no such stage
+		std::string vertexShader;
+		std::string fragmentShader;
+		std::string computeShader;
+
+		// Values of the specialization constants: element i is the value of
+		// constant_id i, in all stages. Shaders declare the constants as
+		// 32-bit types (int, uint, or bool, where 0 is false). Each distinct
+		// set of values is a separate pipeline (a shader variant).
+		std::vector<std::uint32_t> specialization;
+
+		std::vector<VkVertexInputBindingDescription> vertexBindings;
+		std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+		bool depthTest = true;
+		bool depthWrite = true;
+		VkCompareOp depthCompare = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		bool stencilTest = false;
+		VkStencilOpState stencilFront{};
+		VkStencilOpState stencilBack{};
+
+		// One per colour attachment of the subpass
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		std::uint32_t subpass = 0;
+	};
+
+	bool operator== (PipelineDesc const&, PipelineDesc const&);
+	bool operator!= (PipelineDesc const&, PipelineDesc const&);
+
+	std::size_t hash_value( PipelineDesc const& );
+
+	struct PipelineDescHash
+	{
+		std::size_t operator() (PipelineDesc const& aDesc) const { return hash_value( aDesc ); }
+	};
+
+	// Helpers for the common parts of a description
+	VkVertexInputBindingDescription vertex_binding( std::uint32_t aBinding, std::uint32_t aStride, VkVertexInputRate = VK_VERTEX_INPUT_RATE_VERTEX );
+	VkVertexInputAttributeDescription vertex_attribute( std::uint32_t aLocation, std::uint32_t aBinding, VkFormat, std::uint32_t aOffset = 0 );
+
+	// Writes all channels, no blending
+	VkPipelineColorBlendAttachmentState opaque_attachment();
+
+	// Builds the pipeline; throws labutils::Error on failure. The pipeline
+	// is created with the context's pipeline cache.
+	Pipeline create_pipeline( VulkanContext const&, PipelineDesc const& );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,107 @@
+#include "pipeline_registry.hpp"
+
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <exception>
+
+#include <cassert>
+
+namespace labutils
+{
+	PipelineRegistry::PipelineRegistry( VulkanContext const& aContext )
+		: mContext( &aContext )
+	{}
+
+	VkPipeline PipelineRegistry::get( PipelineDesc const& aDesc )
+	{
+		std::promise<VkPipeline> promise;
+
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+
+			if( auto const it = mEntries.find( aDesc ); mEntries.end() != it )
+			{
+				++mStats.hits;
+
+				// Waits (without the lock) if the pipeline is still being
+				// built on another thread
+				auto ready = it->second;
+				lock.unlock();
+				return ready.get();
+			}
+
+			mEntries.emplace( aDesc, promise.get_future().share() );
+			++mStats.builds;
+		}
+
+		try
+		{
+			Pipeline pipe = create_pipeline( *mContext, aDesc );
+			VkPipeline const handle = pipe.handle;
+
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				mPipelines.emplace_back( std::move(pipe) );
+			}
+
+			promise.set_value( handle );
+			return handle;
+		}
+		catch( ... )
+		{
+			// Not cached, such that a later request retries
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				mEntries.erase( aDesc );
+			}
+
+			promise.set_exception( std::current_exception() );
+			throw;
+		}
+	}
+
+	std::size_t PipelineRegistry::evict( VkRenderPass aRenderPass )
+	{
+		assert( VK_NULL_HANDLE != aRenderPass );
+
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		std::size_t count = 0;
+		for( auto it = mEntries.begin(); mEntries.end() != it; )
+		{
+			if( aRenderPass != it->first.renderPass )
+			{
+				++it;
+				continue;
+			}
+
+			// Waiting here would deadlock a build that is still running
+			assert( std::future_status::ready == it->second.wait_for( std::chrono::seconds(0) ) );
+
+			VkPipeline const handle = it->second.get();
+			auto const pipe = std::find_if( mPipelines.begin(), mPipelines.end(), [handle] (Pipeline const& aPipe) {
+				return handle == aPipe.handle;
+			} );
+
+			assert( mPipelines.end() != pipe );
+			mPipelines.erase( pipe );
+
+			it = mEntries.erase( it );
+			++count;
+		}
+
+		return count;
+	}
+
+	PipelineRegistry::Stats PipelineRegistry::stats() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		Stats ret = mStats;
+		ret.pipelines = mPipelines.size();
+		return ret;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
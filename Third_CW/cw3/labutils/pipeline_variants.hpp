@@ -0,0 +1,56 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <map>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "pipeline_desc.hpp"
+#include "pipeline_registry.hpp"
+
+namespace labutils
+{
+	// Shader variants of one pipeline: the pipelines that differ from a base
+	// description only in the values of their specialization constants (see
+	// PipelineDesc::specialization). get() returns the variant for a set of
+	// values, and builds it through the registry on first use. The shaders
+	// are compiled per variant, so constants such as loop bounds or feature
+	// flags fold away.
+	//
+	// Variants that are known up front can be built ahead of time (e.g., with
+	// a PipelineBuilder) from desc(); get() then finds them in the registry.
+	//
+	// Not thread safe: get() is meant to be called from the render loop. The
+	// handles are owned by the registry.
+	class PipelineVariants final
+	{
+		public:
+			PipelineVariants() = default;
+			PipelineVariants( PipelineRegistry&, PipelineDesc aBase );
+
+		public:
+			// Description of the variant with the given constant values
+			PipelineDesc desc( std::vector<std::uint32_t> const& aConstants ) const;
+
+			// May wait for (or run) the variant's build
+			VkPipeline get( std::vector<std::uint32_t> const& aConstants );
+
+			// Forget the variants, e.g., after the registry evicted them
+			// with the base's render pass. Variants are looked up in the
+			// registry again, from the new base.
+			void reset( PipelineDesc aBase );
+
+			std::size_t size() const;
+
+		private:
+			PipelineRegistry* mRegistry = nullptr;
+			PipelineDesc mBase;
+
+			std::map<std::vector<std::uint32_t>, VkPipeline> mVariants;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <string>
+#include <vector>
+#include <initializer_list>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	// Minimal reflection of compiled shaders (SPIR-V): the descriptor
+	// bindings and push constants they declare, and the layout of the
+	// blocks behind them. This is enough to derive descriptor set layouts
+	// and push constant ranges from the shaders, and to check that the C++
+	// structs that are copied into buffers match the shaders' blocks.
+	//
+	// Only the declarations are reflected, not their use. Unused resources
+	// may be missing if the shaders were optimized (glslc -O).
+
+	// Layout of a buffer or push constant block, as decorated in the
+	// SPIR-V (i.e., with std140/std430 applied). Names are empty if the
+	// SPIR-V has no debug names.
+	struct BlockMember
+	{
+		std::string name;
+		std::uint32_t offset = 0;
+		std::uint32_t size = 0; // 0 for a runtime array
+	};
+
+	struct BlockLayout
+	{
+		std::string name;
+		std::uint32_t size = 0; // end of the last member
+		std::vector<BlockMember> members;
+	};
+
+	struct ReflectedBinding
+	{
+		std::uint32_t set = 0;
+		std::uint32_t binding = 0;
+		VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+		std::uint32_t count = 1;
+		VkShaderStageFlags stages = 0;
+
+		std::string name;
+		BlockLayout block; // uniform and storage buffers only
+	};
+
+	struct ReflectedPushConstants
+	{
+		VkShaderStageFlags stages = 0;
+		BlockLayout block;
+	};
+
+	// Resource interface of one or more shaders
+	struct ShaderInterface
+	{
+		VkShaderStageFlags stages = 0;
+
+		// Sorted by set, then binding
+		std::vector<ReflectedBinding> bindings;
+
+		// At most one per stage
+		std::vector<ReflectedPushConstants> pushConstants;
+	};
+
+	// Reflect a SPIR-V module with a single entry point. Throws
+	// labutils::Error on malformed or unsupported SPIR-V.
+	ShaderInterface reflect_spirv( std::uint32_t const* aWords, std::size_t aWordCount );
+	ShaderInterface reflect_spirv_file( char const* aSpirvPath );
+
+	// Combined interface of shaders that share descriptor sets (e.g., the
+	// stages of a pipeline, or pipelines that share a set layout). Bindings
+	// with the same set and binding are merged, with the union of their
+	// stages; they must agree on the descriptor type and count.
+	void merge_interface( ShaderInterface& aInto, ShaderInterface const& aOther );
+	ShaderInterface reflect_shaders( std::initializer_list<char const*> aSpirvPaths );
+
+	ReflectedBinding const* find_binding( ShaderInterface const&, std::uint32_t aSet, std::uint32_t aBinding );
+
+	// Layout bindings of descriptor set aSet, sorted by binding
+	std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings( ShaderInterface const&, std::uint32_t aSet );
+
+	// One range per distinct block; stages with the same block share a
+	// range
+	std::vector<VkPushConstantRange> push_constant_ranges( ShaderInterface const& );
+
+	// Check a C++ struct (aCppName, sizeof() aCppSize, the offsetof() of its
+	// members in order) against a block. The block may declare fewer
+	// members than the struct (a prefix), but each of its members must be
+	// at the struct's offset, and the struct must cover the block. Throws
+	// labutils::Error naming the first mismatch.
+	void check_block_layout( BlockLayout const&, char const* aCppName, std::size_t aCppSize, std::initializer_list<std::size_t> aCppOffsets );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
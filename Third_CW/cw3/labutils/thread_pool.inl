@@ -0,0 +1,22 @@
+namespace labutils
+{
+	template< typename tFunc >
+	inline
+	auto ThreadPool::submit( tFunc&& aFunc ) -> std::future<std::invoke_result_t<std::decay_t<tFunc>>>
+	{
+		using Result_ = std::invoke_result_t<std::decay_t<tFunc>>;
+
+		// std::function<> requires copyable targets, but std::packaged_task<>
+		// is move-only. Hence the shared_ptr<>.
+		auto task = std::make_shared<std::packaged_task<Result_()>>( std::forward<tFunc>(aFunc) );
+		auto future = task->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mJobs.emplace_back( [task] { (*task)(); } );
+		}
+
+		mWakeUp.notify_one();
+		return future;
+	}
+}
@@ -0,0 +1,115 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include <cstdio>
+
+#include "error.hpp"
+
+namespace
+{
+	// Names are expected to be plain identifiers; only characters that
+	// would break the JSON/CSV syntax are replaced.
+	void write_name_( std::FILE* aOut, char const* aName )
+	{
+		for( char const* ch = aName ? aName : ""; *ch; ++ch )
+		{
+			char const c = *ch;
+			std::fputc( ('"' == c || '\\' == c || ',' == c || c < ' ') ? '_' : c, aOut );
+		}
+	}
+
+	std::uint64_t earliest_( std::vector<labutils::TraceEvent> const& aEvents )
+	{
+		std::uint64_t ret = std::numeric_limits<std::uint64_t>::max();
+		for( auto const& ev : aEvents )
+			ret = std::min( ret, ev.beginNs );
+
+		return aEvents.empty() ? 0 : ret;
+	}
+}
+
+namespace labutils
+{
+	std::uint64_t trace_now_ns() noexcept
+	{
+		using Clock_ = std::chrono::steady_clock;
+		return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>( Clock_::now().time_since_epoch() ).count());
+	}
+
+	void write_chrome_trace( char const* aPath, std::vector<TraceEvent> const& aEvents, std::vector<TraceThread> const& aThreads )
+	{
+		std::FILE* out = std::fopen( aPath, "w" );
+		if( !out )
+			throw Error( "Unable to open '%s' for writing", aPath );
+
+		std::uint64_t const base = earliest_( aEvents );
+
+		std::fprintf( out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+		bool first = true;
+		for( auto const& thread : aThreads )
+		{
+			std::fprintf( out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", thread.id );
+			write_name_( out, thread.name.c_str() );
+			std::fprintf( out, "\"}}" );
+			first = false;
+		}
+
+		for( auto const& ev : aEvents )
+		{
+			std::fprintf( out, "%s{\"name\":\"", first ? "" : ",\n" );
+			write_name_( out, ev.name );
+			std::fprintf( out, "\",\"cat\":\"" );
+			write_name_( out, ev.category );
+			std::fprintf( out, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+				ev.thread,
+				double(ev.beginNs - base) / 1000.0,
+				double(ev.durationNs) / 1000.0,
+				static_cast<unsigned long long>(ev.frame)
+			);
+			first = false;
+		}
+
+		std::fprintf( out, "\n]}\n" );
+
+		bool const failed = 0 != std::ferror( out );
+		std::fclose( out );
+
+		if( failed )
+			throw Error( "Error while writing '%s'", aPath );
+	}
+
+	void write_trace_csv( char const* aPath, std::vector<TraceEvent> const& aEvents )
+	{
+		std::FILE* out = std::fopen( aPath, "w" );
+		if( !out )
+			throw Error( "Unable to open '%s' for writing", aPath );
+
+		std::uint64_t const base = earliest_( aEvents );
+
+		std::fprintf( out, "category,name,thread,frame,begin_us,duration_us\n" );
+		for( auto const& ev : aEvents )
+		{
+			write_name_( out, ev.category );
+			std::fputc( ',', out );
+			write_name_( out, ev.name );
+			std::fprintf( out, ",%u,%llu,%.3f,%.3f\n",
+				ev.thread,
+				static_cast<unsigned long long>(ev.frame),
+				double(ev.beginNs - base) / 1000.0,
+				double(ev.durationNs) / 1000.0
+			);
+		}
+
+		bool const failed = 0 != std::ferror( out );
+		std::fclose( out );
+
+		if( failed )
+			throw Error( "Error while writing '%s'", aPath );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
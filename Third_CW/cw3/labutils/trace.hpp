@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+namespace labutils
+{
+	// Timestamp in nanoseconds on the clock that all trace events use
+	// (std::chrono::steady_clock). Events from different sources (e.g., CPU
+	// zones and GPU timestamps) can thus be shown on a common time line.
+	std::uint64_t trace_now_ns() noexcept;
+
+	// A single timed event ("complete event" in the Chrome trace format).
+	//
+	// Note: aName and aCategory are not copied; they must outlive the event
+	// (typically, they are string literals).
+	struct TraceEvent
+	{
+		char const* name = nullptr;
+		char const* category = nullptr;
+
+		std::uint64_t beginNs = 0;
+		std::uint64_t durationNs = 0;
+
+		// Track on which the event is shown (e.g., a CPU thread or the GPU)
+		std::uint32_t thread = 0;
+
+		// Frame that the event belongs to
+		std::uint64_t frame = 0;
+	};
+
+	// Display name of a track
+	struct TraceThread
+	{
+		std::uint32_t id;
+		std::string name;
+	};
+
+	// Write events in the Chrome trace-event JSON format. The result can be
+	// loaded into chrome://tracing or https://ui.perfetto.dev. Times are
+	// written relative to the earliest event.
+	void write_chrome_trace( char const* aPath, std::vector<TraceEvent> const&, std::vector<TraceThread> const& = {} );
+
+	// Write events as CSV, one event per line:
+	//   category,name,thread,frame,begin_us,duration_us
+	void write_trace_csv( char const* aPath, std::vector<TraceEvent> const& );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -43,7 +43,7 @@ namespace labutils
 
 namespace labutils
 {
-	Buffer create_buffer( Allocator const& aAllocator, VkDeviceSize aSize, VkBufferUsageFlags aBufferUsage, VmaMemoryUsage aMemoryUsage )
+	Buffer create_buffer( Allocator const& aAllocator, VkDeviceSize aSize, VkBufferUsageFlags aBufferUsage, VmaMemoryUsage aMemoryUsage, VmaAllocationCreateFlags aAllocationFlags )
 	{
 
 		VkBufferCreateInfo bufferInfo{};
@@ -53,6 +53,7 @@ namespace labutils
 
 		VmaAllocationCreateInfo allocInfo{};
 		allocInfo.usage = aMemoryUsage;
+		allocInfo.flags = aAllocationFlags;
 
 		VkBuffer buffer = VK_NULL_HANDLE;
 		VmaAllocation allocation = VK_NULL_HANDLE;
@@ -32,5 +32,5 @@ namespace labutils
 			VmaAllocator mAllocator = VK_NULL_HANDLE;
 	};
 
-	Buffer create_buffer( Allocator const&, VkDeviceSize, VkBufferUsageFlags, VmaMemoryUsage );
+	Buffer create_buffer( Allocator const&, VkDeviceSize, VkBufferUsageFlags, VmaMemoryUsage, VmaAllocationCreateFlags = 0 );
 }
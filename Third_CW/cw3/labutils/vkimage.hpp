@@ -32,5 +32,5 @@ namespace labutils
 			VmaAllocator mAllocator = VK_NULL_HANDLE;
 	};
 
-	Image create_image( Allocator const&, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat, VkImageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
+	Image create_image( Allocator const&, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat, VkImageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, std::uint32_t aMipLevels = 1 );
 }
@@ -101,6 +101,8 @@ namespace labutils
 
 	using CommandPool = UniqueHandle< VkCommandPool, VkDevice, vkDestroyCommandPool >;
 
+	using QueryPool = UniqueHandle< VkQueryPool, VkDevice, vkDestroyQueryPool >;
+
 	using Fence = UniqueHandle< VkFence, VkDevice, vkDestroyFence >;
 	using Semaphore = UniqueHandle< VkSemaphore, VkDevice, vkDestroySemaphore >;
 
@@ -70,12 +70,12 @@ namespace labutils
 
 	}
 
-	VkCommandBuffer alloc_command_buffer(VulkanContext const& aContext, VkCommandPool aCmdPool)
+	VkCommandBuffer alloc_command_buffer(VulkanContext const& aContext, VkCommandPool aCmdPool, VkCommandBufferLevel aLevel)
 	{
 		VkCommandBufferAllocateInfo cbufInfo{};
 		cbufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		cbufInfo.commandPool = aCmdPool;
-		cbufInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbufInfo.level = aLevel;
 		cbufInfo.commandBufferCount = 1;
 
 		VkCommandBuffer cbuff = VK_NULL_HANDLE;
@@ -114,6 +114,25 @@ namespace labutils
 		return Semaphore(aContext.device, semaphore);
 	}
 
+	Semaphore create_timeline_semaphore(VulkanContext const& aContext, std::uint64_t aInitialValue)
+	{
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = aInitialValue;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		if (auto const res = vkCreateSemaphore(aContext.device, &semaphoreInfo, nullptr, &semaphore); VK_SUCCESS != res)
+		{
+			throw Error("Unable to create timeline semaphore\n" "vkCreateSemaphore() returned %s", to_string(res).c_str());
+		}
+		return Semaphore(aContext.device, semaphore);
+	}
+
 	void buffer_barrier(
 		VkCommandBuffer				aCmdBuff,
 		VkBuffer					aBuffer,
@@ -139,11 +158,41 @@ namespace labutils
 		vkCmdPipelineBarrier(aCmdBuff, aSrcStageMask, aDstStageMask, 0, 0, nullptr, 1, &bbarrier, 0, nullptr);
 	}
 
+	void image_barrier(
+		VkCommandBuffer				aCmdBuff,
+		VkImage						aImage,
+		VkAccessFlags				aSrcAccessMask,
+		VkAccessFlags				aDstAccessMask,
+		VkImageLayout				aSrcLayout,
+		VkImageLayout				aDstLayout,
+		VkPipelineStageFlags		aSrcStageMask,
+		VkPipelineStageFlags		aDstStageMask,
+		VkImageSubresourceRange		aRange,
+		std::uint32_t				aSrcQueueFamilyIndex,
+		std::uint32_t				aDstQueueFamilyIndex)
+	{
+		VkImageMemoryBarrier ibarrier{};
+		ibarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		ibarrier.image = aImage;
+		ibarrier.srcAccessMask = aSrcAccessMask;
+		ibarrier.dstAccessMask = aDstAccessMask;
+		ibarrier.srcQueueFamilyIndex = aSrcQueueFamilyIndex;
+		ibarrier.dstQueueFamilyIndex = aDstQueueFamilyIndex;
+		ibarrier.oldLayout = aSrcLayout;
+		ibarrier.newLayout = aDstLayout;
+		ibarrier.subresourceRange = aRange;
+
+		vkCmdPipelineBarrier(aCmdBuff, aSrcStageMask, aDstStageMask, 0, 0, nullptr, 0, nullptr, 1, &ibarrier);
+	}
+
 	DescriptorPool create_descriptor_pool(VulkanContext const& aContext, std::uint32_t aMaxDescriptors, std::uint32_t aMaxSets)
 	{
 		VkDescriptorPoolSize const pools[] = {
 			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, aMaxDescriptors},
-			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, aMaxDescriptors}
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, aMaxDescriptors},
+			{VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, aMaxDescriptors},
+			{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, aMaxDescriptors},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, aMaxDescriptors}
 		};
 
 		VkDescriptorPoolCreateInfo poolInfo{};
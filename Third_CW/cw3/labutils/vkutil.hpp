@@ -2,6 +2,8 @@
 
 #include <volk/volk.h>
 
+#include <cstdint>
+
 #include "vkobject.hpp"
 #include "vulkan_context.hpp"
 
@@ -10,10 +12,11 @@ namespace labutils
 	ShaderModule load_shader_module( VulkanContext const&, char const* aSpirvPath );
 
 	CommandPool create_command_pool( VulkanContext const&, VkCommandPoolCreateFlags = 0 );
-	VkCommandBuffer alloc_command_buffer( VulkanContext const&, VkCommandPool );
+	VkCommandBuffer alloc_command_buffer( VulkanContext const&, VkCommandPool, VkCommandBufferLevel = VK_COMMAND_BUFFER_LEVEL_PRIMARY );
 
 	Fence create_fence( VulkanContext const&, VkFenceCreateFlags = 0 );
 	Semaphore create_semaphore( VulkanContext const& );
+	Semaphore create_timeline_semaphore( VulkanContext const&, std::uint64_t aInitialValue = 0 );
 
 	void buffer_barrier(
 		VkCommandBuffer,
@@ -28,6 +31,20 @@ namespace labutils
 		uint32_t aDstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED
 	);
 
+	void image_barrier(
+		VkCommandBuffer,
+		VkImage,
+		VkAccessFlags aSrcAccessMask,
+		VkAccessFlags aDstAccessMask,
+		VkImageLayout aSrcLayout,
+		VkImageLayout aDstLayout,
+		VkPipelineStageFlags aSrcStageMask,
+		VkPipelineStageFlags aDstStageMask,
+		VkImageSubresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+		std::uint32_t aSrcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		std::uint32_t aDstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED
+	);
+
 	DescriptorPool create_descriptor_pool(VulkanContext const&, std::uint32_t aMaxDescriptors = 2048, std::uint32_t aMaxSets = 1024);
 	VkDescriptorSet alloc_desc_set(VulkanContext const&, VkDescriptorPool, VkDescriptorSetLayout);
 
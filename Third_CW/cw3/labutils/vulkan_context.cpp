@@ -21,7 +21,8 @@ namespace
 
 	VkDevice create_device( 
 		VkPhysicalDevice,
-		std::uint32_t aQueueFamily
+		std::uint32_t aQueueFamily,
+		lut::detail::OptionalFeatures const&
 	);
 }
 
@@ -33,6 +34,9 @@ namespace labutils
 	VulkanContext::~VulkanContext()
 	{
 		// Device-related objects
+		if( VK_NULL_HANDLE != pipelineCache )
+			vkDestroyPipelineCache( device, pipelineCache, nullptr );
+
 		if( VK_NULL_HANDLE != device )
 			vkDestroyDevice( device, nullptr );
 
@@ -51,6 +55,10 @@ namespace labutils
 		, device( std::exchange( aOther.device, VK_NULL_HANDLE ) )
 		, graphicsFamilyIndex( aOther.graphicsFamilyIndex )
 		, graphicsQueue( std::exchange( aOther.graphicsQueue, VK_NULL_HANDLE ) )
+		, drawIndirectFirstInstance( aOther.drawIndirectFirstInstance )
+		, multiDrawIndirect( aOther.multiDrawIndirect )
+		, drawIndirectCount( aOther.drawIndirectCount )
+		, pipelineCache( std::exchange( aOther.pipelineCache, VK_NULL_HANDLE ) )
 		, debugMessenger( std::exchange( aOther.debugMessenger, VK_NULL_HANDLE ) )
 	{}
 
@@ -72,6 +80,10 @@ namespace labutils
 		std::swap( device, aOther.device );
 		std::swap( graphicsFamilyIndex, aOther.graphicsFamilyIndex );
 		std::swap( graphicsQueue, aOther.graphicsQueue );
+		std::swap( drawIndirectFirstInstance, aOther.drawIndirectFirstInstance );
+		std::swap( multiDrawIndirect, aOther.multiDrawIndirect );
+		std::swap( drawIndirectCount, aOther.drawIndirectCount );
+		std::swap( pipelineCache, aOther.pipelineCache );
 		std::swap( debugMessenger, aOther.debugMessenger );
 		return *this;
 	}
@@ -149,7 +161,12 @@ namespace labutils
 			throw lut::Error( "No queue family with GRAPHICS" );
 		}
 
-		ret.device = create_device( ret.physicalDevice, ret.graphicsFamilyIndex );
+		auto const optional = detail::get_optional_features( ret.physicalDevice );
+		ret.drawIndirectFirstInstance = optional.drawIndirectFirstInstance;
+		ret.multiDrawIndirect = optional.multiDrawIndirect;
+		ret.drawIndirectCount = optional.drawIndirectCount;
+
+		ret.device = create_device( ret.physicalDevice, ret.graphicsFamilyIndex, optional );
 
 		// Retrieve VkQueue
 		vkGetDeviceQueue( ret.device, ret.graphicsFamilyIndex, 0, &ret.graphicsQueue );
@@ -182,7 +199,7 @@ namespace
 		return {};
 	}
 
-	VkDevice create_device( VkPhysicalDevice aPhysicalDev, std::uint32_t aQueueFamily )
+	VkDevice create_device( VkPhysicalDevice aPhysicalDev, std::uint32_t aQueueFamily, lut::detail::OptionalFeatures const& aOptional )
 	{
 		float queuePriorities[1] = { 1.f };
 
@@ -192,11 +209,21 @@ namespace
 		queueInfo.queueCount        = 1;
 		queueInfo.pQueuePriorities  = queuePriorities;
 
+		// Indirect draws (GPU-driven culling) are optional
 		VkPhysicalDeviceFeatures deviceFeatures{};
-		// No extra features for now.
+		deviceFeatures.drawIndirectFirstInstance  = aOptional.drawIndirectFirstInstance;
+		deviceFeatures.multiDrawIndirect          = aOptional.multiDrawIndirect;
+
+		// Timeline semaphores (see gpu_timeline.hpp). Checked for in
+		// score_device().
+		VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+		deviceFeatures12.sType  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		deviceFeatures12.timelineSemaphore  = VK_TRUE;
+		deviceFeatures12.drawIndirectCount  = aOptional.drawIndirectCount;
 		
 		VkDeviceCreateInfo deviceInfo{};
 		deviceInfo.sType  = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		deviceInfo.pNext  = &deviceFeatures12;
 
 		deviceInfo.queueCreateInfoCount  = 1;
 		deviceInfo.pQueueCreateInfos     = &queueInfo;
@@ -222,11 +249,14 @@ namespace
 		VkPhysicalDeviceProperties props;
 		vkGetPhysicalDeviceProperties( aPhysicalDev, &props );
 
-		// Only consider Vulkan 1.1 devices
+		// Only consider Vulkan 1.2 devices with timeline semaphores
 		auto const major = VK_API_VERSION_MAJOR( props.apiVersion );
 		auto const minor = VK_API_VERSION_MINOR( props.apiVersion );
 
-		if( major < 1 || (major == 1 && minor < 1) )
+		if( major < 1 || (major == 1 && minor < 2) )
+			return -1.f;
+
+		if( !lut::detail::get_device_features12( aPhysicalDev ).timelineSemaphore )
 			return -1.f;
 
 		// Discrete GPU > Integrated GPU > others
@@ -28,6 +28,16 @@ namespace labutils
 			std::uint32_t graphicsFamilyIndex = 0;
 			VkQueue graphicsQueue = VK_NULL_HANDLE;
 
+			// Optional device features. These are enabled if the device
+			// supports them; code that relies on them must check first.
+			bool drawIndirectFirstInstance = false;
+			bool multiDrawIndirect = false;
+			bool drawIndirectCount = false;
+
+			// Used for all pipelines; see load_pipeline_cache(). May be
+			// VK_NULL_HANDLE, which disables caching.
+			VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
 			
 			//bool haveDebugUtils = false;
 			VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
@@ -29,7 +29,8 @@ namespace
 	VkDevice create_device(
 		VkPhysicalDevice,
 		std::vector<std::uint32_t> const& aQueueFamilies,
-		std::vector<char const*> const& aEnabledDeviceExtensions = {}
+		std::vector<char const*> const& aEnabledDeviceExtensions = {},
+		lut::detail::OptionalFeatures const& = {}
 	);
 
 	std::vector<VkSurfaceFormatKHR> get_surface_formats(VkPhysicalDevice, VkSurfaceKHR);
@@ -253,7 +254,12 @@ namespace labutils
 			queueFamilyIndices.emplace_back(*present);
 		}
 
-		ret.device = create_device(ret.physicalDevice, queueFamilyIndices, enabledDevExensions);
+		auto const optional = detail::get_optional_features(ret.physicalDevice);
+		ret.drawIndirectFirstInstance = optional.drawIndirectFirstInstance;
+		ret.multiDrawIndirect = optional.multiDrawIndirect;
+		ret.drawIndirectCount = optional.drawIndirectCount;
+
+		ret.device = create_device(ret.physicalDevice, queueFamilyIndices, enabledDevExensions, optional);
 
 		// Retrieve VkQueues
 		vkGetDeviceQueue(ret.device, ret.graphicsFamilyIndex, 0, &ret.graphicsQueue);
@@ -439,6 +445,10 @@ namespace
 		chainInfo.imageExtent = extent;
 		chainInfo.imageArrayLayers = 1;
 		chainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+		// Allow blits to the swapchain images (e.g., from a compute pass)
+		if (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+			chainInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		chainInfo.preTransform = caps.currentTransform;
 		chainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		chainInfo.presentMode = presentMode;
@@ -562,7 +572,7 @@ namespace
 		return {};
 	}
 
-	VkDevice create_device(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t> const& aQueues, std::vector<char const*> const& aEnabledExtensions)
+	VkDevice create_device(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t> const& aQueues, std::vector<char const*> const& aEnabledExtensions, lut::detail::OptionalFeatures const& aOptional)
 	{
 		if (aQueues.empty())
 			throw lut::Error("create_device(): no queues requested");
@@ -581,10 +591,20 @@ namespace
 
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		//deviceFeatures.samplerAnisotropy = VK_TRUE;
-			// No extra features for now.
+		// Indirect draws (GPU-driven culling) are optional
+		deviceFeatures.drawIndirectFirstInstance = aOptional.drawIndirectFirstInstance;
+		deviceFeatures.multiDrawIndirect = aOptional.multiDrawIndirect;
+
+		// Timeline semaphores (see gpu_timeline.hpp). Checked for in
+		// score_device().
+		VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+		deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		deviceFeatures12.timelineSemaphore = VK_TRUE;
+		deviceFeatures12.drawIndirectCount = aOptional.drawIndirectCount;
 
 		VkDeviceCreateInfo deviceInfo{};
 		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		deviceInfo.pNext = &deviceFeatures12;
 
 		deviceInfo.queueCreateInfoCount = std::uint32_t(queueInfos.size());
 		deviceInfo.pQueueCreateInfos = queueInfos.data();
@@ -613,16 +633,22 @@ namespace
 		VkPhysicalDeviceProperties props;
 		vkGetPhysicalDeviceProperties(aPhysicalDev, &props);
 
-		// Only consider Vulkan 1.1 devices
+		// Only consider Vulkan 1.2 devices
 		auto const major = VK_API_VERSION_MAJOR(props.apiVersion);
 		auto const minor = VK_API_VERSION_MINOR(props.apiVersion);
 
-		if (major < 1 || (major == 1 && minor < 1))
+		if (major < 1 || (major == 1 && minor < 2))
 		{
 			std::fprintf(stderr, "Info: Discarding device '%s': insufficient vulkan version\n", props.deviceName);
 			return -1.f;
 		}
 
+		if (!lut::detail::get_device_features12(aPhysicalDev).timelineSemaphore)
+		{
+			std::fprintf(stderr, "Info: Discarding device '%s': no timeline semaphores\n", props.deviceName);
+			return -1.f;
+		}
+
 		// additional checks
 		auto const exts = lut::detail::get_device_extensions(aPhysicalDev);
 		if (!exts.count(VK_KHR_SWAPCHAIN_EXTENSION_NAME))
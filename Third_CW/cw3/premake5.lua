@@ -88,7 +88,8 @@ project "cw3"
 project "cw3-shaders"
 	local shaders = { 
 		"cw3/shaders/*.vert",
-		"cw3/shaders/*.frag"
+		"cw3/shaders/*.frag",
+		"cw3/shaders/*.comp"
 	}
 
 	kind "Utility"